@@ -0,0 +1,327 @@
+// Host benchmark for the session core.  Loads a GGUF model through the same createSession /
+// runCompletion path the app uses and sweeps thread counts, n_batch/n_ubatch, prompt lengths and
+// generation lengths, printing one JSON document with prompt-eval and decode throughput, time to
+// first token and peak RSS per configuration.
+
+#include "llama_session.h"
+
+#include <sys/resource.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    std::string model_path;
+    std::vector<int32_t> threads{4};
+    std::vector<int32_t> batch_sizes{512};
+    std::vector<int32_t> ubatch_sizes{512};
+    std::vector<int32_t> prompt_lengths{128};
+    std::vector<int32_t> generation_lengths{64};
+    int32_t context_size = 0;
+    int32_t repetitions = 1;
+    bool dry_run = false;
+};
+
+struct BenchResult {
+    int32_t prompt_tokens = 0;
+    int32_t generated_tokens = 0;
+    double load_ms = 0.0;
+    double ttft_ms = 0.0;
+    double prompt_tps = 0.0;
+    double decode_tps = 0.0;
+    long peak_rss_kib = 0;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void printUsage(FILE* out) {
+    std::fprintf(out,
+                 "Penggunaan: cicero_bench -m model.gguf [opsi]\n"
+                 "  -m, --model PATH       model GGUF yang diukur\n"
+                 "  -t, --threads LIST     jumlah thread, dipisah koma (default 4)\n"
+                 "  -b, --batch LIST       n_batch (default 512)\n"
+                 "  -ub, --ubatch LIST     n_ubatch (default 512)\n"
+                 "  -p, --prompt LIST      panjang prompt dalam token (default 128)\n"
+                 "  -n, --gen LIST         panjang generasi dalam token (default 64)\n"
+                 "  -c, --ctx N            ukuran konteks (default prompt+gen terbesar)\n"
+                 "  -r, --repeat N         pengulangan per konfigurasi, hasil dirata-rata (default 1)\n"
+                 "  --dry-run              cetak rencana sweep tanpa memuat model\n");
+}
+
+std::vector<int32_t> parseList(const char* flag, const std::string& text) {
+    std::vector<int32_t> values;
+    std::stringstream stream(text);
+    std::string item;
+    while (std::getline(stream, item, ',')) {
+        char* end = nullptr;
+        const long value = std::strtol(item.c_str(), &end, 10);
+        if (item.empty() || *end != '\0' || value <= 0) {
+            throw std::runtime_error(std::string("Nilai tidak valid untuk ") + flag + ": " + text);
+        }
+        values.push_back(static_cast<int32_t>(value));
+    }
+    if (values.empty()) {
+        throw std::runtime_error(std::string("Nilai kosong untuk ") + flag);
+    }
+    return values;
+}
+
+BenchOptions parseArguments(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Argumen " + arg + " membutuhkan nilai.");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-m" || arg == "--model") {
+            options.model_path = value();
+        } else if (arg == "-t" || arg == "--threads") {
+            options.threads = parseList("--threads", value());
+        } else if (arg == "-b" || arg == "--batch") {
+            options.batch_sizes = parseList("--batch", value());
+        } else if (arg == "-ub" || arg == "--ubatch") {
+            options.ubatch_sizes = parseList("--ubatch", value());
+        } else if (arg == "-p" || arg == "--prompt") {
+            options.prompt_lengths = parseList("--prompt", value());
+        } else if (arg == "-n" || arg == "--gen") {
+            options.generation_lengths = parseList("--gen", value());
+        } else if (arg == "-c" || arg == "--ctx") {
+            options.context_size = parseList("--ctx", value()).front();
+        } else if (arg == "-r" || arg == "--repeat") {
+            options.repetitions = parseList("--repeat", value()).front();
+        } else if (arg == "--dry-run") {
+            options.dry_run = true;
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(stdout);
+            std::exit(0);
+        } else {
+            throw std::runtime_error("Argumen tidak dikenal: " + arg);
+        }
+    }
+
+    if (options.model_path.empty() && !options.dry_run) {
+        throw std::runtime_error("Model belum ditentukan (gunakan -m).");
+    }
+    if (options.context_size <= 0) {
+        const int32_t longest_prompt =
+                *std::max_element(options.prompt_lengths.begin(), options.prompt_lengths.end());
+        const int32_t longest_generation =
+                *std::max_element(options.generation_lengths.begin(), options.generation_lengths.end());
+        // A little slack for BOS/EOS and the synthetic prompt overshooting its target.
+        options.context_size = longest_prompt + longest_generation + 16;
+    }
+    return options;
+}
+
+// Peak resident set size of the process so far, in KiB.
+long peakRssKib() {
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+std::string jsonEscape(const std::string& text) {
+    std::string escaped;
+    escaped.reserve(text.size());
+    for (const char c : text) {
+        switch (c) {
+            case '"':
+                escaped += "\\\"";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    escaped += buffer;
+                } else {
+                    escaped += c;
+                }
+        }
+    }
+    return escaped;
+}
+
+// Synthetic prompt of exactly (or, when a word boundary makes that impossible, just under)
+// `target` tokens including the BOS/EOS the vocab adds.
+std::string makePrompt(cicero::LlamaSession* session, int32_t target) {
+    static constexpr const char* kFiller =
+            " Laporan harian mencatat cuaca cerah, lalu lintas lancar, dan pasar buka seperti biasa.";
+    std::string prompt;
+    while (cicero::countPromptTokens(session, prompt) < target) {
+        prompt += kFiller;
+    }
+    while (!prompt.empty() && cicero::countPromptTokens(session, prompt) > target) {
+        const size_t cut = prompt.find_last_of(' ');
+        prompt.resize(cut == std::string::npos ? 0 : cut);
+    }
+    return prompt;
+}
+
+BenchResult measure(cicero::LlamaSession* session,
+                    const std::string& prompt,
+                    int32_t generation_length) {
+    cicero::SamplingNativeOptions sampling;
+    sampling.max_tokens = generation_length;
+    sampling.seed = 42;
+
+    // Every run starts from an empty sequence so prompt evaluation is never served from the
+    // prefix cache.
+    cicero::clearPromptCache(session);
+
+    const Clock::time_point start = Clock::now();
+    Clock::time_point first_token;
+    bool have_first_token = false;
+    runCompletion(session, prompt, sampling, [&](const std::string&) {
+        if (!have_first_token) {
+            first_token = Clock::now();
+            have_first_token = true;
+        }
+    });
+    const Clock::time_point end = Clock::now();
+
+    const cicero::CompletionStats& stats = session->last_stats;
+    BenchResult result;
+    result.prompt_tokens = static_cast<int32_t>(stats.prompt_tokens);
+    result.generated_tokens = static_cast<int32_t>(stats.generated_tokens);
+    if (have_first_token) {
+        // Time to first token covers tokenization, the prefill and the first sample, which makes
+        // it the closest end-to-end proxy for prompt evaluation the public API exposes.
+        result.ttft_ms = elapsedMs(start, first_token);
+        const double evaluated = static_cast<double>(stats.prompt_tokens - stats.reused_tokens);
+        result.prompt_tps = result.ttft_ms > 0.0 ? evaluated * 1000.0 / result.ttft_ms : 0.0;
+        const double decode_ms = elapsedMs(first_token, end);
+        if (stats.generated_tokens > 1 && decode_ms > 0.0) {
+            result.decode_tps = static_cast<double>(stats.generated_tokens - 1) * 1000.0 / decode_ms;
+        }
+    }
+    result.peak_rss_kib = peakRssKib();
+    return result;
+}
+
+void printResult(bool first,
+                 int32_t threads,
+                 int32_t n_batch,
+                 int32_t n_ubatch,
+                 int32_t prompt_length,
+                 int32_t generation_length,
+                 const BenchResult& result) {
+    std::printf("%s\n    {\"threads\": %d, \"n_batch\": %d, \"n_ubatch\": %d, "
+                "\"prompt_length\": %d, \"gen_length\": %d, "
+                "\"prompt_tokens\": %d, \"generated_tokens\": %d, "
+                "\"load_ms\": %.3f, \"ttft_ms\": %.3f, "
+                "\"prompt_eval_tps\": %.3f, \"decode_tps\": %.3f, \"peak_rss_kib\": %ld}",
+                first ? "" : ",",
+                threads, n_batch, n_ubatch,
+                prompt_length, generation_length,
+                result.prompt_tokens, result.generated_tokens,
+                result.load_ms, result.ttft_ms,
+                result.prompt_tps, result.decode_tps, result.peak_rss_kib);
+    std::fflush(stdout);
+}
+
+int runBench(const BenchOptions& options) {
+    std::printf("{\n  \"model\": \"%s\",\n  \"context_size\": %d,\n  \"repetitions\": %d,\n  \"results\": [",
+                jsonEscape(options.model_path).c_str(),
+                options.context_size,
+                options.repetitions);
+
+    bool first = true;
+    for (const int32_t threads : options.threads) {
+        for (const int32_t n_batch : options.batch_sizes) {
+            for (const int32_t n_ubatch : options.ubatch_sizes) {
+                if (options.dry_run) {
+                    for (const int32_t prompt_length : options.prompt_lengths) {
+                        for (const int32_t generation_length : options.generation_lengths) {
+                            printResult(first, threads, n_batch, n_ubatch, prompt_length, generation_length,
+                                        BenchResult());
+                            first = false;
+                        }
+                    }
+                    continue;
+                }
+
+                cicero::RuntimeNativeConfig config =
+                        cicero::makeDefaultRuntimeConfig(threads, options.context_size);
+                config.batch_size = n_batch;
+                config.has_batch_size = true;
+                config.ubatch_size = std::min(n_ubatch, n_batch);
+                config.has_ubatch_size = true;
+
+                const Clock::time_point load_start = Clock::now();
+                auto session = cicero::createSession(options.model_path, config);
+                const double load_ms = elapsedMs(load_start, Clock::now());
+
+                for (const int32_t prompt_length : options.prompt_lengths) {
+                    const std::string prompt = makePrompt(session.get(), prompt_length);
+                    for (const int32_t generation_length : options.generation_lengths) {
+                        BenchResult total;
+                        for (int32_t rep = 0; rep < options.repetitions; ++rep) {
+                            const BenchResult run = measure(session.get(), prompt, generation_length);
+                            total.prompt_tokens = run.prompt_tokens;
+                            total.generated_tokens += run.generated_tokens;
+                            total.ttft_ms += run.ttft_ms;
+                            total.prompt_tps += run.prompt_tps;
+                            total.decode_tps += run.decode_tps;
+                            total.peak_rss_kib = run.peak_rss_kib;
+                        }
+                        const double reps = static_cast<double>(options.repetitions);
+                        total.generated_tokens = static_cast<int32_t>(total.generated_tokens / reps);
+                        total.ttft_ms /= reps;
+                        total.prompt_tps /= reps;
+                        total.decode_tps /= reps;
+                        total.load_ms = load_ms;
+                        printResult(first, threads, n_batch, n_ubatch, prompt_length, generation_length, total);
+                        first = false;
+                    }
+                }
+
+                cicero::releaseSession(std::move(session));
+            }
+        }
+    }
+
+    std::printf("\n  ]\n}\n");
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        return runBench(parseArguments(argc, argv));
+    } catch (const std::exception& ex) {
+        std::fprintf(stderr, "cicero_bench gagal: %s\n", ex.what());
+        printUsage(stderr);
+        return 1;
+    }
+}
@@ -0,0 +1,246 @@
+// Host benchmark for the fused token sampler.  Draws synthetic logits for a large vocabulary and,
+// for several sampling configurations, compares TokenSampler's distribution with a straightforward
+// full-vocabulary implementation of the llama.cpp chain (penalties, top-k, top-p, temperature,
+// dist) and times both per step.  Prints one JSON document; exits non-zero when the total
+// variation distance exceeds --max-tv so ctest can guard the equivalence.
+
+#include "token_sampler.h"
+#include "vector_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    int32_t vocab = 151936;
+    int32_t steps = 50;
+    double max_tv = 1e-4;
+};
+
+struct Scenario {
+    const char* name;
+    cicero::TokenSamplerParams params;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedUs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::micro>(end - start).count();
+}
+
+void printUsage(FILE* out) {
+    std::fprintf(out,
+                 "Penggunaan: cicero_sampler_bench [opsi]\n"
+                 "  -v, --vocab N          ukuran kosakata (default 151936)\n"
+                 "  -s, --steps N          langkah per skenario (default 50)\n"
+                 "  --max-tv X             gagal bila jarak variasi total melebihi X (default 1e-4)\n");
+}
+
+BenchOptions parseArguments(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Argumen " + arg + " membutuhkan nilai.");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-v" || arg == "--vocab") {
+            options.vocab = std::max(1, std::atoi(value().c_str()));
+        } else if (arg == "-s" || arg == "--steps") {
+            options.steps = std::max(1, std::atoi(value().c_str()));
+        } else if (arg == "--max-tv") {
+            options.max_tv = std::strtod(value().c_str(), nullptr);
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(stdout);
+            std::exit(0);
+        } else {
+            throw std::runtime_error("Argumen tidak dikenal: " + arg);
+        }
+    }
+    return options;
+}
+
+// Full-vocabulary reference of the llama.cpp chain, returning a dense probability vector.
+class ReferenceSampler {
+public:
+    explicit ReferenceSampler(const cicero::TokenSamplerParams& params) : params_(params) {}
+
+    void accept(int32_t token) {
+        if (params_.penalty_last_n <= 0) {
+            return;
+        }
+        history_.push_back(token);
+        if (history_.size() > static_cast<size_t>(params_.penalty_last_n)) {
+            history_.erase(history_.begin());
+        }
+    }
+
+    std::vector<double> distribution(const std::vector<float>& logits) const {
+        struct Entry {
+            float logit;
+            int32_t token;
+        };
+        std::vector<Entry> entries(logits.size());
+        for (size_t i = 0; i < logits.size(); ++i) {
+            entries[i] = {logits[i], static_cast<int32_t>(i)};
+        }
+        std::unordered_map<int32_t, int32_t> counts;
+        for (const int32_t token : history_) {
+            ++counts[token];
+        }
+        for (const auto& entry : counts) {
+            float& logit = entries[static_cast<size_t>(entry.first)].logit;
+            logit = logit <= 0.0f ? logit * params_.penalty_repeat : logit / params_.penalty_repeat;
+            logit -= static_cast<float>(entry.second) * params_.penalty_freq + params_.penalty_present;
+        }
+
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry& a, const Entry& b) { return a.logit > b.logit; });
+        size_t count = entries.size();
+        if (params_.top_k) {
+            count = std::min(count, static_cast<size_t>(*params_.top_k));
+        }
+        const double max = entries[0].logit;
+        if (params_.top_p && *params_.top_p < 1.0f) {
+            double sum = 0.0;
+            for (size_t i = 0; i < count; ++i) {
+                sum += std::exp(entries[i].logit - max);
+            }
+            double cumulative = 0.0;
+            for (size_t i = 0; i < count; ++i) {
+                cumulative += std::exp(entries[i].logit - max) / sum;
+                if (cumulative >= *params_.top_p) {
+                    count = i + 1;
+                    break;
+                }
+            }
+        }
+        const double temperature = params_.temperature.value_or(1.0f);
+        std::vector<double> probabilities(logits.size(), 0.0);
+        double total = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            total += std::exp((entries[i].logit - max) / temperature);
+        }
+        for (size_t i = 0; i < count; ++i) {
+            const double weight = std::exp((entries[i].logit - max) / temperature);
+            probabilities[static_cast<size_t>(entries[i].token)] = weight / total;
+        }
+        return probabilities;
+    }
+
+private:
+    cicero::TokenSamplerParams params_;
+    std::vector<int32_t> history_;
+};
+
+std::vector<Scenario> scenarios() {
+    std::vector<Scenario> result;
+    cicero::TokenSamplerParams params;
+    params.seed = 42;
+    result.push_back({"temperature_only", params});
+    params.temperature = 0.8f;
+    params.top_k = 40;
+    params.top_p = 0.95f;
+    result.push_back({"top_k_top_p", params});
+    params.top_k.reset();
+    params.top_p = 0.9f;
+    params.temperature = 1.3f;
+    result.push_back({"top_p_hot", params});
+    params.top_k = 64;
+    params.top_p.reset();
+    params.temperature = 0.7f;
+    params.penalty_last_n = 64;
+    params.penalty_repeat = 1.1f;
+    params.penalty_freq = 0.2f;
+    params.penalty_present = 0.1f;
+    result.push_back({"top_k_penalties", params});
+    return result;
+}
+
+int runBench(const BenchOptions& options) {
+    std::mt19937 rng(7);
+    std::normal_distribution<float> normal(0.0f, 2.5f);
+    std::uniform_int_distribution<int32_t> pick(0, options.vocab - 1);
+    std::vector<float> logits(static_cast<size_t>(options.vocab));
+
+    std::printf("{\n  \"kernel\": \"%s\", \"vocab\": %d, \"steps\": %d,\n  \"results\": [",
+                cicero::vectorKernelName(), options.vocab, options.steps);
+    bool ok = true;
+    bool first = true;
+    std::vector<cicero::TokenProbability> fused_distribution;
+    for (const Scenario& scenario : scenarios()) {
+        cicero::TokenSampler sampler(scenario.params);
+        ReferenceSampler reference(scenario.params);
+        double worst_tv = 0.0;
+        double fused_us = 0.0;
+        double reference_us = 0.0;
+        for (int32_t step = 0; step < options.steps; ++step) {
+            for (float& logit : logits) {
+                logit = normal(rng);
+            }
+            // A peaked head like a real model's.
+            for (int32_t i = 0; i < 8; ++i) {
+                logits[static_cast<size_t>(pick(rng))] += 12.0f - static_cast<float>(i);
+            }
+
+            const Clock::time_point reference_start = Clock::now();
+            const std::vector<double> expected = reference.distribution(logits);
+            reference_us += elapsedUs(reference_start, Clock::now());
+
+            const Clock::time_point fused_start = Clock::now();
+            const int32_t token = sampler.sample(logits.data(), logits.size());
+            fused_us += elapsedUs(fused_start, Clock::now());
+
+            sampler.distribution(logits.data(), logits.size(), fused_distribution);
+            std::vector<double> actual(logits.size(), 0.0);
+            for (const cicero::TokenProbability& entry : fused_distribution) {
+                actual[static_cast<size_t>(entry.token)] = entry.probability;
+            }
+            double tv = 0.0;
+            for (size_t i = 0; i < actual.size(); ++i) {
+                tv += std::fabs(actual[i] - expected[i]);
+            }
+            worst_tv = std::max(worst_tv, tv / 2.0);
+
+            sampler.accept(token);
+            reference.accept(token);
+        }
+        ok = ok && worst_tv <= options.max_tv;
+        std::printf("%s\n    {\"scenario\": \"%s\", \"fused_us\": %.2f, \"reference_us\": %.2f, "
+                    "\"max_tv\": %.3g}",
+                    first ? "" : ",", scenario.name, fused_us / options.steps, reference_us / options.steps,
+                    worst_tv);
+        first = false;
+    }
+    std::printf("\n  ]\n}\n");
+    if (!ok) {
+        std::fprintf(stderr, "Distribusi sampler menyimpang lebih dari %.3g.\n", options.max_tv);
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        return runBench(parseArguments(argc, argv));
+    } catch (const std::exception& ex) {
+        std::fprintf(stderr, "cicero_sampler_bench gagal: %s\n", ex.what());
+        printUsage(stderr);
+        return 1;
+    }
+}
@@ -0,0 +1,255 @@
+// Host benchmark for the vector index.  Builds an index from random vectors in a scratch
+// directory, then measures insert throughput, search latency and recall@k against an exact
+// brute-force scan, printing one JSON document.  Exits non-zero when recall falls below
+// --min-recall so ctest can guard the ANN quality.
+
+#include "vector_index.h"
+#include "vector_kernels.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace {
+
+struct BenchOptions {
+    int32_t vectors = 10000;
+    int32_t dimension = 384;
+    int32_t queries = 200;
+    int32_t k = 10;
+    int32_t ef = 64;
+    int32_t max_neighbors = 16;
+    int32_t ef_construction = 100;
+    bool int8 = false;
+    double min_recall = 0.0;
+    std::string directory;
+};
+
+using Clock = std::chrono::steady_clock;
+
+double elapsedMs(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+void printUsage(FILE* out) {
+    std::fprintf(out,
+                 "Penggunaan: cicero_vector_bench [opsi]\n"
+                 "  -n, --vectors N        jumlah vektor yang diindeks (default 10000)\n"
+                 "  -d, --dim N            dimensi vektor (default 384)\n"
+                 "  -q, --queries N        jumlah kueri (default 200)\n"
+                 "  -k N                   jumlah hasil per kueri (default 10)\n"
+                 "  --ef N                 lebar pencarian (default 64)\n"
+                 "  -M N                   tetangga per simpul (default 16)\n"
+                 "  --ef-construction N    lebar pencarian saat membangun (default 100)\n"
+                 "  --int8                 simpan vektor sebagai int8\n"
+                 "  --min-recall R         gagal bila recall@k di bawah R\n"
+                 "  --dir PATH             direktori indeks (default direktori sementara)\n");
+}
+
+int32_t parsePositive(const std::string& flag, const std::string& text) {
+    char* end = nullptr;
+    const long value = std::strtol(text.c_str(), &end, 10);
+    if (text.empty() || *end != '\0' || value <= 0) {
+        throw std::runtime_error("Nilai tidak valid untuk " + flag + ": " + text);
+    }
+    return static_cast<int32_t>(value);
+}
+
+BenchOptions parseArguments(int argc, char** argv) {
+    BenchOptions options;
+    for (int i = 1; i < argc; ++i) {
+        const std::string arg = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) {
+                throw std::runtime_error("Argumen " + arg + " membutuhkan nilai.");
+            }
+            return argv[++i];
+        };
+
+        if (arg == "-n" || arg == "--vectors") {
+            options.vectors = parsePositive(arg, value());
+        } else if (arg == "-d" || arg == "--dim") {
+            options.dimension = parsePositive(arg, value());
+        } else if (arg == "-q" || arg == "--queries") {
+            options.queries = parsePositive(arg, value());
+        } else if (arg == "-k") {
+            options.k = parsePositive(arg, value());
+        } else if (arg == "--ef") {
+            options.ef = parsePositive(arg, value());
+        } else if (arg == "-M") {
+            options.max_neighbors = parsePositive(arg, value());
+        } else if (arg == "--ef-construction") {
+            options.ef_construction = parsePositive(arg, value());
+        } else if (arg == "--int8") {
+            options.int8 = true;
+        } else if (arg == "--min-recall") {
+            options.min_recall = std::strtod(value().c_str(), nullptr);
+        } else if (arg == "--dir") {
+            options.directory = value();
+        } else if (arg == "-h" || arg == "--help") {
+            printUsage(stdout);
+            std::exit(0);
+        } else {
+            throw std::runtime_error("Argumen tidak dikenal: " + arg);
+        }
+    }
+    return options;
+}
+
+void removeIndex(const std::string& directory) {
+    for (const char* name : {"/vectors.cvi", "/graph.cvi", "/links.cvi"}) {
+        unlink((directory + name).c_str());
+    }
+    rmdir(directory.c_str());
+}
+
+// Clustered data resembles sentence embeddings far better than uniform noise, which every ANN
+// index finds artificially hard.
+std::vector<float> makeVectors(int32_t count, int32_t dimension, std::mt19937& rng) {
+    std::normal_distribution<float> normal(0.0f, 1.0f);
+    const int32_t clusters = std::max(1, count / 100);
+    std::vector<float> centres(static_cast<size_t>(clusters) * dimension);
+    for (float& value : centres) {
+        value = normal(rng);
+    }
+    std::uniform_int_distribution<int32_t> pick(0, clusters - 1);
+    std::vector<float> vectors(static_cast<size_t>(count) * dimension);
+    for (int32_t i = 0; i < count; ++i) {
+        const float* centre = centres.data() + static_cast<size_t>(pick(rng)) * dimension;
+        float* vector = vectors.data() + static_cast<size_t>(i) * dimension;
+        float norm = 0.0f;
+        for (int32_t j = 0; j < dimension; ++j) {
+            vector[j] = centre[j] + 0.5f * normal(rng);
+            norm += vector[j] * vector[j];
+        }
+        norm = std::sqrt(norm);
+        for (int32_t j = 0; j < dimension; ++j) {
+            vector[j] /= norm;
+        }
+    }
+    return vectors;
+}
+
+std::vector<int64_t> exactTopK(const std::vector<float>& vectors, const float* query, int32_t dimension, int32_t k) {
+    const size_t count = vectors.size() / dimension;
+    std::vector<std::pair<float, int64_t>> scored(count);
+    for (size_t i = 0; i < count; ++i) {
+        scored[i] = {cicero::dotF32(query, vectors.data() + i * dimension, dimension), static_cast<int64_t>(i)};
+    }
+    const size_t keep = std::min<size_t>(static_cast<size_t>(k), count);
+    std::partial_sort(scored.begin(), scored.begin() + keep, scored.end(),
+                      [](const auto& a, const auto& b) { return a.first > b.first; });
+    std::vector<int64_t> ids;
+    for (size_t i = 0; i < keep; ++i) {
+        ids.push_back(scored[i].second);
+    }
+    return ids;
+}
+
+int runBench(const BenchOptions& options) {
+    std::string directory = options.directory;
+    const bool scratch = directory.empty();
+    if (scratch) {
+        char pattern[] = "/tmp/cicero_vector_bench.XXXXXX";
+        if (!mkdtemp(pattern)) {
+            throw std::runtime_error("Direktori sementara tidak dapat dibuat.");
+        }
+        directory = pattern;
+    }
+
+    std::mt19937 rng(42);
+    const std::vector<float> vectors = makeVectors(options.vectors, options.dimension, rng);
+    const std::vector<float> queries = makeVectors(options.queries, options.dimension, rng);
+    std::vector<int64_t> ids(static_cast<size_t>(options.vectors));
+    for (int32_t i = 0; i < options.vectors; ++i) {
+        ids[i] = i;
+    }
+
+    cicero::VectorIndexOptions index_options;
+    index_options.dimension = options.dimension;
+    index_options.encoding = options.int8 ? cicero::VectorEncoding::Int8 : cicero::VectorEncoding::Float32;
+    index_options.max_neighbors = options.max_neighbors;
+    index_options.ef_construction = options.ef_construction;
+
+    const Clock::time_point build_start = Clock::now();
+    auto index = cicero::VectorIndex::open(directory, index_options);
+    index->add(ids.data(), vectors.data(), ids.size());
+    const double build_ms = elapsedMs(build_start, Clock::now());
+
+    std::vector<double> latencies;
+    latencies.reserve(static_cast<size_t>(options.queries));
+    size_t hits = 0;
+    for (int32_t q = 0; q < options.queries; ++q) {
+        const float* query = queries.data() + static_cast<size_t>(q) * options.dimension;
+        const Clock::time_point start = Clock::now();
+        const std::vector<cicero::VectorMatch> matches =
+                index->search(query, static_cast<size_t>(options.k), static_cast<size_t>(options.ef));
+        latencies.push_back(elapsedMs(start, Clock::now()));
+
+        const std::vector<int64_t> exact = exactTopK(vectors, query, options.dimension, options.k);
+        const std::unordered_set<int64_t> expected(exact.begin(), exact.end());
+        for (const cicero::VectorMatch& match : matches) {
+            hits += expected.count(match.id);
+        }
+    }
+    std::sort(latencies.begin(), latencies.end());
+    double total_ms = 0.0;
+    for (const double latency : latencies) {
+        total_ms += latency;
+    }
+    const double recall = static_cast<double>(hits) / (static_cast<double>(options.queries) * options.k);
+
+    // Reopening must see every vector without relinking.
+    index.reset();
+    const size_t reopened = cicero::VectorIndex::open(directory, index_options)->size();
+    if (scratch) {
+        removeIndex(directory);
+    }
+
+    std::printf("{\n  \"kernel\": \"%s\", \"encoding\": \"%s\", \"vectors\": %d, \"dimension\": %d,\n"
+                "  \"M\": %d, \"ef_construction\": %d, \"ef\": %d, \"k\": %d,\n"
+                "  \"build_ms\": %.3f, \"inserts_per_s\": %.1f,\n"
+                "  \"search_mean_ms\": %.4f, \"search_p50_ms\": %.4f, \"search_p99_ms\": %.4f,\n"
+                "  \"recall\": %.4f, \"reopened_size\": %zu\n}\n",
+                cicero::vectorKernelName(), options.int8 ? "int8" : "f32", options.vectors, options.dimension,
+                options.max_neighbors, options.ef_construction, options.ef, options.k,
+                build_ms, build_ms > 0.0 ? options.vectors * 1000.0 / build_ms : 0.0,
+                total_ms / latencies.size(), latencies[latencies.size() / 2],
+                latencies[std::min(latencies.size() - 1, latencies.size() * 99 / 100)],
+                recall, reopened);
+
+    if (reopened != static_cast<size_t>(options.vectors)) {
+        std::fprintf(stderr, "Indeks yang dibuka ulang berisi %zu vektor, seharusnya %d.\n", reopened,
+                     options.vectors);
+        return 1;
+    }
+    if (recall < options.min_recall) {
+        std::fprintf(stderr, "Recall %.4f di bawah batas %.4f.\n", recall, options.min_recall);
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    try {
+        return runBench(parseArguments(argc, argv));
+    } catch (const std::exception& ex) {
+        std::fprintf(stderr, "cicero_vector_bench gagal: %s\n", ex.what());
+        printUsage(stderr);
+        return 1;
+    }
+}
@@ -0,0 +1,717 @@
+#include "json_schema_grammar.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+namespace cicero {
+
+namespace {
+
+struct JsonValue {
+    enum class Kind { Null, Boolean, Number, String, Array, Object };
+
+    Kind kind = Kind::Null;
+    bool boolean = false;
+    // String contents, or the number exactly as written.
+    std::string text;
+    std::vector<JsonValue> items;
+    // Members in document order; property order matters for the generated grammar.
+    std::vector<std::pair<std::string, JsonValue>> members;
+
+    const JsonValue* find(const std::string& key) const {
+        for (const auto& member : members) {
+            if (member.first == key) {
+                return &member.second;
+            }
+        }
+        return nullptr;
+    }
+};
+
+class JsonParser {
+public:
+    explicit JsonParser(const std::string& text) : text_(text) {}
+
+    JsonValue parse() {
+        JsonValue value = parseValue(0);
+        skipWhitespace();
+        if (pos_ != text_.size()) {
+            fail("data tambahan setelah nilai");
+        }
+        return value;
+    }
+
+private:
+    static constexpr int kMaxDepth = 128;
+
+    [[noreturn]] void fail(const char* what) const {
+        throw std::runtime_error("Skema JSON tidak valid pada posisi " + std::to_string(pos_) + ": " + what);
+    }
+
+    void skipWhitespace() {
+        while (pos_ < text_.size() &&
+               (text_[pos_] == ' ' || text_[pos_] == '\t' || text_[pos_] == '\n' || text_[pos_] == '\r')) {
+            ++pos_;
+        }
+    }
+
+    bool consume(char expected) {
+        skipWhitespace();
+        if (pos_ < text_.size() && text_[pos_] == expected) {
+            ++pos_;
+            return true;
+        }
+        return false;
+    }
+
+    void expectWord(const char* word) {
+        for (const char* c = word; *c; ++c, ++pos_) {
+            if (pos_ >= text_.size() || text_[pos_] != *c) {
+                fail("kata kunci tidak dikenal");
+            }
+        }
+    }
+
+    JsonValue parseValue(int depth) {
+        if (depth > kMaxDepth) {
+            fail("terlalu dalam");
+        }
+        skipWhitespace();
+        if (pos_ >= text_.size()) {
+            fail("nilai terpotong");
+        }
+        JsonValue value;
+        const char c = text_[pos_];
+        if (c == '{') {
+            ++pos_;
+            value.kind = JsonValue::Kind::Object;
+            if (consume('}')) {
+                return value;
+            }
+            do {
+                skipWhitespace();
+                if (pos_ >= text_.size() || text_[pos_] != '"') {
+                    fail("nama properti harus string");
+                }
+                std::string key = parseString();
+                if (!consume(':')) {
+                    fail("':' diharapkan");
+                }
+                value.members.emplace_back(std::move(key), parseValue(depth + 1));
+            } while (consume(','));
+            if (!consume('}')) {
+                fail("'}' diharapkan");
+            }
+        } else if (c == '[') {
+            ++pos_;
+            value.kind = JsonValue::Kind::Array;
+            if (consume(']')) {
+                return value;
+            }
+            do {
+                value.items.push_back(parseValue(depth + 1));
+            } while (consume(','));
+            if (!consume(']')) {
+                fail("']' diharapkan");
+            }
+        } else if (c == '"') {
+            value.kind = JsonValue::Kind::String;
+            value.text = parseString();
+        } else if (c == 't' || c == 'f') {
+            value.kind = JsonValue::Kind::Boolean;
+            value.boolean = c == 't';
+            expectWord(value.boolean ? "true" : "false");
+        } else if (c == 'n') {
+            expectWord("null");
+        } else if (c == '-' || (c >= '0' && c <= '9')) {
+            value.kind = JsonValue::Kind::Number;
+            const size_t start = pos_;
+            char* end = nullptr;
+            std::strtod(text_.c_str() + start, &end);
+            pos_ = static_cast<size_t>(end - text_.c_str());
+            if (pos_ == start) {
+                fail("angka tidak valid");
+            }
+            value.text = text_.substr(start, pos_ - start);
+        } else {
+            fail("karakter tak terduga");
+        }
+        return value;
+    }
+
+    uint32_t parseHex4() {
+        if (pos_ + 4 > text_.size()) {
+            fail("escape \\u terpotong");
+        }
+        uint32_t code = 0;
+        for (int i = 0; i < 4; ++i) {
+            const char h = text_[pos_++];
+            code <<= 4;
+            if (h >= '0' && h <= '9') {
+                code |= static_cast<uint32_t>(h - '0');
+            } else if (h >= 'a' && h <= 'f') {
+                code |= static_cast<uint32_t>(h - 'a' + 10);
+            } else if (h >= 'A' && h <= 'F') {
+                code |= static_cast<uint32_t>(h - 'A' + 10);
+            } else {
+                fail("escape \\u tidak valid");
+            }
+        }
+        return code;
+    }
+
+    static void appendUtf8(std::string& out, uint32_t code) {
+        if (code < 0x80) {
+            out += static_cast<char>(code);
+        } else if (code < 0x800) {
+            out += static_cast<char>(0xC0 | (code >> 6));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else if (code < 0x10000) {
+            out += static_cast<char>(0xE0 | (code >> 12));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        } else {
+            out += static_cast<char>(0xF0 | (code >> 18));
+            out += static_cast<char>(0x80 | ((code >> 12) & 0x3F));
+            out += static_cast<char>(0x80 | ((code >> 6) & 0x3F));
+            out += static_cast<char>(0x80 | (code & 0x3F));
+        }
+    }
+
+    std::string parseString() {
+        ++pos_;  // opening quote
+        std::string out;
+        while (true) {
+            if (pos_ >= text_.size()) {
+                fail("string terpotong");
+            }
+            const char c = text_[pos_++];
+            if (c == '"') {
+                return out;
+            }
+            if (c != '\\') {
+                out += c;
+                continue;
+            }
+            if (pos_ >= text_.size()) {
+                fail("escape terpotong");
+            }
+            const char escaped = text_[pos_++];
+            switch (escaped) {
+                case '"':
+                case '\\':
+                case '/':
+                    out += escaped;
+                    break;
+                case 'b':
+                    out += '\b';
+                    break;
+                case 'f':
+                    out += '\f';
+                    break;
+                case 'n':
+                    out += '\n';
+                    break;
+                case 'r':
+                    out += '\r';
+                    break;
+                case 't':
+                    out += '\t';
+                    break;
+                case 'u': {
+                    uint32_t code = parseHex4();
+                    if (code >= 0xD800 && code < 0xDC00 && pos_ + 6 <= text_.size() && text_[pos_] == '\\' &&
+                        text_[pos_ + 1] == 'u') {
+                        pos_ += 2;
+                        const uint32_t low = parseHex4();
+                        code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    }
+                    appendUtf8(out, code);
+                    break;
+                }
+                default:
+                    fail("escape tidak dikenal");
+            }
+        }
+    }
+
+    const std::string& text_;
+    size_t pos_ = 0;
+};
+
+void appendJsonString(std::string& out, const std::string& text) {
+    out += '"';
+    for (const char c : text) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\u%04x", c);
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    out += '"';
+}
+
+// Compact serialisation, used for enum and const literals.
+std::string toJson(const JsonValue& value) {
+    std::string out;
+    switch (value.kind) {
+        case JsonValue::Kind::Null:
+            return "null";
+        case JsonValue::Kind::Boolean:
+            return value.boolean ? "true" : "false";
+        case JsonValue::Kind::Number:
+            return value.text;
+        case JsonValue::Kind::String:
+            appendJsonString(out, value.text);
+            return out;
+        case JsonValue::Kind::Array:
+            out += '[';
+            for (size_t i = 0; i < value.items.size(); ++i) {
+                out += i ? "," : "";
+                out += toJson(value.items[i]);
+            }
+            return out + ']';
+        case JsonValue::Kind::Object:
+            out += '{';
+            for (size_t i = 0; i < value.members.size(); ++i) {
+                out += i ? "," : "";
+                appendJsonString(out, value.members[i].first);
+                out += ':';
+                out += toJson(value.members[i].second);
+            }
+            return out + '}';
+    }
+    return out;
+}
+
+// Quoted GBNF literal matching `text` byte for byte.
+std::string gbnfLiteral(const std::string& text) {
+    std::string out = "\"";
+    for (const char c : text) {
+        switch (c) {
+            case '"':
+                out += "\\\"";
+                break;
+            case '\\':
+                out += "\\\\";
+                break;
+            case '\n':
+                out += "\\n";
+                break;
+            case '\r':
+                out += "\\r";
+                break;
+            case '\t':
+                out += "\\t";
+                break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20) {
+                    char buffer[8];
+                    std::snprintf(buffer, sizeof(buffer), "\\x%02x", c);
+                    out += buffer;
+                } else {
+                    out += c;
+                }
+        }
+    }
+    return out + "\"";
+}
+
+struct PrimitiveRule {
+    const char* name;
+    const char* body;
+    std::vector<const char*> dependencies;
+};
+
+const std::vector<PrimitiveRule>& primitiveRules() {
+    static const std::vector<PrimitiveRule> rules = {
+            {"space", R"(| " " | "\n" [ \t]{0,20})", {}},
+            {"boolean", R"(("true" | "false") space)", {"space"}},
+            {"null", R"("null" space)", {"space"}},
+            {"integral-part", R"([0] | [1-9] [0-9]{0,15})", {}},
+            {"decimal-part", R"([0-9]{1,16})", {}},
+            {"integer", R"(("-"? integral-part) space)", {"integral-part", "space"}},
+            {"number", R"(("-"? integral-part) ("." decimal-part)? ([eE] [-+]? integral-part)? space)",
+             {"integral-part", "decimal-part", "space"}},
+            {"char", R"([^"\\\x7F\x00-\x1F] | [\\] (["\\/bfnrt] | "u" [0-9a-fA-F]{4}))", {}},
+            {"string", R"("\"" char* "\"" space)", {"char", "space"}},
+            {"value", R"(object | array | string | number | boolean | null)",
+             {"object", "array", "string", "number", "boolean", "null"}},
+            {"object", R"("{" space (string ":" space value ("," space string ":" space value)*)? "}" space)",
+             {"string", "value", "space"}},
+            {"array", R"("[" space (value ("," space value)*)? "]" space)", {"value", "space"}},
+    };
+    return rules;
+}
+
+class SchemaConverter {
+public:
+    explicit SchemaConverter(const JsonValue& root) : root_(root) {
+        for (const PrimitiveRule& rule : primitiveRules()) {
+            used_names_.insert(rule.name);
+        }
+        used_names_.insert("root");
+    }
+
+    std::string convert() {
+        const std::string root = visit(root_, "root");
+        std::string grammar = "root ::= " + root + "\n";
+        for (const auto& rule : rules_) {
+            grammar += rule.first + " ::= " + rule.second + "\n";
+        }
+        return grammar;
+    }
+
+private:
+    [[noreturn]] static void unsupported(const std::string& what) {
+        throw std::runtime_error("Skema JSON tidak didukung: " + what);
+    }
+
+    static std::string sanitize(const std::string& hint) {
+        std::string name;
+        for (const char c : hint) {
+            const bool word = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+            name += word ? c : '-';
+        }
+        return name.empty() ? "rule" : name;
+    }
+
+    std::string uniqueName(const std::string& hint) {
+        const std::string base = sanitize(hint);
+        std::string name = base;
+        for (int suffix = 1; used_names_.count(name); ++suffix) {
+            name = base + std::to_string(suffix);
+        }
+        used_names_.insert(name);
+        return name;
+    }
+
+    // Defines a rule for `body`, reusing an existing rule with the same body.
+    std::string rule(const std::string& hint, const std::string& body) {
+        const auto existing = rules_by_body_.find(body);
+        if (existing != rules_by_body_.end()) {
+            return existing->second;
+        }
+        const std::string name = uniqueName(hint);
+        rules_.emplace_back(name, body);
+        rules_by_body_.emplace(body, name);
+        return name;
+    }
+
+    std::string primitive(const char* name) {
+        if (defined_primitives_.insert(name).second) {
+            for (const PrimitiveRule& rule : primitiveRules()) {
+                if (name == std::string(rule.name)) {
+                    for (const char* dependency : rule.dependencies) {
+                        primitive(dependency);
+                    }
+                    rules_.emplace_back(rule.name, rule.body);
+                    break;
+                }
+            }
+        }
+        return name;
+    }
+
+    const JsonValue& resolve(const std::string& ref) const {
+        if (ref == "#") {
+            return root_;
+        }
+        if (ref.rfind("#/", 0) != 0) {
+            unsupported("$ref " + ref);
+        }
+        const JsonValue* node = &root_;
+        size_t pos = 2;
+        while (node) {
+            const size_t slash = ref.find('/', pos);
+            std::string segment = ref.substr(pos, slash == std::string::npos ? std::string::npos : slash - pos);
+            // JSON Pointer escapes: "~1" is '/', "~0" is '~'.
+            for (size_t i = 0; (i = segment.find('~', i)) != std::string::npos; ++i) {
+                segment.replace(i, 2, segment.compare(i, 2, "~1") == 0 ? "/" : "~");
+            }
+            node = node->find(segment);
+            if (slash == std::string::npos) {
+                break;
+            }
+            pos = slash + 1;
+        }
+        if (!node) {
+            unsupported("$ref tidak ditemukan " + ref);
+        }
+        return *node;
+    }
+
+    std::string visitRef(const std::string& ref) {
+        const auto known = refs_.find(ref);
+        if (known != refs_.end()) {
+            return known->second;
+        }
+        const size_t slash = ref.find_last_of('/');
+        const std::string name = uniqueName(slash == std::string::npos ? "root" : ref.substr(slash + 1));
+        // Registered before visiting so recursive schemas refer back to the rule by name.
+        refs_.emplace(ref, name);
+        const std::string body = visit(resolve(ref), name);
+        rules_.emplace_back(name, body);
+        return name;
+    }
+
+    std::string visit(const JsonValue& schema, const std::string& hint) {
+        if (schema.kind == JsonValue::Kind::Boolean) {
+            if (!schema.boolean) {
+                unsupported("skema false");
+            }
+            return primitive("value");
+        }
+        if (schema.kind != JsonValue::Kind::Object) {
+            unsupported("skema harus berupa objek");
+        }
+
+        if (const JsonValue* ref = schema.find("$ref")) {
+            return visitRef(ref->text);
+        }
+        if (const JsonValue* value = schema.find("const")) {
+            primitive("space");
+            return gbnfLiteral(toJson(*value)) + " space";
+        }
+        if (const JsonValue* values = schema.find("enum")) {
+            std::string body = "(";
+            for (size_t i = 0; i < values->items.size(); ++i) {
+                body += (i ? " | " : "") + gbnfLiteral(toJson(values->items[i]));
+            }
+            if (values->items.empty()) {
+                unsupported("enum kosong");
+            }
+            primitive("space");
+            return rule(hint, body + ") space");
+        }
+        for (const char* keyword : {"anyOf", "oneOf"}) {
+            if (const JsonValue* options = schema.find(keyword)) {
+                std::string body;
+                for (size_t i = 0; i < options->items.size(); ++i) {
+                    body += (i ? " | " : "") + visit(options->items[i], hint + "-" + std::to_string(i));
+                }
+                if (body.empty()) {
+                    unsupported(std::string(keyword) + " kosong");
+                }
+                return rule(hint, body);
+            }
+        }
+        if (const JsonValue* parts = schema.find("allOf")) {
+            return visit(mergeObjects(*parts), hint);
+        }
+
+        const JsonValue* type = schema.find("type");
+        if (type && type->kind == JsonValue::Kind::Array) {
+            std::string body;
+            for (size_t i = 0; i < type->items.size(); ++i) {
+                body += (i ? " | " : "") + visitType(schema, type->items[i].text, hint + "-" + type->items[i].text);
+            }
+            return rule(hint, body);
+        }
+        if (type) {
+            return visitType(schema, type->text, hint);
+        }
+        if (schema.find("properties")) {
+            return visitType(schema, "object", hint);
+        }
+        if (schema.find("items") || schema.find("prefixItems")) {
+            return visitType(schema, "array", hint);
+        }
+        return primitive("value");
+    }
+
+    // allOf over object schemas: the union of their properties and required lists.
+    JsonValue mergeObjects(const JsonValue& parts) {
+        JsonValue merged;
+        merged.kind = JsonValue::Kind::Object;
+        JsonValue properties;
+        properties.kind = JsonValue::Kind::Object;
+        JsonValue required;
+        required.kind = JsonValue::Kind::Array;
+        for (const JsonValue& part : parts.items) {
+            const JsonValue* schema = &part;
+            if (const JsonValue* ref = part.find("$ref")) {
+                schema = &resolve(ref->text);
+            }
+            const JsonValue* part_properties = schema->find("properties");
+            if (!part_properties) {
+                unsupported("allOf hanya didukung untuk objek");
+            }
+            properties.members.insert(properties.members.end(), part_properties->members.begin(),
+                                      part_properties->members.end());
+            if (const JsonValue* part_required = schema->find("required")) {
+                required.items.insert(required.items.end(), part_required->items.begin(), part_required->items.end());
+            }
+        }
+        JsonValue type;
+        type.kind = JsonValue::Kind::String;
+        type.text = "object";
+        merged.members.emplace_back("type", std::move(type));
+        merged.members.emplace_back("properties", std::move(properties));
+        merged.members.emplace_back("required", std::move(required));
+        return merged;
+    }
+
+    static int64_t integerKeyword(const JsonValue& schema, const char* key, int64_t fallback) {
+        const JsonValue* value = schema.find(key);
+        return value && value->kind == JsonValue::Kind::Number ? std::strtoll(value->text.c_str(), nullptr, 10)
+                                                              : fallback;
+    }
+
+    // "{min,max}" suffix, or "*" / "+" / "?" where those say the same thing.
+    static std::string repetition(int64_t min, int64_t max) {
+        if (max < 0) {
+            return min == 0 ? "*" : min == 1 ? "+" : "{" + std::to_string(min) + ",}";
+        }
+        if (min == 0 && max == 1) {
+            return "?";
+        }
+        return min == max ? "{" + std::to_string(min) + "}"
+                          : "{" + std::to_string(min) + "," + std::to_string(max) + "}";
+    }
+
+    std::string visitType(const JsonValue& schema, const std::string& type, const std::string& hint) {
+        if (type == "string") {
+            const int64_t min = integerKeyword(schema, "minLength", 0);
+            const int64_t max = integerKeyword(schema, "maxLength", -1);
+            if (min == 0 && max < 0) {
+                return primitive("string");
+            }
+            primitive("char");
+            primitive("space");
+            return rule(hint, "\"\\\"\" char" + repetition(min, max) + " \"\\\"\" space");
+        }
+        if (type == "integer" || type == "number" || type == "boolean" || type == "null") {
+            return primitive(type.c_str());
+        }
+        if (type == "object") {
+            return visitObject(schema, hint);
+        }
+        if (type == "array") {
+            return visitArray(schema, hint);
+        }
+        unsupported("type " + type);
+    }
+
+    std::string visitObject(const JsonValue& schema, const std::string& hint) {
+        primitive("space");
+        const JsonValue* properties = schema.find("properties");
+        const JsonValue* additional = schema.find("additionalProperties");
+        if (!properties || properties->members.empty()) {
+            if (additional && additional->kind == JsonValue::Kind::Object) {
+                const std::string value = visit(*additional, hint + "-value");
+                const std::string member = primitive("string") + " \":\" space " + value;
+                return rule(hint, "\"{\" space (" + member + " (\",\" space " + member + ")*)? \"}\" space");
+            }
+            if (additional && additional->kind == JsonValue::Kind::Boolean && !additional->boolean) {
+                return rule(hint, "\"{\" space \"}\" space");
+            }
+            return primitive("object");
+        }
+
+        std::set<std::string> required;
+        if (const JsonValue* names = schema.find("required")) {
+            for (const JsonValue& name : names->items) {
+                required.insert(name.text);
+            }
+        }
+        std::vector<std::string> mandatory;
+        std::vector<std::string> optional;
+        for (const auto& property : properties->members) {
+            std::string key;
+            appendJsonString(key, property.first);
+            const std::string value = visit(property.second, hint + "-" + property.first);
+            const std::string member =
+                    rule(hint + "-" + property.first + "-kv", gbnfLiteral(key) + " space \":\" space " + value);
+            (required.count(property.first) ? mandatory : optional).push_back(member);
+        }
+
+        std::string members;
+        for (size_t i = 0; i < mandatory.size(); ++i) {
+            members += (i ? " \",\" space " : "") + mandatory[i];
+        }
+        if (!mandatory.empty()) {
+            for (const std::string& member : optional) {
+                members += " (\",\" space " + member + ")?";
+            }
+        } else if (!optional.empty()) {
+            // No member is guaranteed, so whichever optional one comes first carries no comma.
+            members += "(";
+            for (size_t first = 0; first < optional.size(); ++first) {
+                members += (first ? " | " : "") + optional[first];
+                for (size_t next = first + 1; next < optional.size(); ++next) {
+                    members += " (\",\" space " + optional[next] + ")?";
+                }
+            }
+            members += ")?";
+        }
+        return rule(hint, "\"{\" space " + members + " \"}\" space");
+    }
+
+    std::string visitArray(const JsonValue& schema, const std::string& hint) {
+        primitive("space");
+        if (const JsonValue* prefix = schema.find("prefixItems")) {
+            std::string items;
+            for (size_t i = 0; i < prefix->items.size(); ++i) {
+                items += (i ? " \",\" space " : "") + visit(prefix->items[i], hint + "-" + std::to_string(i));
+            }
+            return rule(hint, "\"[\" space " + items + " \"]\" space");
+        }
+
+        const JsonValue* items = schema.find("items");
+        const std::string item = items ? visit(*items, hint + "-item") : primitive("value");
+        const int64_t min = integerKeyword(schema, "minItems", 0);
+        const int64_t max = integerKeyword(schema, "maxItems", -1);
+        if (max == 0) {
+            return rule(hint, "\"[\" space \"]\" space");
+        }
+        const std::string rest = "(\",\" space " + item + ")" +
+                                 repetition(min > 0 ? min - 1 : 0, max < 0 ? -1 : max - 1);
+        std::string body = item + " " + rest;
+        if (min == 0) {
+            body = "(" + body + ")?";
+        }
+        return rule(hint, "\"[\" space " + body + " \"]\" space");
+    }
+
+    const JsonValue& root_;
+    std::vector<std::pair<std::string, std::string>> rules_;
+    std::map<std::string, std::string> rules_by_body_;
+    std::map<std::string, std::string> refs_;
+    std::set<std::string> used_names_;
+    std::set<std::string> defined_primitives_;
+};
+
+}  // namespace
+
+std::string jsonSchemaToGrammar(const std::string& schema) {
+    const JsonValue root = JsonParser(schema).parse();
+    return SchemaConverter(root).convert();
+}
+
+}  // namespace cicero
@@ -0,0 +1,18 @@
+#pragma once
+
+#include <string>
+
+// JSON Schema to GBNF conversion for constrained generation.  Independent of llama.cpp so host
+// tools can check the output without a model.
+namespace cicero {
+
+// Converts `schema` to a GBNF grammar whose `root` rule accepts exactly the JSON documents the
+// schema allows, with optional whitespace between tokens.  Supported: type (including type
+// lists), properties/required/additionalProperties, items/prefixItems/minItems/maxItems,
+// minLength/maxLength, enum, const, anyOf/oneOf, allOf over objects and local "#/..." $refs.
+// Properties are emitted in declaration order; additionalProperties defaults to false when
+// properties are listed.  Numeric bounds, pattern and format are not enforced.  Throws
+// std::runtime_error for malformed JSON or unsupported constructs.
+std::string jsonSchemaToGrammar(const std::string& schema);
+
+}  // namespace cicero
@@ -1,28 +1,27 @@
 #include <jni.h>
-#include <android/log.h>
 
-#include "llama.h"
-#if defined(GGML_USE_VULKAN)
-#include "ggml-vulkan.h"
-#endif
+#include "llama_session.h"
+#include "model_probe.h"
+#include "native_log.h"
+#include "vector_index.h"
 
 #include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <cstdint>
+#include <cstring>
 #include <functional>
-#include <limits>
 #include <memory>
-#include <mutex>
-#include <optional>
-#include <sstream>
 #include <stdexcept>
 #include <string>
+#include <string_view>
 #include <type_traits>
 #include <vector>
 
-namespace {
+using namespace cicero;
 
-constexpr const char* kTag = "CiceroLlama";
+namespace {
 
 class JniString {
 public:
@@ -43,88 +42,24 @@ private:
     const char* chars_;
 };
 
-struct LlamaSession {
-    std::string model_path;
-    int thread_count = 0;
-    int thread_count_batch = 0;
-    int context_size = 0;
-    llama_model* model = nullptr;
-    llama_context* context = nullptr;
-    int32_t tokens_processed = 0;
-};
-
-struct RuntimeNativeConfig {
-    int32_t thread_count = 0;
-    int32_t thread_count_batch = 0;
-    bool has_thread_count_batch = false;
-    int32_t context_size = 0;
-    int32_t batch_size = 0;
-    bool has_batch_size = false;
-    int32_t ubatch_size = 0;
-    bool has_ubatch_size = false;
-    int32_t seq_max = 0;
-    bool has_seq_max = false;
-    int32_t n_gpu_layers = 0;
-    bool has_n_gpu_layers = false;
-    int32_t main_gpu = 0;
-    bool has_main_gpu = false;
-    int32_t flash_attention = 0;
-    bool has_flash_attention = false;
-    float rope_freq_base = 0.0f;
-    bool has_rope_freq_base = false;
-    float rope_freq_scale = 0.0f;
-    bool has_rope_freq_scale = false;
-    bool offload_kqv = false;
-    bool has_offload_kqv = false;
-    bool no_perf = true;
-    bool has_no_perf = false;
-    bool embeddings = false;
-    bool has_embeddings = false;
-    bool kv_unified = false;
-    bool has_kv_unified = false;
-    bool use_mmap = false;
-    bool has_use_mmap = false;
-    bool use_mlock = false;
-    bool has_use_mlock = false;
-};
-
-struct SamplingNativeOptions {
-    int32_t max_tokens = 0;
-    std::optional<float> temperature;
-    std::optional<float> top_p;
-    std::optional<int32_t> top_k;
-    std::optional<float> repeat_penalty;
-    std::optional<int32_t> repeat_last_n;
-    std::optional<float> frequency_penalty;
-    std::optional<float> presence_penalty;
-    std::vector<std::string> stop_sequences;
-    std::optional<uint32_t> seed;
-};
-
-std::once_flag g_backend_once;
-std::mutex g_backend_mutex;
-int g_backend_users = 0;
-
-void retainBackend() {
-    std::call_once(g_backend_once, []() {
-        ggml_backend_load_all();
-        llama_backend_init();
-    });
-
-    std::lock_guard<std::mutex> lock(g_backend_mutex);
-    ++g_backend_users;
-}
-
-void releaseBackend() {
-    std::lock_guard<std::mutex> lock(g_backend_mutex);
-    if (g_backend_users == 0) {
-        return;
-    }
-
-    --g_backend_users;
-    if (g_backend_users == 0) {
-        llama_backend_free();
+// Copies a Java String[] into UTF-8 strings; null elements become empty strings.
+std::vector<std::string> readStringArray(JNIEnv* env, jobjectArray array) {
+    std::vector<std::string> strings;
+    const jsize length = array ? env->GetArrayLength(array) : 0;
+    strings.reserve(static_cast<size_t>(length));
+    for (jsize index = 0; index < length; ++index) {
+        auto* element = static_cast<jstring>(env->GetObjectArrayElement(array, index));
+        if (!element) {
+            strings.emplace_back();
+            continue;
+        }
+        {
+            JniString text(env, element);
+            strings.emplace_back(text.get() ? text.get() : "");
+        }
+        env->DeleteLocalRef(element);
     }
+    return strings;
 }
 
 jlong toHandle(LlamaSession* session) {
@@ -148,629 +83,574 @@ void throwJavaException(JNIEnv* env, const char* class_name, const std::string&
     env->ThrowNew(clazz, message.c_str());
 }
 
-std::optional<int32_t> getOptionalInt(JNIEnv* env, jobject object, jmethodID method) {
-    if (!env || !object || !method) {
-        return std::nullopt;
-    }
-
-    jobject value_obj = env->CallObjectMethod(object, method);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        throw std::runtime_error("Gagal membaca nilai Integer dari konfigurasi runtime.");
-    }
-    if (!value_obj) {
-        return std::nullopt;
-    }
-
-    jclass integer_class = env->FindClass("java/lang/Integer");
-    if (!integer_class) {
-        env->ExceptionClear();
-        env->DeleteLocalRef(value_obj);
-        throw std::runtime_error("java.lang.Integer tidak tersedia di lingkungan JNI.");
-    }
-    jmethodID int_value_method = env->GetMethodID(integer_class, "intValue", "()I");
-    if (!int_value_method) {
-        env->DeleteLocalRef(integer_class);
-        env->DeleteLocalRef(value_obj);
-        throw std::runtime_error("Metode intValue tidak ditemukan pada java.lang.Integer.");
-    }
-    const jint result = env->CallIntMethod(value_obj, int_value_method);
-    env->DeleteLocalRef(integer_class);
-    env->DeleteLocalRef(value_obj);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        throw std::runtime_error("Gagal mengambil nilai Integer dari konfigurasi runtime.");
-    }
-    return static_cast<int32_t>(result);
-}
-
-std::optional<float> getOptionalFloat(JNIEnv* env, jobject object, jmethodID method) {
-    if (!env || !object || !method) {
-        return std::nullopt;
-    }
-
-    jobject value_obj = env->CallObjectMethod(object, method);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        throw std::runtime_error("Gagal membaca nilai Float dari konfigurasi runtime.");
-    }
-    if (!value_obj) {
-        return std::nullopt;
-    }
-
-    jclass float_class = env->FindClass("java/lang/Float");
-    if (!float_class) {
-        env->ExceptionClear();
-        env->DeleteLocalRef(value_obj);
-        throw std::runtime_error("java.lang.Float tidak tersedia di lingkungan JNI.");
-    }
-    jmethodID float_value_method = env->GetMethodID(float_class, "floatValue", "()F");
-    if (!float_value_method) {
-        env->DeleteLocalRef(float_class);
-        env->DeleteLocalRef(value_obj);
-        throw std::runtime_error("Metode floatValue tidak ditemukan pada java.lang.Float.");
-    }
-    const jfloat result = env->CallFloatMethod(value_obj, float_value_method);
-    env->DeleteLocalRef(float_class);
-    env->DeleteLocalRef(value_obj);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        throw std::runtime_error("Gagal mengambil nilai Float dari konfigurasi runtime.");
-    }
-    return static_cast<float>(result);
-}
-
-std::optional<bool> getOptionalBoolean(JNIEnv* env, jobject object, jmethodID method) {
-    if (!env || !object || !method) {
-        return std::nullopt;
-    }
-
-    jobject value_obj = env->CallObjectMethod(object, method);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        throw std::runtime_error("Gagal membaca nilai Boolean dari konfigurasi runtime.");
-    }
-    if (!value_obj) {
-        return std::nullopt;
-    }
-
-    jclass boolean_class = env->FindClass("java/lang/Boolean");
-    if (!boolean_class) {
-        env->ExceptionClear();
-        env->DeleteLocalRef(value_obj);
-        throw std::runtime_error("java.lang.Boolean tidak tersedia di lingkungan JNI.");
-    }
-    jmethodID bool_value_method = env->GetMethodID(boolean_class, "booleanValue", "()Z");
-    if (!bool_value_method) {
-        env->DeleteLocalRef(boolean_class);
-        env->DeleteLocalRef(value_obj);
-        throw std::runtime_error("Metode booleanValue tidak ditemukan pada java.lang.Boolean.");
-    }
-    const jboolean result = env->CallBooleanMethod(value_obj, bool_value_method);
-    env->DeleteLocalRef(boolean_class);
-    env->DeleteLocalRef(value_obj);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        throw std::runtime_error("Gagal mengambil nilai Boolean dari konfigurasi runtime.");
-    }
-    return result == JNI_TRUE;
-}
-
-RuntimeNativeConfig parseRuntimeConfig(JNIEnv* env, jobject runtime_config) {
-    if (!env) {
-        throw std::runtime_error("Lingkungan JNI tidak tersedia untuk runtime config.");
-    }
-    if (!runtime_config) {
-        throw std::runtime_error("RuntimeConfig tidak boleh null.");
-    }
-
-    jclass config_class = env->GetObjectClass(runtime_config);
-    if (!config_class) {
-        throw std::runtime_error("Tidak dapat mengambil kelas RuntimeConfig.");
-    }
-
-    jmethodID get_thread_count = env->GetMethodID(config_class, "getThreadCount", "()I");
-    jmethodID get_context_size = env->GetMethodID(config_class, "getContextSize", "()I");
-    jmethodID get_thread_batch = env->GetMethodID(config_class, "getThreadCountBatch", "()Ljava/lang/Integer;");
-    jmethodID get_batch_size = env->GetMethodID(config_class, "getBatchSize", "()Ljava/lang/Integer;");
-    jmethodID get_ubatch_size = env->GetMethodID(config_class, "getUbatchSize", "()Ljava/lang/Integer;");
-    jmethodID get_seq_max = env->GetMethodID(config_class, "getSeqMax", "()Ljava/lang/Integer;");
-    jmethodID get_n_gpu_layers = env->GetMethodID(config_class, "getNGpuLayers", "()Ljava/lang/Integer;");
-    jmethodID get_main_gpu = env->GetMethodID(config_class, "getMainGpu", "()Ljava/lang/Integer;");
-    jmethodID get_flash_attention = env->GetMethodID(config_class, "getFlashAttention", "()Ljava/lang/Integer;");
-    jmethodID get_rope_freq_base = env->GetMethodID(config_class, "getRopeFreqBase", "()Ljava/lang/Float;");
-    jmethodID get_rope_freq_scale = env->GetMethodID(config_class, "getRopeFreqScale", "()Ljava/lang/Float;");
-    jmethodID get_offload_kqv = env->GetMethodID(config_class, "getOffloadKqv", "()Ljava/lang/Boolean;");
-    jmethodID get_no_perf = env->GetMethodID(config_class, "getNoPerf", "()Ljava/lang/Boolean;");
-    jmethodID get_embeddings = env->GetMethodID(config_class, "getEmbeddings", "()Ljava/lang/Boolean;");
-    jmethodID get_kv_unified = env->GetMethodID(config_class, "getKvUnified", "()Ljava/lang/Boolean;");
-    jmethodID get_use_mmap = env->GetMethodID(config_class, "getUseMmap", "()Ljava/lang/Boolean;");
-    jmethodID get_use_mlock = env->GetMethodID(config_class, "getUseMlock", "()Ljava/lang/Boolean;");
+// Packed config encoding shared with NativeConfigCodec.kt.  A buffer starts with a fixed header
+// (magic, version, kind, payload length) followed by tag/length/value records in native byte
+// order.  Absent optional fields are simply not written and unknown tags are skipped, so new
+// knobs can be added on either side without breaking the other.
+constexpr uint32_t kPackedConfigMagic = 0x47464343;  // "CCFG"
+constexpr uint16_t kPackedConfigVersion = 1;
+constexpr uint16_t kPackedKindRuntime = 1;
+constexpr uint16_t kPackedKindSampling = 2;
+constexpr size_t kPackedHeaderBytes = 12;
+
+enum RuntimeConfigTag : uint16_t {
+    kRuntimeThreadCount = 1,
+    kRuntimeContextSize = 2,
+    kRuntimeThreadCountBatch = 3,
+    kRuntimeBatchSize = 4,
+    kRuntimeUbatchSize = 5,
+    kRuntimeSeqMax = 6,
+    kRuntimeNGpuLayers = 7,
+    kRuntimeMainGpu = 8,
+    kRuntimeFlashAttention = 9,
+    kRuntimeRopeFreqBase = 10,
+    kRuntimeRopeFreqScale = 11,
+    kRuntimeOffloadKqv = 12,
+    kRuntimeNoPerf = 13,
+    kRuntimeEmbeddings = 14,
+    kRuntimeKvUnified = 15,
+    kRuntimeUseMmap = 16,
+    kRuntimeUseMlock = 17,
+    kRuntimeDraftModelPath = 18,
+    kRuntimeDraftTokens = 19,
+    kRuntimeAutoTune = 20,
+    kRuntimeTuneCacheDir = 21,
+    kRuntimePrefetch = 22,
+    kRuntimeTypeK = 23,
+    kRuntimeTypeV = 24,
+};
 
-    RuntimeNativeConfig config;
-    config.thread_count = env->CallIntMethod(runtime_config, get_thread_count);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        env->DeleteLocalRef(config_class);
-        throw std::runtime_error("Nilai threadCount tidak valid pada runtime config.");
-    }
-    config.context_size = env->CallIntMethod(runtime_config, get_context_size);
-    if (env->ExceptionCheck()) {
-        env->ExceptionClear();
-        env->DeleteLocalRef(config_class);
-        throw std::runtime_error("Nilai contextSize tidak valid pada runtime config.");
-    }
+enum SamplingConfigTag : uint16_t {
+    kSamplingMaxTokens = 1,
+    kSamplingTemperature = 2,
+    kSamplingTopP = 3,
+    kSamplingTopK = 4,
+    kSamplingRepeatPenalty = 5,
+    kSamplingRepeatLastN = 6,
+    kSamplingFrequencyPenalty = 7,
+    kSamplingPresencePenalty = 8,
+    kSamplingStopSequence = 9,
+    kSamplingSeed = 10,
+    kSamplingContextShift = 11,
+    kSamplingSinkTokens = 12,
+    kSamplingGrammar = 13,
+    kSamplingJsonSchema = 14,
+};
 
-    if (auto value = getOptionalInt(env, runtime_config, get_thread_batch)) {
-        if (*value > 0) {
-            config.thread_count_batch = *value;
-            config.has_thread_count_batch = true;
-        }
-    }
-    if (auto value = getOptionalInt(env, runtime_config, get_batch_size)) {
-        if (*value > 0) {
-            config.batch_size = *value;
-            config.has_batch_size = true;
-        }
-    }
-    if (auto value = getOptionalInt(env, runtime_config, get_ubatch_size)) {
-        if (*value > 0) {
-            config.ubatch_size = *value;
-            config.has_ubatch_size = true;
+class PackedConfigReader {
+public:
+    PackedConfigReader(JNIEnv* env, jobject buffer, uint16_t expected_kind) {
+        const auto* data = static_cast<const uint8_t*>(buffer ? env->GetDirectBufferAddress(buffer) : nullptr);
+        const jlong capacity = buffer ? env->GetDirectBufferCapacity(buffer) : -1;
+        if (!data || capacity < static_cast<jlong>(kPackedHeaderBytes)) {
+            throw std::runtime_error("Konfigurasi terkemas harus berupa direct ByteBuffer yang valid.");
         }
-    }
-    if (auto value = getOptionalInt(env, runtime_config, get_seq_max)) {
-        if (*value > 0) {
-            config.seq_max = *value;
-            config.has_seq_max = true;
+
+        uint32_t magic = 0;
+        uint16_t version = 0;
+        uint16_t kind = 0;
+        uint32_t length = 0;
+        std::memcpy(&magic, data, sizeof(magic));
+        std::memcpy(&version, data + 4, sizeof(version));
+        std::memcpy(&kind, data + 6, sizeof(kind));
+        std::memcpy(&length, data + 8, sizeof(length));
+        if (magic != kPackedConfigMagic || kind != expected_kind) {
+            throw std::runtime_error("Format konfigurasi terkemas tidak dikenali.");
         }
-    }
-    if (auto value = getOptionalInt(env, runtime_config, get_n_gpu_layers)) {
-        if (*value >= 0) {
-            config.n_gpu_layers = *value;
-            config.has_n_gpu_layers = true;
+        if (version != kPackedConfigVersion) {
+            throw std::runtime_error("Versi konfigurasi terkemas tidak didukung: " + std::to_string(version));
         }
-    }
-    if (auto value = getOptionalInt(env, runtime_config, get_main_gpu)) {
-        if (*value >= 0) {
-            config.main_gpu = *value;
-            config.has_main_gpu = true;
+        if (static_cast<jlong>(length) > capacity - static_cast<jlong>(kPackedHeaderBytes)) {
+            throw std::runtime_error("Panjang konfigurasi terkemas melebihi buffer.");
         }
+        cursor_ = data + kPackedHeaderBytes;
+        end_ = cursor_ + length;
     }
-    if (auto value = getOptionalInt(env, runtime_config, get_flash_attention)) {
-        if (*value < -1 || *value > 1) {
-            env->DeleteLocalRef(config_class);
-            throw std::runtime_error("Nilai flash_attn tidak valid (gunakan -1, 0, atau 1).");
+
+    bool next(uint16_t& tag, std::string_view& value) {
+        if (cursor_ == end_) {
+            return false;
         }
-        config.flash_attention = *value;
-        config.has_flash_attention = true;
-    }
-    if (auto value = getOptionalFloat(env, runtime_config, get_rope_freq_base)) {
-        if (*value > 0.0f) {
-            config.rope_freq_base = *value;
-            config.has_rope_freq_base = true;
+        uint16_t length = 0;
+        if (end_ - cursor_ < 4) {
+            throw std::runtime_error("Record konfigurasi terkemas terpotong.");
         }
-    }
-    if (auto value = getOptionalFloat(env, runtime_config, get_rope_freq_scale)) {
-        if (*value > 0.0f) {
-            config.rope_freq_scale = *value;
-            config.has_rope_freq_scale = true;
+        std::memcpy(&tag, cursor_, sizeof(tag));
+        std::memcpy(&length, cursor_ + 2, sizeof(length));
+        cursor_ += 4;
+        if (end_ - cursor_ < length) {
+            throw std::runtime_error("Record konfigurasi terkemas terpotong.");
         }
-    }
-    if (auto value = getOptionalBoolean(env, runtime_config, get_offload_kqv)) {
-        config.offload_kqv = *value;
-        config.has_offload_kqv = true;
-    }
-    if (auto value = getOptionalBoolean(env, runtime_config, get_no_perf)) {
-        config.no_perf = *value;
-        config.has_no_perf = true;
-    }
-    if (auto value = getOptionalBoolean(env, runtime_config, get_embeddings)) {
-        config.embeddings = *value;
-        config.has_embeddings = true;
-    }
-    if (auto value = getOptionalBoolean(env, runtime_config, get_kv_unified)) {
-        config.kv_unified = *value;
-        config.has_kv_unified = true;
-    }
-    if (auto value = getOptionalBoolean(env, runtime_config, get_use_mmap)) {
-        config.use_mmap = *value;
-        config.has_use_mmap = true;
-    }
-    if (auto value = getOptionalBoolean(env, runtime_config, get_use_mlock)) {
-        config.use_mlock = *value;
-        config.has_use_mlock = true;
+        value = std::string_view(reinterpret_cast<const char*>(cursor_), length);
+        cursor_ += length;
+        return true;
     }
 
-    env->DeleteLocalRef(config_class);
-
-    if (config.thread_count <= 0 || config.context_size <= 0) {
-        throw std::runtime_error("Parameter inisialisasi tidak valid.");
-    }
-
-    return config;
-}
-
-std::vector<std::string> extractStopSequences(JNIEnv* env, jobjectArray sequences) {
-    std::vector<std::string> result;
-    if (!env || !sequences) {
+    template <typename T>
+    static T scalar(std::string_view value) {
+        static_assert(std::is_trivially_copyable<T>::value, "scalar records must be trivially copyable");
+        if (value.size() != sizeof(T)) {
+            throw std::runtime_error("Ukuran record konfigurasi terkemas tidak sesuai.");
+        }
+        T result;
+        std::memcpy(&result, value.data(), sizeof(T));
         return result;
     }
 
-    const jsize length = env->GetArrayLength(sequences);
-    result.reserve(static_cast<size_t>(length));
-    for (jsize index = 0; index < length; ++index) {
-        jstring element = static_cast<jstring>(env->GetObjectArrayElement(sequences, index));
-        if (!element) {
-            continue;
-        }
-        JniString text(env, element);
-        if (text.get() && text.get()[0] != '\0') {
-            result.emplace_back(text.get());
-        }
-        env->DeleteLocalRef(element);
-    }
-    return result;
-}
+    static bool flag(std::string_view value) { return scalar<uint8_t>(value) != 0; }
 
-std::string tokenToString(const llama_vocab* vocab, llama_token token) {
-    std::vector<char> buffer(128);
-    while (true) {
-        const int32_t written = llama_token_to_piece(vocab, token, buffer.data(), buffer.size(), 0, true);
-        if (written >= 0) {
-            return std::string(buffer.data(), written);
-        }
+private:
+    const uint8_t* cursor_ = nullptr;
+    const uint8_t* end_ = nullptr;
+};
 
-        const size_t required = static_cast<size_t>(-written);
-        if (required <= buffer.size()) {
-            buffer.resize(buffer.size() * 2);
-        } else {
-            buffer.resize(required);
+RuntimeNativeConfig decodeRuntimeConfig(JNIEnv* env, jobject packed) {
+    PackedConfigReader reader(env, packed, kPackedKindRuntime);
+    RuntimeNativeConfig config;
+    uint16_t tag = 0;
+    std::string_view value;
+    while (reader.next(tag, value)) {
+        switch (tag) {
+            case kRuntimeThreadCount:
+                config.thread_count = PackedConfigReader::scalar<int32_t>(value);
+                break;
+            case kRuntimeContextSize:
+                config.context_size = PackedConfigReader::scalar<int32_t>(value);
+                break;
+            case kRuntimeThreadCountBatch:
+                config.thread_count_batch = PackedConfigReader::scalar<int32_t>(value);
+                config.has_thread_count_batch = config.thread_count_batch > 0;
+                break;
+            case kRuntimeBatchSize:
+                config.batch_size = PackedConfigReader::scalar<int32_t>(value);
+                config.has_batch_size = config.batch_size > 0;
+                break;
+            case kRuntimeUbatchSize:
+                config.ubatch_size = PackedConfigReader::scalar<int32_t>(value);
+                config.has_ubatch_size = config.ubatch_size > 0;
+                break;
+            case kRuntimeSeqMax:
+                config.seq_max = PackedConfigReader::scalar<int32_t>(value);
+                config.has_seq_max = config.seq_max > 0;
+                break;
+            case kRuntimeNGpuLayers:
+                config.n_gpu_layers = PackedConfigReader::scalar<int32_t>(value);
+                config.has_n_gpu_layers = config.n_gpu_layers >= 0;
+                break;
+            case kRuntimeMainGpu:
+                config.main_gpu = PackedConfigReader::scalar<int32_t>(value);
+                config.has_main_gpu = config.main_gpu >= 0;
+                break;
+            case kRuntimeFlashAttention:
+                config.flash_attention = PackedConfigReader::scalar<int32_t>(value);
+                if (config.flash_attention < -1 || config.flash_attention > 1) {
+                    throw std::runtime_error("Nilai flash_attn tidak valid (gunakan -1, 0, atau 1).");
+                }
+                config.has_flash_attention = true;
+                break;
+            case kRuntimeRopeFreqBase:
+                config.rope_freq_base = PackedConfigReader::scalar<float>(value);
+                config.has_rope_freq_base = config.rope_freq_base > 0.0f;
+                break;
+            case kRuntimeRopeFreqScale:
+                config.rope_freq_scale = PackedConfigReader::scalar<float>(value);
+                config.has_rope_freq_scale = config.rope_freq_scale > 0.0f;
+                break;
+            case kRuntimeOffloadKqv:
+                config.offload_kqv = PackedConfigReader::flag(value);
+                config.has_offload_kqv = true;
+                break;
+            case kRuntimeNoPerf:
+                config.no_perf = PackedConfigReader::flag(value);
+                config.has_no_perf = true;
+                break;
+            case kRuntimeEmbeddings:
+                config.embeddings = PackedConfigReader::flag(value);
+                config.has_embeddings = true;
+                break;
+            case kRuntimeKvUnified:
+                config.kv_unified = PackedConfigReader::flag(value);
+                config.has_kv_unified = true;
+                break;
+            case kRuntimeUseMmap:
+                config.use_mmap = PackedConfigReader::flag(value);
+                config.has_use_mmap = true;
+                break;
+            case kRuntimeUseMlock:
+                config.use_mlock = PackedConfigReader::flag(value);
+                config.has_use_mlock = true;
+                break;
+            case kRuntimeDraftModelPath:
+                config.draft_model_path.assign(value.data(), value.size());
+                break;
+            case kRuntimeDraftTokens:
+                config.draft_tokens = PackedConfigReader::scalar<int32_t>(value);
+                config.has_draft_tokens = config.draft_tokens > 0;
+                break;
+            case kRuntimeAutoTune:
+                config.auto_tune = PackedConfigReader::scalar<uint32_t>(value) &
+                                   (kAutoTuneThreads | kAutoTuneThreadsBatch | kAutoTuneBatch | kAutoTuneUbatch);
+                break;
+            case kRuntimeTuneCacheDir:
+                config.tune_cache_dir.assign(value.data(), value.size());
+                break;
+            case kRuntimePrefetch:
+                config.prefetch = PackedConfigReader::flag(value);
+                config.has_prefetch = true;
+                break;
+            case kRuntimeTypeK:
+                config.type_k = static_cast<ggml_type>(PackedConfigReader::scalar<int32_t>(value));
+                config.has_type_k = true;
+                break;
+            case kRuntimeTypeV:
+                config.type_v = static_cast<ggml_type>(PackedConfigReader::scalar<int32_t>(value));
+                config.has_type_v = true;
+                break;
+            default:
+                break;
         }
     }
-}
-
-std::vector<llama_token> tokenizePrompt(const llama_model* model, const std::string& prompt) {
-    const llama_vocab* vocab = llama_model_get_vocab(model);
-    const int32_t estimated = llama_tokenize(
-            vocab,
-            prompt.c_str(),
-            static_cast<int32_t>(prompt.size()),
-            nullptr,
-            0,
-            true,
-            true);
-
-    if (estimated == std::numeric_limits<int32_t>::min()) {
-        throw std::runtime_error("Jumlah token terlalu besar.");
-    }
-
-    const int32_t required = estimated < 0 ? -estimated : estimated;
-    std::vector<llama_token> tokens(static_cast<size_t>(required));
-    if (required == 0) {
-        return tokens;
-    }
-
-    const int32_t encoded = llama_tokenize(
-            vocab,
-            prompt.c_str(),
-            static_cast<int32_t>(prompt.size()),
-            tokens.data(),
-            static_cast<int32_t>(tokens.size()),
-            true,
-            true);
-
-    if (encoded < 0) {
-        throw std::runtime_error("Failed to tokenize prompt");
-    }
 
-    tokens.resize(static_cast<size_t>(encoded));
-    return tokens;
-}
-
-RuntimeNativeConfig makeDefaultRuntimeConfig(int thread_count, int context_size) {
-    RuntimeNativeConfig config;
-    config.thread_count = thread_count;
-    config.context_size = context_size;
-    return config;
-}
-
-jlong createSession(JNIEnv* env,
-                    const char* model_path,
-                    const RuntimeNativeConfig& config) {
-    if (!model_path) {
-        throw std::runtime_error("Parameter inisialisasi tidak valid.");
-    }
     if (config.thread_count <= 0 || config.context_size <= 0) {
         throw std::runtime_error("Parameter inisialisasi tidak valid.");
     }
-
-    auto session = std::make_unique<LlamaSession>();
-    session->model_path = model_path;
-    session->thread_count = config.thread_count;
-    session->thread_count_batch = config.has_thread_count_batch ? config.thread_count_batch
-                                                                : config.thread_count;
-    session->context_size = config.context_size;
-
-    retainBackend();
-
-    llama_model_params model_params = llama_model_default_params();
-    if (config.has_n_gpu_layers) {
-        model_params.n_gpu_layers = config.n_gpu_layers;
-    }
-    if (config.has_main_gpu) {
-        model_params.main_gpu = config.main_gpu;
-    }
-    if (config.has_use_mmap) {
-        model_params.use_mmap = config.use_mmap;
-    }
-    if (config.has_use_mlock) {
-        model_params.use_mlock = config.use_mlock;
-    }
-
-    model_params.progress_callback = nullptr;
-
-    session->model = llama_model_load_from_file(session->model_path.c_str(), model_params);
-    if (!session->model) {
-        releaseBackend();
-        std::ostringstream msg;
-        msg << "Gagal memuat model: " << session->model_path;
-        throw std::runtime_error(msg.str());
-    }
-
-    llama_context_params ctx_params = llama_context_default_params();
-    ctx_params.n_ctx = session->context_size;
-    if (config.has_batch_size) {
-        ctx_params.n_batch = std::max<int32_t>(1, config.batch_size);
-    } else {
-        ctx_params.n_batch = std::min(session->context_size, 512);
-    }
-    if (config.has_ubatch_size) {
-        ctx_params.n_ubatch = std::max<int32_t>(1, config.ubatch_size);
-    }
-    if (config.has_seq_max) {
-        ctx_params.n_seq_max = std::max<int32_t>(1, config.seq_max);
-    }
-    ctx_params.n_threads = session->thread_count;
-    ctx_params.n_threads_batch = config.has_thread_count_batch ? config.thread_count_batch
-                                                               : session->thread_count;
-    if (config.has_flash_attention) {
-        ctx_params.flash_attn_type = static_cast<llama_flash_attn_type>(config.flash_attention);
-    }
-    if (config.has_rope_freq_base) {
-        ctx_params.rope_freq_base = config.rope_freq_base;
-    }
-    if (config.has_rope_freq_scale) {
-        ctx_params.rope_freq_scale = config.rope_freq_scale;
-    }
-    if (config.has_offload_kqv) {
-        ctx_params.offload_kqv = config.offload_kqv;
-    }
-    if (config.has_no_perf) {
-        ctx_params.no_perf = config.no_perf;
-    } else {
-        ctx_params.no_perf = true;
-    }
-    if (config.has_embeddings) {
-        ctx_params.embeddings = config.embeddings;
-    }
-    if (config.has_kv_unified) {
-        ctx_params.kv_unified = config.kv_unified;
-    }
-
-    session->context = llama_init_from_model(session->model, ctx_params);
-    if (!session->context) {
-        llama_model_free(session->model);
-        session->model = nullptr;
-        releaseBackend();
-        throw std::runtime_error("Gagal membuat konteks llama.");
-    }
-
-    __android_log_print(ANDROID_LOG_INFO, kTag,
-                        "Session siap. Model=%s, threads=%d, ctx=%d",
-                        session->model_path.c_str(),
-                        session->thread_count,
-                        session->context_size);
-
-    return toHandle(session.release());
+    return config;
 }
 
-std::string runCompletion(LlamaSession* session,
-                          const std::string& prompt,
-                          const SamplingNativeOptions& options,
-                          const std::function<void(const std::string&)>& on_token) {
-    if (!session || !session->model || !session->context) {
-        throw std::runtime_error("Session belum siap digunakan.");
+// Layout of the direct ByteBuffer shared with TokenStreamBuffer.kt: two native-endian int64
+// cursors (bytes ever written by native, bytes ever consumed by Kotlin) followed by the ring.
+constexpr size_t kStreamWriteCursorOffset = 0;
+constexpr size_t kStreamReadCursorOffset = 8;
+constexpr size_t kStreamHeaderBytes = 16;
+
+// Copies generated text into the shared ring buffer and notifies the listener only every
+// `flush_tokens` tokens or `flush_interval_ms`, whichever comes first.  Chunks always end on a
+// UTF-8 character boundary; a character split across tokens stays staged until it is complete.
+// When the ring is full the writer notifies and blocks on the listener draining it, so a slow
+// consumer throttles generation instead of losing text.
+class TokenStreamWriter {
+public:
+    TokenStreamWriter(uint8_t* buffer,
+                      size_t buffer_size,
+                      int32_t flush_tokens,
+                      int32_t flush_interval_ms,
+                      std::function<void()> notify)
+        : write_cursor_(reinterpret_cast<std::atomic<int64_t>*>(buffer + kStreamWriteCursorOffset)),
+          read_cursor_(reinterpret_cast<std::atomic<int64_t>*>(buffer + kStreamReadCursorOffset)),
+          data_(buffer + kStreamHeaderBytes),
+          capacity_(buffer_size - kStreamHeaderBytes),
+          flush_tokens_(std::max<int32_t>(1, flush_tokens)),
+          flush_interval_(std::max<int32_t>(0, flush_interval_ms)),
+          notify_(std::move(notify)) {
+        write_cursor_->store(0, std::memory_order_relaxed);
+        read_cursor_->store(0, std::memory_order_relaxed);
+    }
+
+    void write(const std::string& piece) {
+        staged_ += piece;
+        ++staged_tokens_;
+        const auto now = std::chrono::steady_clock::now();
+        // The first chunk goes out immediately so time-to-first-token is not delayed.
+        if (!published_any_ || staged_tokens_ >= flush_tokens_ || now - last_flush_ >= flush_interval_) {
+            publish(completeUtf8Length(staged_.data(), staged_.size()));
+        }
     }
 
-    session->tokens_processed = 0;
+    // Publishes everything still staged, including a trailing partial character.
+    void finish() { publish(staged_.size()); }
 
-    if (options.max_tokens <= 0) {
-        return std::string();
+private:
+    // Length of the longest prefix of `text` that does not end inside a UTF-8 sequence.
+    static size_t completeUtf8Length(const char* text, size_t size) {
+        for (size_t back = 1; back <= std::min<size_t>(4, size); ++back) {
+            const auto byte = static_cast<uint8_t>(text[size - back]);
+            if ((byte & 0xC0) == 0x80) {
+                continue;
+            }
+            size_t expected = 1;
+            if ((byte & 0xE0) == 0xC0) {
+                expected = 2;
+            } else if ((byte & 0xF0) == 0xE0) {
+                expected = 3;
+            } else if ((byte & 0xF8) == 0xF0) {
+                expected = 4;
+            }
+            return expected > back ? size - back : size;
+        }
+        return size;
     }
 
-    const llama_vocab* vocab = llama_model_get_vocab(session->model);
-
-    auto tokens = tokenizePrompt(session->model, prompt);
-    if (tokens.empty()) {
-        const llama_token bos = llama_vocab_bos(vocab);
-        if (bos == LLAMA_TOKEN_NULL) {
-            throw std::runtime_error("Model tidak memiliki token BOS.");
+    void publish(size_t length) {
+        if (length == 0) {
+            return;
         }
-        tokens.push_back(bos);
-    }
-    const int total_needed = static_cast<int>(tokens.size()) + options.max_tokens;
-    if (total_needed > session->context_size) {
-        std::ostringstream msg;
-        msg << "Konteks terlalu kecil: membutuhkan " << total_needed
-            << ", tetapi konteks saat ini " << session->context_size << '.';
-        throw std::runtime_error(msg.str());
-    }
 
-    llama_set_n_threads(session->context, session->thread_count, session->thread_count_batch);
-    // llama_kv_cache_clear(session->context) is not available in the pinned llama.cpp revision.
+        int64_t written = write_cursor_->load(std::memory_order_relaxed);
+        size_t offset = 0;
+        // A chunk larger than the free space goes out in parts, each cut on a character boundary so
+        // the listener never decodes half of a multi-byte sequence.
+        const auto fitting = [&]() {
+            const size_t free_bytes = capacity_ - static_cast<size_t>(
+                    written - read_cursor_->load(std::memory_order_acquire));
+            const size_t remaining = length - offset;
+            return free_bytes >= remaining ? remaining
+                                           : completeUtf8Length(staged_.data() + offset, free_bytes);
+        };
+        while (offset < length) {
+            size_t count = fitting();
+            if (count == 0) {
+                notify_();
+                count = fitting();
+                if (count == 0) {
+                    throw std::runtime_error("Listener streaming tidak mengosongkan buffer token.");
+                }
+            }
 
-    auto evaluate_tokens = [&](const llama_token* data, int32_t count) {
-        if (count <= 0) {
-            return;
+            const size_t start = static_cast<size_t>(written) % capacity_;
+            const size_t first = std::min(count, capacity_ - start);
+            std::memcpy(data_ + start, staged_.data() + offset, first);
+            std::memcpy(data_, staged_.data() + offset + first, count - first);
+            written += static_cast<int64_t>(count);
+            write_cursor_->store(written, std::memory_order_release);
+            offset += count;
         }
 
-        const int32_t max_batch = std::max<int32_t>(1, static_cast<int32_t>(llama_n_batch(session->context)));
-        int32_t processed = 0;
-        while (processed < count) {
-            const int32_t chunk = std::min<int32_t>(max_batch, count - processed);
-            llama_batch batch = llama_batch_get_one(const_cast<llama_token*>(data + processed), chunk);
+        staged_.erase(0, length);
+        staged_tokens_ = 0;
+        published_any_ = true;
+        last_flush_ = std::chrono::steady_clock::now();
+        notify_();
+    }
+
+    std::atomic<int64_t>* write_cursor_;
+    std::atomic<int64_t>* read_cursor_;
+    uint8_t* data_;
+    size_t capacity_;
+    int32_t flush_tokens_;
+    std::chrono::milliseconds flush_interval_;
+    std::function<void()> notify_;
+    std::string staged_;
+    int32_t staged_tokens_ = 0;
+    bool published_any_ = false;
+    std::chrono::steady_clock::time_point last_flush_ = std::chrono::steady_clock::now();
+};
 
-            if (batch.pos) {
-                for (int32_t i = 0; i < batch.n_tokens; ++i) {
-                    batch.pos[i] = session->tokens_processed + processed + i;
+SamplingNativeOptions decodeSamplingOptions(JNIEnv* env, jobject packed) {
+    PackedConfigReader reader(env, packed, kPackedKindSampling);
+    SamplingNativeOptions options;
+    uint16_t tag = 0;
+    std::string_view value;
+    while (reader.next(tag, value)) {
+        switch (tag) {
+            case kSamplingMaxTokens:
+                options.max_tokens = std::max<int32_t>(0, PackedConfigReader::scalar<int32_t>(value));
+                break;
+            case kSamplingTemperature: {
+                const float temperature = PackedConfigReader::scalar<float>(value);
+                if (std::isfinite(temperature) && temperature > 0.0f) {
+                    options.temperature = temperature;
                 }
+                break;
             }
-            if (batch.seq_id && batch.n_tokens > 0) {
-                for (int32_t i = 0; i < batch.n_tokens; ++i) {
-                    batch.n_seq_id[i] = 1;
-                    batch.seq_id[i][0] = 0;
+            case kSamplingTopP: {
+                const float top_p = PackedConfigReader::scalar<float>(value);
+                if (std::isfinite(top_p) && top_p > 0.0f && top_p <= 1.0f) {
+                    options.top_p = top_p;
                 }
+                break;
             }
-            if (batch.logits && batch.n_tokens > 0) {
-                for (int32_t i = 0; i < batch.n_tokens; ++i) {
-                    batch.logits[i] = (i == batch.n_tokens - 1) ? 1 : 0;
+            case kSamplingTopK: {
+                const int32_t top_k = PackedConfigReader::scalar<int32_t>(value);
+                if (top_k > 0) {
+                    options.top_k = top_k;
                 }
+                break;
             }
-
-            const int32_t status = llama_decode(session->context, batch);
-            // Batches created via llama_batch_get_one do not own their buffers,
-            // so they must not be released with llama_batch_free.
-            if (status != 0) {
-                std::ostringstream msg;
-                msg << "Gagal memproses token (status=" << status << ")";
-                throw std::runtime_error(msg.str());
+            case kSamplingRepeatPenalty: {
+                const float penalty = PackedConfigReader::scalar<float>(value);
+                if (std::isfinite(penalty) && penalty > 0.0f) {
+                    options.repeat_penalty = penalty;
+                }
+                break;
+            }
+            case kSamplingRepeatLastN: {
+                const int32_t last_n = PackedConfigReader::scalar<int32_t>(value);
+                if (last_n >= 0) {
+                    options.repeat_last_n = last_n;
+                }
+                break;
+            }
+            case kSamplingFrequencyPenalty: {
+                const float penalty = PackedConfigReader::scalar<float>(value);
+                if (std::isfinite(penalty)) {
+                    options.frequency_penalty = penalty;
+                }
+                break;
+            }
+            case kSamplingPresencePenalty: {
+                const float penalty = PackedConfigReader::scalar<float>(value);
+                if (std::isfinite(penalty)) {
+                    options.presence_penalty = penalty;
+                }
+                break;
             }
-            processed += chunk;
-            session->tokens_processed += chunk;
+            case kSamplingStopSequence:
+                if (!value.empty()) {
+                    options.stop_sequences.emplace_back(value);
+                }
+                break;
+            case kSamplingSeed: {
+                const int32_t seed = PackedConfigReader::scalar<int32_t>(value);
+                if (seed >= 0) {
+                    options.seed = static_cast<uint32_t>(seed);
+                }
+                break;
+            }
+            case kSamplingContextShift:
+                options.context_shift = PackedConfigReader::flag(value);
+                break;
+            case kSamplingSinkTokens: {
+                const int32_t sink = PackedConfigReader::scalar<int32_t>(value);
+                if (sink >= 0) {
+                    options.sink_tokens = sink;
+                }
+                break;
+            }
+            case kSamplingGrammar:
+                options.grammar.assign(value.data(), value.size());
+                break;
+            case kSamplingJsonSchema:
+                options.json_schema.assign(value.data(), value.size());
+                break;
+            default:
+                break;
         }
-    };
-
-    evaluate_tokens(tokens.data(), static_cast<int32_t>(tokens.size()));
-
-    auto sampler_params = llama_sampler_chain_default_params();
-    sampler_params.no_perf = true;
-    llama_sampler* sampler = llama_sampler_chain_init(sampler_params);
-    if (!sampler) {
-        throw std::runtime_error("Tidak dapat membuat sampler llama.");
     }
+    return options;
+}
 
-    std::unique_ptr<llama_sampler, decltype(&llama_sampler_free)> sampler_guard(sampler, &llama_sampler_free);
+// Listener method IDs resolved once in JNI_OnLoad, so completions never look them up per call.
+struct JniRegistry {
+    jmethodID on_token_generated = nullptr;
+    jmethodID on_chunks_available = nullptr;
+    jmethodID on_load_progress = nullptr;
+    jmethodID on_bulk_item = nullptr;
+};
 
-    auto add_sampler_to_chain = [&](llama_sampler* sampler_to_add, const char* name) {
-        if (!sampler_to_add) {
-            std::ostringstream msg;
-            msg << "Tidak dapat membuat sampler " << name << '.';
-            throw std::runtime_error(msg.str());
-        }
-        using ChainAddReturn = std::invoke_result_t<decltype(&llama_sampler_chain_add), llama_sampler*, llama_sampler*>;
-        static_assert(std::is_same_v<ChainAddReturn, bool> || std::is_same_v<ChainAddReturn, void>,
-                "llama_sampler_chain_add return type must be bool or void");
+JniRegistry g_jni;
 
-        const bool added = [&]() {
-            if constexpr (std::is_same_v<ChainAddReturn, bool>) {
-                return llama_sampler_chain_add(sampler, sampler_to_add);
-            } else {
-                llama_sampler_chain_add(sampler, sampler_to_add);
-                return true;
+// Wraps the Kotlin NativeCompletionListener.  The returned callback must only be invoked on the
+// thread that owns `env`.
+std::function<void(const std::string&)> makeProgressCallback(JNIEnv* env, jobject listener) {
+    std::function<void(const std::string&)> progress_callback;
+    if (listener) {
+        progress_callback = [env, listener](const std::string& token_text) {
+            jstring token_string = env->NewStringUTF(token_text.c_str());
+            if (!token_string) {
+                throw std::runtime_error(
+                        "Gagal membuat representasi string untuk token yang dihasilkan.");
             }
-        }();
-
-        if (!added) {
-            llama_sampler_free(sampler_to_add);
-            std::ostringstream msg;
-            msg << "Tidak dapat menambahkan sampler " << name << " ke rantai.";
-            throw std::runtime_error(msg.str());
-        }
-    };
-
-    const float repeat_penalty_value = options.repeat_penalty.value_or(1.0f);
-    const float frequency_penalty_value = options.frequency_penalty.value_or(0.0f);
-    const float presence_penalty_value = options.presence_penalty.value_or(0.0f);
-    const bool use_repeat_penalty = options.repeat_penalty.has_value() && repeat_penalty_value > 1.0f + 1e-5f;
-    const bool use_frequency_penalty = options.frequency_penalty.has_value() && std::fabs(frequency_penalty_value) > 1e-5f;
-    const bool use_presence_penalty = options.presence_penalty.has_value() && std::fabs(presence_penalty_value) > 1e-5f;
-    if (use_repeat_penalty || use_frequency_penalty || use_presence_penalty) {
-        const int32_t repeat_last_n = options.repeat_last_n.value_or(
-                std::min(session->context_size, 64));
-        llama_sampler* penalties = llama_sampler_init_penalties(
-                repeat_last_n,
-                use_repeat_penalty ? repeat_penalty_value : 1.0f,
-                use_frequency_penalty ? frequency_penalty_value : 0.0f,
-                use_presence_penalty ? presence_penalty_value : 0.0f);
-        add_sampler_to_chain(penalties, "penalties");
-    }
 
-    if (options.top_k.has_value()) {
-        llama_sampler* top_k = llama_sampler_init_top_k(options.top_k.value());
-        add_sampler_to_chain(top_k, "top_k");
-    }
+            env->CallVoidMethod(listener, g_jni.on_token_generated, token_string);
+            env->DeleteLocalRef(token_string);
 
-    if (options.top_p.has_value()) {
-        llama_sampler* top_p = llama_sampler_init_top_p(options.top_p.value(), 1);
-        add_sampler_to_chain(top_p, "top_p");
+            if (env->ExceptionCheck()) {
+                env->ExceptionClear();
+                throw std::runtime_error("Listener progres melempar pengecualian.");
+            }
+        };
     }
+    return progress_callback;
+}
 
-    if (options.temperature.has_value()) {
-        llama_sampler* temperature = llama_sampler_init_temp(options.temperature.value());
-        add_sampler_to_chain(temperature, "temperature");
+// Wraps the Kotlin NativeLoadListener; a listener that throws cancels the load like one that
+// returns false.
+LoadProgressCallback makeLoadProgressCallback(JNIEnv* env, jobject listener) {
+    LoadProgressCallback callback;
+    if (listener) {
+        callback = [env, listener](float progress) {
+            const jboolean keep_going = env->CallBooleanMethod(listener, g_jni.on_load_progress, progress);
+            if (env->ExceptionCheck()) {
+                env->ExceptionClear();
+                return false;
+            }
+            return keep_going == JNI_TRUE;
+        };
     }
+    return callback;
+}
 
-    const uint32_t sampler_seed = options.seed.value_or(LLAMA_DEFAULT_SEED);
-    llama_sampler* dist = llama_sampler_init_dist(sampler_seed);
-    add_sampler_to_chain(dist, "dist");
-
-    for (llama_token token : tokens) {
-        llama_sampler_accept(sampler, token);
+// CompletionStats in the order CompletionStats.fromNative reads them.
+jlongArray newCompletionStatsArray(JNIEnv* env, const CompletionStats& stats) {
+    const jlong values[] = {
+            stats.prompt_tokens,
+            stats.reused_tokens,
+            stats.generated_tokens,
+            stats.draft_max_tokens,
+            stats.draft_steps,
+            stats.draft_proposed,
+            stats.draft_accepted,
+            stats.context_shifts,
+            stats.shifted_tokens,
+            stats.cancelled,
+    };
+    const jsize count = static_cast<jsize>(sizeof(values) / sizeof(values[0]));
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        env->SetLongArrayRegion(result, 0, count, values);
     }
+    return result;
+}
 
-    std::string completion;
-    completion.reserve(static_cast<size_t>(options.max_tokens) * 4);
-
-    for (int generated = 0; generated < options.max_tokens; ++generated) {
-        const llama_token next = llama_sampler_sample(sampler, session->context, -1);
-
-        if (llama_vocab_is_eog(vocab, next)) {
-            break;
-        }
-
-        const std::string token_text = tokenToString(vocab, next);
-        std::string candidate = completion;
-        candidate += token_text;
-
-        bool reached_stop = false;
-        for (const auto& stop : options.stop_sequences) {
-            if (!stop.empty() && candidate.size() >= stop.size()) {
-                const size_t offset = candidate.size() - stop.size();
-                if (candidate.compare(offset, stop.size(), stop) == 0) {
-                    candidate.erase(offset);
-                    reached_stop = true;
-                    break;
-                }
-            }
+// Wraps the Kotlin NativeBulkListener.  A listener that throws stops the job and the exception is
+// rethrown as the native call's error.
+BulkItemCallback makeBulkItemCallback(JNIEnv* env, jobject listener) {
+    return [env, listener](const BulkItemResult& item) {
+        jstring text = env->NewStringUTF(item.completion.c_str());
+        jstring error = item.error.empty() ? nullptr : env->NewStringUTF(item.error.c_str());
+        jlongArray stats = newCompletionStatsArray(env, item.stats);
+        if (!text || !stats || (!item.error.empty() && !error)) {
+            throw std::runtime_error("Gagal membuat hasil bulk completion untuk Java.");
         }
-
-        if (reached_stop) {
-            completion = std::move(candidate);
-            break;
+        const jboolean keep_going = env->CallBooleanMethod(
+                listener, g_jni.on_bulk_item, static_cast<jint>(item.index), text, error, stats);
+        env->DeleteLocalRef(text);
+        if (error) {
+            env->DeleteLocalRef(error);
         }
-
-        llama_sampler_accept(sampler, next);
-        completion = std::move(candidate);
-
-        if (on_token) {
-            on_token(token_text);
+        env->DeleteLocalRef(stats);
+        if (env->ExceptionCheck()) {
+            env->ExceptionClear();
+            throw std::runtime_error("Listener bulk completion melempar pengecualian.");
         }
+        return keep_going == JNI_TRUE;
+    };
+}
 
-        evaluate_tokens(&next, 1);
-    }
-
-    return completion;
+std::unique_ptr<TokenStreamWriter> makeTokenStreamWriter(JNIEnv* env,
+                                                         jobject buffer,
+                                                         jint flushTokens,
+                                                         jint flushIntervalMs,
+                                                         jobject listener) {
+    auto* address = static_cast<uint8_t*>(buffer ? env->GetDirectBufferAddress(buffer) : nullptr);
+    const jlong capacity = buffer ? env->GetDirectBufferCapacity(buffer) : -1;
+    if (!address || capacity <= static_cast<jlong>(kStreamHeaderBytes) ||
+        reinterpret_cast<uintptr_t>(address) % alignof(int64_t) != 0) {
+        throw std::runtime_error("Buffer streaming harus berupa direct ByteBuffer yang valid.");
+    }
+    if (!listener) {
+        throw std::runtime_error("Listener streaming tidak boleh null.");
+    }
+
+    return std::make_unique<TokenStreamWriter>(
+            address, static_cast<size_t>(capacity), flushTokens, flushIntervalMs,
+            [env, listener]() {
+                env->CallVoidMethod(listener, g_jni.on_chunks_available);
+                if (env->ExceptionCheck()) {
+                    env->ExceptionClear();
+                    throw std::runtime_error("Listener streaming melempar pengecualian.");
+                }
+            });
 }
 
 }  // namespace
@@ -789,9 +669,9 @@ Java_com_cicero_ciceroai_llama_LlamaBridge_nativeInit(
         }
 
         RuntimeNativeConfig config = makeDefaultRuntimeConfig(threadCount, contextSize);
-        return createSession(env, path.get(), config);
+        return toHandle(createSession(path.get(), config).release());
     } catch (const std::exception& ex) {
-        __android_log_print(ANDROID_LOG_ERROR, kTag, "nativeInit gagal: %s", ex.what());
+        logPrint(LogLevel::Error, "nativeInit gagal: %s", ex.what());
         throwJavaException(env, "java/lang/IllegalStateException", ex.what());
         return 0;
     }
@@ -799,21 +679,55 @@ Java_com_cicero_ciceroai_llama_LlamaBridge_nativeInit(
 
 extern "C" JNIEXPORT jboolean JNICALL
 Java_com_cicero_ciceroai_llama_LlamaBridge_nativeIsVulkanAvailable(
-        JNIEnv* env,
+        JNIEnv* /* env */,
         jobject /* thiz */) {
-#if defined(GGML_USE_VULKAN)
-    (void) env;
-    retainBackend();
-    struct BackendGuard {
-        ~BackendGuard() { releaseBackend(); }
-    };
-    [[maybe_unused]] BackendGuard guard;
-    const bool available = ggml_backend_vk_get_device_count() > 0;
-    return available ? JNI_TRUE : JNI_FALSE;
-#else
-    (void) env;
-    return JNI_FALSE;
-#endif
+    return isVulkanAvailable() ? JNI_TRUE : JNI_FALSE;
+}
+
+// Numbers in ModelInfo.fromNative order: file size, parameter count, weight bytes, context
+// length, layers, embedding length, heads, KV heads, key length, value length, vocabulary size,
+// feed-forward length.
+// `strings` receives architecture, name, quantization and chat template (null when empty).
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeProbeModel(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jstring modelPath,
+        jobjectArray strings) {
+    try {
+        JniString path(env, modelPath);
+        if (!path.get()) {
+            throw std::runtime_error("Path model tidak valid.");
+        }
+        if (!strings || env->GetArrayLength(strings) < 4) {
+            throw std::runtime_error("Array keluaran probe model terlalu kecil.");
+        }
+
+        const ModelInfo info = probeModel(path.get());
+        const jlong numbers[] = {
+                info.file_size, info.parameter_count, info.weight_bytes, info.context_length,
+                info.layer_count, info.embedding_length, info.head_count, info.head_count_kv,
+                info.key_length, info.value_length, info.vocab_size, info.feed_forward_length,
+        };
+        const std::string* texts[] = {&info.architecture, &info.name, &info.quantization, &info.chat_template};
+        for (jsize index = 0; index < 4; ++index) {
+            jstring text = texts[index]->empty() ? nullptr : env->NewStringUTF(texts[index]->c_str());
+            env->SetObjectArrayElement(strings, index, text);
+            if (text) {
+                env->DeleteLocalRef(text);
+            }
+        }
+        const auto count = static_cast<jsize>(sizeof(numbers) / sizeof(numbers[0]));
+        jlongArray result = env->NewLongArray(count);
+        if (result) {
+            env->SetLongArrayRegion(result, 0, count, numbers);
+        }
+        return result;
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeProbeModel gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return nullptr;
+    }
 }
 
 extern "C" JNIEXPORT jlong JNICALL
@@ -821,116 +735,244 @@ Java_com_cicero_ciceroai_llama_LlamaBridge_nativeInitWithConfig(
         JNIEnv* env,
         jobject /* thiz */,
         jstring modelPath,
-        jobject runtimeConfig) {
+        jobject packedRuntimeConfig,
+        jobject listener) {
     try {
         JniString path(env, modelPath);
         if (!path.get()) {
             throw std::runtime_error("Parameter inisialisasi tidak valid.");
         }
 
-        RuntimeNativeConfig config = parseRuntimeConfig(env, runtimeConfig);
-        return createSession(env, path.get(), config);
+        RuntimeNativeConfig config = decodeRuntimeConfig(env, packedRuntimeConfig);
+        return toHandle(createSession(path.get(), config, makeLoadProgressCallback(env, listener)).release());
+    } catch (const ModelLoadCancelled& ex) {
+        logPrint(LogLevel::Info, "%s", ex.what());
+        throwJavaException(env, "java/util/concurrent/CancellationException", ex.what());
+        return 0;
     } catch (const std::exception& ex) {
-        __android_log_print(ANDROID_LOG_ERROR, kTag, "nativeInitWithConfig gagal: %s", ex.what());
+        logPrint(LogLevel::Error, "nativeInitWithConfig gagal: %s", ex.what());
         throwJavaException(env, "java/lang/IllegalStateException", ex.what());
         return 0;
     }
 }
 
-extern "C" JNIEXPORT jstring JNICALL
-Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCompletionWithOptions(
+// Weight, KV, compute and total bytes and the largest context that fits `budgetBytes` (see MemoryPlan).
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativePlanMemory(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jstring modelPath,
+        jobject packedRuntimeConfig,
+        jlong budgetBytes) {
+    try {
+        JniString path(env, modelPath);
+        if (!path.get()) {
+            throw std::runtime_error("Path model tidak valid.");
+        }
+
+        const RuntimeNativeConfig config = decodeRuntimeConfig(env, packedRuntimeConfig);
+        const MemoryPlan plan = planMemory(path.get(), config, budgetBytes);
+        const jlong values[] = {plan.weight_bytes, plan.kv_bytes, plan.compute_bytes, plan.total_bytes,
+                                plan.max_context_size};
+        const auto count = static_cast<jsize>(sizeof(values) / sizeof(values[0]));
+        jlongArray result = env->NewLongArray(count);
+        if (result) {
+            env->SetLongArrayRegion(result, 0, count, values);
+        }
+        return result;
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativePlanMemory gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return nullptr;
+    }
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeReconfigure(
         JNIEnv* env,
         jobject /* thiz */,
         jlong handle,
-        jstring prompt,
-        jint maxTokens,
-        jfloat temperature,
-        jfloat topP,
-        jint topK,
-        jfloat repeatPenalty,
-        jint repeatLastN,
-        jfloat frequencyPenalty,
-        jfloat presencePenalty,
-        jobjectArray stopSequences,
-        jint seed,
-        jobject listener) {
+        jobject packedRuntimeConfig) {
     auto* session = fromHandle(handle);
     try {
         if (!session) {
             throw std::runtime_error("Session tidak ditemukan.");
         }
+        const RuntimeNativeConfig config = decodeRuntimeConfig(env, packedRuntimeConfig);
+        return reconfigureSession(session, config) ? JNI_TRUE : JNI_FALSE;
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeReconfigure gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return JNI_FALSE;
+    }
+}
 
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeConfigurePromptSnapshots(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring directory,
+        jlong maxBytes) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
+        JniString directory_utf(env, directory);
+        configurePromptSnapshots(session,
+                                 directory_utf.get() ? directory_utf.get() : "",
+                                 static_cast<int64_t>(maxBytes));
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeConfigurePromptSnapshots gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+    }
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeSavePromptSnapshot(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring prompt) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
         JniString prompt_utf(env, prompt);
         const std::string prompt_str = prompt_utf.get() ? prompt_utf.get() : "";
+        return savePromptSnapshot(session, prompt_str) ? JNI_TRUE : JNI_FALSE;
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeSavePromptSnapshot gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return JNI_FALSE;
+    }
+}
 
-        SamplingNativeOptions options;
-        options.max_tokens = std::max(0, static_cast<int>(maxTokens));
-        if (std::isfinite(temperature) && temperature > 0.0f) {
-            options.temperature = temperature;
-        }
-        if (std::isfinite(topP) && topP > 0.0f && topP <= 1.0f) {
-            options.top_p = topP;
-        }
-        if (topK > 0) {
-            options.top_k = topK;
-        }
-        if (std::isfinite(repeatPenalty) && repeatPenalty > 0.0f) {
-            options.repeat_penalty = repeatPenalty;
-        }
-        if (repeatLastN >= 0) {
-            options.repeat_last_n = repeatLastN;
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCompletionWithOptions(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring prompt,
+        jobject packedSampling,
+        jobject listener) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
         }
-        if (std::isfinite(frequencyPenalty)) {
-            options.frequency_penalty = frequencyPenalty;
+
+        JniString prompt_utf(env, prompt);
+        const std::string prompt_str = prompt_utf.get() ? prompt_utf.get() : "";
+
+        const SamplingNativeOptions options = decodeSamplingOptions(env, packedSampling);
+        const auto progress_callback = makeProgressCallback(env, listener);
+
+        const std::string completion =
+                runCompletion(session, prompt_str, options, progress_callback);
+        return env->NewStringUTF(completion.c_str());
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeCompletionWithOptions gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return nullptr;
+    }
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeBatchedCompletion(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring prompt,
+        jobject packedSampling,
+        jobject listener) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
         }
-        if (std::isfinite(presencePenalty)) {
-            options.presence_penalty = presencePenalty;
+
+        JniString prompt_utf(env, prompt);
+        const std::string prompt_str = prompt_utf.get() ? prompt_utf.get() : "";
+
+        const SamplingNativeOptions options = decodeSamplingOptions(env, packedSampling);
+        const auto progress_callback = makeProgressCallback(env, listener);
+
+        const std::string completion =
+                runBatchedCompletion(session, prompt_str, options, progress_callback);
+        return env->NewStringUTF(completion.c_str());
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeBatchedCompletion gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return nullptr;
+    }
+}
+
+// Runs every input after the shared prefix and reports each item to `listener` as it finishes.
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeBulkCompletion(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring prefix,
+        jobjectArray inputs,
+        jobject packedSampling,
+        jobject listener) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
         }
-        if (seed >= 0) {
-            options.seed = static_cast<uint32_t>(seed);
+        if (!listener) {
+            throw std::runtime_error("Listener bulk completion tidak boleh null.");
         }
-        options.stop_sequences = extractStopSequences(env, stopSequences);
 
-        std::function<void(const std::string&)> progress_callback;
-        if (listener) {
-            jclass listener_class = env->GetObjectClass(listener);
-            if (!listener_class) {
-                throw std::runtime_error("Listener progres tidak valid.");
-            }
+        JniString prefix_utf(env, prefix);
+        const std::string prefix_str = prefix_utf.get() ? prefix_utf.get() : "";
+        const std::vector<std::string> input_texts = readStringArray(env, inputs);
+        const SamplingNativeOptions options = decodeSamplingOptions(env, packedSampling);
 
-            jmethodID on_token_method = env->GetMethodID(
-                    listener_class, "onTokenGenerated", "(Ljava/lang/String;)V");
-            env->DeleteLocalRef(listener_class);
-            if (!on_token_method) {
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                }
-                throw std::runtime_error(
-                        "Metode onTokenGenerated tidak ditemukan pada listener progres.");
-            }
+        runBulkCompletion(session, prefix_str, input_texts, options, makeBulkItemCallback(env, listener));
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeBulkCompletion gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+    }
+}
 
-            progress_callback = [env, listener, on_token_method](const std::string& token_text) {
-                jstring token_string = env->NewStringUTF(token_text.c_str());
-                if (!token_string) {
-                    throw std::runtime_error(
-                            "Gagal membuat representasi string untuk token yang dihasilkan.");
-                }
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeStreamingCompletion(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring prompt,
+        jobject packedSampling,
+        jboolean batched,
+        jobject buffer,
+        jint flushTokens,
+        jint flushIntervalMs,
+        jobject listener) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
 
-                env->CallVoidMethod(listener, on_token_method, token_string);
-                env->DeleteLocalRef(token_string);
+        JniString prompt_utf(env, prompt);
+        const std::string prompt_str = prompt_utf.get() ? prompt_utf.get() : "";
 
-                if (env->ExceptionCheck()) {
-                    env->ExceptionClear();
-                    throw std::runtime_error("Listener progres melempar pengecualian.");
-                }
-            };
-        }
+        const SamplingNativeOptions options = decodeSamplingOptions(env, packedSampling);
+        auto writer = makeTokenStreamWriter(env, buffer, flushTokens, flushIntervalMs, listener);
+        const auto on_token = [&writer](const std::string& token_text) { writer->write(token_text); };
 
-        const std::string completion =
-                runCompletion(session, prompt_str, options, progress_callback);
+        const std::string completion = batched == JNI_TRUE
+                ? runBatchedCompletion(session, prompt_str, options, on_token)
+                : runCompletion(session, prompt_str, options, on_token);
+        writer->finish();
         return env->NewStringUTF(completion.c_str());
     } catch (const std::exception& ex) {
-        __android_log_print(ANDROID_LOG_ERROR, kTag, "nativeCompletionWithOptions gagal: %s", ex.what());
+        logPrint(LogLevel::Error, "nativeStreamingCompletion gagal: %s", ex.what());
         throwJavaException(env, "java/lang/IllegalStateException", ex.what());
         return nullptr;
     }
@@ -939,51 +981,478 @@ Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCompletionWithOptions(
 extern "C" JNIEXPORT jstring JNICALL
 Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCompletion(
         JNIEnv* env,
-        jobject thiz,
+        jobject /* thiz */,
         jlong handle,
         jstring prompt,
         jint maxTokens,
         jobject listener) {
-    const jfloat nan = std::numeric_limits<float>::quiet_NaN();
-    return Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCompletionWithOptions(
-            env,
-            thiz,
-            handle,
-            prompt,
-            maxTokens,
-            nan,
-            nan,
-            -1,
-            nan,
-            -1,
-            nan,
-            nan,
-            nullptr,
-            -1,
-            listener);
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
+
+        JniString prompt_utf(env, prompt);
+        const std::string prompt_str = prompt_utf.get() ? prompt_utf.get() : "";
+
+        SamplingNativeOptions options;
+        options.max_tokens = std::max(0, static_cast<int>(maxTokens));
+        const auto progress_callback = makeProgressCallback(env, listener);
+
+        const std::string completion =
+                runCompletion(session, prompt_str, options, progress_callback);
+        return env->NewStringUTF(completion.c_str());
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeCompletion gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return nullptr;
+    }
+}
+
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeGetLastCompletionStats(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle) {
+    auto* session = fromHandle(handle);
+    if (!session) {
+        throwJavaException(env, "java/lang/IllegalStateException", "Session tidak ditemukan.");
+        return nullptr;
+    }
+
+    return newCompletionStatsArray(env, session->last_stats);
+}
+
+// Per-phase counters in MetricPhase order: count, total ns, max ns and the log2 microsecond
+// histogram for each phase (see session_metrics.h).
+extern "C" JNIEXPORT jlongArray JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeGetMetrics(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jboolean reset) {
+    auto* session = fromHandle(handle);
+    if (!session) {
+        throwJavaException(env, "java/lang/IllegalStateException", "Session tidak ditemukan.");
+        return nullptr;
+    }
+
+    const std::vector<int64_t> values = session->metrics.snapshot(reset == JNI_TRUE);
+    const auto count = static_cast<jsize>(values.size());
+    jlongArray result = env->NewLongArray(count);
+    if (result) {
+        static_assert(sizeof(jlong) == sizeof(int64_t), "jlong harus 64-bit");
+        env->SetLongArrayRegion(result, 0, count, reinterpret_cast<const jlong*>(values.data()));
+    }
+    return result;
 }
 
 extern "C" JNIEXPORT void JNICALL
-Java_com_cicero_ciceroai_llama_LlamaBridge_nativeRelease(
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeConfigureTrace(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jint max_events) {
+    auto* session = fromHandle(handle);
+    if (!session) {
+        throwJavaException(env, "java/lang/IllegalStateException", "Session tidak ditemukan.");
+        return;
+    }
+    session->metrics.configureTrace(static_cast<size_t>(std::max<jint>(0, max_events)));
+}
+
+extern "C" JNIEXPORT jstring JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeDumpTrace(
         JNIEnv* env,
         jobject /* thiz */,
         jlong handle) {
-    std::unique_ptr<LlamaSession> session{fromHandle(handle)};
+    auto* session = fromHandle(handle);
     if (!session) {
+        throwJavaException(env, "java/lang/IllegalStateException", "Session tidak ditemukan.");
+        return nullptr;
+    }
+    return env->NewStringUTF(session->metrics.chromeTrace().c_str());
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeRelease(
+        JNIEnv* /* env */,
+        jobject /* thiz */,
+        jlong handle) {
+    releaseSession(std::unique_ptr<LlamaSession>(fromHandle(handle)));
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCountTokens(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jstring text) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
+        JniString text_utf(env, text);
+        return countPromptTokens(session, text_utf.get() ? text_utf.get() : "");
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeCountTokens gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT jintArray JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeFitPrompt(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jobjectArray segments,
+        jint pinnedSegments,
+        jint maxTokens) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
+
+        const std::vector<std::string> segment_texts = readStringArray(env, segments);
+        const PromptFit fit = fitPrompt(session, segment_texts, pinnedSegments, maxTokens);
+        const jint values[] = {fit.first_segment, fit.prompt_tokens, fit.max_tokens, fit.capacity};
+        const jsize count = static_cast<jsize>(sizeof(values) / sizeof(values[0]));
+        jintArray result = env->NewIntArray(count);
+        if (result) {
+            env->SetIntArrayRegion(result, 0, count, values);
+        }
+        return result;
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeFitPrompt gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return nullptr;
+    }
+}
+
+extern "C" JNIEXPORT jint JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeEmbeddingSize(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle) {
+    try {
+        return embeddingSize(fromHandle(handle));
+    } catch (const std::exception& ex) {
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return 0;
+    }
+}
+
+// Writes embeddingSize() floats per text, in input order, straight into the direct `output`
+// buffer allocated by Kotlin.
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeEmbed(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jobjectArray texts,
+        jint pooling,
+        jboolean normalize,
+        jobject output) {
+    auto* session = fromHandle(handle);
+    try {
+        if (!session) {
+            throw std::runtime_error("Session tidak ditemukan.");
+        }
+        if (pooling < static_cast<jint>(EmbeddingPooling::Mean) ||
+            pooling > static_cast<jint>(EmbeddingPooling::Last)) {
+            throw std::runtime_error("Mode pooling embedding tidak dikenal.");
+        }
+
+        const std::vector<std::string> inputs = readStringArray(env, texts);
+        auto* data = output ? static_cast<float*>(env->GetDirectBufferAddress(output)) : nullptr;
+        const jlong capacity = output ? env->GetDirectBufferCapacity(output) : -1;
+        const auto required = static_cast<jlong>(inputs.size()) * embeddingSize(session) *
+                              static_cast<jlong>(sizeof(float));
+        if (!data || capacity < required) {
+            throw std::runtime_error("Buffer embedding tidak valid atau terlalu kecil.");
+        }
+
+        embedTexts(session, inputs, static_cast<EmbeddingPooling>(pooling), normalize == JNI_TRUE, data);
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeEmbed gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+    }
+}
+
+extern "C" JNIEXPORT jboolean JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCancel(
+        JNIEnv* /* env */,
+        jobject /* thiz */,
+        jlong handle) {
+    return cancelCompletion(fromHandle(handle)) ? JNI_TRUE : JNI_FALSE;
+}
+
+namespace {
+
+VectorIndex* vectorIndexFromHandle(JNIEnv* env, jlong handle) {
+    auto* index = reinterpret_cast<VectorIndex*>(handle);
+    if (!index) {
+        throwJavaException(env, "java/lang/IllegalStateException", "Indeks vektor sudah ditutup.");
+    }
+    return index;
+}
+
+// Direct FloatBuffer contents; `floats` receives the capacity in floats, or -1 when the buffer is
+// not direct.
+float* directFloats(JNIEnv* env, jobject buffer, jlong& floats) {
+    floats = buffer ? env->GetDirectBufferCapacity(buffer) : -1;
+    return buffer ? static_cast<float*>(env->GetDirectBufferAddress(buffer)) : nullptr;
+}
+
+}  // namespace
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexOpen(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jstring directory,
+        jint dimension,
+        jboolean int8,
+        jint max_neighbors,
+        jint ef_construction) {
+    try {
+        JniString path(env, directory);
+        if (!path.get()) {
+            throw std::runtime_error("Direktori indeks vektor tidak valid.");
+        }
+        VectorIndexOptions options;
+        options.dimension = dimension;
+        options.encoding = int8 == JNI_TRUE ? VectorEncoding::Int8 : VectorEncoding::Float32;
+        options.max_neighbors = max_neighbors;
+        options.ef_construction = ef_construction;
+        return reinterpret_cast<jlong>(VectorIndex::open(path.get(), options).release());
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeVectorIndexOpen gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return 0;
+    }
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexClose(
+        JNIEnv* /* env */,
+        jobject /* thiz */,
+        jlong handle) {
+    delete reinterpret_cast<VectorIndex*>(handle);
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexAdd(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jlongArray ids,
+        jobject vectors) {
+    VectorIndex* index = vectorIndexFromHandle(env, handle);
+    if (!index) {
         return;
     }
+    try {
+        const jsize count = ids ? env->GetArrayLength(ids) : 0;
+        jlong floats = -1;
+        const float* data = directFloats(env, vectors, floats);
+        if (!data || floats < static_cast<jlong>(count) * index->dimension()) {
+            throw std::runtime_error("Buffer vektor tidak valid atau terlalu kecil.");
+        }
+        std::vector<int64_t> keys(static_cast<size_t>(count));
+        env->GetLongArrayRegion(ids, 0, count, reinterpret_cast<jlong*>(keys.data()));
+        index->add(keys.data(), data, keys.size());
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeVectorIndexAdd gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+    }
+}
 
-    if (session->context) {
-        llama_free(session->context);
-        session->context = nullptr;
+// Fills `out_ids` / `out_scores` best first and returns how many matches were written.
+extern "C" JNIEXPORT jint JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexSearch(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle,
+        jobject query,
+        jint ef,
+        jlongArray out_ids,
+        jfloatArray out_scores) {
+    VectorIndex* index = vectorIndexFromHandle(env, handle);
+    if (!index) {
+        return 0;
     }
-    if (session->model) {
-        llama_model_free(session->model);
-        session->model = nullptr;
+    try {
+        jlong floats = -1;
+        const float* data = directFloats(env, query, floats);
+        if (!data || floats < index->dimension()) {
+            throw std::runtime_error("Buffer kueri vektor tidak valid atau terlalu kecil.");
+        }
+        const jsize k = std::min(env->GetArrayLength(out_ids), env->GetArrayLength(out_scores));
+        const std::vector<VectorMatch> matches =
+                index->search(data, static_cast<size_t>(k), static_cast<size_t>(std::max(ef, 0)));
+        std::vector<jlong> ids(matches.size());
+        std::vector<jfloat> scores(matches.size());
+        for (size_t i = 0; i < matches.size(); ++i) {
+            ids[i] = matches[i].id;
+            scores[i] = matches[i].score;
+        }
+        const auto found = static_cast<jsize>(matches.size());
+        env->SetLongArrayRegion(out_ids, 0, found, ids.data());
+        env->SetFloatArrayRegion(out_scores, 0, found, scores.data());
+        return found;
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Error, "nativeVectorIndexSearch gagal: %s", ex.what());
+        throwJavaException(env, "java/lang/IllegalStateException", ex.what());
+        return 0;
     }
+}
+
+extern "C" JNIEXPORT jlong JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexSize(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle) {
+    VectorIndex* index = vectorIndexFromHandle(env, handle);
+    return index ? static_cast<jlong>(index->size()) : 0;
+}
+
+extern "C" JNIEXPORT void JNICALL
+Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexSync(
+        JNIEnv* env,
+        jobject /* thiz */,
+        jlong handle) {
+    if (VectorIndex* index = vectorIndexFromHandle(env, handle)) {
+        index->sync();
+    }
+}
 
-    releaseBackend();
-    __android_log_print(ANDROID_LOG_INFO, kTag,
-                        "Session ditutup untuk %s",
-                        session->model_path.c_str());
+namespace {
+
+constexpr const char* kBridgeClass = "com/cicero/ciceroai/llama/LlamaBridge";
+constexpr const char* kCompletionListenerClass =
+        "com/cicero/ciceroai/llama/LlamaBridge$NativeCompletionListener";
+constexpr const char* kStreamListenerClass = "com/cicero/ciceroai/llama/LlamaBridge$NativeStreamListener";
+constexpr const char* kLoadListenerClass = "com/cicero/ciceroai/llama/LlamaBridge$NativeLoadListener";
+constexpr const char* kBulkListenerClass = "com/cicero/ciceroai/llama/LlamaBridge$NativeBulkListener";
+
+jmethodID lookupMethod(JNIEnv* env, const char* class_name, const char* name, const char* signature) {
+    jclass clazz = env->FindClass(class_name);
+    if (!clazz) {
+        env->ExceptionClear();
+        return nullptr;
+    }
+    jmethodID method = env->GetMethodID(clazz, name, signature);
+    env->DeleteLocalRef(clazz);
+    if (!method) {
+        env->ExceptionClear();
+    }
+    return method;
+}
+
+}  // namespace
+
+// Binds every LlamaBridge external through RegisterNatives and caches the listener method IDs,
+// so no JNI call pays for symbol lookup or reflection after the library is loaded.
+extern "C" JNIEXPORT jint JNICALL JNI_OnLoad(JavaVM* vm, void* /* reserved */) {
+    JNIEnv* env = nullptr;
+    if (vm->GetEnv(reinterpret_cast<void**>(&env), JNI_VERSION_1_6) != JNI_OK || !env) {
+        return JNI_ERR;
+    }
+
+    g_jni.on_token_generated = lookupMethod(
+            env, kCompletionListenerClass, "onTokenGenerated", "(Ljava/lang/String;)V");
+    g_jni.on_chunks_available = lookupMethod(env, kStreamListenerClass, "onChunksAvailable", "()V");
+    g_jni.on_load_progress = lookupMethod(env, kLoadListenerClass, "onLoadProgress", "(F)Z");
+    g_jni.on_bulk_item = lookupMethod(
+            env, kBulkListenerClass, "onItemFinished", "(ILjava/lang/String;Ljava/lang/String;[J)Z");
+    if (!g_jni.on_token_generated || !g_jni.on_chunks_available || !g_jni.on_load_progress ||
+        !g_jni.on_bulk_item) {
+        logPrint(LogLevel::Error, "Listener JNI tidak ditemukan saat JNI_OnLoad");
+        return JNI_ERR;
+    }
+
+    const JNINativeMethod methods[] = {
+            {"nativeInitWithConfig",
+             "(Ljava/lang/String;Ljava/nio/ByteBuffer;Lcom/cicero/ciceroai/llama/LlamaBridge$NativeLoadListener;)J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeInitWithConfig)},
+            {"nativePlanMemory", "(Ljava/lang/String;Ljava/nio/ByteBuffer;J)[J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativePlanMemory)},
+            {"nativeReconfigure", "(JLjava/nio/ByteBuffer;)Z",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeReconfigure)},
+            {"nativeRelease", "(J)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeRelease)},
+            {"nativeConfigurePromptSnapshots", "(JLjava/lang/String;J)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeConfigurePromptSnapshots)},
+            {"nativeSavePromptSnapshot", "(JLjava/lang/String;)Z",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeSavePromptSnapshot)},
+            {"nativeIsVulkanAvailable", "()Z",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeIsVulkanAvailable)},
+            {"nativeProbeModel", "(Ljava/lang/String;[Ljava/lang/String;)[J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeProbeModel)},
+            {"nativeCountTokens", "(JLjava/lang/String;)I",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCountTokens)},
+            {"nativeFitPrompt", "(J[Ljava/lang/String;II)[I",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeFitPrompt)},
+            {"nativeEmbeddingSize", "(J)I",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeEmbeddingSize)},
+            {"nativeEmbed", "(J[Ljava/lang/String;IZLjava/nio/ByteBuffer;)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeEmbed)},
+            {"nativeVectorIndexOpen", "(Ljava/lang/String;IZII)J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexOpen)},
+            {"nativeVectorIndexClose", "(J)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexClose)},
+            {"nativeVectorIndexAdd", "(J[JLjava/nio/FloatBuffer;)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexAdd)},
+            {"nativeVectorIndexSearch", "(JLjava/nio/FloatBuffer;I[J[F)I",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexSearch)},
+            {"nativeVectorIndexSize", "(J)J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexSize)},
+            {"nativeVectorIndexSync", "(J)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeVectorIndexSync)},
+            {"nativeCancel", "(J)Z",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCancel)},
+            {"nativeGetLastCompletionStats", "(J)[J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeGetLastCompletionStats)},
+            {"nativeGetMetrics", "(JZ)[J",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeGetMetrics)},
+            {"nativeConfigureTrace", "(JI)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeConfigureTrace)},
+            {"nativeDumpTrace", "(J)Ljava/lang/String;",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeDumpTrace)},
+            {"nativeCompletionWithOptions",
+             "(JLjava/lang/String;Ljava/nio/ByteBuffer;"
+             "Lcom/cicero/ciceroai/llama/LlamaBridge$NativeCompletionListener;)Ljava/lang/String;",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeCompletionWithOptions)},
+            {"nativeBatchedCompletion",
+             "(JLjava/lang/String;Ljava/nio/ByteBuffer;"
+             "Lcom/cicero/ciceroai/llama/LlamaBridge$NativeCompletionListener;)Ljava/lang/String;",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeBatchedCompletion)},
+            {"nativeBulkCompletion",
+             "(JLjava/lang/String;[Ljava/lang/String;Ljava/nio/ByteBuffer;"
+             "Lcom/cicero/ciceroai/llama/LlamaBridge$NativeBulkListener;)V",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeBulkCompletion)},
+            {"nativeStreamingCompletion",
+             "(JLjava/lang/String;Ljava/nio/ByteBuffer;ZLjava/nio/ByteBuffer;II"
+             "Lcom/cicero/ciceroai/llama/LlamaBridge$NativeStreamListener;)Ljava/lang/String;",
+             reinterpret_cast<void*>(Java_com_cicero_ciceroai_llama_LlamaBridge_nativeStreamingCompletion)},
+    };
+
+    jclass bridge_class = env->FindClass(kBridgeClass);
+    if (!bridge_class) {
+        env->ExceptionClear();
+        return JNI_ERR;
+    }
+    const jint status = env->RegisterNatives(
+            bridge_class, methods, static_cast<jint>(sizeof(methods) / sizeof(methods[0])));
+    env->DeleteLocalRef(bridge_class);
+    if (status != JNI_OK) {
+        env->ExceptionClear();
+        logPrint(LogLevel::Error, "RegisterNatives gagal (status=%d)", status);
+        return JNI_ERR;
+    }
+    return JNI_VERSION_1_6;
 }
@@ -0,0 +1,3376 @@
+#include "llama_session.h"
+
+#include "json_schema_grammar.h"
+#include "model_probe.h"
+#include "native_log.h"
+#include "token_sampler.h"
+
+#if defined(GGML_USE_VULKAN)
+#include "ggml-vulkan.h"
+#endif
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cerrno>
+#include <cmath>
+#include <cstdio>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
+
+namespace cicero {
+
+// Streams a model file into the page cache on a background thread with large sequential
+// readahead requests.  With mmap the weights are otherwise only paged in by the first decodes,
+// one random fault at a time, which dominates first-token latency on phone storage.  The pages
+// land in the shared page cache, so the loader's own mapping picks them up without extra copies.
+class ModelPrefetcher {
+public:
+    explicit ModelPrefetcher(const std::string& path) : path_(path) {
+        worker_ = std::thread([this]() { run(); });
+    }
+
+    ModelPrefetcher(const ModelPrefetcher&) = delete;
+    ModelPrefetcher& operator=(const ModelPrefetcher&) = delete;
+
+    ~ModelPrefetcher() {
+        stop_.store(true, std::memory_order_relaxed);
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+    }
+
+private:
+    static constexpr off_t kChunkBytes = 16 * 1024 * 1024;
+
+    void run() {
+        const int fd = open(path_.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            logPrint(LogLevel::Warn, "Prefetch model gagal membuka %s: %s", path_.c_str(), std::strerror(errno));
+            return;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) != 0) {
+            close(fd);
+            return;
+        }
+
+        const auto start = std::chrono::steady_clock::now();
+        off_t offset = 0;
+        while (offset < info.st_size && !stop_.load(std::memory_order_relaxed)) {
+            const off_t length = std::min<off_t>(kChunkBytes, info.st_size - offset);
+#if defined(__linux__)
+            // readahead blocks until the chunk's I/O is queued, which keeps the stream sequential
+            // and lets stop_ interrupt it between chunks.
+            if (readahead(fd, offset, static_cast<size_t>(length)) != 0) {
+                break;
+            }
+#elif defined(POSIX_FADV_WILLNEED)
+            if (posix_fadvise(fd, offset, length, POSIX_FADV_WILLNEED) != 0) {
+                break;
+            }
+#else
+            break;
+#endif
+            offset += length;
+        }
+        close(fd);
+
+        const auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::steady_clock::now() - start);
+        logPrint(LogLevel::Debug,
+                 "Prefetch model %s: %lld MiB dalam %lld ms",
+                 path_.c_str(),
+                 static_cast<long long>(offset / (1024 * 1024)),
+                 static_cast<long long>(elapsed.count()));
+    }
+
+    std::string path_;
+    std::atomic<bool> stop_{false};
+    std::thread worker_;
+};
+
+// Compiled grammar samplers keyed by their source, so repeated constrained requests clone a parsed
+// prototype instead of converting the schema and parsing the GBNF again.  Prototypes never accept
+// tokens and stay in their start state.
+class GrammarCache {
+public:
+    static constexpr size_t kCapacity = 32;
+
+    // Fresh grammar sampler for `source`, a JSON schema when `json_schema` is set and GBNF with a
+    // `root` rule otherwise.  Throws std::runtime_error when it does not compile.
+    llama_sampler* instantiate(const llama_vocab* vocab, bool json_schema, const std::string& source) {
+        std::string key = (json_schema ? "s:" : "g:") + source;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            const auto it = index_.find(key);
+            if (it != index_.end()) {
+                entries_.splice(entries_.begin(), entries_, it->second);
+                return clone(it->second->second.get());
+            }
+        }
+
+        // Compiled outside the lock: a large schema must not stall unrelated completions.
+        const std::string grammar = json_schema ? jsonSchemaToGrammar(source) : source;
+        Prototype prototype(llama_sampler_init_grammar(vocab, grammar.c_str(), "root"), &llama_sampler_free);
+        if (!prototype) {
+            throw std::runtime_error(json_schema ? "Grammar dari skema JSON tidak dapat diurai."
+                                                 : "Grammar GBNF tidak valid.");
+        }
+        llama_sampler* instance = clone(prototype.get());
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(key) == 0) {
+            entries_.emplace_front(std::move(key), std::move(prototype));
+            index_.emplace(entries_.front().first, entries_.begin());
+            while (entries_.size() > kCapacity) {
+                index_.erase(entries_.back().first);
+                entries_.pop_back();
+            }
+        }
+        return instance;
+    }
+
+private:
+    using Prototype = std::unique_ptr<llama_sampler, decltype(&llama_sampler_free)>;
+    using Entry = std::pair<std::string, Prototype>;
+
+    static llama_sampler* clone(const llama_sampler* prototype) {
+        llama_sampler* instance = llama_sampler_clone(prototype);
+        if (!instance) {
+            throw std::runtime_error("Tidak dapat membuat sampler grammar.");
+        }
+        return instance;
+    }
+
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    // Keys view the strings owned by `entries_`; list nodes never move.
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+};
+
+// Weights loaded once per model file and model-level parameters (see acquireModel) and shared by
+// every session and draft model that asks for the same key.  Contexts only hold a reference; the
+// last one to let go frees the model.
+struct SharedModel {
+    std::string key;
+    llama_model* model = nullptr;
+    std::unique_ptr<ModelPrefetcher> prefetcher;
+    // Grammars are compiled against the vocabulary, so they are shared per model.
+    GrammarCache grammars;
+
+    SharedModel() = default;
+    SharedModel(const SharedModel&) = delete;
+    SharedModel& operator=(const SharedModel&) = delete;
+
+    ~SharedModel() {
+        prefetcher.reset();
+        if (model) {
+            llama_model_free(model);
+        }
+    }
+};
+
+// Small draft model used for speculative decoding.  It proposes `max_tokens` greedy tokens that
+// the target verifies in one batched llama_decode.
+struct DraftModel {
+    std::string model_path;
+    std::shared_ptr<SharedModel> shared_model;
+    // shared_model->model, cached for the generation loops.
+    llama_model* model = nullptr;
+    llama_context* context = nullptr;
+    int32_t max_tokens = 0;
+    // Tokens currently held in sequence 0 of the draft context.
+    std::vector<llama_token> evaluated_tokens;
+    // Verification batch for the target context: the pending token plus up to max_tokens drafts.
+    llama_batch verify_batch{};
+
+    DraftModel() = default;
+    DraftModel(const DraftModel&) = delete;
+    DraftModel& operator=(const DraftModel&) = delete;
+
+    ~DraftModel() {
+        if (verify_batch.token) {
+            llama_batch_free(verify_batch);
+        }
+        if (context) {
+            llama_free(context);
+        }
+    }
+};
+
+namespace {
+
+std::once_flag g_backend_once;
+std::mutex g_backend_mutex;
+int g_backend_users = 0;
+
+void retainBackend() {
+    std::call_once(g_backend_once, []() {
+        ggml_backend_load_all();
+        llama_backend_init();
+    });
+
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+    ++g_backend_users;
+}
+
+void releaseBackend() {
+    std::lock_guard<std::mutex> lock(g_backend_mutex);
+    if (g_backend_users == 0) {
+        return;
+    }
+
+    --g_backend_users;
+    if (g_backend_users == 0) {
+        llama_backend_free();
+    }
+}
+
+}  // namespace
+
+// Text of every vocabulary token, rendered once with llama_token_to_piece into a single arena.
+// The generation loops look pieces up by token id instead of detokenizing each sampled token
+// into a freshly allocated buffer.
+class TokenPieceTable {
+public:
+    explicit TokenPieceTable(const llama_vocab* vocab) {
+        const int32_t n_tokens = std::max<int32_t>(0, llama_vocab_n_tokens(vocab));
+        offsets_.reserve(static_cast<size_t>(n_tokens) + 1);
+        arena_.reserve(static_cast<size_t>(n_tokens) * 8);
+        offsets_.push_back(0);
+
+        std::vector<char> buffer(128);
+        for (llama_token token = 0; token < n_tokens; ++token) {
+            int32_t written = llama_token_to_piece(
+                    vocab, token, buffer.data(), static_cast<int32_t>(buffer.size()), 0, true);
+            if (written < 0) {
+                buffer.resize(static_cast<size_t>(-written));
+                written = llama_token_to_piece(
+                        vocab, token, buffer.data(), static_cast<int32_t>(buffer.size()), 0, true);
+            }
+            if (written > 0) {
+                arena_.append(buffer.data(), static_cast<size_t>(written));
+            }
+            offsets_.push_back(static_cast<uint32_t>(arena_.size()));
+        }
+        arena_.shrink_to_fit();
+    }
+
+    std::string_view piece(llama_token token) const {
+        if (token < 0 || static_cast<size_t>(token) + 1 >= offsets_.size()) {
+            return std::string_view();
+        }
+        const uint32_t begin = offsets_[static_cast<size_t>(token)];
+        return std::string_view(arena_.data() + begin, offsets_[static_cast<size_t>(token) + 1] - begin);
+    }
+
+    size_t pieceLength(llama_token token) const { return piece(token).size(); }
+
+    size_t memoryBytes() const { return arena_.capacity() + offsets_.capacity() * sizeof(uint32_t); }
+
+private:
+    std::string arena_;
+    // offsets_[t] .. offsets_[t + 1] delimits the piece of token t inside arena_.
+    std::vector<uint32_t> offsets_;
+};
+
+namespace {
+
+std::mutex g_token_pieces_mutex;
+std::vector<std::pair<const llama_model*, std::weak_ptr<const TokenPieceTable>>> g_token_pieces;
+
+// Returns the detokenization table for `model`, building it only when no live session already
+// holds one.  Entries are weak so a table disappears together with the last session using it.
+std::shared_ptr<const TokenPieceTable> acquireTokenPieceTable(const llama_model* model) {
+    std::lock_guard<std::mutex> lock(g_token_pieces_mutex);
+    g_token_pieces.erase(
+            std::remove_if(g_token_pieces.begin(), g_token_pieces.end(),
+                           [](const auto& entry) { return entry.second.expired(); }),
+            g_token_pieces.end());
+    for (const auto& entry : g_token_pieces) {
+        if (entry.first == model) {
+            if (auto table = entry.second.lock()) {
+                return table;
+            }
+        }
+    }
+
+    auto table = std::make_shared<const TokenPieceTable>(llama_model_get_vocab(model));
+    g_token_pieces.emplace_back(model, table);
+    logPrint(LogLevel::Info,
+             "Tabel detokenisasi dibuat (%d token, %zu byte)",
+             llama_vocab_n_tokens(llama_model_get_vocab(model)),
+             table->memoryBytes());
+    return table;
+}
+
+const TokenPieceTable& tokenPieces(LlamaSession* session) {
+    std::call_once(session->token_pieces_once, [session]() {
+        session->token_pieces = acquireTokenPieceTable(session->model);
+    });
+    return *session->token_pieces;
+}
+
+std::vector<llama_token> tokenizePrompt(const llama_model* model,
+                                        const std::string& prompt,
+                                        bool add_special = true) {
+    const llama_vocab* vocab = llama_model_get_vocab(model);
+    const int32_t estimated = llama_tokenize(
+            vocab,
+            prompt.c_str(),
+            static_cast<int32_t>(prompt.size()),
+            nullptr,
+            0,
+            add_special,
+            true);
+
+    if (estimated == std::numeric_limits<int32_t>::min()) {
+        throw std::runtime_error("Jumlah token terlalu besar.");
+    }
+
+    const int32_t required = estimated < 0 ? -estimated : estimated;
+    std::vector<llama_token> tokens(static_cast<size_t>(required));
+    if (required == 0) {
+        return tokens;
+    }
+
+    const int32_t encoded = llama_tokenize(
+            vocab,
+            prompt.c_str(),
+            static_cast<int32_t>(prompt.size()),
+            tokens.data(),
+            static_cast<int32_t>(tokens.size()),
+            add_special,
+            true);
+
+    if (encoded < 0) {
+        throw std::runtime_error("Failed to tokenize prompt");
+    }
+
+    tokens.resize(static_cast<size_t>(encoded));
+    return tokens;
+}
+
+size_t commonPrefixLength(const std::vector<llama_token>& lhs, const std::vector<llama_token>& rhs) {
+    const size_t limit = std::min(lhs.size(), rhs.size());
+    size_t length = 0;
+    while (length < limit && lhs[length] == rhs[length]) {
+        ++length;
+    }
+    return length;
+}
+
+constexpr uint32_t kSnapshotMagic = 0x504e5343;  // "CSNP"
+constexpr uint32_t kSnapshotVersion = 1;
+constexpr const char* kSnapshotExtension = ".snap";
+
+struct SnapshotFileHeader {
+    uint32_t magic = kSnapshotMagic;
+    uint32_t version = kSnapshotVersion;
+    uint64_t fingerprint = 0;
+    uint64_t token_count = 0;
+    uint64_t state_size = 0;
+};
+
+uint64_t fnv1a(const void* data, size_t size, uint64_t hash = 0xcbf29ce484222325ULL) {
+    const auto* bytes = static_cast<const uint8_t*>(data);
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+template <typename T>
+uint64_t fnv1aValue(const T& value, uint64_t hash) {
+    static_assert(std::is_trivially_copyable_v<T>, "fnv1aValue requires trivially copyable values");
+    return fnv1a(&value, sizeof(value), hash);
+}
+
+// Only the parts of the runtime config that change the layout or contents of the KV cache take
+// part in the fingerprint; thread counts or mmap flags do not invalidate a snapshot.
+uint64_t computeSnapshotFingerprint(const LlamaSession& session) {
+    uint64_t hash = fnv1aValue(kSnapshotVersion, 0xcbf29ce484222325ULL);
+    hash = fnv1a(session.model_path.data(), session.model_path.size(), hash);
+
+    struct stat info {};
+    if (stat(session.model_path.c_str(), &info) == 0) {
+        hash = fnv1aValue(static_cast<int64_t>(info.st_size), hash);
+        hash = fnv1aValue(static_cast<int64_t>(info.st_mtime), hash);
+    }
+
+    const RuntimeNativeConfig& config = session.config;
+    hash = fnv1aValue(config.context_size, hash);
+    hash = fnv1aValue(config.has_seq_max ? config.seq_max : 0, hash);
+    hash = fnv1aValue(config.has_flash_attention ? config.flash_attention : -2, hash);
+    hash = fnv1aValue(config.has_rope_freq_base ? config.rope_freq_base : 0.0f, hash);
+    hash = fnv1aValue(config.has_rope_freq_scale ? config.rope_freq_scale : 0.0f, hash);
+    hash = fnv1aValue(config.has_kv_unified && config.kv_unified, hash);
+    hash = fnv1aValue(config.has_type_k ? config.type_k : GGML_TYPE_F16, hash);
+    hash = fnv1aValue(config.has_type_v ? config.type_v : GGML_TYPE_F16, hash);
+    return hash;
+}
+
+std::string snapshotPath(const PromptSnapshotLibrary& library, const llama_token* tokens, size_t count) {
+    uint64_t key = fnv1aValue(library.fingerprint, 0xcbf29ce484222325ULL);
+    key = fnv1a(tokens, count * sizeof(llama_token), key);
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx", static_cast<unsigned long long>(key));
+    return library.directory + "/" + name + kSnapshotExtension;
+}
+
+bool hasSnapshotExtension(const char* name) {
+    const size_t length = std::strlen(name);
+    const size_t suffix = std::strlen(kSnapshotExtension);
+    return length > suffix && std::strcmp(name + length - suffix, kSnapshotExtension) == 0;
+}
+
+bool readSnapshotHeader(const std::string& path, SnapshotFileHeader& header) {
+    std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(path.c_str(), "rb"), &std::fclose);
+    if (!file) {
+        return false;
+    }
+    return std::fread(&header, sizeof(header), 1, file.get()) == 1 &&
+           header.magic == kSnapshotMagic &&
+           header.version == kSnapshotVersion;
+}
+
+// Rebuilds the list of prefix lengths available for this session and evicts the least recently
+// used snapshots (by mtime, which is refreshed on every restore) until the directory fits in
+// max_bytes.  Files with a foreign magic or format version are removed outright.
+void scanPromptSnapshots(PromptSnapshotLibrary& library) {
+    struct Entry {
+        std::string path;
+        int64_t size;
+        int64_t mtime;
+    };
+
+    std::vector<Entry> entries;
+    std::vector<size_t> lengths;
+    int64_t total_bytes = 0;
+
+    struct DirCloser {
+        void operator()(DIR* handle) const { closedir(handle); }
+    };
+    std::unique_ptr<DIR, DirCloser> dir(opendir(library.directory.c_str()));
+    if (!dir) {
+        library.prefix_lengths.clear();
+        return;
+    }
+    while (dirent* item = readdir(dir.get())) {
+        if (!hasSnapshotExtension(item->d_name)) {
+            continue;
+        }
+        std::string path = library.directory + "/" + item->d_name;
+        struct stat info {};
+        if (stat(path.c_str(), &info) != 0 || !S_ISREG(info.st_mode)) {
+            continue;
+        }
+
+        SnapshotFileHeader header;
+        if (!readSnapshotHeader(path, header)) {
+            unlink(path.c_str());
+            continue;
+        }
+        if (header.fingerprint == library.fingerprint) {
+            lengths.push_back(static_cast<size_t>(header.token_count));
+        }
+        total_bytes += static_cast<int64_t>(info.st_size);
+        entries.push_back({std::move(path), static_cast<int64_t>(info.st_size), static_cast<int64_t>(info.st_mtime)});
+    }
+
+    if (library.max_bytes > 0 && total_bytes > library.max_bytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& lhs, const Entry& rhs) {
+            return lhs.mtime < rhs.mtime;
+        });
+        for (const auto& entry : entries) {
+            if (total_bytes <= library.max_bytes) {
+                break;
+            }
+            if (unlink(entry.path.c_str()) == 0) {
+                total_bytes -= entry.size;
+            }
+        }
+    }
+
+    std::sort(lengths.begin(), lengths.end(), std::greater<>());
+    lengths.erase(std::unique(lengths.begin(), lengths.end()), lengths.end());
+    library.prefix_lengths = std::move(lengths);
+}
+
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path) {
+        const int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            return;
+        }
+        struct stat info {};
+        if (fstat(fd, &info) == 0 && info.st_size > 0) {
+            void* mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+            if (mapped != MAP_FAILED) {
+                data_ = static_cast<const uint8_t*>(mapped);
+                size_ = static_cast<size_t>(info.st_size);
+                madvise(mapped, size_, MADV_SEQUENTIAL);
+            }
+        }
+        close(fd);
+    }
+
+    ~MappedFile() {
+        if (data_) {
+            munmap(const_cast<uint8_t*>(data_), size_);
+        }
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+};
+
+// Tries to replace sequence 0 with the longest stored snapshot that is a prefix of `tokens` and
+// longer than what is already cached.  Returns the number of prompt tokens now in the cache.
+size_t restorePromptSnapshot(LlamaSession* session, const std::vector<llama_token>& tokens, size_t reused) {
+    PromptSnapshotLibrary& library = session->snapshots;
+    if (!library.enabled()) {
+        return reused;
+    }
+
+    for (const size_t length : library.prefix_lengths) {
+        if (length <= reused) {
+            break;
+        }
+        if (length > tokens.size()) {
+            continue;
+        }
+
+        const std::string path = snapshotPath(library, tokens.data(), length);
+        MappedFile file(path);
+        if (!file.data()) {
+            continue;
+        }
+
+        SnapshotFileHeader header;
+        const size_t tokens_bytes = length * sizeof(llama_token);
+        if (file.size() < sizeof(header)) {
+            unlink(path.c_str());
+            continue;
+        }
+        std::memcpy(&header, file.data(), sizeof(header));
+        const bool valid = header.magic == kSnapshotMagic &&
+                           header.version == kSnapshotVersion &&
+                           header.fingerprint == library.fingerprint &&
+                           header.token_count == length &&
+                           file.size() == sizeof(header) + tokens_bytes + header.state_size &&
+                           std::memcmp(file.data() + sizeof(header), tokens.data(), tokens_bytes) == 0;
+        if (!valid) {
+            unlink(path.c_str());
+            continue;
+        }
+
+        llama_memory_t memory = llama_get_memory(session->context);
+        llama_memory_seq_rm(memory, 0, -1, -1);
+        session->evaluated_tokens.clear();
+        const size_t read = llama_state_seq_set_data(session->context,
+                                                     file.data() + sizeof(header) + tokens_bytes,
+                                                     static_cast<size_t>(header.state_size),
+                                                     0);
+        if (read == 0) {
+            logPrint(LogLevel::Warn, "Snapshot prompt ditolak: %s", path.c_str());
+            llama_memory_seq_rm(memory, 0, -1, -1);
+            unlink(path.c_str());
+            return 0;
+        }
+
+        session->evaluated_tokens.assign(tokens.begin(), tokens.begin() + static_cast<std::ptrdiff_t>(length));
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        logPrint(LogLevel::Debug,
+                 "Snapshot prompt dipulihkan: %zu token dari %s",
+                 length,
+                 path.c_str());
+        return length;
+    }
+    return reused;
+}
+
+// Aligns sequence 0 with `tokens`: keeps the longest prefix already in the KV cache (or restored
+// from a snapshot) and drops everything after it.  Returns the number of leading tokens that do
+// not need to be decoded again.
+size_t preparePromptCache(LlamaSession* session, const std::vector<llama_token>& tokens, bool need_logits) {
+    llama_memory_t memory = llama_get_memory(session->context);
+    size_t reused = commonPrefixLength(session->evaluated_tokens, tokens);
+    reused = restorePromptSnapshot(session, tokens, reused);
+    if (need_logits && reused == tokens.size() && reused > 0) {
+        // The last prompt token is always re-evaluated because its logits seed the first sample.
+        --reused;
+    }
+    if (!llama_memory_seq_rm(memory, 0, static_cast<llama_pos>(reused), -1)) {
+        // Some memory types (e.g. recurrent state) cannot drop a partial range.
+        llama_memory_clear(memory, true);
+        reused = 0;
+    }
+    session->evaluated_tokens.resize(reused);
+    logPrint(LogLevel::Debug,
+             "Prefix cache: %zu token dipakai ulang, %zu token dievaluasi",
+             reused,
+             tokens.size() - reused);
+    return reused;
+}
+
+// Thrown when the interactive completion is cancelled while decoding.  The KV cache and
+// evaluated_tokens are already consistent when it propagates.
+class CompletionCancelled : public std::runtime_error {
+public:
+    CompletionCancelled() : std::runtime_error("Completion dibatalkan.") {}
+};
+
+bool interactiveCancelRequested(const LlamaSession* session) {
+    const uint64_t id = session->active_request.load(std::memory_order_acquire);
+    return id != 0 && session->cancelled_request.load(std::memory_order_acquire) == id;
+}
+
+// ggml abort callback installed on the session context.  Only interrupts decodes issued by the
+// cancelled interactive completion, never batch engine steps.
+bool abortCancelledDecode(void* data) {
+    const auto* session = static_cast<const LlamaSession*>(data);
+    const uint64_t id = session->decoding_request.load(std::memory_order_relaxed);
+    return id != 0 && session->cancelled_request.load(std::memory_order_relaxed) == id;
+}
+
+// Decodes `data` into sequence 0 of `context` right after the tokens recorded in `evaluated`,
+// in n_batch sized chunks, and appends them to `evaluated` once they are in the cache.  Only the
+// last token of each chunk requests logits.  With an owner session the decode is cancellable and
+// every chunk is recorded under `phase` in the owner's metrics.
+void decodeTokens(llama_context* context,
+                  std::vector<llama_token>& evaluated,
+                  const llama_token* data,
+                  int32_t count,
+                  LlamaSession* cancel_owner = nullptr,
+                  MetricPhase phase = MetricPhase::Prefill) {
+    if (count <= 0) {
+        return;
+    }
+
+    llama_memory_t memory = llama_get_memory(context);
+    const int32_t max_batch = std::max<int32_t>(1, static_cast<int32_t>(llama_n_batch(context)));
+    int32_t processed = 0;
+    while (processed < count) {
+        if (cancel_owner && interactiveCancelRequested(cancel_owner)) {
+            throw CompletionCancelled();
+        }
+        const int32_t chunk = std::min<int32_t>(max_batch, count - processed);
+        llama_batch batch = llama_batch_get_one(const_cast<llama_token*>(data + processed), chunk);
+
+        const llama_pos base_pos = static_cast<llama_pos>(evaluated.size());
+        if (batch.pos) {
+            for (int32_t i = 0; i < batch.n_tokens; ++i) {
+                batch.pos[i] = base_pos + i;
+            }
+        }
+        if (batch.seq_id && batch.n_tokens > 0) {
+            for (int32_t i = 0; i < batch.n_tokens; ++i) {
+                batch.n_seq_id[i] = 1;
+                batch.seq_id[i][0] = 0;
+            }
+        }
+        if (batch.logits && batch.n_tokens > 0) {
+            for (int32_t i = 0; i < batch.n_tokens; ++i) {
+                batch.logits[i] = (i == batch.n_tokens - 1) ? 1 : 0;
+            }
+        }
+
+        const auto decode_start = SessionMetrics::Clock::now();
+        const int32_t status = llama_decode(context, batch);
+        if (cancel_owner) {
+            cancel_owner->metrics.record(phase, decode_start, SessionMetrics::Clock::now());
+        }
+        // Batches created via llama_batch_get_one do not own their buffers,
+        // so they must not be released with llama_batch_free.
+        if (status != 0) {
+            // Discard whatever part of the failed chunk reached the cache so the recorded
+            // token sequence stays an exact mirror of sequence 0.
+            llama_memory_seq_rm(memory, 0, base_pos, -1);
+            if (status == 2 && cancel_owner) {
+                throw CompletionCancelled();
+            }
+            std::ostringstream msg;
+            msg << "Gagal memproses token (status=" << status << ")";
+            throw std::runtime_error(msg.str());
+        }
+        evaluated.insert(evaluated.end(), data + processed, data + processed + chunk);
+        processed += chunk;
+    }
+}
+
+void evaluateTokens(LlamaSession* session,
+                    const llama_token* data,
+                    int32_t count,
+                    MetricPhase phase = MetricPhase::Prefill) {
+    decodeTokens(session->context, session->evaluated_tokens, data, count, session, phase);
+}
+
+// Drops tokens [keep, keep + discard) from sequence 0 of `context` and moves the tail down by
+// `discard` positions, keeping `evaluated` an exact mirror of the cache.  The shifted entries keep
+// their K/V values; only their positions (and RoPE) are adjusted, so nothing is re-evaluated.
+void shiftSequence(llama_context* context, std::vector<llama_token>& evaluated, size_t keep, size_t discard) {
+    llama_memory_t memory = llama_get_memory(context);
+    const auto p0 = static_cast<llama_pos>(keep);
+    const auto p1 = static_cast<llama_pos>(keep + discard);
+    if (!llama_memory_seq_rm(memory, 0, p0, p1)) {
+        throw std::runtime_error("Memori konteks tidak dapat menghapus sebagian token untuk context shift.");
+    }
+    llama_memory_seq_add(memory, 0, p1, -1, -static_cast<llama_pos>(discard));
+    evaluated.erase(evaluated.begin() + static_cast<std::ptrdiff_t>(keep),
+                    evaluated.begin() + static_cast<std::ptrdiff_t>(keep + discard));
+}
+
+// Frees half of the non-sink window of sequence 0, like llama.cpp's n_keep/n_discard scheme.
+// Returns the number of discarded tokens.
+size_t shiftSessionContext(LlamaSession* session, size_t sink_tokens) {
+    auto& evaluated = session->evaluated_tokens;
+    const size_t keep = std::min(sink_tokens, evaluated.size());
+    const size_t discard = (evaluated.size() - keep) / 2;
+    if (discard == 0) {
+        throw std::runtime_error("Context shift tidak dapat membebaskan ruang: token sink memenuhi konteks.");
+    }
+
+    const std::vector<llama_token> before = evaluated;
+    shiftSequence(session->context, evaluated, keep, discard);
+
+    // Mirror the shift in the draft so it does not have to re-prefill the whole window.
+    if (session->draft && commonPrefixLength(session->draft->evaluated_tokens, before) >= keep + discard) {
+        try {
+            shiftSequence(session->draft->context, session->draft->evaluated_tokens, keep, discard);
+        } catch (const std::exception&) {
+            llama_memory_clear(llama_get_memory(session->draft->context), true);
+            session->draft->evaluated_tokens.clear();
+        }
+    }
+
+    CompletionStats& stats = session->last_stats;
+    ++stats.context_shifts;
+    stats.shifted_tokens += static_cast<int64_t>(discard);
+    logPrint(LogLevel::Debug,
+             "Context shift: %zu token sink dipertahankan, %zu token dibuang",
+             keep, discard);
+    return discard;
+}
+
+// On-device runtime tuning.  The first load of a model on a device times prefill and single-token
+// decode across candidate thread counts and batch shapes on a small scratch context, and keeps
+// the fastest setting of each phase.  Results are cached per model and CPU topology, so the cost
+// is paid once; on big.LITTLE SoCs the right thread count depends on both.
+constexpr const char* kTuningFileName = "runtime_tuning.txt";
+// Part of the cache key; bump when the measurement changes so older results are re-measured.
+constexpr uint32_t kTuningVersion = 2;
+constexpr int32_t kTuneContextSize = 512;
+constexpr int32_t kTuneWarmupTokens = 32;
+constexpr int32_t kTunePrefillTokens = 256;
+// Phase 2 prompt: two batches of the largest n_batch candidate, so every shape splits it into its
+// own number of llama_decode calls and ubatches instead of all fitting one 256-token ubatch.
+constexpr int32_t kTuneBatchPrefillTokens = 1024;
+constexpr int32_t kTuneDecodeTokens = 16;
+constexpr size_t kTuneHashedBytes = 64 * 1024;
+// Candidates left when the budget runs out are skipped; the best one measured so far wins.
+constexpr std::chrono::seconds kTuneBudget{30};
+
+struct RuntimeTuning {
+    int32_t thread_count = 0;
+    int32_t thread_count_batch = 0;
+    int32_t batch_size = 0;
+    int32_t ubatch_size = 0;
+};
+
+struct CpuCluster {
+    long long max_freq_khz = 0;
+    int32_t cores = 0;
+};
+
+// CPUs grouped by maximum frequency, fastest cluster first.  Hosts without cpufreq end up with a
+// single cluster at frequency 0.
+std::vector<CpuCluster> readCpuTopology() {
+    const long n_cpus = std::max(1L, sysconf(_SC_NPROCESSORS_CONF));
+    std::vector<long long> frequencies;
+    frequencies.reserve(static_cast<size_t>(n_cpus));
+    for (long cpu = 0; cpu < n_cpus; ++cpu) {
+        const std::string path =
+                "/sys/devices/system/cpu/cpu" + std::to_string(cpu) + "/cpufreq/cpuinfo_max_freq";
+        long long frequency = 0;
+        std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(path.c_str(), "r"), &std::fclose);
+        if (!file || std::fscanf(file.get(), "%lld", &frequency) != 1) {
+            frequency = 0;
+        }
+        frequencies.push_back(frequency);
+    }
+    std::sort(frequencies.begin(), frequencies.end(), std::greater<>());
+
+    std::vector<CpuCluster> clusters;
+    for (const long long frequency : frequencies) {
+        if (clusters.empty() || clusters.back().max_freq_khz != frequency) {
+            clusters.push_back({frequency, 0});
+        }
+        ++clusters.back().cores;
+    }
+    return clusters;
+}
+
+std::string describeTopology(const std::vector<CpuCluster>& clusters) {
+    std::string description;
+    for (const CpuCluster& cluster : clusters) {
+        if (!description.empty()) {
+            description += ',';
+        }
+        description += std::to_string(cluster.cores) + "x" + std::to_string(cluster.max_freq_khz);
+    }
+    return description;
+}
+
+// Thread counts worth measuring: every cluster boundary (fastest cores first), the requested
+// count, and half the cores when there is no cluster structure to go by.
+std::vector<int32_t> threadCandidates(const std::vector<CpuCluster>& clusters, int32_t requested) {
+    std::vector<int32_t> candidates;
+    int32_t total = 0;
+    for (const CpuCluster& cluster : clusters) {
+        total += cluster.cores;
+        candidates.push_back(total);
+    }
+    if (clusters.size() == 1) {
+        candidates.push_back(std::max<int32_t>(1, total / 2));
+    }
+    candidates.push_back(std::clamp<int32_t>(requested, 1, std::max<int32_t>(1, total)));
+    std::sort(candidates.begin(), candidates.end());
+    candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+    return candidates;
+}
+
+// Identifies the model by its size and the bytes at both ends of the file (GGUF header and
+// metadata at the front, tensor data at the back), so renaming or re-downloading the same file
+// keeps its tuning.  Settings that change the cost of a decode take part as well.
+uint64_t computeTuningKey(const std::string& model_path,
+                          const std::string& topology,
+                          const RuntimeNativeConfig& config) {
+    uint64_t hash = fnv1a(topology.data(), topology.size(), fnv1aValue(kTuningVersion, 0xcbf29ce484222325ULL));
+
+    const int fd = open(model_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd >= 0) {
+        struct stat info {};
+        if (fstat(fd, &info) == 0) {
+            hash = fnv1aValue(static_cast<int64_t>(info.st_size), hash);
+            std::vector<uint8_t> buffer(kTuneHashedBytes);
+            const off_t tail = std::max<off_t>(0, info.st_size - static_cast<off_t>(kTuneHashedBytes));
+            for (const off_t offset : {static_cast<off_t>(0), tail}) {
+                const ssize_t read_bytes = pread(fd, buffer.data(), buffer.size(), offset);
+                if (read_bytes > 0) {
+                    hash = fnv1a(buffer.data(), static_cast<size_t>(read_bytes), hash);
+                }
+            }
+        }
+        close(fd);
+    }
+
+    hash = fnv1aValue(config.has_n_gpu_layers ? config.n_gpu_layers : -1, hash);
+    hash = fnv1aValue(config.has_flash_attention ? config.flash_attention : -2, hash);
+    hash = fnv1aValue(config.has_offload_kqv && config.offload_kqv, hash);
+    hash = fnv1aValue(config.has_type_k ? static_cast<int32_t>(config.type_k) : -1, hash);
+    hash = fnv1aValue(config.has_type_v ? static_cast<int32_t>(config.type_v) : -1, hash);
+    return hash;
+}
+
+bool loadRuntimeTuning(const std::string& path, uint64_t key, RuntimeTuning& tuning) {
+    std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(path.c_str(), "r"), &std::fclose);
+    if (!file) {
+        return false;
+    }
+    unsigned long long entry_key = 0;
+    RuntimeTuning entry;
+    while (std::fscanf(file.get(), "%llx %d %d %d %d", &entry_key, &entry.thread_count,
+                       &entry.thread_count_batch, &entry.batch_size, &entry.ubatch_size) == 5) {
+        if (entry_key == key && entry.thread_count > 0 && entry.thread_count_batch > 0 &&
+            entry.batch_size > 0 && entry.ubatch_size > 0) {
+            tuning = entry;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Rewrites the cache with `tuning` replacing any previous entry for `key`.  Failures only cost a
+// re-tune on the next load, so they are logged rather than thrown.
+void storeRuntimeTuning(const std::string& directory, const std::string& path, uint64_t key,
+                        const RuntimeTuning& tuning) {
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        logPrint(LogLevel::Warn, "Direktori tuning runtime tidak dapat dibuat: %s", directory.c_str());
+        return;
+    }
+
+    std::vector<std::string> lines;
+    {
+        std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(path.c_str(), "r"), &std::fclose);
+        char line[128];
+        while (file && std::fgets(line, sizeof(line), file.get())) {
+            unsigned long long entry_key = 0;
+            if (std::sscanf(line, "%llx", &entry_key) == 1 && entry_key != key) {
+                lines.emplace_back(line);
+            }
+        }
+    }
+    char entry[128];
+    std::snprintf(entry, sizeof(entry), "%016llx %d %d %d %d\n", static_cast<unsigned long long>(key),
+                  tuning.thread_count, tuning.thread_count_batch, tuning.batch_size, tuning.ubatch_size);
+    lines.emplace_back(entry);
+
+    const std::string temp_path = path + ".tmp";
+    std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(temp_path.c_str(), "w"), &std::fclose);
+    bool ok = static_cast<bool>(file);
+    for (const std::string& line : lines) {
+        ok = ok && std::fputs(line.c_str(), file.get()) >= 0;
+    }
+    ok = ok && std::fflush(file.get()) == 0;
+    file.reset();
+    if (!ok || std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        logPrint(LogLevel::Warn, "Hasil tuning runtime tidak dapat disimpan: %s", path.c_str());
+    }
+}
+
+using ContextPtr = std::unique_ptr<llama_context, decltype(&llama_free)>;
+
+ContextPtr createTuningContext(llama_model* model,
+                               const RuntimeNativeConfig& config,
+                               int32_t context_size,
+                               int32_t batch_size,
+                               int32_t ubatch_size,
+                               int32_t threads) {
+    llama_context_params params = llama_context_default_params();
+    params.n_ctx = context_size;
+    params.n_batch = batch_size;
+    params.n_ubatch = ubatch_size;
+    params.n_seq_max = 1;
+    params.n_threads = threads;
+    params.n_threads_batch = threads;
+    params.no_perf = true;
+    if (config.has_flash_attention) {
+        params.flash_attn_type = static_cast<llama_flash_attn_type>(config.flash_attention);
+    }
+    if (config.has_offload_kqv) {
+        params.offload_kqv = config.offload_kqv;
+    }
+    // Quantized caches decode at a different speed, so tune with the types the session will use.
+    if (config.has_type_k) {
+        params.type_k = config.type_k;
+    }
+    if (config.has_type_v) {
+        params.type_v = config.type_v;
+    }
+    ContextPtr context(llama_init_from_model(model, params), &llama_free);
+    if (!context) {
+        throw std::runtime_error("Gagal membuat konteks llama untuk tuning runtime.");
+    }
+    return context;
+}
+
+// Tokens per second of evaluating `count` tokens of `tokens` from an empty cache.
+double measurePrefill(llama_context* context, const std::vector<llama_token>& tokens, int32_t count) {
+    llama_memory_clear(llama_get_memory(context), true);
+    std::vector<llama_token> evaluated;
+    const auto start = std::chrono::steady_clock::now();
+    decodeTokens(context, evaluated, tokens.data(), count);
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() > 0.0 ? count / elapsed.count() : 0.0;
+}
+
+// Tokens per second of single-token decode steps after a short prompt.
+double measureDecode(llama_context* context, const std::vector<llama_token>& tokens) {
+    llama_memory_clear(llama_get_memory(context), true);
+    std::vector<llama_token> evaluated;
+    decodeTokens(context, evaluated, tokens.data(), kTuneWarmupTokens);
+    const auto start = std::chrono::steady_clock::now();
+    for (int32_t i = 0; i < kTuneDecodeTokens; ++i) {
+        decodeTokens(context, evaluated, &tokens[static_cast<size_t>(kTuneWarmupTokens + i)], 1);
+    }
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() > 0.0 ? kTuneDecodeTokens / elapsed.count() : 0.0;
+}
+
+RuntimeTuning runRuntimeTuning(llama_model* model,
+                               const RuntimeNativeConfig& config,
+                               const std::vector<int32_t>& thread_candidates) {
+    const auto deadline = std::chrono::steady_clock::now() + kTuneBudget;
+    auto out_of_time = [&deadline]() { return std::chrono::steady_clock::now() >= deadline; };
+
+    RuntimeTuning tuning;
+    tuning.thread_count = config.thread_count;
+    tuning.thread_count_batch = config.has_thread_count_batch ? config.thread_count_batch : config.thread_count;
+    tuning.batch_size = config.has_batch_size ? config.batch_size : std::min(config.context_size, 512);
+    tuning.ubatch_size = config.has_ubatch_size ? std::min(config.ubatch_size, tuning.batch_size)
+                                                : tuning.batch_size;
+
+    // Token ids only need to be valid; the content does not change the cost of a decode.
+    const int32_t n_vocab = llama_vocab_n_tokens(llama_model_get_vocab(model));
+    std::vector<llama_token> tokens(static_cast<size_t>(kTuneBatchPrefillTokens));
+    for (size_t i = 0; i < tokens.size(); ++i) {
+        tokens[i] = static_cast<llama_token>((i * 7919 + 13) % static_cast<size_t>(std::max(1, n_vocab)));
+    }
+
+    // Phase 1: thread counts, timing prefill and single-token decode separately.
+    {
+        ContextPtr context = createTuningContext(model, config, kTuneContextSize, tuning.batch_size,
+                                                 tuning.ubatch_size, thread_candidates.back());
+        measurePrefill(context.get(), tokens, kTuneWarmupTokens);
+        double best_prefill = 0.0;
+        double best_decode = 0.0;
+        for (const int32_t threads : thread_candidates) {
+            if (out_of_time()) {
+                break;
+            }
+            llama_set_n_threads(context.get(), threads, threads);
+            const double prefill = measurePrefill(context.get(), tokens, kTunePrefillTokens);
+            const double decode = measureDecode(context.get(), tokens);
+            logPrint(LogLevel::Debug, "Tuning threads=%d: prefill %.1f tok/s, decode %.1f tok/s",
+                     threads, prefill, decode);
+            if (prefill > best_prefill) {
+                best_prefill = prefill;
+                tuning.thread_count_batch = threads;
+            }
+            if (decode > best_decode) {
+                best_decode = decode;
+                tuning.thread_count = threads;
+            }
+        }
+    }
+
+    // Phase 2: batch shapes for prefill, on the prefill thread count picked above.  Each shape
+    // prefills the same multi-batch prompt, so n_batch and n_ubatch both change the work measured.
+    static constexpr std::array<std::pair<int32_t, int32_t>, 5> kBatchShapes{{
+            {512, 512}, {512, 256}, {256, 256}, {256, 128}, {128, 64},
+    }};
+    static_assert(kTuneBatchPrefillTokens >= 2 * kBatchShapes[0].first,
+                  "the phase 2 prompt must span several batches of the largest shape");
+    double best_prefill = 0.0;
+    for (const auto& [batch_size, ubatch_size] : kBatchShapes) {
+        if (out_of_time()) {
+            break;
+        }
+        ContextPtr context = createTuningContext(model, config, kTuneBatchPrefillTokens, batch_size,
+                                                 ubatch_size, tuning.thread_count_batch);
+        const double prefill = measurePrefill(context.get(), tokens, kTuneBatchPrefillTokens);
+        logPrint(LogLevel::Debug, "Tuning batch=%d ubatch=%d: prefill %.1f tok/s",
+                 batch_size, ubatch_size, prefill);
+        if (prefill > best_prefill) {
+            best_prefill = prefill;
+            tuning.batch_size = batch_size;
+            tuning.ubatch_size = ubatch_size;
+        }
+    }
+    return tuning;
+}
+
+// Replaces the auto-tuned fields of `config` with cached or freshly measured values for `model`.
+// A failed tuning run keeps the configured values.
+void applyRuntimeTuning(llama_model* model, const std::string& model_path, RuntimeNativeConfig& config) {
+    const std::vector<CpuCluster> clusters = readCpuTopology();
+    const std::string topology = describeTopology(clusters);
+    const uint64_t key = computeTuningKey(model_path, topology, config);
+    const std::string cache_path =
+            config.tune_cache_dir.empty() ? std::string() : config.tune_cache_dir + "/" + kTuningFileName;
+
+    RuntimeTuning tuning;
+    const bool cached = !cache_path.empty() && loadRuntimeTuning(cache_path, key, tuning);
+    if (!cached) {
+        try {
+            tuning = runRuntimeTuning(model, config, threadCandidates(clusters, config.thread_count));
+        } catch (const std::exception& ex) {
+            logPrint(LogLevel::Warn, "Tuning runtime gagal: %s", ex.what());
+            return;
+        }
+        if (!cache_path.empty()) {
+            storeRuntimeTuning(config.tune_cache_dir, cache_path, key, tuning);
+        }
+    }
+
+    if (config.auto_tune & kAutoTuneThreads) {
+        config.thread_count = tuning.thread_count;
+    }
+    if (config.auto_tune & kAutoTuneThreadsBatch) {
+        config.thread_count_batch = tuning.thread_count_batch;
+        config.has_thread_count_batch = true;
+    }
+    if (config.auto_tune & kAutoTuneBatch) {
+        config.batch_size = tuning.batch_size;
+        config.has_batch_size = true;
+    }
+    if (config.auto_tune & kAutoTuneUbatch) {
+        config.ubatch_size = tuning.ubatch_size;
+        config.has_ubatch_size = true;
+    }
+    if (config.has_batch_size && config.has_ubatch_size) {
+        config.ubatch_size = std::min(config.ubatch_size, config.batch_size);
+    }
+    logPrint(LogLevel::Info,
+             "Tuning runtime %s (CPU %s): threads=%d, threads_batch=%d, batch=%d, ubatch=%d",
+             cached ? "dari cache" : "diukur",
+             topology.c_str(),
+             tuning.thread_count,
+             tuning.thread_count_batch,
+             tuning.batch_size,
+             tuning.ubatch_size);
+}
+
+// Forwards llama's per-tensor load progress to a LoadProgressCallback in steps of at least 1%,
+// remembering whether the callback asked to cancel.
+struct LoadProgressRelay {
+    const LoadProgressCallback& callback;
+    float last_reported = -1.0f;
+    bool cancelled = false;
+
+    bool report(float progress) {
+        if (cancelled) {
+            return false;
+        }
+        if (progress < 1.0f ? progress - last_reported < 0.01f : last_reported >= 1.0f) {
+            return true;
+        }
+        last_reported = progress;
+        cancelled = !callback(std::clamp(progress, 0.0f, 1.0f));
+        return !cancelled;
+    }
+};
+
+bool relayLoadProgress(float progress, void* user_data) {
+    return static_cast<LoadProgressRelay*>(user_data)->report(progress);
+}
+
+// Registry of loaded models.  An entry with `loading` set is being loaded by one caller with the
+// lock released; other callers for that key wait on g_models_changed instead of loading it twice.
+struct ModelEntry {
+    std::string key;
+    std::weak_ptr<SharedModel> model;
+    bool loading = false;
+};
+
+std::mutex g_models_mutex;
+std::condition_variable g_models_changed;
+std::vector<ModelEntry> g_models;
+
+llama_model_params modelParamsFor(const RuntimeNativeConfig& config) {
+    llama_model_params model_params = llama_model_default_params();
+    if (config.has_n_gpu_layers) {
+        model_params.n_gpu_layers = config.n_gpu_layers;
+    }
+    if (config.has_main_gpu) {
+        model_params.main_gpu = config.main_gpu;
+    }
+    if (config.has_use_mmap) {
+        model_params.use_mmap = config.use_mmap;
+    }
+    if (config.has_use_mlock) {
+        model_params.use_mlock = config.use_mlock;
+    }
+    return model_params;
+}
+
+// Everything that changes the loaded weights or where they live.  Context-level settings never
+// take part, so sessions that only differ in those share one model.
+std::string modelKey(const std::string& path, const llama_model_params& params) {
+    std::ostringstream key;
+    key << path << '|' << params.n_gpu_layers << '|' << params.main_gpu << '|' << params.use_mmap << '|'
+        << params.use_mlock;
+    return key.str();
+}
+
+// Returns the loaded model for `path` and `params`, loading it when no live session holds it.
+// The load itself runs without the registry lock, so callers for other models are not held up; a
+// second caller for the same key waits for the first instead of mapping the file twice, and
+// retries the load itself if the first one fails or is cancelled.
+std::shared_ptr<SharedModel> acquireModel(const std::string& path,
+                                          llama_model_params params,
+                                          bool prefetch,
+                                          const LoadProgressCallback& on_progress) {
+    const std::string key = modelKey(path, params);
+    const auto findEntry = [&key]() {
+        return std::find_if(g_models.begin(), g_models.end(),
+                            [&key](const ModelEntry& entry) { return entry.key == key; });
+    };
+
+    std::shared_ptr<SharedModel> loaded;
+    {
+        std::unique_lock<std::mutex> lock(g_models_mutex);
+        while (true) {
+            g_models.erase(std::remove_if(g_models.begin(), g_models.end(),
+                                          [](const ModelEntry& entry) {
+                                              return !entry.loading && entry.model.expired();
+                                          }),
+                           g_models.end());
+            const auto it = findEntry();
+            if (it == g_models.end()) {
+                g_models.push_back({key, {}, true});
+                break;
+            }
+            if (!it->loading) {
+                loaded = it->model.lock();
+                if (loaded) {
+                    break;
+                }
+                // The last holder let go after the prune above.
+                g_models.erase(it);
+                continue;
+            }
+            g_models_changed.wait(lock);
+        }
+    }
+    if (loaded) {
+        if (on_progress && !on_progress(1.0f)) {
+            throw ModelLoadCancelled();
+        }
+        return loaded;
+    }
+
+    // Clears this caller's in-flight entry and wakes the waiters, which retry or pick up `model`.
+    const auto finishLoading = [&](const std::shared_ptr<SharedModel>& model) {
+        {
+            std::lock_guard<std::mutex> lock(g_models_mutex);
+            const auto it = findEntry();
+            if (model) {
+                it->model = model;
+                it->loading = false;
+            } else {
+                g_models.erase(it);
+            }
+        }
+        g_models_changed.notify_all();
+    };
+
+    auto shared = std::make_shared<SharedModel>();
+    shared->key = key;
+    LoadProgressRelay progress_relay{on_progress};
+    try {
+        if (prefetch && params.use_mmap && !params.use_mlock) {
+            // Started before the loader so the readahead overlaps metadata parsing and tensor setup.
+            shared->prefetcher = std::make_unique<ModelPrefetcher>(path);
+        }
+        if (on_progress) {
+            params.progress_callback = relayLoadProgress;
+            params.progress_callback_user_data = &progress_relay;
+        } else {
+            params.progress_callback = nullptr;
+        }
+        shared->model = llama_model_load_from_file(path.c_str(), params);
+        if (shared->model && on_progress && !progress_relay.report(1.0f)) {
+            llama_model_free(shared->model);
+            shared->model = nullptr;
+        }
+    } catch (...) {
+        finishLoading(nullptr);
+        throw;
+    }
+    if (!shared->model) {
+        finishLoading(nullptr);
+        if (progress_relay.cancelled) {
+            throw ModelLoadCancelled();
+        }
+        throw std::runtime_error("Gagal memuat model: " + path);
+    }
+
+    finishLoading(shared);
+    return shared;
+}
+
+constexpr int32_t kDefaultDraftTokens = 8;
+
+// Loads the speculative draft model next to the target.  It shares the target's model and context
+// parameters (threads, n_ctx, n_batch, flash attention) and must use the same vocabulary.
+std::unique_ptr<DraftModel> loadDraftModel(const LlamaSession* session,
+                                           const RuntimeNativeConfig& config,
+                                           const llama_context_params& target_ctx_params) {
+    auto draft = std::make_unique<DraftModel>();
+    draft->model_path = config.draft_model_path;
+    draft->max_tokens = config.has_draft_tokens ? config.draft_tokens : kDefaultDraftTokens;
+
+    // The draft loads silently; its progress would restart the target's progress bar from zero.
+    try {
+        draft->shared_model = acquireModel(draft->model_path, modelParamsFor(config), false, nullptr);
+    } catch (const std::runtime_error&) {
+        throw std::runtime_error("Gagal memuat model draft: " + draft->model_path);
+    }
+    draft->model = draft->shared_model->model;
+
+    const llama_vocab* target_vocab = llama_model_get_vocab(session->model);
+    const llama_vocab* draft_vocab = llama_model_get_vocab(draft->model);
+    if (llama_vocab_n_tokens(target_vocab) != llama_vocab_n_tokens(draft_vocab) ||
+        llama_vocab_bos(target_vocab) != llama_vocab_bos(draft_vocab) ||
+        llama_vocab_eos(target_vocab) != llama_vocab_eos(draft_vocab)) {
+        throw std::runtime_error("Vocabulary model draft tidak cocok dengan model utama.");
+    }
+
+    llama_context_params ctx_params = target_ctx_params;
+    ctx_params.n_seq_max = 1;
+    ctx_params.embeddings = false;
+    ctx_params.no_perf = true;
+    draft->context = llama_init_from_model(draft->model, ctx_params);
+    if (!draft->context) {
+        throw std::runtime_error("Gagal membuat konteks llama untuk model draft.");
+    }
+
+    draft->verify_batch = llama_batch_init(draft->max_tokens + 1, 0, 1);
+    logPrint(LogLevel::Info,
+             "Model draft siap. Model=%s, draft=%d token",
+             draft->model_path.c_str(),
+             draft->max_tokens);
+    return draft;
+}
+
+llama_token greedyToken(llama_context* context, const llama_vocab* vocab) {
+    const float* logits = llama_get_logits_ith(context, -1);
+    const int32_t n_vocab = llama_vocab_n_tokens(vocab);
+    return static_cast<llama_token>(std::max_element(logits, logits + n_vocab) - logits);
+}
+
+// Brings the draft context in line with the target sequence (`target_tokens` followed by the
+// not yet evaluated `pending` token) and lets it propose up to `count` greedy continuations.
+// Speculation is best effort: a draft failure resets the draft cache and proposes nothing.
+std::vector<llama_token> proposeDraftTokens(DraftModel& draft,
+                                            const std::vector<llama_token>& target_tokens,
+                                            llama_token pending,
+                                            int32_t count) {
+    std::vector<llama_token> proposal;
+    if (count <= 0) {
+        return proposal;
+    }
+
+    llama_memory_t memory = llama_get_memory(draft.context);
+    const llama_vocab* vocab = llama_model_get_vocab(draft.model);
+    try {
+        size_t common = commonPrefixLength(draft.evaluated_tokens, target_tokens);
+        if (!llama_memory_seq_rm(memory, 0, static_cast<llama_pos>(common), -1)) {
+            llama_memory_clear(memory, true);
+            common = 0;
+        }
+        draft.evaluated_tokens.resize(common);
+        decodeTokens(draft.context,
+                     draft.evaluated_tokens,
+                     target_tokens.data() + common,
+                     static_cast<int32_t>(target_tokens.size() - common));
+        decodeTokens(draft.context, draft.evaluated_tokens, &pending, 1);
+
+        proposal.reserve(static_cast<size_t>(count));
+        while (true) {
+            const llama_token token = greedyToken(draft.context, vocab);
+            if (llama_vocab_is_eog(vocab, token)) {
+                break;
+            }
+            proposal.push_back(token);
+            if (static_cast<int32_t>(proposal.size()) >= count) {
+                break;
+            }
+            decodeTokens(draft.context, draft.evaluated_tokens, &token, 1);
+        }
+    } catch (const std::exception& ex) {
+        logPrint(LogLevel::Warn, "Model draft gagal: %s", ex.what());
+        llama_memory_clear(memory, true);
+        draft.evaluated_tokens.clear();
+    }
+    return proposal;
+}
+
+using SamplerPtr = std::unique_ptr<llama_sampler, decltype(&llama_sampler_free)>;
+
+TokenSamplerParams tokenSamplerParams(const LlamaSession* session, const SamplingNativeOptions& options) {
+    TokenSamplerParams params;
+    const float repeat_penalty_value = options.repeat_penalty.value_or(1.0f);
+    const float frequency_penalty_value = options.frequency_penalty.value_or(0.0f);
+    const float presence_penalty_value = options.presence_penalty.value_or(0.0f);
+    const bool use_repeat_penalty = options.repeat_penalty.has_value() && repeat_penalty_value > 1.0f + 1e-5f;
+    const bool use_frequency_penalty =
+            options.frequency_penalty.has_value() && std::fabs(frequency_penalty_value) > 1e-5f;
+    const bool use_presence_penalty =
+            options.presence_penalty.has_value() && std::fabs(presence_penalty_value) > 1e-5f;
+    if (use_repeat_penalty || use_frequency_penalty || use_presence_penalty) {
+        params.penalty_last_n = options.repeat_last_n.value_or(std::min(session->context_size, 64));
+        params.penalty_repeat = use_repeat_penalty ? repeat_penalty_value : 1.0f;
+        params.penalty_freq = use_frequency_penalty ? frequency_penalty_value : 0.0f;
+        params.penalty_present = use_presence_penalty ? presence_penalty_value : 0.0f;
+    }
+    params.top_k = options.top_k;
+    params.top_p = options.top_p;
+    params.temperature = options.temperature;
+    params.seed = options.seed.value_or(LLAMA_DEFAULT_SEED);
+    return params;
+}
+
+// Token sampler of one completion plus its optional grammar.  The grammar stays outside the
+// sampler: the sampler also sees the prompt tokens (for the penalties), which the grammar must
+// never accept.
+struct CompletionSampler {
+    std::unique_ptr<TokenSampler> sampler;
+    SamplerPtr grammar{nullptr, &llama_sampler_free};
+    // Buffers reused by every constrained sampling step.
+    std::vector<llama_token_data> candidates;
+    std::vector<float> masked_logits;
+};
+
+// Builds the sampler for `options`.  `reuse` is a sampler from an earlier completion: when its
+// parameters match it is reset instead of reallocating its vocabulary-sized buffers.
+CompletionSampler buildCompletionSampler(LlamaSession* session,
+                                         const SamplingNativeOptions& options,
+                                         std::unique_ptr<TokenSampler> reuse = nullptr) {
+    if (!options.grammar.empty() && !options.json_schema.empty()) {
+        throw std::runtime_error("Grammar dan skema JSON tidak dapat dipakai bersamaan.");
+    }
+    CompletionSampler sampler;
+    const TokenSamplerParams params = tokenSamplerParams(session, options);
+    if (reuse && reuse->params() == params) {
+        reuse->reset();
+        sampler.sampler = std::move(reuse);
+    } else {
+        sampler.sampler = std::make_unique<TokenSampler>(params);
+    }
+    if (!options.grammar.empty() || !options.json_schema.empty()) {
+        const bool json_schema = !options.json_schema.empty();
+        sampler.grammar.reset(session->shared_model->grammars.instantiate(
+                llama_model_get_vocab(session->model), json_schema,
+                json_schema ? options.json_schema : options.grammar));
+    }
+    return sampler;
+}
+
+// Feeds the prompt to the repetition penalties.  Only the tail inside the penalty window can
+// matter, so longer prompts are not walked in full.
+void acceptPromptTokens(CompletionSampler& sampler, const std::vector<llama_token>& prompt) {
+    const auto window = static_cast<size_t>(std::max(sampler.sampler->params().penalty_last_n, 0));
+    const size_t begin = prompt.size() > window ? prompt.size() - window : 0;
+    for (size_t i = begin; i < prompt.size(); ++i) {
+        sampler.sampler->accept(prompt[i]);
+    }
+}
+
+// Records a generated token in the sampler and the grammar.
+void acceptToken(CompletionSampler& sampler, llama_token token) {
+    sampler.sampler->accept(token);
+    if (sampler.grammar) {
+        llama_sampler_accept(sampler.grammar.get(), token);
+    }
+}
+
+std::vector<llama_token> tokenizeCompletionPrompt(LlamaSession* session, const std::string& prompt) {
+    PhaseTimer timer(session->metrics, MetricPhase::Tokenize);
+    auto tokens = tokenizePrompt(session->model, prompt);
+    if (tokens.empty()) {
+        const llama_token bos = llama_vocab_bos(llama_model_get_vocab(session->model));
+        if (bos == LLAMA_TOKEN_NULL) {
+            throw std::runtime_error("Model tidak memiliki token BOS.");
+        }
+        tokens.push_back(bos);
+    }
+    return tokens;
+}
+
+// Number of KV cells a single sequence can occupy.  Without a unified KV cache the context is
+// split evenly between n_seq_max streams.
+int32_t sequenceCapacity(const LlamaSession* session) {
+    const int32_t n_ctx = static_cast<int32_t>(llama_n_ctx(session->context));
+    const int32_t n_seq = std::max<int32_t>(1, static_cast<int32_t>(llama_n_seq_max(session->context)));
+    const bool unified = session->config.has_kv_unified && session->config.kv_unified;
+    return unified ? n_ctx : n_ctx / n_seq;
+}
+
+void ensureFitsContext(const LlamaSession* session, size_t prompt_tokens, int32_t max_tokens) {
+    const int32_t capacity = std::min(session->context_size, sequenceCapacity(session));
+    const int total_needed = static_cast<int>(prompt_tokens) + max_tokens;
+    if (total_needed > capacity) {
+        std::ostringstream msg;
+        msg << "Konteks terlalu kecil: membutuhkan " << total_needed
+            << ", tetapi konteks saat ini " << capacity << '.';
+        throw std::runtime_error(msg.str());
+    }
+}
+
+// Exact token count of `text` as a prompt fragment, excluding the BOS/EOS the vocab would add.
+int32_t countSegmentTokens(LlamaSession* session, const std::string& text) {
+    if (auto cached = session->segment_tokens.find(text)) {
+        return *cached;
+    }
+    const auto count = static_cast<int32_t>(tokenizePrompt(session->model, text, false).size());
+    session->segment_tokens.insert(text, count);
+    return count;
+}
+
+// Number of tokens tokenizeCompletionPrompt adds around the text itself.
+int32_t specialTokenOverhead(const LlamaSession* session) {
+    const llama_vocab* vocab = llama_model_get_vocab(session->model);
+    return (llama_vocab_get_add_bos(vocab) ? 1 : 0) + (llama_vocab_get_add_eos(vocab) ? 1 : 0);
+}
+
+// Streaming multi-pattern stop-sequence matcher (Aho-Corasick automaton with a dense transition
+// table).  Generated pieces are fed byte by byte while the automaton state carries across token
+// boundaries, so each byte costs one table lookup regardless of how many stop sequences there
+// are.  Only the bytes that are still a prefix of some stop sequence are withheld; everything
+// before them is released immediately, which keeps streamed output from leaking a partial stop
+// string while never copying the completion itself.
+class StopSequenceMatcher {
+public:
+    explicit StopSequenceMatcher(const std::vector<std::string>& stop_sequences) {
+        nodes_.emplace_back();
+        for (const auto& stop : stop_sequences) {
+            if (stop.empty()) {
+                continue;
+            }
+            int32_t state = 0;
+            for (const char ch : stop) {
+                const auto byte = static_cast<uint8_t>(ch);
+                if (nodes_[state].next[byte] <= 0) {
+                    nodes_[state].next[byte] = static_cast<int32_t>(nodes_.size());
+                    nodes_.emplace_back();
+                    nodes_.back().depth = nodes_[state].depth + 1;
+                }
+                state = nodes_[state].next[byte];
+            }
+            if (nodes_[state].match_length == 0) {
+                nodes_[state].match_length = static_cast<int32_t>(stop.size());
+            }
+        }
+        buildTransitions();
+    }
+
+    bool active() const { return nodes_.size() > 1; }
+
+    // Feeds `piece` and appends the bytes that can no longer start a stop sequence to `released`.
+    // Returns true once a stop sequence completes; the stop text and anything after it are
+    // dropped and the matcher must not be fed again.
+    bool feed(std::string_view piece, std::string& released) {
+        if (!active()) {
+            released += piece;
+            return false;
+        }
+
+        for (const char ch : piece) {
+            state_ = nodes_[state_].next[static_cast<uint8_t>(ch)];
+            held_.push_back(ch);
+
+            const Node& node = nodes_[state_];
+            if (node.match_length > 0) {
+                released.append(held_, 0, held_.size() - static_cast<size_t>(node.match_length));
+                held_.clear();
+                state_ = 0;
+                return true;
+            }
+
+            const size_t keep = static_cast<size_t>(node.depth);
+            if (held_.size() > keep) {
+                released.append(held_, 0, held_.size() - keep);
+                held_.erase(0, held_.size() - keep);
+            }
+        }
+        return false;
+    }
+
+    // Releases the withheld tail once generation ends without reaching a stop sequence.
+    void flush(std::string& released) {
+        released += held_;
+        held_.clear();
+        state_ = 0;
+    }
+
+private:
+    struct Node {
+        std::array<int32_t, 256> next{};
+        int32_t depth = 0;
+        // Length of the shortest stop sequence that ends at this node, following suffix links.
+        int32_t match_length = 0;
+    };
+
+    void buildTransitions() {
+        std::vector<int32_t> fail(nodes_.size(), 0);
+        std::deque<int32_t> queue;
+        for (auto& target : nodes_[0].next) {
+            if (target > 0) {
+                queue.push_back(target);
+            } else {
+                target = 0;
+            }
+        }
+        while (!queue.empty()) {
+            const int32_t state = queue.front();
+            queue.pop_front();
+            const int32_t link = fail[state];
+            const int32_t inherited = nodes_[link].match_length;
+            if (inherited > 0 &&
+                (nodes_[state].match_length == 0 || inherited < nodes_[state].match_length)) {
+                nodes_[state].match_length = inherited;
+            }
+            for (size_t byte = 0; byte < 256; ++byte) {
+                int32_t& target = nodes_[state].next[byte];
+                if (target > 0) {
+                    fail[target] = nodes_[link].next[byte];
+                    queue.push_back(target);
+                } else {
+                    target = nodes_[link].next[byte];
+                }
+            }
+        }
+    }
+
+    std::vector<Node> nodes_;
+    int32_t state_ = 0;
+    std::string held_;
+};
+
+// Detokenizes `token` and feeds it to `matcher`, recording both steps in the session metrics.
+bool feedToken(LlamaSession* session,
+               const TokenPieceTable& pieces,
+               StopSequenceMatcher& matcher,
+               llama_token token,
+               std::string& released) {
+    std::string_view piece;
+    {
+        PhaseTimer timer(session->metrics, MetricPhase::Detokenize);
+        piece = pieces.piece(token);
+    }
+    PhaseTimer timer(session->metrics, MetricPhase::StopMatch);
+    return matcher.feed(piece, released);
+}
+
+// Samples logits row `index`, recorded as one Sample event.  With a grammar the sampler first
+// picks a token unconstrained and the grammar checks only that one candidate; the full-vocabulary
+// grammar pass, which matches every token's text against the grammar stacks, runs only when the
+// pick is rejected.  Once the model follows the format that is the rare case.
+llama_token sampleToken(LlamaSession* session, CompletionSampler& sampler, int32_t index) {
+    PhaseTimer timer(session->metrics, MetricPhase::Sample);
+    const float* logits = llama_get_logits_ith(session->context, index);
+    if (!logits) {
+        throw std::runtime_error("Logit token tidak tersedia.");
+    }
+    const auto n_vocab = static_cast<size_t>(llama_vocab_n_tokens(llama_model_get_vocab(session->model)));
+    const llama_token token = sampler.sampler->sample(logits, n_vocab);
+    if (!sampler.grammar) {
+        return token;
+    }
+
+    llama_token_data pick{token, 1.0f, 0.0f};
+    llama_token_data_array single{&pick, 1, -1, false};
+    llama_sampler_apply(sampler.grammar.get(), &single);
+    if (!std::isinf(pick.logit)) {
+        return token;
+    }
+
+    sampler.candidates.resize(n_vocab);
+    for (size_t i = 0; i < n_vocab; ++i) {
+        sampler.candidates[i] = {static_cast<llama_token>(i), logits[i], 0.0f};
+    }
+    llama_token_data_array candidates{sampler.candidates.data(), n_vocab, -1, false};
+    llama_sampler_apply(sampler.grammar.get(), &candidates);
+    // The grammar only masks tokens (logit -inf) and keeps the array in token order.
+    sampler.masked_logits.resize(n_vocab);
+    for (size_t i = 0; i < n_vocab; ++i) {
+        sampler.masked_logits[i] = sampler.candidates[i].logit;
+    }
+    return sampler.sampler->sample(sampler.masked_logits.data(), n_vocab);
+}
+
+}  // namespace
+
+// Continuous batching engine for concurrent completions on one llama_context.  Every request gets
+// its own KV sequence (1..n_seq_max-1; sequence 0 stays reserved for the prefix-cached
+// interactive path) and sampler.  A worker thread builds one llama_batch per step holding
+// the next token of every generating sequence plus as many pending prompt tokens as fit in
+// n_batch, so requests join and retire between steps without stalling each other.  Callers block
+// in submit() / submitBulk() and receive their output on their own thread, which keeps JNI
+// callbacks on the thread that owns the JNIEnv.
+//
+// Bulk jobs add one prefill-only request for their shared prefix.  Once it is decoded, each item
+// copies that sequence into its own with llama_memory_seq_cp and prefills only its suffix; the
+// prefix sequence is retired after the last copy.
+class BatchEngine {
+public:
+    explicit BatchEngine(LlamaSession* session)
+            : session_(session),
+              batch_(llama_batch_init(static_cast<int32_t>(llama_n_batch(session->context)), 0, 1)) {
+        const int32_t n_seq = static_cast<int32_t>(llama_n_seq_max(session->context));
+        for (llama_seq_id seq_id = n_seq - 1; seq_id >= 1; --seq_id) {
+            free_seq_ids_.push_back(seq_id);
+        }
+        worker_ = std::thread(&BatchEngine::run, this);
+    }
+
+    ~BatchEngine() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stopping_ = true;
+        }
+        work_cv_.notify_all();
+        if (worker_.joinable()) {
+            worker_.join();
+        }
+        llama_batch_free(batch_);
+    }
+
+    BatchEngine(const BatchEngine&) = delete;
+    BatchEngine& operator=(const BatchEngine&) = delete;
+
+    std::string submit(const std::string& prompt,
+                       const SamplingNativeOptions& options,
+                       const std::function<void(const std::string&)>& on_token) {
+        if (options.max_tokens <= 0) {
+            return std::string();
+        }
+
+        auto request = std::make_shared<Request>();
+        request->prompt = tokenizeCompletionPrompt(session_, prompt);
+        ensureFitsContext(session_, request->prompt.size(), options.max_tokens);
+        request->options = options;
+        request->sampler = buildCompletionSampler(session_, options);
+        request->stop_matcher = std::make_unique<StopSequenceMatcher>(options.stop_sequences);
+        // Make sure the worker never has to build the detokenization table under the decode lock.
+        tokenPieces(session_);
+        acceptPromptTokens(request->sampler, request->prompt);
+        request->completion.reserve(static_cast<size_t>(options.max_tokens) * 4);
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stopping_) {
+            throw std::runtime_error("Batch engine sudah dihentikan.");
+        }
+        waiting_.push_back(request);
+        work_cv_.notify_one();
+
+        while (true) {
+            output_cv_.wait(lock, [&]() { return request->finished || !request->pending.empty(); });
+            std::vector<std::string> pieces;
+            pieces.swap(request->pending);
+            const bool finished = request->finished;
+
+            if (on_token && !pieces.empty()) {
+                lock.unlock();
+                try {
+                    for (const auto& piece : pieces) {
+                        PhaseTimer timer(session_->metrics, MetricPhase::Callback);
+                        on_token(piece);
+                    }
+                } catch (...) {
+                    lock.lock();
+                    request->cancelled = true;
+                    throw;
+                }
+                lock.lock();
+            }
+            if (finished) {
+                break;
+            }
+        }
+
+        if (!request->error.empty()) {
+            throw std::runtime_error(request->error);
+        }
+        return request->completion;
+    }
+
+    void submitBulk(const std::string& prefix,
+                    const std::vector<std::string>& inputs,
+                    const SamplingNativeOptions& options,
+                    const BulkItemCallback& on_item) {
+        if (inputs.empty() || options.max_tokens <= 0) {
+            return;
+        }
+
+        auto job = std::make_shared<BulkJob>();
+        std::vector<llama_token> prefix_tokens = tokenizeCompletionPrompt(session_, prefix);
+        // The last prefix token is decoded by every item, so each item has at least one token of
+        // its own to produce logits from, even with an empty input.
+        const llama_token prefix_tail = prefix_tokens.back();
+        prefix_tokens.pop_back();
+        job->prefix_tokens = prefix_tokens.size();
+        tokenPieces(session_);
+
+        std::vector<RequestPtr> items;
+        items.reserve(inputs.size());
+        for (size_t i = 0; i < inputs.size(); ++i) {
+            auto request = std::make_shared<Request>();
+            request->job = job;
+            request->job_index = i;
+            request->options = options;
+            // Sampling options are shared, so an invalid grammar fails the whole job.
+            request->sampler = buildCompletionSampler(session_, options);
+            // A malformed or oversized input only fails its own item.
+            try {
+                std::vector<llama_token> suffix;
+                {
+                    PhaseTimer timer(session_->metrics, MetricPhase::Tokenize);
+                    suffix = tokenizePrompt(session_->model, inputs[i], false);
+                }
+                request->prompt.reserve(suffix.size() + 1);
+                request->prompt.push_back(prefix_tail);
+                request->prompt.insert(request->prompt.end(), suffix.begin(), suffix.end());
+                ensureFitsContext(session_, prefix_tokens.size() + request->prompt.size(), options.max_tokens);
+            } catch (const std::exception& ex) {
+                request->error = ex.what();
+            }
+            if (!request->error.empty()) {
+                request->finished = true;
+                request->sampler = CompletionSampler();
+                items.push_back(std::move(request));
+                continue;
+            }
+            acceptPromptTokens(request->sampler, prefix_tokens);
+            acceptPromptTokens(request->sampler, request->prompt);
+            request->stop_matcher = std::make_unique<StopSequenceMatcher>(options.stop_sequences);
+            request->needs_prefix = !prefix_tokens.empty();
+            request->completion.reserve(static_cast<size_t>(options.max_tokens) * 4);
+            items.push_back(std::move(request));
+        }
+
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (stopping_) {
+            throw std::runtime_error("Batch engine sudah dihentikan.");
+        }
+        RequestPtr prefix_request;
+        if (prefix_tokens.empty()) {
+            job->prefix_ready = true;
+        } else {
+            prefix_request = std::make_shared<Request>();
+            prefix_request->prompt = std::move(prefix_tokens);
+            prefix_request->job = job;
+            prefix_request->prefill_only = true;
+            job->prefix = prefix_request;
+            waiting_.push_back(prefix_request);
+        }
+        for (const RequestPtr& request : items) {
+            if (request->finished) {
+                job->finished.push_back(request);
+                continue;
+            }
+            if (request->needs_prefix) {
+                ++job->pending_copies;
+            }
+            waiting_.push_back(request);
+        }
+        if (prefix_request && job->pending_copies == 0) {
+            finishLocked(prefix_request, std::string());
+        }
+        work_cv_.notify_one();
+
+        auto cancel_items = [&]() {
+            job->abandoned = true;
+            job->finished.clear();
+            for (const RequestPtr& request : items) {
+                request->cancelled = true;
+            }
+            work_cv_.notify_one();
+        };
+        size_t delivered = 0;
+        while (delivered < items.size()) {
+            output_cv_.wait(lock, [&]() { return !job->finished.empty(); });
+            std::deque<RequestPtr> finished;
+            finished.swap(job->finished);
+            lock.unlock();
+
+            bool keep_going = true;
+            try {
+                for (const RequestPtr& request : finished) {
+                    ++delivered;
+                    BulkItemResult result;
+                    result.index = request->job_index;
+                    result.completion = std::move(request->completion);
+                    result.error = request->error;
+                    result.stats.prompt_tokens = static_cast<int64_t>(job->prefix_tokens + request->prompt.size());
+                    result.stats.reused_tokens = request->error.empty() ? static_cast<int64_t>(job->prefix_tokens) : 0;
+                    result.stats.generated_tokens = request->generated;
+                    result.stats.cancelled = request->cancelled ? 1 : 0;
+                    PhaseTimer timer(session_->metrics, MetricPhase::Callback);
+                    if (!on_item(result)) {
+                        keep_going = false;
+                        break;
+                    }
+                }
+            } catch (...) {
+                lock.lock();
+                cancel_items();
+                throw;
+            }
+            lock.lock();
+            if (!keep_going) {
+                cancel_items();
+                return;
+            }
+        }
+    }
+
+private:
+    struct BulkJob;
+
+    struct Request {
+        std::vector<llama_token> prompt;
+        SamplingNativeOptions options;
+        CompletionSampler sampler;
+        std::unique_ptr<StopSequenceMatcher> stop_matcher;
+        // Bulk job membership; null for submit() requests.  The job's prefix request is
+        // prefill-only: it never samples and stays active until every item has copied it.
+        std::shared_ptr<BulkJob> job;
+        size_t job_index = 0;
+        bool prefill_only = false;
+        // Copy the job prefix into seq_id before prefilling `prompt`.
+        bool needs_prefix = false;
+
+        // Worker-only state.
+        llama_seq_id seq_id = -1;
+        size_t prompt_cursor = 0;
+        llama_pos n_past = 0;
+        int32_t logits_index = -1;
+        bool has_next = false;
+        llama_token next = LLAMA_TOKEN_NULL;
+        int generated = 0;
+
+        // Shared with the submitting thread, guarded by BatchEngine::mutex_.
+        std::string completion;
+        std::vector<std::string> pending;
+        std::string error;
+        bool finished = false;
+        bool cancelled = false;
+    };
+    using RequestPtr = std::shared_ptr<Request>;
+
+    // Shared state of one submitBulk call, guarded by mutex_.
+    struct BulkJob {
+        size_t prefix_tokens = 0;
+        llama_seq_id prefix_seq = -1;
+        bool prefix_ready = false;
+        // Set when the prefix request finished before it was decoded; waiting items fail with it.
+        bool prefix_failed = false;
+        std::string prefix_error;
+        // Items that have not copied the prefix yet; the prefix is retired when this reaches 0.
+        size_t pending_copies = 0;
+        std::weak_ptr<Request> prefix;
+        // Finished items not yet handed to the caller; no longer filled once the caller gave up.
+        std::deque<RequestPtr> finished;
+        bool abandoned = false;
+    };
+
+    void run() {
+        std::vector<RequestPtr> active;
+        std::vector<llama_seq_id> retired;
+        while (true) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                work_cv_.wait(lock, [&]() { return stopping_ || !waiting_.empty() || !active.empty(); });
+                if (stopping_) {
+                    for (auto& request : active) {
+                        finishLocked(request, "Session ditutup sebelum permintaan selesai.");
+                    }
+                    for (auto& request : waiting_) {
+                        finishLocked(request, "Session ditutup sebelum permintaan selesai.");
+                    }
+                    waiting_.clear();
+                    return;
+                }
+                collectFinishedLocked(active, retired);
+            }
+
+            if (!retired.empty()) {
+                {
+                    std::lock_guard<std::mutex> decode_lock(session_->decode_mutex);
+                    llama_memory_t memory = llama_get_memory(session_->context);
+                    for (llama_seq_id seq_id : retired) {
+                        llama_memory_seq_rm(memory, seq_id, -1, -1);
+                    }
+                }
+                std::lock_guard<std::mutex> lock(mutex_);
+                free_seq_ids_.insert(free_seq_ids_.end(), retired.begin(), retired.end());
+                retired.clear();
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                admitWaitingLocked(active);
+            }
+
+            if (!active.empty()) {
+                step(active);
+            }
+        }
+    }
+
+    // Moves waiting requests that can start into `active`.  submit() requests go first; bulk items
+    // wait for their job's prefix to be decoded, and a bulk prefix only starts while another
+    // sequence stays free for its items, so concurrent jobs cannot starve each other of sequences.
+    void admitWaitingLocked(std::vector<RequestPtr>& active) {
+        for (const bool bulk : {false, true}) {
+            for (auto it = waiting_.begin(); it != waiting_.end();) {
+                const RequestPtr request = *it;
+                if (static_cast<bool>(request->job) != bulk) {
+                    ++it;
+                    continue;
+                }
+                const bool prefix_failed = bulk && !request->prefill_only && request->job->prefix_failed;
+                if (request->cancelled || request->finished || prefix_failed) {
+                    finishLocked(request, prefix_failed ? request->job->prefix_error : std::string());
+                    if (request->needs_prefix) {
+                        request->needs_prefix = false;
+                        releasePrefixCopyLocked(request->job);
+                    }
+                    request->sampler = CompletionSampler();
+                    it = waiting_.erase(it);
+                    continue;
+                }
+                const size_t needed_seqs = request->prefill_only ? 2 : 1;
+                const bool prefix_pending = bulk && !request->prefill_only && !request->job->prefix_ready;
+                if (free_seq_ids_.size() < needed_seqs || prefix_pending) {
+                    ++it;
+                    continue;
+                }
+                request->seq_id = free_seq_ids_.back();
+                free_seq_ids_.pop_back();
+                if (request->prefill_only) {
+                    request->job->prefix_seq = request->seq_id;
+                }
+                active.push_back(request);
+                it = waiting_.erase(it);
+            }
+        }
+    }
+
+    // One item of `job` no longer needs the prefix sequence.
+    void releasePrefixCopyLocked(const std::shared_ptr<BulkJob>& job) {
+        if (--job->pending_copies > 0) {
+            return;
+        }
+        if (RequestPtr prefix = job->prefix.lock()) {
+            finishLocked(prefix, std::string());
+        }
+    }
+
+    void step(std::vector<RequestPtr>& active) {
+        std::lock_guard<std::mutex> decode_lock(session_->decode_mutex);
+        llama_set_n_threads(session_->context, session_->thread_count, session_->thread_count_batch);
+
+        // Bulk items admitted since the last step start from a copy of their job's prefix.
+        llama_memory_t memory = llama_get_memory(session_->context);
+        for (auto& request : active) {
+            if (!request->needs_prefix) {
+                continue;
+            }
+            request->needs_prefix = false;
+            llama_memory_seq_cp(memory, request->job->prefix_seq, request->seq_id, -1, -1);
+            request->n_past = static_cast<llama_pos>(request->job->prefix_tokens);
+            std::lock_guard<std::mutex> lock(mutex_);
+            releasePrefixCopyLocked(request->job);
+        }
+
+        const int32_t capacity = static_cast<int32_t>(llama_n_batch(session_->context));
+        batch_.n_tokens = 0;
+        auto add = [&](llama_token token, llama_pos pos, llama_seq_id seq_id, bool logits) {
+            const int32_t index = batch_.n_tokens++;
+            batch_.token[index] = token;
+            batch_.pos[index] = pos;
+            batch_.n_seq_id[index] = 1;
+            batch_.seq_id[index][0] = seq_id;
+            batch_.logits[index] = logits ? 1 : 0;
+            return index;
+        };
+
+        // Decode-phase sequences first so generation never starves behind a long prefill.
+        for (auto& request : active) {
+            request->logits_index = -1;
+            if (request->has_next && batch_.n_tokens < capacity) {
+                request->logits_index = add(request->next, request->n_past++, request->seq_id, true);
+                request->has_next = false;
+            }
+        }
+        for (auto& request : active) {
+            while (request->prompt_cursor < request->prompt.size() && batch_.n_tokens < capacity) {
+                const bool last = request->prompt_cursor + 1 == request->prompt.size();
+                const bool wants_logits = last && !request->prefill_only;
+                const int32_t index = add(request->prompt[request->prompt_cursor++],
+                                          request->n_past++,
+                                          request->seq_id,
+                                          wants_logits);
+                if (wants_logits) {
+                    request->logits_index = index;
+                }
+            }
+        }
+        if (batch_.n_tokens == 0) {
+            return;
+        }
+
+        // Steps that carry prompt chunks are booked as prefill, pure one-token-per-request steps
+        // as decode.
+        const MetricPhase phase = batch_.n_tokens > static_cast<int32_t>(active.size()) ? MetricPhase::Prefill
+                                                                                       : MetricPhase::Decode;
+        const auto decode_start = SessionMetrics::Clock::now();
+        const int32_t status = llama_decode(session_->context, batch_);
+        session_->metrics.record(phase, decode_start, SessionMetrics::Clock::now());
+        if (status != 0) {
+            std::ostringstream msg;
+            msg << "Gagal memproses token (status=" << status << ")";
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (auto& request : active) {
+                finishLocked(request, msg.str());
+            }
+            return;
+        }
+
+        const llama_vocab* vocab = llama_model_get_vocab(session_->model);
+        const TokenPieceTable& pieces = tokenPieces(session_);
+        for (auto& request : active) {
+            if (request->prefill_only && request->prompt_cursor == request->prompt.size() &&
+                !request->job->prefix_ready) {
+                std::lock_guard<std::mutex> lock(mutex_);
+                request->job->prefix_ready = true;
+            }
+            if (request->logits_index < 0) {
+                continue;
+            }
+            const llama_token token = sampleToken(session_, request->sampler, request->logits_index);
+            std::lock_guard<std::mutex> lock(mutex_);
+            std::string released;
+            if (llama_vocab_is_eog(vocab, token)) {
+                request->stop_matcher->flush(released);
+                releaseLocked(request, released);
+                finishLocked(request, std::string());
+                continue;
+            }
+
+            if (feedToken(session_, pieces, *request->stop_matcher, token, released)) {
+                releaseLocked(request, released);
+                finishLocked(request, std::string());
+                continue;
+            }
+
+            acceptToken(request->sampler, token);
+            if (++request->generated >= request->options.max_tokens) {
+                request->stop_matcher->flush(released);
+                releaseLocked(request, released);
+                finishLocked(request, std::string());
+                continue;
+            }
+            releaseLocked(request, released);
+            request->next = token;
+            request->has_next = true;
+            output_cv_.notify_all();
+        }
+    }
+
+    void releaseLocked(const RequestPtr& request, std::string& released) {
+        if (released.empty()) {
+            return;
+        }
+        request->completion += released;
+        // Bulk items deliver their text only once finished.
+        if (!request->job) {
+            request->pending.push_back(std::move(released));
+        }
+        released.clear();
+    }
+
+    void finishLocked(const RequestPtr& request, const std::string& error) {
+        if (request->finished) {
+            return;
+        }
+        request->finished = true;
+        request->error = error;
+        if (const auto& job = request->job) {
+            if (!request->prefill_only) {
+                if (!job->abandoned) {
+                    job->finished.push_back(request);
+                }
+            } else if (!job->prefix_ready) {
+                job->prefix_failed = true;
+                job->prefix_error = error.empty() ? "Prefiks bulk tidak selesai diproses." : error;
+            }
+        }
+        output_cv_.notify_all();
+    }
+
+    // Moves the sequence ids of finished or abandoned requests into `retired`.
+    void collectFinishedLocked(std::vector<RequestPtr>& active, std::vector<llama_seq_id>& retired) {
+        for (auto it = active.begin(); it != active.end();) {
+            const RequestPtr& request = *it;
+            if (request->cancelled) {
+                finishLocked(request, std::string());
+            }
+            if (!request->finished) {
+                ++it;
+                continue;
+            }
+            if (request->needs_prefix) {
+                request->needs_prefix = false;
+                releasePrefixCopyLocked(request->job);
+            }
+            if (request->job) {
+                // Finished items may wait a while for the caller; their sampler buffers can go now.
+                request->sampler = CompletionSampler();
+            }
+            retired.push_back(request->seq_id);
+            it = active.erase(it);
+        }
+    }
+
+    LlamaSession* session_;
+    llama_batch batch_;
+    std::mutex mutex_;
+    std::condition_variable work_cv_;
+    std::condition_variable output_cv_;
+    std::deque<RequestPtr> waiting_;
+    std::vector<llama_seq_id> free_seq_ids_;
+    std::thread worker_;
+    bool stopping_ = false;
+};
+
+namespace {
+
+// Decode lock of the interactive path.  While held it marks the completion as the owner of the
+// context's llama_decode calls so the abort callback can stop them mid-graph; batch engine steps
+// that run while it is released are never aborted.
+class InteractiveDecodeLock {
+public:
+    InteractiveDecodeLock(LlamaSession* session, uint64_t request_id)
+        : session_(session), request_id_(request_id), lock_(session->decode_mutex, std::defer_lock) {
+        lock();
+    }
+
+    ~InteractiveDecodeLock() {
+        if (owns_lock()) {
+            unlock();
+        }
+    }
+
+    void lock() {
+        lock_.lock();
+        session_->decoding_request.store(request_id_, std::memory_order_release);
+    }
+
+    void unlock() {
+        session_->decoding_request.store(0, std::memory_order_release);
+        lock_.unlock();
+    }
+
+    bool owns_lock() const { return lock_.owns_lock(); }
+
+private:
+    LlamaSession* session_;
+    uint64_t request_id_;
+    std::unique_lock<std::mutex> lock_;
+};
+
+// Speculative generation loop.  The draft proposes tokens after the pending (sampled but not yet
+// evaluated) token, the target decodes pending + proposal in one batch, and the target's own
+// sampler chain is then run position by position.  A draft token is kept only when the target
+// samples exactly that token, so the sampler sees the same logits and consumes its RNG once per
+// emitted token, just like the plain loop; the output therefore matches plain decoding for a
+// fixed seed.  Rejected positions are dropped from the KV cache before the next round.
+void generateSpeculative(LlamaSession* session,
+                         CompletionSampler& sampler,
+                         const SamplingNativeOptions& options,
+                         const std::optional<size_t>& shift_sink,
+                         const std::function<void(const std::string&)>& on_token,
+                         InteractiveDecodeLock& decode_lock,
+                         std::string& completion) {
+    DraftModel& draft = *session->draft;
+    CompletionStats& stats = session->last_stats;
+    stats.draft_max_tokens = draft.max_tokens;
+
+    const llama_vocab* vocab = llama_model_get_vocab(session->model);
+    const TokenPieceTable& pieces = tokenPieces(session);
+    llama_memory_t memory = llama_get_memory(session->context);
+    const int32_t capacity = std::min(session->context_size, sequenceCapacity(session));
+    StopSequenceMatcher stop_matcher(options.stop_sequences);
+    // Text released by the stop matcher but not yet forwarded to on_token.
+    std::string released;
+    int generated = 0;
+
+    // Returns false when `token` ends generation instead of becoming part of the output.
+    auto accept_token = [&](llama_token token) {
+        if (llama_vocab_is_eog(vocab, token)) {
+            return false;
+        }
+        if (feedToken(session, pieces, stop_matcher, token, released)) {
+            return false;
+        }
+        acceptToken(sampler, token);
+        ++generated;
+        return true;
+    };
+    auto flush_pieces = [&]() {
+        if (released.empty()) {
+            return;
+        }
+        completion += released;
+        decode_lock.unlock();
+        if (on_token) {
+            PhaseTimer timer(session->metrics, MetricPhase::Callback);
+            on_token(released);
+        }
+        released.clear();
+        decode_lock.lock();
+    };
+
+    llama_token pending = sampleToken(session, sampler, -1);
+    bool done = !accept_token(pending);
+    flush_pieces();
+
+    while (!done && generated < options.max_tokens) {
+        if (interactiveCancelRequested(session)) {
+            stats.cancelled = 1;
+            break;
+        }
+        if (shift_sink && session->evaluated_tokens.size() + 1 + static_cast<size_t>(draft.max_tokens) >
+                                  static_cast<size_t>(capacity)) {
+            shiftSessionContext(session, *shift_sink);
+        }
+        const int32_t room = capacity - static_cast<int32_t>(session->evaluated_tokens.size()) - 1;
+        const int32_t n_draft = std::max<int32_t>(
+                0, std::min({draft.max_tokens, options.max_tokens - generated, room}));
+        const std::vector<llama_token> proposal =
+                proposeDraftTokens(draft, session->evaluated_tokens, pending, n_draft);
+
+        llama_batch& batch = draft.verify_batch;
+        const llama_pos base_pos = static_cast<llama_pos>(session->evaluated_tokens.size());
+        batch.n_tokens = static_cast<int32_t>(proposal.size()) + 1;
+        for (int32_t i = 0; i < batch.n_tokens; ++i) {
+            batch.token[i] = i == 0 ? pending : proposal[static_cast<size_t>(i - 1)];
+            batch.pos[i] = base_pos + i;
+            batch.n_seq_id[i] = 1;
+            batch.seq_id[i][0] = 0;
+            batch.logits[i] = 1;
+        }
+
+        const auto verify_start = SessionMetrics::Clock::now();
+        const int32_t status = llama_decode(session->context, batch);
+        session->metrics.record(MetricPhase::Decode, verify_start, SessionMetrics::Clock::now());
+        if (status != 0) {
+            llama_memory_seq_rm(memory, 0, base_pos, -1);
+            if (status == 2) {
+                stats.cancelled = 1;
+                break;
+            }
+            std::ostringstream msg;
+            msg << "Gagal memverifikasi token draft (status=" << status << ")";
+            throw std::runtime_error(msg.str());
+        }
+        session->evaluated_tokens.push_back(pending);
+        session->evaluated_tokens.insert(session->evaluated_tokens.end(), proposal.begin(), proposal.end());
+        ++stats.draft_steps;
+        stats.draft_proposed += static_cast<int64_t>(proposal.size());
+
+        size_t accepted = 0;
+        for (size_t i = 0; i <= proposal.size(); ++i) {
+            const llama_token token = sampleToken(session, sampler, static_cast<int32_t>(i));
+            const bool matches_draft = i < proposal.size() && token == proposal[i];
+            if (!accept_token(token)) {
+                done = true;
+                break;
+            }
+            if (matches_draft) {
+                ++accepted;
+            }
+            if (generated >= options.max_tokens) {
+                done = true;
+                break;
+            }
+            if (!matches_draft) {
+                pending = token;
+                break;
+            }
+        }
+
+        // Keep the pending token and the accepted drafts; everything after them was evaluated
+        // for a continuation the target rejected.
+        const size_t keep = static_cast<size_t>(base_pos) + 1 + accepted;
+        llama_memory_seq_rm(memory, 0, static_cast<llama_pos>(keep), -1);
+        session->evaluated_tokens.resize(keep);
+        stats.draft_accepted += static_cast<int64_t>(accepted);
+        flush_pieces();
+    }
+
+    stop_matcher.flush(released);
+    flush_pieces();
+    stats.generated_tokens = generated;
+}
+
+// The config a session runs with after auto-tuning, and the context size and thread counts its
+// contexts are created with.
+struct RuntimeSettings {
+    RuntimeNativeConfig config;
+    int context_size = 0;
+    int thread_count = 0;
+    int thread_count_batch = 0;
+};
+
+// Runs the auto-tuner for the fields it owns (rewriting the returned config) and derives the
+// thread counts the context is created with.  Touches no session state, so a reconfigure can tune
+// while completions keep running and publish the result under the decode lock.
+RuntimeSettings resolveRuntimeSettings(llama_model* model,
+                                       const std::string& model_path,
+                                       const RuntimeNativeConfig& requested_config) {
+    RuntimeSettings settings;
+    settings.config = requested_config;
+    const RuntimeNativeConfig& config = settings.config;
+    if (config.auto_tune != 0) {
+        applyRuntimeTuning(model, model_path, settings.config);
+    }
+    settings.context_size = config.context_size;
+    settings.thread_count = config.thread_count;
+    settings.thread_count_batch = config.has_thread_count_batch ? config.thread_count_batch : config.thread_count;
+    return settings;
+}
+
+void publishRuntimeSettings(LlamaSession* session, const RuntimeSettings& settings) {
+    session->config = settings.config;
+    session->context_size = settings.context_size;
+    session->thread_count = settings.thread_count;
+    session->thread_count_batch = settings.thread_count_batch;
+}
+
+bool isKvCacheType(ggml_type type) {
+    switch (type) {
+        case GGML_TYPE_F32:
+        case GGML_TYPE_F16:
+        case GGML_TYPE_BF16:
+        case GGML_TYPE_Q8_0:
+        case GGML_TYPE_Q5_1:
+        case GGML_TYPE_Q5_0:
+        case GGML_TYPE_Q4_1:
+        case GGML_TYPE_Q4_0:
+        case GGML_TYPE_IQ4_NL:
+            return true;
+        default:
+            return false;
+    }
+}
+
+// Rejects what llama_init_from_model would only report as a null context.
+void validateKvCacheTypes(const RuntimeNativeConfig& config) {
+    if ((config.has_type_k && !isKvCacheType(config.type_k)) ||
+        (config.has_type_v && !isKvCacheType(config.type_v))) {
+        throw std::runtime_error("Tipe cache KV tidak didukung (gunakan f32, f16, bf16, q8_0, q5_1, q5_0, "
+                                 "q4_1, q4_0, atau iq4_nl).");
+    }
+    if (config.has_type_v && ggml_is_quantized(config.type_v) && config.has_flash_attention &&
+        config.flash_attention == 0) {
+        throw std::runtime_error("Cache V terkuantisasi membutuhkan flash attention (flash_attn 1 atau -1).");
+    }
+}
+
+int32_t batchSizeFor(const RuntimeNativeConfig& config, int32_t context_size) {
+    return config.has_batch_size ? std::max<int32_t>(1, config.batch_size) : std::min(context_size, 512);
+}
+
+llama_context_params contextParamsFor(const RuntimeSettings& settings) {
+    const RuntimeNativeConfig& config = settings.config;
+    llama_context_params ctx_params = llama_context_default_params();
+    ctx_params.n_ctx = settings.context_size;
+    ctx_params.n_batch = batchSizeFor(config, settings.context_size);
+    if (config.has_ubatch_size) {
+        ctx_params.n_ubatch = std::max<int32_t>(1, config.ubatch_size);
+    }
+    if (config.has_seq_max) {
+        ctx_params.n_seq_max = std::max<int32_t>(1, config.seq_max);
+    }
+    ctx_params.n_threads = settings.thread_count;
+    ctx_params.n_threads_batch = settings.thread_count_batch;
+    if (config.has_flash_attention) {
+        ctx_params.flash_attn_type = static_cast<llama_flash_attn_type>(config.flash_attention);
+    }
+    if (config.has_rope_freq_base) {
+        ctx_params.rope_freq_base = config.rope_freq_base;
+    }
+    if (config.has_rope_freq_scale) {
+        ctx_params.rope_freq_scale = config.rope_freq_scale;
+    }
+    if (config.has_offload_kqv) {
+        ctx_params.offload_kqv = config.offload_kqv;
+    }
+    if (config.has_no_perf) {
+        ctx_params.no_perf = config.no_perf;
+    } else {
+        ctx_params.no_perf = true;
+    }
+    if (config.has_embeddings) {
+        ctx_params.embeddings = config.embeddings;
+    }
+    if (config.has_kv_unified) {
+        ctx_params.kv_unified = config.kv_unified;
+    }
+    if (config.has_type_k) {
+        ctx_params.type_k = config.type_k;
+    }
+    if (config.has_type_v) {
+        ctx_params.type_v = config.type_v;
+    }
+    return ctx_params;
+}
+
+// True when contexts built from `a` and `b` differ at most in their thread counts, which
+// llama_set_n_threads can change in place.
+bool sameContextShape(const llama_context_params& a, const llama_context_params& b) {
+    return a.n_ctx == b.n_ctx && a.n_batch == b.n_batch && a.n_ubatch == b.n_ubatch &&
+           a.n_seq_max == b.n_seq_max && a.flash_attn_type == b.flash_attn_type &&
+           a.rope_freq_base == b.rope_freq_base && a.rope_freq_scale == b.rope_freq_scale &&
+           a.offload_kqv == b.offload_kqv && a.no_perf == b.no_perf && a.embeddings == b.embeddings &&
+           a.kv_unified == b.kv_unified && a.type_k == b.type_k && a.type_v == b.type_v;
+}
+
+// Memory planning.  llama.cpp sizes the KV cache in whole 256-cell blocks and reserves its compute
+// graph for a full ubatch against the whole cache, so both are estimated at that worst case.
+constexpr int32_t kKvCellPadding = 256;
+constexpr int32_t kDefaultUbatchSize = 512;
+constexpr int32_t kUnknownMaxContext = 131072;
+// Graph metadata, vocabulary and detokenization tables, allocator slack.
+constexpr int64_t kSessionOverheadBytes = 48LL * 1024 * 1024;
+
+int64_t rowBytes(ggml_type type, int64_t elements) {
+    const int64_t block = std::max<int64_t>(1, ggml_blck_size(type));
+    return (elements + block - 1) / block * static_cast<int64_t>(ggml_type_size(type));
+}
+
+// Memory of one model's weights, KV cache and compute buffers at `context_size` cells.
+MemoryPlan estimateModelMemory(const ModelInfo& info,
+                               const RuntimeNativeConfig& config,
+                               int32_t context_size,
+                               int32_t seq_max) {
+    const int64_t cells = (static_cast<int64_t>(context_size) + kKvCellPadding - 1) / kKvCellPadding * kKvCellPadding;
+    const int64_t kv_width = static_cast<int64_t>(info.head_count_kv);
+    const int64_t per_cell = info.layer_count * (rowBytes(config.has_type_k ? config.type_k : GGML_TYPE_F16,
+                                                          kv_width * info.key_length) +
+                                                 rowBytes(config.has_type_v ? config.type_v : GGML_TYPE_F16,
+                                                          kv_width * info.value_length));
+
+    const int64_t n_batch = batchSizeFor(config, context_size);
+    const int64_t n_ubatch = std::min<int64_t>(config.has_ubatch_size ? std::max(1, config.ubatch_size)
+                                                                      : kDefaultUbatchSize,
+                                               n_batch);
+    const int64_t n_embd = info.embedding_length;
+    const int64_t n_ff = info.feed_forward_length > 0 ? info.feed_forward_length : 4 * n_embd;
+    const int64_t n_vocab = info.vocab_size;
+    const bool flash_attention = !config.has_flash_attention || config.flash_attention != 0;
+    // Without flash attention the f32 KQ matrix spans the whole cache for every head.
+    const int64_t attention = flash_attention ? n_ubatch * info.head_count * info.value_length * 4
+                                              : n_ubatch * info.head_count * cells * 4;
+    const int64_t feed_forward = n_ubatch * n_ff * 4 * 2;
+    const int64_t residual = n_ubatch * n_embd * 4 * 4;
+    const int64_t logits = n_ubatch * n_vocab * 4 + static_cast<int64_t>(std::max(1, seq_max)) * n_vocab * 4;
+
+    MemoryPlan plan;
+    plan.weight_bytes = info.weight_bytes;
+    plan.kv_bytes = cells * per_cell;
+    plan.compute_bytes = logits + std::max(attention, feed_forward) + residual;
+    plan.total_bytes = plan.weight_bytes + plan.kv_bytes + plan.compute_bytes;
+    return plan;
+}
+
+MemoryPlan estimateSessionMemory(const ModelInfo& target,
+                                 const ModelInfo* draft,
+                                 const RuntimeNativeConfig& config,
+                                 int32_t context_size) {
+    MemoryPlan plan = estimateModelMemory(target, config, context_size, config.has_seq_max ? config.seq_max : 1);
+    if (draft) {
+        // The draft context copies the target's parameters with a single sequence.
+        const MemoryPlan draft_plan = estimateModelMemory(*draft, config, context_size, 1);
+        plan.weight_bytes += draft_plan.weight_bytes;
+        plan.kv_bytes += draft_plan.kv_bytes;
+        plan.compute_bytes += draft_plan.compute_bytes;
+    }
+    plan.compute_bytes += kSessionOverheadBytes;
+    plan.total_bytes = plan.weight_bytes + plan.kv_bytes + plan.compute_bytes;
+    return plan;
+}
+
+// Dedicated embedding context: every sequence in one packed batch shares a unified KV cache of
+// kEmbeddingBatchTokens cells, and the whole batch fits one ubatch so non-causal encoders see each
+// text in a single pass.
+constexpr int32_t kEmbeddingBatchTokens = 1024;
+constexpr int32_t kEmbeddingMaxSequences = 64;
+
+llama_context* embeddingContext(LlamaSession* session) {
+    if (session->embedding_context) {
+        return session->embedding_context;
+    }
+    llama_context_params params = llama_context_default_params();
+    params.n_ctx = kEmbeddingBatchTokens;
+    params.n_batch = kEmbeddingBatchTokens;
+    params.n_ubatch = kEmbeddingBatchTokens;
+    params.n_seq_max = kEmbeddingMaxSequences;
+    params.kv_unified = true;
+    params.n_threads = session->thread_count;
+    params.n_threads_batch = session->thread_count_batch;
+    params.embeddings = true;
+    // Pooling happens in embedTexts, so the context keeps one output row per token.
+    params.pooling_type = LLAMA_POOLING_TYPE_NONE;
+    params.no_perf = true;
+    session->embedding_context = llama_init_from_model(session->model, params);
+    if (!session->embedding_context) {
+        throw std::runtime_error("Gagal membuat konteks embedding.");
+    }
+    return session->embedding_context;
+}
+
+void freeEmbeddingContext(LlamaSession* session) {
+    std::lock_guard<std::mutex> lock(session->embedding_mutex);
+    if (session->embedding_context) {
+        llama_free(session->embedding_context);
+        session->embedding_context = nullptr;
+    }
+}
+
+// Creates the session's main context (and draft, when `config` names one) from `ctx_params`.  On
+// failure nothing is left behind: session->context is null and session->draft empty.
+void buildSessionContext(LlamaSession* session,
+                         const RuntimeNativeConfig& config,
+                         const llama_context_params& ctx_params) {
+    ContextPtr context(llama_init_from_model(session->model, ctx_params), &llama_free);
+    if (!context) {
+        throw std::runtime_error("Gagal membuat konteks llama.");
+    }
+    std::unique_ptr<DraftModel> draft;
+    if (!config.draft_model_path.empty()) {
+        draft = loadDraftModel(session, config, ctx_params);
+    }
+    llama_set_abort_callback(context.get(), abortCancelledDecode, session);
+    session->context = context.release();
+    session->draft = std::move(draft);
+    session->context_params = ctx_params;
+}
+
+// Decodes the texts packed into `batch` (sequence s holds texts[first + s]) and writes their
+// pooled, optionally normalised vectors to `out`, n_embd floats per text.
+void decodeEmbeddingBatch(LlamaSession* session,
+                          llama_context* context,
+                          llama_batch& batch,
+                          const std::vector<int32_t>& lengths,
+                          EmbeddingPooling pooling,
+                          bool normalize,
+                          float* out) {
+    if (llama_memory_t memory = llama_get_memory(context)) {
+        llama_memory_clear(memory, true);
+    }
+
+    const auto decode_start = SessionMetrics::Clock::now();
+    const int32_t status = llama_decode(context, batch);
+    session->metrics.record(MetricPhase::Embed, decode_start, SessionMetrics::Clock::now());
+    if (status != 0) {
+        std::ostringstream msg;
+        msg << "Gagal menghitung embedding (status=" << status << ")";
+        throw std::runtime_error(msg.str());
+    }
+
+    const int32_t n_embd = llama_model_n_embd(session->model);
+    int32_t index = 0;
+    for (size_t seq = 0; seq < lengths.size(); ++seq) {
+        float* vector = out + seq * static_cast<size_t>(n_embd);
+        std::fill(vector, vector + n_embd, 0.0f);
+        const int32_t length = lengths[seq];
+        for (int32_t i = 0; i < length; ++i, ++index) {
+            if (!batch.logits[index]) {
+                continue;
+            }
+            const float* row = llama_get_embeddings_ith(context, index);
+            if (!row) {
+                throw std::runtime_error("Embedding token tidak tersedia.");
+            }
+            for (int32_t d = 0; d < n_embd; ++d) {
+                vector[d] += row[d];
+            }
+        }
+        if (pooling == EmbeddingPooling::Mean && length > 0) {
+            const float scale = 1.0f / static_cast<float>(length);
+            for (int32_t d = 0; d < n_embd; ++d) {
+                vector[d] *= scale;
+            }
+        }
+        if (normalize) {
+            double norm = 0.0;
+            for (int32_t d = 0; d < n_embd; ++d) {
+                norm += static_cast<double>(vector[d]) * vector[d];
+            }
+            if (norm > 0.0) {
+                const auto scale = static_cast<float>(1.0 / std::sqrt(norm));
+                for (int32_t d = 0; d < n_embd; ++d) {
+                    vector[d] *= scale;
+                }
+            }
+        }
+    }
+}
+
+}  // namespace
+
+RuntimeNativeConfig makeDefaultRuntimeConfig(int thread_count, int context_size) {
+    RuntimeNativeConfig config;
+    config.thread_count = thread_count;
+    config.context_size = context_size;
+    return config;
+}
+
+std::unique_ptr<LlamaSession> createSession(const std::string& model_path,
+                                            const RuntimeNativeConfig& requested_config,
+                                            const LoadProgressCallback& on_progress) {
+    if (model_path.empty() || requested_config.thread_count <= 0 || requested_config.context_size <= 0) {
+        throw std::runtime_error("Parameter inisialisasi tidak valid.");
+    }
+    validateKvCacheTypes(requested_config);
+
+    auto session = std::make_unique<LlamaSession>();
+    session->model_path = model_path;
+    const RuntimeNativeConfig& config = requested_config;
+
+    retainBackend();
+
+    const bool prefetch = config.has_prefetch ? config.prefetch : true;
+    try {
+        session->shared_model = acquireModel(session->model_path, modelParamsFor(config), prefetch, on_progress);
+    } catch (...) {
+        releaseBackend();
+        throw;
+    }
+    session->model = session->shared_model->model;
+
+    // Auto-tuning rewrites the thread and batch fields of the session's copy of the config.
+    const RuntimeSettings settings = resolveRuntimeSettings(session->model, model_path, requested_config);
+    publishRuntimeSettings(session.get(), settings);
+    const llama_context_params ctx_params = contextParamsFor(settings);
+
+    try {
+        buildSessionContext(session.get(), settings.config, ctx_params);
+    } catch (...) {
+        session->model = nullptr;
+        session->shared_model.reset();
+        releaseBackend();
+        throw;
+    }
+
+    logPrint(LogLevel::Info,
+             "Session siap. Model=%s, threads=%d, ctx=%d",
+             session->model_path.c_str(),
+             session->thread_count,
+             session->context_size);
+
+    return session;
+}
+
+void releaseSession(std::unique_ptr<LlamaSession> session) {
+    if (!session) {
+        return;
+    }
+
+    // Stop the batch worker before the context it decodes into goes away.
+    session->batch_engine.reset();
+    session->draft.reset();
+    session->token_pieces.reset();
+    freeEmbeddingContext(session.get());
+
+    if (session->context) {
+        llama_free(session->context);
+        session->context = nullptr;
+    }
+    // Frees the weights unless another session still shares them.
+    session->model = nullptr;
+    session->shared_model.reset();
+
+    releaseBackend();
+    logPrint(LogLevel::Info, "Session ditutup untuk %s", session->model_path.c_str());
+}
+
+bool reconfigureSession(LlamaSession* session, const RuntimeNativeConfig& requested_config) {
+    if (!session || !session->model) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    if (requested_config.thread_count <= 0 || requested_config.context_size <= 0) {
+        throw std::runtime_error("Parameter inisialisasi tidak valid.");
+    }
+    validateKvCacheTypes(requested_config);
+    if (modelKey(session->model_path, modelParamsFor(requested_config)) != session->shared_model->key) {
+        return false;
+    }
+
+    // The tuning pass can take many seconds and only reads the model, so it runs without the decode
+    // lock; the session keeps serving with its current settings until they are published below.
+    const RuntimeSettings settings = resolveRuntimeSettings(session->model, session->model_path, requested_config);
+    const RuntimeNativeConfig& config = settings.config;
+    const llama_context_params ctx_params = contextParamsFor(settings);
+
+    std::unique_lock<std::mutex> lock(session->decode_mutex);
+    const RuntimeNativeConfig& previous = session->config;
+    const bool same_draft = previous.draft_model_path == config.draft_model_path &&
+                            previous.has_draft_tokens == config.has_draft_tokens &&
+                            previous.draft_tokens == config.draft_tokens;
+
+    if (session->context && same_draft && sameContextShape(session->context_params, ctx_params)) {
+        llama_set_n_threads(session->context, ctx_params.n_threads, ctx_params.n_threads_batch);
+        if (session->draft) {
+            llama_set_n_threads(session->draft->context, ctx_params.n_threads, ctx_params.n_threads_batch);
+        }
+        {
+            std::lock_guard<std::mutex> embedding_lock(session->embedding_mutex);
+            if (session->embedding_context) {
+                llama_set_n_threads(session->embedding_context, ctx_params.n_threads, ctx_params.n_threads_batch);
+            }
+            publishRuntimeSettings(session, settings);
+        }
+        session->context_params = ctx_params;
+        logPrint(LogLevel::Info,
+                 "Thread session diubah tanpa membangun ulang konteks. threads=%d, threads_batch=%d",
+                 session->thread_count,
+                 session->thread_count_batch);
+        return true;
+    }
+
+    // Stop the batch worker before the context it decodes into goes away.  Its step takes the decode
+    // lock, so it is joined with the lock released.
+    lock.unlock();
+    session->batch_engine.reset();
+    // Recreated with the new thread counts on the next embedTexts.
+    freeEmbeddingContext(session);
+    lock.lock();
+
+    const RuntimeNativeConfig previous_config = session->config;
+    const llama_context_params previous_params = session->context_params;
+    // Holding the old draft's weights keeps them loaded while its context is rebuilt, and lets a
+    // failed rebuild restore it without reading the file again.
+    const std::shared_ptr<SharedModel> previous_draft_model =
+            session->draft ? session->draft->shared_model : nullptr;
+    // The old context is freed before the new one is created so that a larger n_ctx does not need
+    // both KV caches in memory at once.
+    session->draft.reset();
+    if (session->context) {
+        llama_free(session->context);
+        session->context = nullptr;
+    }
+    session->evaluated_tokens.clear();
+
+    try {
+        buildSessionContext(session, config, ctx_params);
+    } catch (const std::exception& error) {
+        logPrint(LogLevel::Error, "Gagal membangun ulang konteks session: %s", error.what());
+        // Nothing was published, so the session's settings still describe the previous context.
+        try {
+            buildSessionContext(session, previous_config, previous_params);
+        } catch (const std::exception& restore_error) {
+            logPrint(LogLevel::Error, "Gagal memulihkan konteks session sebelumnya: %s", restore_error.what());
+        }
+        throw;
+    }
+    {
+        std::lock_guard<std::mutex> embedding_lock(session->embedding_mutex);
+        publishRuntimeSettings(session, settings);
+    }
+
+    PromptSnapshotLibrary& library = session->snapshots;
+    if (library.enabled()) {
+        library.fingerprint = computeSnapshotFingerprint(*session);
+        scanPromptSnapshots(library);
+    }
+
+    logPrint(LogLevel::Info,
+             "Konteks session dibangun ulang. threads=%d, ctx=%d",
+             session->thread_count,
+             session->context_size);
+    return true;
+}
+
+MemoryPlan planMemory(const std::string& model_path, const RuntimeNativeConfig& config, int64_t budget_bytes) {
+    if (config.context_size <= 0) {
+        throw std::runtime_error("Parameter inisialisasi tidak valid.");
+    }
+    validateKvCacheTypes(config);
+    const ModelInfo target = probeModel(model_path);
+    std::optional<ModelInfo> draft;
+    if (!config.draft_model_path.empty()) {
+        draft = probeModel(config.draft_model_path);
+    }
+    const ModelInfo* draft_info = draft ? &*draft : nullptr;
+
+    MemoryPlan plan = estimateSessionMemory(target, draft_info, config, config.context_size);
+    if (budget_bytes <= 0) {
+        return plan;
+    }
+
+    // Past the training context the model degrades unless RoPE scaling was asked for.
+    const int32_t ceiling = target.context_length > 0 && !config.has_rope_freq_scale ? target.context_length
+                                                                                      : kUnknownMaxContext;
+    // The estimate grows with the context, so bisect over whole KV blocks.
+    int32_t low = 0;
+    int32_t high = std::max(1, ceiling / kKvCellPadding);
+    while (low < high) {
+        const int32_t blocks = low + (high - low + 1) / 2;
+        const int32_t candidate = std::min(ceiling, blocks * kKvCellPadding);
+        if (estimateSessionMemory(target, draft_info, config, candidate).total_bytes <= budget_bytes) {
+            low = blocks;
+        } else {
+            high = blocks - 1;
+        }
+    }
+    plan.max_context_size = std::min(ceiling, low * kKvCellPadding);
+    return plan;
+}
+
+void configurePromptSnapshots(LlamaSession* session, const std::string& directory, int64_t max_bytes) {
+    if (!session || !session->model || !session->context) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+
+    PromptSnapshotLibrary& library = session->snapshots;
+    if (directory.empty()) {
+        library = PromptSnapshotLibrary();
+        return;
+    }
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Direktori snapshot prompt tidak dapat dibuat: " + directory);
+    }
+
+    library.directory = directory;
+    library.max_bytes = std::max<int64_t>(0, max_bytes);
+    library.fingerprint = computeSnapshotFingerprint(*session);
+    scanPromptSnapshots(library);
+}
+
+// Evaluates `prompt` into sequence 0 (reusing whatever prefix is already cached) and stores the
+// resulting sequence state so later completions starting with the same tokens skip the prefill.
+bool savePromptSnapshot(LlamaSession* session, const std::string& prompt) {
+    if (!session || !session->model || !session->context) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    PromptSnapshotLibrary& library = session->snapshots;
+    if (!library.enabled()) {
+        throw std::runtime_error("Direktori snapshot prompt belum dikonfigurasi.");
+    }
+
+    const auto tokens = tokenizePrompt(session->model, prompt);
+    if (tokens.empty()) {
+        return false;
+    }
+    if (static_cast<int>(tokens.size()) >= session->context_size) {
+        std::ostringstream msg;
+        msg << "Prompt snapshot terlalu panjang: " << tokens.size()
+            << " token untuk konteks " << session->context_size << '.';
+        throw std::runtime_error(msg.str());
+    }
+
+    const std::string path = snapshotPath(library, tokens.data(), tokens.size());
+    if (access(path.c_str(), R_OK) == 0) {
+        utimensat(AT_FDCWD, path.c_str(), nullptr, 0);
+        return true;
+    }
+
+    std::vector<uint8_t> state;
+    size_t written = 0;
+    {
+        // Sequence 0 is shared with the interactive path and the batch engine decodes into the same
+        // context; the lock is dropped once the state is copied, before the file I/O.
+        std::lock_guard<std::mutex> lock(session->decode_mutex);
+        llama_set_n_threads(session->context, session->thread_count, session->thread_count_batch);
+        const size_t reused = preparePromptCache(session, tokens, false);
+        evaluateTokens(session, tokens.data() + reused, static_cast<int32_t>(tokens.size() - reused));
+
+        state.resize(llama_state_seq_get_size(session->context, 0));
+        written = llama_state_seq_get_data(session->context, state.data(), state.size(), 0);
+    }
+    if (written == 0) {
+        return false;
+    }
+
+    SnapshotFileHeader header;
+    header.fingerprint = library.fingerprint;
+    header.token_count = tokens.size();
+    header.state_size = written;
+
+    // Write to a temporary name and rename so a crash never leaves a truncated snapshot behind.
+    const std::string temp_path = path + ".tmp";
+    {
+        std::unique_ptr<FILE, decltype(&std::fclose)> file(std::fopen(temp_path.c_str(), "wb"), &std::fclose);
+        if (!file) {
+            throw std::runtime_error("Snapshot prompt tidak dapat ditulis: " + temp_path);
+        }
+        const bool ok = std::fwrite(&header, sizeof(header), 1, file.get()) == 1 &&
+                        std::fwrite(tokens.data(), sizeof(llama_token), tokens.size(), file.get()) == tokens.size() &&
+                        std::fwrite(state.data(), 1, written, file.get()) == written &&
+                        std::fflush(file.get()) == 0;
+        if (!ok) {
+            file.reset();
+            unlink(temp_path.c_str());
+            throw std::runtime_error("Snapshot prompt tidak dapat ditulis: " + temp_path);
+        }
+    }
+    if (std::rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        throw std::runtime_error("Snapshot prompt tidak dapat disimpan: " + path);
+    }
+
+    scanPromptSnapshots(library);
+    logPrint(LogLevel::Info,
+             "Snapshot prompt disimpan: %zu token, %zu byte",
+             tokens.size(),
+             written);
+    return true;
+}
+
+void clearPromptCache(LlamaSession* session) {
+    if (!session || !session->context) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    std::lock_guard<std::mutex> lock(session->decode_mutex);
+    llama_memory_seq_rm(llama_get_memory(session->context), 0, -1, -1);
+    session->evaluated_tokens.clear();
+}
+
+int32_t countPromptTokens(LlamaSession* session, const std::string& prompt) {
+    // A joined prompt is unlikely to be counted twice; caching it would only evict segments.
+    const auto text_tokens = static_cast<int32_t>(tokenizePrompt(session->model, prompt, false).size());
+    const int32_t tokens = text_tokens + specialTokenOverhead(session);
+    // tokenizeCompletionPrompt falls back to a lone BOS for an empty prompt.
+    return std::max<int32_t>(1, tokens);
+}
+
+// Drops the oldest unpinned segments until the prompt leaves room for `max_tokens` in the
+// sequence.  Segments are concatenated verbatim; the first `pinned` (persona/system) and the last
+// (current turn) are always kept.  The fit is checked against the exact count of the joined
+// prompt, since tokens can merge across segment boundaries.
+PromptFit fitPrompt(LlamaSession* session,
+                    const std::vector<std::string>& segments,
+                    int32_t pinned,
+                    int32_t max_tokens) {
+    const auto n_segments = static_cast<int32_t>(segments.size());
+    pinned = std::max<int32_t>(0, std::min(pinned, n_segments));
+    max_tokens = std::max<int32_t>(0, max_tokens);
+
+    PromptFit fit;
+    fit.capacity = std::min(session->context_size, sequenceCapacity(session));
+    fit.first_segment = pinned;
+    const int32_t limit = fit.capacity - max_tokens;
+
+    int32_t estimate = specialTokenOverhead(session);
+    std::vector<int32_t> counts(segments.size());
+    for (int32_t i = 0; i < n_segments; ++i) {
+        counts[i] = countSegmentTokens(session, segments[i]);
+        estimate += counts[i];
+    }
+    while (estimate > limit && fit.first_segment < n_segments - 1) {
+        estimate -= counts[fit.first_segment++];
+    }
+
+    while (true) {
+        std::string prompt;
+        for (int32_t i = 0; i < n_segments; ++i) {
+            if (i < pinned || i >= fit.first_segment) {
+                prompt += segments[i];
+            }
+        }
+        fit.prompt_tokens = countPromptTokens(session, prompt);
+        if (fit.prompt_tokens <= limit || fit.first_segment >= n_segments - 1) {
+            break;
+        }
+        ++fit.first_segment;
+    }
+
+    fit.max_tokens = std::max<int32_t>(0, std::min(max_tokens, fit.capacity - fit.prompt_tokens));
+    return fit;
+}
+
+int32_t embeddingSize(LlamaSession* session) {
+    if (!session || !session->model) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    return llama_model_n_embd(session->model);
+}
+
+void embedTexts(LlamaSession* session,
+                const std::vector<std::string>& texts,
+                EmbeddingPooling pooling,
+                bool normalize,
+                float* out) {
+    if (!session || !session->model) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    if (texts.empty()) {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(session->embedding_mutex);
+    llama_context* context = embeddingContext(session);
+    const int32_t n_embd = llama_model_n_embd(session->model);
+
+    struct BatchDeleter {
+        void operator()(llama_batch* batch) const {
+            llama_batch_free(*batch);
+            delete batch;
+        }
+    };
+    std::unique_ptr<llama_batch, BatchDeleter> batch(
+            new llama_batch(llama_batch_init(kEmbeddingBatchTokens, 0, 1)));
+    std::vector<int32_t> lengths;
+    lengths.reserve(kEmbeddingMaxSequences);
+    size_t first_text = 0;
+
+    auto flush = [&]() {
+        if (lengths.empty()) {
+            return;
+        }
+        decodeEmbeddingBatch(session, context, *batch, lengths, pooling, normalize,
+                             out + first_text * static_cast<size_t>(n_embd));
+        first_text += lengths.size();
+        lengths.clear();
+        batch->n_tokens = 0;
+    };
+
+    for (const std::string& text : texts) {
+        std::vector<llama_token> tokens = tokenizeCompletionPrompt(session, text);
+        if (static_cast<int32_t>(tokens.size()) > kEmbeddingBatchTokens) {
+            // Embedding models are trained on bounded inputs; longer texts are cut like
+            // sentence-transformers does.
+            tokens.resize(kEmbeddingBatchTokens);
+        }
+        const auto length = static_cast<int32_t>(tokens.size());
+        if (batch->n_tokens + length > kEmbeddingBatchTokens ||
+            static_cast<int32_t>(lengths.size()) == kEmbeddingMaxSequences) {
+            flush();
+        }
+
+        const auto seq = static_cast<llama_seq_id>(lengths.size());
+        for (int32_t i = 0; i < length; ++i) {
+            const int32_t index = batch->n_tokens++;
+            batch->token[index] = tokens[static_cast<size_t>(i)];
+            batch->pos[index] = i;
+            batch->n_seq_id[index] = 1;
+            batch->seq_id[index][0] = seq;
+            bool output = true;
+            if (pooling == EmbeddingPooling::Cls) {
+                output = i == 0;
+            } else if (pooling == EmbeddingPooling::Last) {
+                output = i == length - 1;
+            }
+            batch->logits[index] = output ? 1 : 0;
+        }
+        lengths.push_back(length);
+    }
+    flush();
+}
+
+LlamaSession::~LlamaSession() = default;
+
+namespace {
+
+BatchEngine* batchEngine(LlamaSession* session) {
+    std::lock_guard<std::mutex> lock(session->batch_engine_mutex);
+    if (!session->batch_engine) {
+        session->batch_engine = std::make_unique<BatchEngine>(session);
+    }
+    return session->batch_engine.get();
+}
+
+}  // namespace
+
+std::string runBatchedCompletion(LlamaSession* session,
+                                 const std::string& prompt,
+                                 const SamplingNativeOptions& options,
+                                 const std::function<void(const std::string&)>& on_token) {
+    if (!session || !session->model || !session->context) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    if (llama_n_seq_max(session->context) < 2) {
+        throw std::runtime_error("Batch engine membutuhkan seq_max minimal 2 pada runtime config.");
+    }
+
+    return batchEngine(session)->submit(prompt, options, on_token);
+}
+
+void runBulkCompletion(LlamaSession* session,
+                       const std::string& prefix,
+                       const std::vector<std::string>& inputs,
+                       const SamplingNativeOptions& options,
+                       const BulkItemCallback& on_item) {
+    if (!session || !session->model || !session->context) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+    if (llama_n_seq_max(session->context) < 3) {
+        throw std::runtime_error("Bulk completion membutuhkan seq_max minimal 3 pada runtime config.");
+    }
+    if (!on_item) {
+        throw std::runtime_error("Callback bulk completion tidak boleh kosong.");
+    }
+    batchEngine(session)->submitBulk(prefix, inputs, options, on_item);
+}
+
+std::string runCompletion(LlamaSession* session,
+                          const std::string& prompt,
+                          const SamplingNativeOptions& options,
+                          const std::function<void(const std::string&)>& on_token) {
+    if (!session || !session->model || !session->context) {
+        throw std::runtime_error("Session belum siap digunakan.");
+    }
+
+    if (options.max_tokens <= 0) {
+        return std::string();
+    }
+
+    const llama_vocab* vocab = llama_model_get_vocab(session->model);
+
+    const auto tokens = tokenizeCompletionPrompt(session, prompt);
+    const int32_t capacity = std::min(session->context_size, sequenceCapacity(session));
+    std::optional<size_t> shift_sink;
+    if (options.context_shift) {
+        if (!llama_memory_can_shift(llama_get_memory(session->context))) {
+            throw std::runtime_error("Context shift tidak didukung oleh memori model ini.");
+        }
+        // The prompt itself must still fit; only generation may run past the window.
+        ensureFitsContext(session, tokens.size(), 1);
+        shift_sink = options.sink_tokens
+                ? static_cast<size_t>(*options.sink_tokens)
+                : std::min(tokens.size(), static_cast<size_t>(capacity / 4));
+    } else {
+        ensureFitsContext(session, tokens.size(), options.max_tokens);
+    }
+    // Built outside the decode lock so the first completion does not stall the batch engine.
+    const TokenPieceTable& pieces = tokenPieces(session);
+
+    // Interactive completions reuse the session's sampler and hand it back when they finish.
+    std::unique_ptr<TokenSampler> cached_sampler;
+    {
+        std::lock_guard<std::mutex> lock(session->sampler_mutex);
+        cached_sampler = std::move(session->cached_sampler);
+    }
+    CompletionSampler sampler = buildCompletionSampler(session, options, std::move(cached_sampler));
+    struct CachedSamplerGuard {
+        LlamaSession* session;
+        CompletionSampler& sampler;
+        ~CachedSamplerGuard() {
+            std::lock_guard<std::mutex> lock(session->sampler_mutex);
+            session->cached_sampler = std::move(sampler.sampler);
+        }
+    } sampler_guard{session, sampler};
+    acceptPromptTokens(sampler, tokens);
+
+    const uint64_t request_id = ++session->next_request_id;
+    session->active_request.store(request_id, std::memory_order_release);
+    struct ActiveRequestGuard {
+        LlamaSession* session;
+        ~ActiveRequestGuard() { session->active_request.store(0, std::memory_order_release); }
+    } active_guard{session};
+
+    // The decode lock is held from each llama_decode until its logits have been sampled, so batch
+    // engine steps can interleave between tokens without clobbering the logits read here.
+    InteractiveDecodeLock decode_lock(session, request_id);
+    llama_set_n_threads(session->context, session->thread_count, session->thread_count_batch);
+
+    const size_t reused = preparePromptCache(session, tokens, true);
+
+    CompletionStats& stats = session->last_stats;
+    stats = CompletionStats();
+    stats.prompt_tokens = static_cast<int64_t>(tokens.size());
+    stats.reused_tokens = static_cast<int64_t>(reused);
+
+    try {
+        evaluateTokens(session, tokens.data() + reused, static_cast<int32_t>(tokens.size() - reused));
+    } catch (const CompletionCancelled&) {
+        // Fully decoded chunks stay cached, so a retry of the same prompt resumes from there.
+        stats.cancelled = 1;
+        return std::string();
+    }
+
+    std::string completion;
+    completion.reserve(static_cast<size_t>(std::min(options.max_tokens, capacity)) * 4);
+
+    if (session->draft) {
+        generateSpeculative(session, sampler, options, shift_sink, on_token, decode_lock, completion);
+        return completion;
+    }
+
+    StopSequenceMatcher stop_matcher(options.stop_sequences);
+    std::string released;
+    auto emit = [&]() {
+        if (released.empty()) {
+            return;
+        }
+        completion += released;
+        if (on_token) {
+            PhaseTimer timer(session->metrics, MetricPhase::Callback);
+            on_token(released);
+        }
+        released.clear();
+    };
+
+    bool stopped = false;
+    for (int generated = 0; generated < options.max_tokens; ++generated) {
+        const llama_token next = sampleToken(session, sampler, -1);
+        decode_lock.unlock();
+
+        if (llama_vocab_is_eog(vocab, next)) {
+            break;
+        }
+
+        stopped = feedToken(session, pieces, stop_matcher, next, released);
+        emit();
+        if (stopped) {
+            break;
+        }
+
+        acceptToken(sampler, next);
+        ++stats.generated_tokens;
+
+        decode_lock.lock();
+        if (interactiveCancelRequested(session)) {
+            stats.cancelled = 1;
+            break;
+        }
+        if (shift_sink && session->evaluated_tokens.size() + 1 > static_cast<size_t>(capacity)) {
+            shiftSessionContext(session, *shift_sink);
+        }
+        try {
+            evaluateTokens(session, &next, 1, MetricPhase::Decode);
+        } catch (const CompletionCancelled&) {
+            stats.cancelled = 1;
+            break;
+        }
+    }
+
+    if (!stopped) {
+        if (decode_lock.owns_lock()) {
+            decode_lock.unlock();
+        }
+        stop_matcher.flush(released);
+        emit();
+    }
+
+    return completion;
+}
+
+bool cancelCompletion(LlamaSession* session) {
+    if (!session) {
+        return false;
+    }
+    const uint64_t active = session->active_request.load(std::memory_order_acquire);
+    if (active == 0) {
+        return false;
+    }
+    session->cancelled_request.store(active, std::memory_order_release);
+    return true;
+}
+
+bool isVulkanAvailable() {
+#if defined(GGML_USE_VULKAN)
+    retainBackend();
+    struct BackendGuard {
+        ~BackendGuard() { releaseBackend(); }
+    };
+    [[maybe_unused]] BackendGuard guard;
+    return ggml_backend_vk_get_device_count() > 0;
+#else
+    return false;
+#endif
+}
+
+}  // namespace cicero
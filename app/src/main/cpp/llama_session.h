@@ -0,0 +1,366 @@
+#pragma once
+
+#include "llama.h"
+#include "session_metrics.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+// Session and completion core shared by the JNI bridge and the host tools (cicero_bench).  Nothing
+// here depends on JNI or Android, so it builds and runs on plain Linux as well.
+namespace cicero {
+
+struct RuntimeNativeConfig {
+    int32_t thread_count = 0;
+    int32_t thread_count_batch = 0;
+    bool has_thread_count_batch = false;
+    int32_t context_size = 0;
+    int32_t batch_size = 0;
+    bool has_batch_size = false;
+    int32_t ubatch_size = 0;
+    bool has_ubatch_size = false;
+    int32_t seq_max = 0;
+    bool has_seq_max = false;
+    int32_t n_gpu_layers = 0;
+    bool has_n_gpu_layers = false;
+    int32_t main_gpu = 0;
+    bool has_main_gpu = false;
+    int32_t flash_attention = 0;
+    bool has_flash_attention = false;
+    float rope_freq_base = 0.0f;
+    bool has_rope_freq_base = false;
+    float rope_freq_scale = 0.0f;
+    bool has_rope_freq_scale = false;
+    bool offload_kqv = false;
+    bool has_offload_kqv = false;
+    bool no_perf = true;
+    bool has_no_perf = false;
+    bool embeddings = false;
+    bool has_embeddings = false;
+    bool kv_unified = false;
+    bool has_kv_unified = false;
+    bool use_mmap = false;
+    bool has_use_mmap = false;
+    bool use_mlock = false;
+    bool has_use_mlock = false;
+    // KV cache element types.  q8_0 halves an f16 cache and q4_0 quarters it; a quantized V cache
+    // needs flash attention (on or auto).
+    ggml_type type_k = GGML_TYPE_F16;
+    bool has_type_k = false;
+    ggml_type type_v = GGML_TYPE_F16;
+    bool has_type_v = false;
+    // Background readahead of the mmapped model file (ignored without mmap or with mlock).
+    bool prefetch = true;
+    bool has_prefetch = false;
+    std::string draft_model_path;
+    int32_t draft_tokens = 0;
+    bool has_draft_tokens = false;
+    // kAutoTune* bits of the fields the on-device tuner picks instead of the values above, and the
+    // directory its results are cached in (empty: tune on every load).
+    uint32_t auto_tune = 0;
+    std::string tune_cache_dir;
+};
+
+enum AutoTuneField : uint32_t {
+    kAutoTuneThreads = 1u << 0,
+    kAutoTuneThreadsBatch = 1u << 1,
+    kAutoTuneBatch = 1u << 2,
+    kAutoTuneUbatch = 1u << 3,
+};
+
+// On-disk library of evaluated prompt prefixes for sequence 0.  Each snapshot file holds the
+// prefix token ids plus the serialised sequence state and is keyed by a hash of the session
+// fingerprint (model file + KV-relevant runtime config) and the prefix tokens.
+struct PromptSnapshotLibrary {
+    std::string directory;
+    int64_t max_bytes = 0;
+    uint64_t fingerprint = 0;
+    // Distinct prefix lengths stored on disk for this fingerprint, longest first.
+    std::vector<size_t> prefix_lengths;
+
+    bool enabled() const { return !directory.empty(); }
+};
+
+class BatchEngine;
+class TokenPieceTable;
+class TokenSampler;
+struct DraftModel;
+struct SharedModel;
+
+// LRU of token counts for prompt segments (persona, history turns) so repeated pieces are not
+// re-tokenized on every fitPrompt call.  Counts exclude BOS/EOS added by the vocab.  Whole joined
+// prompts are counted without it, so they never evict the segments.
+constexpr size_t kSegmentTokenCacheEntries = 64;
+
+class SegmentTokenCache {
+public:
+    explicit SegmentTokenCache(size_t capacity) : capacity_(capacity) {}
+
+    std::optional<int32_t> find(const std::string& segment) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        const auto it = index_.find(segment);
+        if (it == index_.end()) {
+            return std::nullopt;
+        }
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    void insert(const std::string& segment, int32_t count) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (index_.count(segment) > 0) {
+            return;
+        }
+        entries_.emplace_front(segment, count);
+        index_.emplace(entries_.front().first, entries_.begin());
+        while (entries_.size() > capacity_) {
+            index_.erase(entries_.back().first);
+            entries_.pop_back();
+        }
+    }
+
+private:
+    using Entry = std::pair<std::string, int32_t>;
+
+    size_t capacity_;
+    std::mutex mutex_;
+    std::list<Entry> entries_;
+    // Keys view the strings owned by `entries_`; list nodes never move.
+    std::unordered_map<std::string_view, std::list<Entry>::iterator> index_;
+};
+
+// Counters of the most recent runCompletion call on a session.
+struct CompletionStats {
+    int64_t prompt_tokens = 0;
+    int64_t reused_tokens = 0;
+    int64_t generated_tokens = 0;
+    int64_t draft_max_tokens = 0;
+    int64_t draft_steps = 0;
+    int64_t draft_proposed = 0;
+    int64_t draft_accepted = 0;
+    int64_t context_shifts = 0;
+    int64_t shifted_tokens = 0;
+    int64_t cancelled = 0;
+};
+
+struct LlamaSession {
+    std::string model_path;
+    int thread_count = 0;
+    int thread_count_batch = 0;
+    int context_size = 0;
+    // Weights shared with every other session on the same file and model-level parameters;
+    // `model` is shared_model->model.
+    std::shared_ptr<SharedModel> shared_model;
+    llama_model* model = nullptr;
+    llama_context* context = nullptr;
+    // Parameters `context` was created with, compared by reconfigureSession.
+    llama_context_params context_params{};
+    // Tokens whose KV entries currently live in sequence 0, in position order.  Used to reuse the
+    // shared prompt prefix (persona/system preamble) across completions.
+    std::vector<llama_token> evaluated_tokens;
+    RuntimeNativeConfig config;
+    PromptSnapshotLibrary snapshots;
+    // Serialises llama_decode and the logits reads that follow it between the interactive
+    // completion path, prompt snapshot saves and the batch engine worker.
+    std::mutex decode_mutex;
+    // Guards the lazy creation of `batch_engine`; reconfigureSession drops it with the context.
+    std::mutex batch_engine_mutex;
+    std::unique_ptr<BatchEngine> batch_engine;
+    std::unique_ptr<DraftModel> draft;
+    CompletionStats last_stats;
+    // Sampler of the last interactive completion, reset and reused by the next one when its
+    // sampling parameters match.  Taken out under the mutex while a completion runs.
+    std::mutex sampler_mutex;
+    std::unique_ptr<TokenSampler> cached_sampler;
+    // Detokenization table for `model`, built on first use and shared with every other session
+    // running the same model.
+    std::once_flag token_pieces_once;
+    std::shared_ptr<const TokenPieceTable> token_pieces;
+    SegmentTokenCache segment_tokens{kSegmentTokenCacheEntries};
+    // Cancellation of the interactive path.  Each completion gets an id; `decoding_request` holds
+    // it only while that completion owns llama_decode (0 during batch engine steps), which is what
+    // the context's abort callback compares against `cancelled_request`.
+    std::atomic<uint64_t> next_request_id{0};
+    std::atomic<uint64_t> active_request{0};
+    std::atomic<uint64_t> decoding_request{0};
+    std::atomic<uint64_t> cancelled_request{0};
+    // Lazily created context for embedTexts; it shares `model` and never touches sequence 0.
+    std::mutex embedding_mutex;
+    llama_context* embedding_context = nullptr;
+    // Per-phase timings of the completion paths, exported through nativeGetMetrics / nativeDumpTrace.
+    SessionMetrics metrics;
+
+    ~LlamaSession();
+};
+
+struct SamplingNativeOptions {
+    int32_t max_tokens = 0;
+    std::optional<float> temperature;
+    std::optional<float> top_p;
+    std::optional<int32_t> top_k;
+    std::optional<float> repeat_penalty;
+    std::optional<int32_t> repeat_last_n;
+    std::optional<float> frequency_penalty;
+    std::optional<float> presence_penalty;
+    std::vector<std::string> stop_sequences;
+    std::optional<uint32_t> seed;
+    // Sliding-window generation: when sequence 0 fills up, the tokens after the first
+    // `sink_tokens` are partly discarded and the rest shifted down instead of stopping.
+    bool context_shift = false;
+    std::optional<int32_t> sink_tokens;
+    // Output constraint: a GBNF grammar with a `root` rule, or a JSON schema converted to one (see
+    // jsonSchemaToGrammar).  At most one may be set.  Compiled grammars are cached per model.
+    std::string grammar;
+    std::string json_schema;
+};
+
+// How embedTexts reduces the per-token embeddings of a text to one vector.
+enum class EmbeddingPooling : int32_t {
+    Mean = 0,
+    Cls = 1,
+    Last = 2,
+};
+
+struct PromptFit {
+    // Index of the oldest unpinned segment that is kept; segments [pinned, first_segment) were
+    // dropped to make room.
+    int32_t first_segment = 0;
+    int32_t prompt_tokens = 0;
+    int32_t max_tokens = 0;
+    int32_t capacity = 0;
+};
+
+// Thrown by createSession when the progress callback asked to stop loading.
+class ModelLoadCancelled : public std::runtime_error {
+public:
+    ModelLoadCancelled() : std::runtime_error("Pemuatan model dibatalkan.") {}
+};
+
+// Receives model loading progress in [0, 1] on the loading thread; returning false cancels the
+// load.
+using LoadProgressCallback = std::function<bool(float)>;
+
+RuntimeNativeConfig makeDefaultRuntimeConfig(int thread_count, int context_size);
+
+// Loads the model (and the optional draft model) and creates the llama context.  Throws
+// ModelLoadCancelled when `on_progress` returns false and std::runtime_error on failure.
+std::unique_ptr<LlamaSession> createSession(const std::string& model_path,
+                                            const RuntimeNativeConfig& config,
+                                            const LoadProgressCallback& on_progress = nullptr);
+
+// Stops the batch engine and frees the context, model and backend reference of `session`.
+void releaseSession(std::unique_ptr<LlamaSession> session);
+
+// Applies `config` to a live session without reloading its weights.  Thread-only changes go
+// through llama_set_n_threads; any other context setting rebuilds the llama context (dropping the
+// cached prompt).  Returns false, leaving the session untouched, when `config` changes model-level
+// parameters (n_gpu_layers, main_gpu, use_mmap, use_mlock) and needs a full createSession.  When
+// the rebuild fails (e.g. the new KV cache does not fit) it throws std::runtime_error after
+// restoring the previous config and recreating the previous context, so the session keeps working
+// as before minus its cached prompt; only if that recreation fails too is the session left without
+// a context, and every later call on it throws until it is destroyed.  Auto-tuning runs before any
+// session lock is taken; the new settings are published, and the context swapped, under
+// decode_mutex.  An interactive completion releases that lock between tokens, so callers must still
+// not reconfigure a session while a completion on it is running (LlamaController serialises them).
+bool reconfigureSession(LlamaSession* session, const RuntimeNativeConfig& config);
+
+// Resident memory a session would need, estimated from GGUF metadata before anything is loaded.
+struct MemoryPlan {
+    // Weights of the model and of the draft model, if any.
+    int64_t weight_bytes = 0;
+    int64_t kv_bytes = 0;
+    // Compute graph buffers, logits output and fixed per-session overhead.
+    int64_t compute_bytes = 0;
+    int64_t total_bytes = 0;
+    // Largest context, in whole 256-cell KV blocks and at most the training context (unless RoPE
+    // scaling is set), whose total fits the budget; 0 when not even one block fits.
+    int32_t max_context_size = 0;
+};
+
+// Estimates weights + KV cache + compute buffers for loading `model_path` with `config`, using only
+// the GGUF metadata (see probeModel), and searches the largest context that fits `budget_bytes`
+// with the same settings (skipped when the budget is not positive).  The compute part is a
+// heuristic of llama.cpp's graph reservation; sliding-window models are overestimated.
+MemoryPlan planMemory(const std::string& model_path, const RuntimeNativeConfig& config, int64_t budget_bytes);
+
+void configurePromptSnapshots(LlamaSession* session, const std::string& directory, int64_t max_bytes);
+bool savePromptSnapshot(LlamaSession* session, const std::string& prompt);
+
+// Drops every cached token of sequence 0, so the next completion evaluates its prompt from scratch.
+void clearPromptCache(LlamaSession* session);
+
+int32_t countPromptTokens(LlamaSession* session, const std::string& prompt);
+PromptFit fitPrompt(LlamaSession* session,
+                    const std::vector<std::string>& segments,
+                    int32_t pinned,
+                    int32_t max_tokens);
+
+// Width of the vectors embedTexts produces (the model's n_embd).
+int32_t embeddingSize(LlamaSession* session);
+
+// Embeds every text, packing as many as fit into each multi-sequence batch of a dedicated
+// embedding context, and writes embeddingSize() floats per text to `out` in input order.  Texts
+// longer than the embedding batch are truncated.
+void embedTexts(LlamaSession* session,
+                const std::vector<std::string>& texts,
+                EmbeddingPooling pooling,
+                bool normalize,
+                float* out);
+
+// Interactive completion on sequence 0.  `on_token` receives the generated text piece by piece on
+// the calling thread.
+std::string runCompletion(LlamaSession* session,
+                          const std::string& prompt,
+                          const SamplingNativeOptions& options,
+                          const std::function<void(const std::string&)>& on_token);
+
+// Completion through the session's continuous batching engine (requires seq_max >= 2).
+std::string runBatchedCompletion(LlamaSession* session,
+                                 const std::string& prompt,
+                                 const SamplingNativeOptions& options,
+                                 const std::function<void(const std::string&)>& on_token);
+
+// One finished item of runBulkCompletion.
+struct BulkItemResult {
+    size_t index = 0;
+    std::string completion;
+    // Empty on success, otherwise why this item failed; the other items are unaffected.
+    std::string error;
+    // prompt_tokens counts prefix and input; reused_tokens is the shared part of the prefix.
+    CompletionStats stats;
+};
+
+// Receives bulk items on the calling thread in the order they finish; returning false cancels
+// the items still queued or running.
+using BulkItemCallback = std::function<bool(const BulkItemResult&)>;
+
+// Offline bulk completion through the batch engine (requires seq_max >= 3).  `prefix` is
+// prefilled once into its own sequence and copied into the sequence of every item, so only the
+// `inputs` are prefilled per item, many of them per llama_decode.  Prefix and inputs are tokenized
+// separately: end the prefix at a natural boundary such as a newline.  Meant for background jobs;
+// runBatchedCompletion requests are admitted ahead of waiting bulk items.
+void runBulkCompletion(LlamaSession* session,
+                       const std::string& prefix,
+                       const std::vector<std::string>& inputs,
+                       const SamplingNativeOptions& options,
+                       const BulkItemCallback& on_item);
+
+// Requests cancellation of the interactive completion currently running on `session`.  Returns
+// false when no completion is active.
+bool cancelCompletion(LlamaSession* session);
+
+bool isVulkanAvailable();
+
+}  // namespace cicero
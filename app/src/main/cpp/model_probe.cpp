@@ -0,0 +1,222 @@
+#include "model_probe.h"
+
+#include "ggml.h"
+#include "gguf.h"
+#include "llama.h"
+
+#include <sys/stat.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+namespace cicero {
+
+namespace {
+
+using GgufPtr = std::unique_ptr<gguf_context, decltype(&gguf_free)>;
+
+struct FileIdentity {
+    int64_t size = 0;
+    int64_t mtime_ns = 0;
+    uint64_t inode = 0;
+
+    bool operator==(const FileIdentity& other) const {
+        return size == other.size && mtime_ns == other.mtime_ns && inode == other.inode;
+    }
+};
+
+struct CachedProbe {
+    FileIdentity identity;
+    ModelInfo info;
+};
+
+std::mutex g_probe_mutex;
+std::unordered_map<std::string, CachedProbe> g_probe_cache;
+
+FileIdentity statModelFile(const std::string& path) {
+    struct stat info {};
+    if (stat(path.c_str(), &info) != 0) {
+        throw std::runtime_error("Tidak dapat membaca berkas model " + path + ": " + std::strerror(errno));
+    }
+    if (!S_ISREG(info.st_mode)) {
+        throw std::runtime_error("Berkas model bukan berkas biasa: " + path);
+    }
+    FileIdentity identity;
+    identity.size = static_cast<int64_t>(info.st_size);
+    identity.mtime_ns = static_cast<int64_t>(info.st_mtim.tv_sec) * 1000000000LL + info.st_mtim.tv_nsec;
+    identity.inode = static_cast<uint64_t>(info.st_ino);
+    return identity;
+}
+
+// gguf_get_val_* abort on a type mismatch, so every read checks the stored type first.
+std::optional<int64_t> readInteger(const gguf_context* meta, const std::string& key) {
+    const int64_t id = gguf_find_key(meta, key.c_str());
+    if (id < 0) {
+        return std::nullopt;
+    }
+    switch (gguf_get_kv_type(meta, id)) {
+        case GGUF_TYPE_UINT8:
+            return gguf_get_val_u8(meta, id);
+        case GGUF_TYPE_INT8:
+            return gguf_get_val_i8(meta, id);
+        case GGUF_TYPE_UINT16:
+            return gguf_get_val_u16(meta, id);
+        case GGUF_TYPE_INT16:
+            return gguf_get_val_i16(meta, id);
+        case GGUF_TYPE_UINT32:
+            return gguf_get_val_u32(meta, id);
+        case GGUF_TYPE_INT32:
+            return gguf_get_val_i32(meta, id);
+        case GGUF_TYPE_UINT64:
+            return static_cast<int64_t>(gguf_get_val_u64(meta, id));
+        case GGUF_TYPE_INT64:
+            return gguf_get_val_i64(meta, id);
+        default:
+            return std::nullopt;
+    }
+}
+
+int32_t readInt32(const gguf_context* meta, const std::string& key) {
+    const std::optional<int64_t> value = readInteger(meta, key);
+    return value && *value > 0 && *value <= INT32_MAX ? static_cast<int32_t>(*value) : 0;
+}
+
+std::string readString(const gguf_context* meta, const char* key) {
+    const int64_t id = gguf_find_key(meta, key);
+    if (id < 0 || gguf_get_kv_type(meta, id) != GGUF_TYPE_STRING) {
+        return {};
+    }
+    const char* value = gguf_get_val_str(meta, id);
+    return value ? value : "";
+}
+
+// Labels of general.file_type as printed by llama.cpp's loader.
+const char* fileTypeName(int64_t file_type) {
+    switch (static_cast<llama_ftype>(file_type & ~static_cast<int64_t>(LLAMA_FTYPE_GUESSED))) {
+        case LLAMA_FTYPE_ALL_F32: return "F32";
+        case LLAMA_FTYPE_MOSTLY_F16: return "F16";
+        case LLAMA_FTYPE_MOSTLY_BF16: return "BF16";
+        case LLAMA_FTYPE_MOSTLY_Q4_0: return "Q4_0";
+        case LLAMA_FTYPE_MOSTLY_Q4_1: return "Q4_1";
+        case LLAMA_FTYPE_MOSTLY_Q5_0: return "Q5_0";
+        case LLAMA_FTYPE_MOSTLY_Q5_1: return "Q5_1";
+        case LLAMA_FTYPE_MOSTLY_Q8_0: return "Q8_0";
+        case LLAMA_FTYPE_MOSTLY_Q2_K: return "Q2_K";
+        case LLAMA_FTYPE_MOSTLY_Q2_K_S: return "Q2_K_S";
+        case LLAMA_FTYPE_MOSTLY_Q3_K_S: return "Q3_K_S";
+        case LLAMA_FTYPE_MOSTLY_Q3_K_M: return "Q3_K_M";
+        case LLAMA_FTYPE_MOSTLY_Q3_K_L: return "Q3_K_L";
+        case LLAMA_FTYPE_MOSTLY_Q4_K_S: return "Q4_K_S";
+        case LLAMA_FTYPE_MOSTLY_Q4_K_M: return "Q4_K_M";
+        case LLAMA_FTYPE_MOSTLY_Q5_K_S: return "Q5_K_S";
+        case LLAMA_FTYPE_MOSTLY_Q5_K_M: return "Q5_K_M";
+        case LLAMA_FTYPE_MOSTLY_Q6_K: return "Q6_K";
+        case LLAMA_FTYPE_MOSTLY_IQ1_S: return "IQ1_S";
+        case LLAMA_FTYPE_MOSTLY_IQ1_M: return "IQ1_M";
+        case LLAMA_FTYPE_MOSTLY_IQ2_XXS: return "IQ2_XXS";
+        case LLAMA_FTYPE_MOSTLY_IQ2_XS: return "IQ2_XS";
+        case LLAMA_FTYPE_MOSTLY_IQ2_S: return "IQ2_S";
+        case LLAMA_FTYPE_MOSTLY_IQ2_M: return "IQ2_M";
+        case LLAMA_FTYPE_MOSTLY_IQ3_XXS: return "IQ3_XXS";
+        case LLAMA_FTYPE_MOSTLY_IQ3_XS: return "IQ3_XS";
+        case LLAMA_FTYPE_MOSTLY_IQ3_S: return "IQ3_S";
+        case LLAMA_FTYPE_MOSTLY_IQ3_M: return "IQ3_M";
+        case LLAMA_FTYPE_MOSTLY_IQ4_NL: return "IQ4_NL";
+        case LLAMA_FTYPE_MOSTLY_IQ4_XS: return "IQ4_XS";
+        default: return nullptr;
+    }
+}
+
+ModelInfo readModelInfo(const std::string& path, int64_t file_size) {
+    // Without a ggml context gguf only parses the header, the key/value pairs and the tensor table.
+    gguf_init_params params{};
+    params.no_alloc = true;
+    params.ctx = nullptr;
+    GgufPtr meta(gguf_init_from_file(path.c_str(), params), &gguf_free);
+    if (!meta) {
+        throw std::runtime_error("Berkas bukan model GGUF yang valid: " + path);
+    }
+
+    ModelInfo info;
+    info.file_size = file_size;
+    info.architecture = readString(meta.get(), "general.architecture");
+    info.name = readString(meta.get(), "general.name");
+    info.chat_template = readString(meta.get(), "tokenizer.chat_template");
+
+    const std::string& arch = info.architecture;
+    info.context_length = readInt32(meta.get(), arch + ".context_length");
+    info.layer_count = readInt32(meta.get(), arch + ".block_count");
+    info.embedding_length = readInt32(meta.get(), arch + ".embedding_length");
+    info.head_count = readInt32(meta.get(), arch + ".attention.head_count");
+    info.head_count_kv = readInt32(meta.get(), arch + ".attention.head_count_kv");
+    info.feed_forward_length = readInt32(meta.get(), arch + ".feed_forward_length");
+    if (info.head_count_kv == 0) {
+        info.head_count_kv = info.head_count;
+    }
+    const int32_t head_width = info.head_count > 0 ? info.embedding_length / info.head_count : 0;
+    info.key_length = readInt32(meta.get(), arch + ".attention.key_length");
+    info.value_length = readInt32(meta.get(), arch + ".attention.value_length");
+    info.key_length = info.key_length > 0 ? info.key_length : head_width;
+    info.value_length = info.value_length > 0 ? info.value_length : head_width;
+
+    const int64_t tokens_id = gguf_find_key(meta.get(), "tokenizer.ggml.tokens");
+    if (tokens_id >= 0 && gguf_get_kv_type(meta.get(), tokens_id) == GGUF_TYPE_ARRAY) {
+        info.vocab_size = static_cast<int32_t>(gguf_get_arr_n(meta.get(), tokens_id));
+    }
+
+    std::vector<int64_t> bytes_by_type(GGML_TYPE_COUNT, 0);
+    const int64_t n_tensors = gguf_get_n_tensors(meta.get());
+    for (int64_t i = 0; i < n_tensors; ++i) {
+        const ggml_type type = gguf_get_tensor_type(meta.get(), i);
+        const auto bytes = static_cast<int64_t>(gguf_get_tensor_size(meta.get(), i));
+        const auto type_size = static_cast<int64_t>(ggml_type_size(type));
+        if (type_size > 0) {
+            info.parameter_count += bytes / type_size * ggml_blck_size(type);
+        }
+        info.weight_bytes += bytes;
+        if (type >= 0 && type < GGML_TYPE_COUNT) {
+            bytes_by_type[static_cast<size_t>(type)] += bytes;
+        }
+    }
+
+    const std::optional<int64_t> file_type = readInteger(meta.get(), "general.file_type");
+    const char* label = file_type ? fileTypeName(*file_type) : nullptr;
+    if (label) {
+        info.quantization = label;
+    } else if (info.weight_bytes > 0) {
+        size_t dominant = 0;
+        for (size_t type = 1; type < bytes_by_type.size(); ++type) {
+            if (bytes_by_type[type] > bytes_by_type[dominant]) {
+                dominant = type;
+            }
+        }
+        info.quantization = ggml_type_name(static_cast<ggml_type>(dominant));
+    }
+    return info;
+}
+
+}  // namespace
+
+ModelInfo probeModel(const std::string& path) {
+    const FileIdentity identity = statModelFile(path);
+    {
+        std::lock_guard<std::mutex> lock(g_probe_mutex);
+        const auto it = g_probe_cache.find(path);
+        if (it != g_probe_cache.end() && it->second.identity == identity) {
+            return it->second.info;
+        }
+    }
+
+    ModelInfo info = readModelInfo(path, identity.size);
+    std::lock_guard<std::mutex> lock(g_probe_mutex);
+    g_probe_cache[path] = {identity, info};
+    return info;
+}
+
+}  // namespace cicero
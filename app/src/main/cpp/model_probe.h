@@ -0,0 +1,43 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+// Model metadata read straight from a GGUF file's header, key/value section and tensor table,
+// without mapping or loading any weights.  Used to pick and validate a runtime config before the
+// multi-second createSession.
+namespace cicero {
+
+struct ModelInfo {
+    std::string architecture;
+    // general.name; empty when the file does not set it.
+    std::string name;
+    // llama.cpp file type label (Q4_K_M, Q8_0, ...), or the ggml name of the type holding most of
+    // the weight bytes when general.file_type is missing or unknown.
+    std::string quantization;
+    // tokenizer.chat_template; empty when the model has none.
+    std::string chat_template;
+    int64_t file_size = 0;
+    int64_t parameter_count = 0;
+    // Bytes of tensor data, i.e. what the weights occupy once loaded.
+    int64_t weight_bytes = 0;
+    // Hyper-parameters of the architecture; 0 when the file does not state them (or stores them
+    // per layer).
+    int32_t context_length = 0;
+    int32_t layer_count = 0;
+    int32_t embedding_length = 0;
+    int32_t head_count = 0;
+    int32_t head_count_kv = 0;
+    // Per-head K and V widths, derived from embedding_length / head_count when not stored.
+    int32_t key_length = 0;
+    int32_t value_length = 0;
+    int32_t vocab_size = 0;
+    int32_t feed_forward_length = 0;
+};
+
+// Reads the metadata of the GGUF model at `path`, typically in a few milliseconds.  Results are
+// cached per path and reused while the file's size, mtime and inode are unchanged.  Throws
+// std::runtime_error when the file cannot be read or is not a valid GGUF.
+ModelInfo probeModel(const std::string& path);
+
+}  // namespace cicero
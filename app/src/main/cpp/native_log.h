@@ -0,0 +1,56 @@
+#pragma once
+
+#include <cstdarg>
+#include <cstdio>
+
+#if defined(__ANDROID__)
+#include <android/log.h>
+#endif
+
+namespace cicero {
+
+constexpr const char* kLogTag = "CiceroLlama";
+
+enum class LogLevel {
+    Debug,
+    Info,
+    Warn,
+    Error,
+};
+
+// Native logging shared by the JNI bridge and host tools: logcat on Android, stderr elsewhere so
+// benchmark output on stdout stays machine readable.
+inline void logPrint(LogLevel level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+inline void logPrint(LogLevel level, const char* format, ...) {
+    va_list args;
+    va_start(args, format);
+#if defined(__ANDROID__)
+    int priority = ANDROID_LOG_INFO;
+    switch (level) {
+        case LogLevel::Debug:
+            priority = ANDROID_LOG_DEBUG;
+            break;
+        case LogLevel::Info:
+            priority = ANDROID_LOG_INFO;
+            break;
+        case LogLevel::Warn:
+            priority = ANDROID_LOG_WARN;
+            break;
+        case LogLevel::Error:
+            priority = ANDROID_LOG_ERROR;
+            break;
+    }
+    __android_log_vprint(priority, kLogTag, format, args);
+#else
+    if (level != LogLevel::Debug) {
+        static constexpr const char* kLevelNames[] = {"D", "I", "W", "E"};
+        std::fprintf(stderr, "%s/%s: ", kLevelNames[static_cast<int>(level)], kLogTag);
+        std::vfprintf(stderr, format, args);
+        std::fputc('\n', stderr);
+    }
+#endif
+    va_end(args);
+}
+
+}  // namespace cicero
@@ -0,0 +1,117 @@
+#include "session_metrics.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <functional>
+#include <thread>
+
+namespace cicero {
+
+namespace {
+
+constexpr const char* kPhaseNames[kMetricPhaseCount] = {
+        "tokenize", "prefill", "decode", "sample", "detokenize", "stop_match", "callback", "embed",
+};
+
+size_t bucketFor(uint64_t duration_ns) {
+    uint64_t micros = duration_ns / 1000;
+    size_t bucket = 0;
+    while (micros > 0 && bucket + 1 < kMetricBuckets) {
+        micros >>= 1;
+        ++bucket;
+    }
+    return bucket;
+}
+
+uint32_t currentThreadId() {
+    return static_cast<uint32_t>(std::hash<std::thread::id>()(std::this_thread::get_id()));
+}
+
+}  // namespace
+
+void SessionMetrics::record(MetricPhase phase, Clock::time_point start, Clock::time_point end) {
+    const auto duration_ns = static_cast<uint64_t>(
+            std::max<int64_t>(0, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count()));
+    PhaseCounters& counters = phases_[static_cast<size_t>(phase)];
+    counters.count.fetch_add(1, std::memory_order_relaxed);
+    counters.total_ns.fetch_add(duration_ns, std::memory_order_relaxed);
+    counters.buckets[bucketFor(duration_ns)].fetch_add(1, std::memory_order_relaxed);
+    uint64_t max_ns = counters.max_ns.load(std::memory_order_relaxed);
+    while (duration_ns > max_ns &&
+           !counters.max_ns.compare_exchange_weak(max_ns, duration_ns, std::memory_order_relaxed)) {
+    }
+
+    if (tracing_.load(std::memory_order_relaxed)) {
+        appendTrace(phase, start, static_cast<int64_t>(duration_ns));
+    }
+}
+
+std::vector<int64_t> SessionMetrics::snapshot(bool reset) {
+    std::vector<int64_t> values;
+    values.reserve(kMetricPhaseCount * kMetricValuesPerPhase);
+    auto take = [reset](std::atomic<uint64_t>& value) {
+        return static_cast<int64_t>(reset ? value.exchange(0, std::memory_order_relaxed)
+                                          : value.load(std::memory_order_relaxed));
+    };
+    for (PhaseCounters& counters : phases_) {
+        values.push_back(take(counters.count));
+        values.push_back(take(counters.total_ns));
+        values.push_back(take(counters.max_ns));
+        for (std::atomic<uint64_t>& bucket : counters.buckets) {
+            values.push_back(take(bucket));
+        }
+    }
+    return values;
+}
+
+void SessionMetrics::configureTrace(size_t capacity) {
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    trace_.clear();
+    trace_.shrink_to_fit();
+    trace_.resize(capacity);
+    trace_next_ = 0;
+    trace_wrapped_ = false;
+    tracing_.store(capacity > 0, std::memory_order_relaxed);
+}
+
+void SessionMetrics::appendTrace(MetricPhase phase, Clock::time_point start, int64_t duration_ns) {
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    if (trace_.empty()) {
+        return;
+    }
+    TraceEvent& event = trace_[trace_next_];
+    event.phase = phase;
+    event.thread = currentThreadId();
+    event.start_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(start - epoch_).count();
+    event.duration_ns = duration_ns;
+    if (++trace_next_ == trace_.size()) {
+        trace_next_ = 0;
+        trace_wrapped_ = true;
+    }
+}
+
+std::string SessionMetrics::chromeTrace() {
+    std::lock_guard<std::mutex> lock(trace_mutex_);
+    const size_t count = trace_wrapped_ ? trace_.size() : trace_next_;
+    const size_t first = trace_wrapped_ ? trace_next_ : 0;
+
+    std::string json = "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[";
+    json.reserve(json.size() + count * 96 + 2);
+    char entry[160];
+    for (size_t i = 0; i < count; ++i) {
+        const TraceEvent& event = trace_[(first + i) % trace_.size()];
+        std::snprintf(entry, sizeof(entry),
+                      "%s{\"name\":\"%s\",\"cat\":\"llama\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,"
+                      "\"ts\":%.3f,\"dur\":%.3f}",
+                      i == 0 ? "" : ",",
+                      kPhaseNames[static_cast<size_t>(event.phase)],
+                      event.thread,
+                      static_cast<double>(event.start_ns) / 1000.0,
+                      static_cast<double>(event.duration_ns) / 1000.0);
+        json += entry;
+    }
+    json += "]}";
+    return json;
+}
+
+}  // namespace cicero
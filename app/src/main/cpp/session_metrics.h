@@ -0,0 +1,97 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <vector>
+
+namespace cicero {
+
+// Hot-path phases timed per session.  The order is the order of the JNI metrics array
+// (NativeMetrics.kt) and must only ever be appended to.
+enum class MetricPhase : uint8_t {
+    Tokenize,
+    Prefill,
+    Decode,
+    Sample,
+    Detokenize,
+    StopMatch,
+    Callback,
+    Embed,
+    Count,
+};
+
+constexpr size_t kMetricPhaseCount = static_cast<size_t>(MetricPhase::Count);
+// Log2 latency histogram: bucket 0 counts durations under 1 us, bucket i durations in
+// [2^(i-1), 2^i) us, and the last bucket everything from ~4 s up.
+constexpr size_t kMetricBuckets = 24;
+// Per phase: count, total ns, max ns, then the histogram buckets.
+constexpr size_t kMetricValuesPerPhase = 3 + kMetricBuckets;
+
+// Lock-free counters and histograms for every MetricPhase plus an optional trace of individual
+// events.  Recording is a handful of relaxed atomic adds, so the counters stay on in production;
+// the trace ring takes a mutex and is only touched while enabled.
+class SessionMetrics {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    void record(MetricPhase phase, Clock::time_point start, Clock::time_point end);
+
+    // Flattened counters (kMetricValuesPerPhase values per phase, in MetricPhase order).
+    std::vector<int64_t> snapshot(bool reset);
+
+    // Keeps the most recent `capacity` events for chromeTrace(); 0 disables tracing and drops the
+    // buffer.
+    void configureTrace(size_t capacity);
+
+    // Buffered events as Chrome trace-event JSON (chrome://tracing, Perfetto).
+    std::string chromeTrace();
+
+private:
+    struct PhaseCounters {
+        std::atomic<uint64_t> count{0};
+        std::atomic<uint64_t> total_ns{0};
+        std::atomic<uint64_t> max_ns{0};
+        std::array<std::atomic<uint64_t>, kMetricBuckets> buckets{};
+    };
+
+    struct TraceEvent {
+        MetricPhase phase = MetricPhase::Tokenize;
+        uint32_t thread = 0;
+        int64_t start_ns = 0;
+        int64_t duration_ns = 0;
+    };
+
+    void appendTrace(MetricPhase phase, Clock::time_point start, int64_t duration_ns);
+
+    std::array<PhaseCounters, kMetricPhaseCount> phases_{};
+    std::atomic<bool> tracing_{false};
+    std::mutex trace_mutex_;
+    std::vector<TraceEvent> trace_;
+    size_t trace_next_ = 0;
+    bool trace_wrapped_ = false;
+    const Clock::time_point epoch_ = Clock::now();
+};
+
+// Records the lifetime of the enclosing scope as one `phase` event.
+class PhaseTimer {
+public:
+    PhaseTimer(SessionMetrics& metrics, MetricPhase phase)
+        : metrics_(metrics), phase_(phase), start_(SessionMetrics::Clock::now()) {}
+
+    ~PhaseTimer() { metrics_.record(phase_, start_, SessionMetrics::Clock::now()); }
+
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+private:
+    SessionMetrics& metrics_;
+    MetricPhase phase_;
+    SessionMetrics::Clock::time_point start_;
+};
+
+}  // namespace cicero
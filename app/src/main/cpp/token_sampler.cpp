@@ -0,0 +1,143 @@
+#include "token_sampler.h"
+
+#include "vector_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace cicero {
+
+bool TokenSamplerParams::operator==(const TokenSamplerParams& other) const {
+    return top_k == other.top_k && top_p == other.top_p && temperature == other.temperature &&
+           penalty_last_n == other.penalty_last_n && penalty_repeat == other.penalty_repeat &&
+           penalty_freq == other.penalty_freq && penalty_present == other.penalty_present && seed == other.seed;
+}
+
+TokenSampler::TokenSampler(const TokenSamplerParams& params) : params_(params) {
+    if (params_.penalty_repeat == 1.0f && params_.penalty_freq == 0.0f && params_.penalty_present == 0.0f) {
+        params_.penalty_last_n = 0;
+    }
+    history_.resize(static_cast<size_t>(std::max(params_.penalty_last_n, 0)));
+    reset();
+}
+
+void TokenSampler::reset() {
+    history_next_ = 0;
+    history_size_ = 0;
+    counts_.clear();
+    rng_.seed(params_.seed == kRandomSeed ? std::random_device{}() : params_.seed);
+}
+
+void TokenSampler::accept(int32_t token) {
+    if (history_.empty()) {
+        return;
+    }
+    if (history_size_ == history_.size()) {
+        const auto oldest = counts_.find(history_[history_next_]);
+        if (oldest != counts_.end() && --oldest->second == 0) {
+            counts_.erase(oldest);
+        }
+    } else {
+        ++history_size_;
+    }
+    history_[history_next_] = token;
+    history_next_ = (history_next_ + 1) % history_.size();
+    ++counts_[token];
+}
+
+size_t TokenSampler::prepare(const float* logits, size_t n_vocab, double& total) {
+    const float* values = logits;
+    if (!counts_.empty()) {
+        // Same arithmetic as llama.cpp's penalties stage.
+        penalised_.assign(logits, logits + n_vocab);
+        for (const auto& entry : counts_) {
+            if (entry.first < 0 || static_cast<size_t>(entry.first) >= n_vocab) {
+                continue;
+            }
+            float& logit = penalised_[static_cast<size_t>(entry.first)];
+            logit = logit <= 0.0f ? logit * params_.penalty_repeat : logit / params_.penalty_repeat;
+            logit -= static_cast<float>(entry.second) * params_.penalty_freq + params_.penalty_present;
+        }
+        values = penalised_.data();
+    }
+
+    const float max = maxF32(values, n_vocab);
+    if (!(max > -INFINITY)) {
+        throw std::runtime_error("Tidak ada token yang dapat dipilih.");
+    }
+    const float temperature = params_.temperature.value_or(1.0f);
+    indices_.resize(n_vocab);
+    size_t count =
+            selectAtLeast(values, n_vocab, max - kLogitWindow * std::max(1.0f, temperature), indices_.data());
+    candidates_.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        candidates_[i] = {values[indices_[i]], static_cast<int32_t>(indices_[i])};
+    }
+
+    const auto by_logit = [](const Candidate& a, const Candidate& b) { return a.logit > b.logit; };
+    const auto begin = candidates_.begin();
+    if (params_.top_k && static_cast<size_t>(*params_.top_k) < count) {
+        count = static_cast<size_t>(*params_.top_k);
+        std::nth_element(begin, begin + static_cast<ptrdiff_t>(count - 1), candidates_.end(), by_logit);
+    }
+
+    if (params_.top_p && *params_.top_p < 1.0f) {
+        // top-p sees the untempered softmax, as in the chain where it ran before temperature.
+        double sum = 0.0;
+        for (size_t i = 0; i < count; ++i) {
+            sum += std::exp(static_cast<double>(candidates_[i].logit - max));
+        }
+        const double target = static_cast<double>(*params_.top_p) * sum;
+        const auto end = begin + static_cast<ptrdiff_t>(count);
+        double cumulative = 0.0;
+        size_t kept = count;
+        size_t sorted = 0;
+        for (size_t chunk = 64; sorted < count && kept == count; chunk *= 4) {
+            const size_t limit = std::min(count, sorted + chunk);
+            std::partial_sort(begin + static_cast<ptrdiff_t>(sorted), begin + static_cast<ptrdiff_t>(limit), end,
+                              by_logit);
+            for (; sorted < limit; ++sorted) {
+                cumulative += std::exp(static_cast<double>(candidates_[sorted].logit - max));
+                if (cumulative >= target) {
+                    kept = sorted + 1;
+                    break;
+                }
+            }
+        }
+        count = kept;
+    }
+
+    weights_.resize(count);
+    total = 0.0;
+    const float inverse_temperature = 1.0f / temperature;
+    for (size_t i = 0; i < count; ++i) {
+        weights_[i] = std::exp((candidates_[i].logit - max) * inverse_temperature);
+        total += weights_[i];
+    }
+    return count;
+}
+
+int32_t TokenSampler::sample(const float* logits, size_t n_vocab) {
+    double total = 0.0;
+    const size_t count = prepare(logits, n_vocab, total);
+    double target = std::uniform_real_distribution<double>(0.0, total)(rng_);
+    for (size_t i = 0; i + 1 < count; ++i) {
+        target -= weights_[i];
+        if (target < 0.0) {
+            return candidates_[i].token;
+        }
+    }
+    return candidates_[count - 1].token;
+}
+
+void TokenSampler::distribution(const float* logits, size_t n_vocab, std::vector<TokenProbability>& out) {
+    double total = 0.0;
+    const size_t count = prepare(logits, n_vocab, total);
+    out.resize(count);
+    for (size_t i = 0; i < count; ++i) {
+        out[i] = {candidates_[i].token, static_cast<float>(weights_[i] / total)};
+    }
+}
+
+}  // namespace cicero
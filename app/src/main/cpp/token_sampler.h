@@ -0,0 +1,92 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+// Next-token sampling over raw logits.  Independent of llama.cpp so host tools can compare it
+// against a reference implementation without a model.
+namespace cicero {
+
+struct TokenSamplerParams {
+    std::optional<int32_t> top_k;
+    std::optional<float> top_p;
+    std::optional<float> temperature;
+    // Repetition penalties over the last `penalty_last_n` accepted tokens; 0 disables them.
+    int32_t penalty_last_n = 0;
+    float penalty_repeat = 1.0f;
+    float penalty_freq = 0.0f;
+    float penalty_present = 0.0f;
+    // kRandomSeed draws a fresh seed on every reset, like LLAMA_DEFAULT_SEED.
+    uint32_t seed = 0xFFFFFFFF;
+
+    bool operator==(const TokenSamplerParams& other) const;
+    bool operator!=(const TokenSamplerParams& other) const { return !(*this == other); }
+};
+
+struct TokenProbability {
+    int32_t token = 0;
+    float probability = 0.0f;
+};
+
+// The penalties -> top-k -> top-p -> temperature -> dist chain the sessions used to build from
+// llama_sampler stages, fused into one pass that never materialises the full vocabulary:
+//   1. a SIMD max over the (penalised) logits,
+//   2. a SIMD compaction of the tokens within kLogitWindow * max(1, temperature) of it; the rest
+//      carry less than e^-30 of the probability mass each,
+//   3. top-k by partial selection instead of a full sort,
+//   4. top-p by sorting the survivors in growing chunks and stopping as soon as the nucleus is
+//      complete,
+//   5. temperature and sampling over what is left.
+// The result matches the llama.cpp chain's distribution up to the truncated tail.  Buffers are
+// reused across calls, so one sampler per completion (or per session) allocates once.
+class TokenSampler {
+public:
+    static constexpr uint32_t kRandomSeed = 0xFFFFFFFF;
+    static constexpr float kLogitWindow = 30.0f;
+
+    explicit TokenSampler(const TokenSamplerParams& params);
+
+    const TokenSamplerParams& params() const { return params_; }
+
+    // Forgets the penalty history and reseeds, leaving the sampler as if newly constructed.
+    void reset();
+
+    // Records a token for the repetition penalties.  Prompt tokens count as well.
+    void accept(int32_t token);
+
+    // Draws the next token from `logits` (n_vocab entries; -infinity marks a forbidden token).
+    // Throws std::runtime_error when every token is forbidden.
+    int32_t sample(const float* logits, size_t n_vocab);
+
+    // The distribution sample() draws from, in no particular order.
+    void distribution(const float* logits, size_t n_vocab, std::vector<TokenProbability>& out);
+
+private:
+    struct Candidate {
+        float logit;
+        int32_t token;
+    };
+
+    // Leaves the kept candidates in candidates_[0, returned count) and their unnormalised
+    // probabilities in weights_; returns the weight total in `total`.
+    size_t prepare(const float* logits, size_t n_vocab, double& total);
+
+    TokenSamplerParams params_;
+    std::mt19937 rng_;
+    // Penalty window: ring buffer of recent tokens and their counts.
+    std::vector<int32_t> history_;
+    size_t history_next_ = 0;
+    size_t history_size_ = 0;
+    std::unordered_map<int32_t, int32_t> counts_;
+    // Per-call scratch, kept to avoid reallocating vocabulary-sized buffers.
+    std::vector<float> penalised_;
+    std::vector<uint32_t> indices_;
+    std::vector<Candidate> candidates_;
+    std::vector<float> weights_;
+};
+
+}  // namespace cicero
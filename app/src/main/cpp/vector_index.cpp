@@ -0,0 +1,617 @@
+#include "vector_index.h"
+
+#include "native_log.h"
+#include "vector_kernels.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cerrno>
+#include <cmath>
+#include <cstring>
+#include <mutex>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+
+namespace cicero {
+
+// Read-write shared mapping of a file that grows by doubling.  Growing remaps, so pointers into
+// data() are only valid until the next reserve().
+class MappedRegion {
+public:
+    explicit MappedRegion(const std::string& path) : path_(path) {
+        fd_ = ::open(path.c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+        if (fd_ < 0) {
+            throw std::runtime_error("Berkas indeks vektor tidak dapat dibuka: " + path);
+        }
+        struct stat info {};
+        if (fstat(fd_, &info) != 0) {
+            ::close(fd_);
+            throw std::runtime_error("Berkas indeks vektor tidak dapat dibaca: " + path);
+        }
+        created_ = info.st_size == 0;
+        capacity_ = static_cast<size_t>(info.st_size);
+        try {
+            reserve(kInitialCapacity);
+            if (!data_) {
+                map();
+            }
+        } catch (...) {
+            ::close(fd_);
+            throw;
+        }
+    }
+
+    MappedRegion(const MappedRegion&) = delete;
+    MappedRegion& operator=(const MappedRegion&) = delete;
+
+    ~MappedRegion() {
+        if (data_) {
+            munmap(data_, capacity_);
+        }
+        ::close(fd_);
+    }
+
+    uint8_t* data() const { return data_; }
+    bool created() const { return created_; }
+
+    void reserve(size_t bytes) {
+        if (bytes <= capacity_ && data_) {
+            return;
+        }
+        if (bytes > capacity_) {
+            size_t capacity = std::max(capacity_, kInitialCapacity);
+            while (capacity < bytes) {
+                capacity *= 2;
+            }
+            if (ftruncate(fd_, static_cast<off_t>(capacity)) != 0) {
+                throw std::runtime_error("Berkas indeks vektor tidak dapat diperbesar: " + path_ + ": " +
+                                         std::strerror(errno));
+            }
+            if (data_) {
+                munmap(data_, capacity_);
+                data_ = nullptr;
+            }
+            capacity_ = capacity;
+        }
+        map();
+    }
+
+    void sync() const {
+        if (data_) {
+            msync(data_, capacity_, MS_SYNC);
+        }
+    }
+
+private:
+    static constexpr size_t kInitialCapacity = 64 * 1024;
+
+    void map() {
+        void* data = mmap(nullptr, capacity_, PROT_READ | PROT_WRITE, MAP_SHARED, fd_, 0);
+        if (data == MAP_FAILED) {
+            throw std::runtime_error("Berkas indeks vektor tidak dapat dipetakan: " + path_);
+        }
+        data_ = static_cast<uint8_t*>(data);
+    }
+
+    std::string path_;
+    int fd_ = -1;
+    uint8_t* data_ = nullptr;
+    size_t capacity_ = 0;
+    bool created_ = false;
+};
+
+namespace {
+
+constexpr uint32_t kVectorMagic = 0x49564343;  // "CCVI"
+constexpr uint32_t kGraphMagic = 0x47484343;   // "CCHG"
+constexpr uint32_t kLinksMagic = 0x4c4b4343;   // "CCKL"
+constexpr uint32_t kVectorIndexVersion = 1;
+constexpr size_t kHeaderBytes = 64;
+constexpr int32_t kMaxLevel = 15;
+
+struct VectorFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t dimension;
+    uint32_t encoding;
+    uint64_t count;
+    uint32_t record_bytes;
+    uint32_t reserved[9];
+};
+
+struct GraphFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t max_neighbors;
+    int32_t max_level;
+    uint64_t count;
+    uint32_t entry_point;
+    uint32_t reserved[9];
+};
+
+struct LinksFileHeader {
+    uint32_t magic;
+    uint32_t version;
+    // Used length of the link area in uint32 words.
+    uint64_t used;
+    uint32_t reserved[12];
+};
+
+static_assert(sizeof(VectorFileHeader) == kHeaderBytes, "header vektor harus 64 byte");
+static_assert(sizeof(GraphFileHeader) == kHeaderBytes, "header graf harus 64 byte");
+static_assert(sizeof(LinksFileHeader) == kHeaderBytes, "header tautan harus 64 byte");
+
+// Fixed part of every vector record; the payload (float or int8) follows.
+struct VectorRecord {
+    int64_t id;
+    float scale;
+    uint32_t reserved;
+};
+
+// Fixed part of every graph node; 2 * M layer-0 links follow.  Nodes above layer 0 own
+// level * (1 + M) words at `upper_offset` in links.cvi: a count followed by M links per layer.
+struct GraphNode {
+    uint32_t level;
+    uint32_t upper_offset;
+    uint32_t count0;
+};
+
+size_t alignTo(size_t value, size_t alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void normalize(std::vector<float>& vector) {
+    const float norm = std::sqrt(dotF32(vector.data(), vector.data(), vector.size()));
+    if (norm > 0.0f) {
+        const float scale = 1.0f / norm;
+        for (float& value : vector) {
+            value *= scale;
+        }
+    }
+}
+
+// Visit marks reused across searches on the same thread; bumping the generation clears them.
+struct VisitedSet {
+    std::vector<uint32_t> marks;
+    uint32_t generation = 0;
+
+    void reset(size_t size) {
+        if (marks.size() < size) {
+            marks.resize(size, 0);
+        }
+        if (++generation == 0) {
+            std::fill(marks.begin(), marks.end(), 0);
+            generation = 1;
+        }
+    }
+
+    bool insert(uint32_t node) {
+        if (marks[node] == generation) {
+            return false;
+        }
+        marks[node] = generation;
+        return true;
+    }
+};
+
+thread_local VisitedSet t_visited;
+
+using Candidate = std::pair<float, uint32_t>;
+
+}  // namespace
+
+struct VectorIndex::Query {
+    std::vector<float> values;
+    std::vector<int8_t> quantized;
+    float scale = 0.0f;
+};
+
+VectorIndex::VectorIndex(const VectorIndexOptions& options) : options_(options) {}
+
+VectorIndex::~VectorIndex() = default;
+
+std::unique_ptr<VectorIndex> VectorIndex::open(const std::string& directory, const VectorIndexOptions& options) {
+    if (options.dimension <= 0 || options.max_neighbors < 2 || options.ef_construction <= 0) {
+        throw std::runtime_error("Parameter indeks vektor tidak valid.");
+    }
+    if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+        throw std::runtime_error("Direktori indeks vektor tidak dapat dibuat: " + directory);
+    }
+
+    std::unique_ptr<VectorIndex> index(new VectorIndex(options));
+    index->vectors_ = std::make_unique<MappedRegion>(directory + "/vectors.cvi");
+    index->graph_ = std::make_unique<MappedRegion>(directory + "/graph.cvi");
+    index->links_ = std::make_unique<MappedRegion>(directory + "/links.cvi");
+
+    const size_t payload = options.encoding == VectorEncoding::Int8
+                                   ? static_cast<size_t>(options.dimension)
+                                   : static_cast<size_t>(options.dimension) * sizeof(float);
+    index->record_bytes_ = alignTo(sizeof(VectorRecord) + payload, 16);
+
+    auto* vectors = reinterpret_cast<VectorFileHeader*>(index->vectors_->data());
+    auto* graph = reinterpret_cast<GraphFileHeader*>(index->graph_->data());
+    auto* links = reinterpret_cast<LinksFileHeader*>(index->links_->data());
+    if (vectors->magic != kVectorMagic) {
+        *vectors = VectorFileHeader{};
+        vectors->magic = kVectorMagic;
+        vectors->version = kVectorIndexVersion;
+        vectors->dimension = static_cast<uint32_t>(options.dimension);
+        vectors->encoding = static_cast<uint32_t>(options.encoding);
+        vectors->record_bytes = static_cast<uint32_t>(index->record_bytes_);
+    } else if (vectors->version != kVectorIndexVersion ||
+               vectors->dimension != static_cast<uint32_t>(options.dimension) ||
+               vectors->encoding != static_cast<uint32_t>(options.encoding) ||
+               vectors->record_bytes != index->record_bytes_) {
+        throw std::runtime_error("Indeks vektor di " + directory + " dibuat dengan dimensi atau encoding lain.");
+    }
+    if (graph->magic != kGraphMagic) {
+        *graph = GraphFileHeader{};
+        graph->magic = kGraphMagic;
+        graph->version = kVectorIndexVersion;
+        graph->max_neighbors = static_cast<uint32_t>(options.max_neighbors);
+        graph->max_level = -1;
+    } else {
+        // The stored fan-out fixes the node layout.
+        index->options_.max_neighbors = static_cast<int32_t>(graph->max_neighbors);
+    }
+    if (links->magic != kLinksMagic) {
+        *links = LinksFileHeader{};
+        links->magic = kLinksMagic;
+        links->version = kVectorIndexVersion;
+    }
+    index->node_bytes_ = sizeof(GraphNode) + 2 * static_cast<size_t>(index->options_.max_neighbors) * sizeof(uint32_t);
+    index->rng_state_ = 0x9e3779b97f4a7c15ULL ^ vectors->count;
+
+    // Vectors appended before a crash but never linked.
+    const uint64_t stored = vectors->count;
+    const uint64_t linked = std::min<uint64_t>(graph->count, stored);
+    for (uint64_t node = linked; node < stored; ++node) {
+        index->linkNode(static_cast<uint32_t>(node));
+    }
+    if (stored > linked) {
+        logPrint(LogLevel::Warn, "Indeks vektor: %llu vektor ditautkan ulang",
+                 static_cast<unsigned long long>(stored - linked));
+    }
+    return index;
+}
+
+size_t VectorIndex::size() const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    return static_cast<size_t>(reinterpret_cast<const GraphFileHeader*>(graph_->data())->count);
+}
+
+void VectorIndex::sync() {
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    vectors_->sync();
+    links_->sync();
+    graph_->sync();
+}
+
+void VectorIndex::add(const int64_t* ids, const float* vectors, size_t count) {
+    if (count == 0) {
+        return;
+    }
+    std::unique_lock<std::shared_mutex> lock(mutex_);
+    const auto dimension = static_cast<size_t>(options_.dimension);
+    const uint64_t first = reinterpret_cast<const VectorFileHeader*>(vectors_->data())->count;
+    vectors_->reserve(kHeaderBytes + (first + count) * record_bytes_);
+    graph_->reserve(kHeaderBytes + (first + count) * node_bytes_);
+
+    std::vector<float> normalized(dimension);
+    for (size_t i = 0; i < count; ++i) {
+        const uint64_t node = first + i;
+        if (node >= UINT32_MAX) {
+            throw std::runtime_error("Indeks vektor penuh.");
+        }
+        normalized.assign(vectors + i * dimension, vectors + (i + 1) * dimension);
+        normalize(normalized);
+
+        uint8_t* record = vectors_->data() + kHeaderBytes + node * record_bytes_;
+        auto* header = reinterpret_cast<VectorRecord*>(record);
+        header->id = ids[i];
+        header->reserved = 0;
+        if (options_.encoding == VectorEncoding::Int8) {
+            header->scale = quantizeI8(normalized.data(),
+                                       reinterpret_cast<int8_t*>(record + sizeof(VectorRecord)),
+                                       dimension);
+        } else {
+            header->scale = 1.0f;
+            std::memcpy(record + sizeof(VectorRecord), normalized.data(), dimension * sizeof(float));
+        }
+        reinterpret_cast<VectorFileHeader*>(vectors_->data())->count = node + 1;
+        linkNode(static_cast<uint32_t>(node));
+    }
+}
+
+std::vector<VectorMatch> VectorIndex::search(const float* query, size_t k, size_t ef) const {
+    std::shared_lock<std::shared_mutex> lock(mutex_);
+    const auto* graph = reinterpret_cast<const GraphFileHeader*>(graph_->data());
+    if (graph->count == 0 || k == 0) {
+        return {};
+    }
+
+    const Query prepared = prepareQuery(query);
+    uint32_t entry = graph->entry_point;
+    for (int32_t level = graph->max_level; level > 0; --level) {
+        entry = greedyClosest(prepared, entry, level);
+    }
+    std::vector<Candidate> found = searchLayer(prepared, {entry}, std::max(ef, k), 0);
+    std::sort(found.begin(), found.end(), [](const Candidate& a, const Candidate& b) { return a.first > b.first; });
+    if (found.size() > k) {
+        found.resize(k);
+    }
+
+    std::vector<VectorMatch> matches;
+    matches.reserve(found.size());
+    for (const Candidate& candidate : found) {
+        const uint8_t* record = vectors_->data() + kHeaderBytes + candidate.second * record_bytes_;
+        matches.push_back({reinterpret_cast<const VectorRecord*>(record)->id, candidate.first});
+    }
+    return matches;
+}
+
+VectorIndex::Query VectorIndex::prepareQuery(const float* vector) const {
+    Query query;
+    query.values.assign(vector, vector + options_.dimension);
+    normalize(query.values);
+    if (options_.encoding == VectorEncoding::Int8) {
+        query.quantized.resize(query.values.size());
+        query.scale = quantizeI8(query.values.data(), query.quantized.data(), query.values.size());
+    }
+    return query;
+}
+
+VectorIndex::Query VectorIndex::nodeQuery(uint32_t node) const {
+    const uint8_t* record = vectors_->data() + kHeaderBytes + node * record_bytes_;
+    const uint8_t* payload = record + sizeof(VectorRecord);
+    const auto dimension = static_cast<size_t>(options_.dimension);
+    Query query;
+    if (options_.encoding == VectorEncoding::Int8) {
+        const auto* values = reinterpret_cast<const int8_t*>(payload);
+        query.quantized.assign(values, values + dimension);
+        query.scale = reinterpret_cast<const VectorRecord*>(record)->scale;
+    } else {
+        const auto* values = reinterpret_cast<const float*>(payload);
+        query.values.assign(values, values + dimension);
+    }
+    return query;
+}
+
+float VectorIndex::similarity(const Query& query, uint32_t node) const {
+    const uint8_t* record = vectors_->data() + kHeaderBytes + node * record_bytes_;
+    const uint8_t* payload = record + sizeof(VectorRecord);
+    const auto dimension = static_cast<size_t>(options_.dimension);
+    if (options_.encoding == VectorEncoding::Int8) {
+        const float scale = reinterpret_cast<const VectorRecord*>(record)->scale;
+        return query.scale * scale *
+               static_cast<float>(dotI8(query.quantized.data(), reinterpret_cast<const int8_t*>(payload), dimension));
+    }
+    return dotF32(query.values.data(), reinterpret_cast<const float*>(payload), dimension);
+}
+
+float VectorIndex::similarity(uint32_t a, uint32_t b) const {
+    const uint8_t* record_a = vectors_->data() + kHeaderBytes + a * record_bytes_;
+    const uint8_t* record_b = vectors_->data() + kHeaderBytes + b * record_bytes_;
+    const auto dimension = static_cast<size_t>(options_.dimension);
+    if (options_.encoding == VectorEncoding::Int8) {
+        const float scale = reinterpret_cast<const VectorRecord*>(record_a)->scale *
+                            reinterpret_cast<const VectorRecord*>(record_b)->scale;
+        return scale * static_cast<float>(dotI8(reinterpret_cast<const int8_t*>(record_a + sizeof(VectorRecord)),
+                                                reinterpret_cast<const int8_t*>(record_b + sizeof(VectorRecord)),
+                                                dimension));
+    }
+    return dotF32(reinterpret_cast<const float*>(record_a + sizeof(VectorRecord)),
+                  reinterpret_cast<const float*>(record_b + sizeof(VectorRecord)),
+                  dimension);
+}
+
+uint32_t* VectorIndex::links(uint32_t node, int32_t level, uint32_t*& count) const {
+    auto* record = reinterpret_cast<GraphNode*>(graph_->data() + kHeaderBytes + node * node_bytes_);
+    if (level == 0) {
+        count = &record->count0;
+        return reinterpret_cast<uint32_t*>(record + 1);
+    }
+    uint32_t* block = reinterpret_cast<uint32_t*>(links_->data() + kHeaderBytes) + record->upper_offset +
+                      static_cast<size_t>(level - 1) * (1 + static_cast<size_t>(options_.max_neighbors));
+    count = block;
+    return block + 1;
+}
+
+uint32_t VectorIndex::greedyClosest(const Query& query, uint32_t entry, int32_t level) const {
+    uint32_t current = entry;
+    float best = similarity(query, current);
+    for (bool improved = true; improved;) {
+        improved = false;
+        uint32_t* count = nullptr;
+        const uint32_t* neighbors = links(current, level, count);
+        for (uint32_t i = 0; i < *count; ++i) {
+            const float score = similarity(query, neighbors[i]);
+            if (score > best) {
+                best = score;
+                current = neighbors[i];
+                improved = true;
+            }
+        }
+    }
+    return current;
+}
+
+std::vector<Candidate> VectorIndex::searchLayer(const Query& query,
+                                                const std::vector<uint32_t>& entries,
+                                                size_t ef,
+                                                int32_t level) const {
+    const auto* graph = reinterpret_cast<const GraphFileHeader*>(graph_->data());
+    VisitedSet& visited = t_visited;
+    visited.reset(static_cast<size_t>(graph->count) + 1);
+
+    // Best unexpanded candidate on top / worst kept result on top.
+    std::priority_queue<Candidate> candidates;
+    std::priority_queue<Candidate, std::vector<Candidate>, std::greater<Candidate>> results;
+    for (const uint32_t entry : entries) {
+        if (!visited.insert(entry)) {
+            continue;
+        }
+        const float score = similarity(query, entry);
+        candidates.emplace(score, entry);
+        results.emplace(score, entry);
+        if (results.size() > ef) {
+            results.pop();
+        }
+    }
+
+    while (!candidates.empty()) {
+        const Candidate current = candidates.top();
+        if (results.size() >= ef && current.first < results.top().first) {
+            break;
+        }
+        candidates.pop();
+
+        uint32_t* count = nullptr;
+        const uint32_t* neighbors = links(current.second, level, count);
+        for (uint32_t i = 0; i < *count; ++i) {
+            const uint32_t neighbor = neighbors[i];
+            if (!visited.insert(neighbor)) {
+                continue;
+            }
+            const float score = similarity(query, neighbor);
+            if (results.size() < ef || score > results.top().first) {
+                candidates.emplace(score, neighbor);
+                results.emplace(score, neighbor);
+                if (results.size() > ef) {
+                    results.pop();
+                }
+            }
+        }
+    }
+
+    std::vector<Candidate> found;
+    found.reserve(results.size());
+    while (!results.empty()) {
+        found.push_back(results.top());
+        results.pop();
+    }
+    return found;
+}
+
+// HNSW neighbour heuristic: a candidate is kept only when it is closer to the base point than to
+// every neighbour already kept, which spreads the links across directions.
+std::vector<uint32_t> VectorIndex::selectNeighbors(std::vector<Candidate> candidates, size_t limit) const {
+    std::sort(candidates.begin(), candidates.end(), [](const Candidate& a, const Candidate& b) {
+        return a.first > b.first;
+    });
+    std::vector<uint32_t> selected;
+    selected.reserve(limit);
+    for (const Candidate& candidate : candidates) {
+        if (selected.size() >= limit) {
+            break;
+        }
+        bool diverse = true;
+        for (const uint32_t kept : selected) {
+            if (similarity(candidate.second, kept) > candidate.first) {
+                diverse = false;
+                break;
+            }
+        }
+        if (diverse) {
+            selected.push_back(candidate.second);
+        }
+    }
+    return selected;
+}
+
+void VectorIndex::connect(uint32_t node, uint32_t neighbor, int32_t level) {
+    const size_t capacity = static_cast<size_t>(options_.max_neighbors) * (level == 0 ? 2 : 1);
+    uint32_t* count = nullptr;
+    uint32_t* neighbors = links(node, level, count);
+    if (*count < capacity) {
+        neighbors[(*count)++] = neighbor;
+        return;
+    }
+
+    std::vector<Candidate> candidates;
+    candidates.reserve(capacity + 1);
+    for (uint32_t i = 0; i < *count; ++i) {
+        candidates.emplace_back(similarity(node, neighbors[i]), neighbors[i]);
+    }
+    candidates.emplace_back(similarity(node, neighbor), neighbor);
+    const std::vector<uint32_t> kept = selectNeighbors(std::move(candidates), capacity);
+    std::copy(kept.begin(), kept.end(), neighbors);
+    *count = static_cast<uint32_t>(kept.size());
+}
+
+void VectorIndex::linkNode(uint32_t node) {
+    const auto max_neighbors = static_cast<size_t>(options_.max_neighbors);
+    graph_->reserve(kHeaderBytes + (static_cast<size_t>(node) + 1) * node_bytes_);
+
+    // Level ~ floor(-ln(U) / ln(M)), drawn from a splitmix64 stream.
+    rng_state_ += 0x9e3779b97f4a7c15ULL;
+    uint64_t bits = rng_state_;
+    bits = (bits ^ (bits >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    bits = (bits ^ (bits >> 27)) * 0x94d049bb133111ebULL;
+    bits ^= bits >> 31;
+    const double uniform = (static_cast<double>(bits >> 11) + 1.0) / 9007199254740993.0;
+    const auto level = std::min<int32_t>(
+            kMaxLevel, static_cast<int32_t>(-std::log(uniform) / std::log(static_cast<double>(max_neighbors))));
+
+    uint32_t upper_offset = 0;
+    if (level > 0) {
+        const size_t words = static_cast<size_t>(level) * (1 + max_neighbors);
+        auto* links_header = reinterpret_cast<LinksFileHeader*>(links_->data());
+        upper_offset = static_cast<uint32_t>(links_header->used);
+        links_->reserve(kHeaderBytes + (links_header->used + words) * sizeof(uint32_t));
+        links_header = reinterpret_cast<LinksFileHeader*>(links_->data());
+        std::memset(reinterpret_cast<uint32_t*>(links_->data() + kHeaderBytes) + upper_offset, 0,
+                    words * sizeof(uint32_t));
+        links_header->used += words;
+    }
+    auto* record = reinterpret_cast<GraphNode*>(graph_->data() + kHeaderBytes + node * node_bytes_);
+    record->level = static_cast<uint32_t>(level);
+    record->upper_offset = upper_offset;
+    record->count0 = 0;
+
+    auto* graph = reinterpret_cast<GraphFileHeader*>(graph_->data());
+    if (graph->max_level < 0) {
+        graph->entry_point = node;
+        graph->max_level = level;
+        graph->count = static_cast<uint64_t>(node) + 1;
+        return;
+    }
+
+    const Query query = nodeQuery(node);
+    uint32_t entry = graph->entry_point;
+    for (int32_t current = graph->max_level; current > level; --current) {
+        entry = greedyClosest(query, entry, current);
+    }
+    std::vector<uint32_t> entries{entry};
+    for (int32_t current = std::min(level, graph->max_level); current >= 0; --current) {
+        const std::vector<Candidate> found =
+                searchLayer(query, entries, static_cast<size_t>(options_.ef_construction), current);
+        const std::vector<uint32_t> selected = selectNeighbors(found, max_neighbors);
+
+        uint32_t* count = nullptr;
+        uint32_t* neighbors = links(node, current, count);
+        std::copy(selected.begin(), selected.end(), neighbors);
+        *count = static_cast<uint32_t>(selected.size());
+        for (const uint32_t neighbor : selected) {
+            connect(neighbor, node, current);
+        }
+
+        entries.clear();
+        for (const Candidate& candidate : found) {
+            entries.push_back(candidate.second);
+        }
+    }
+
+    if (level > graph->max_level) {
+        graph->entry_point = node;
+        graph->max_level = level;
+    }
+    graph->count = static_cast<uint64_t>(node) + 1;
+}
+
+}  // namespace cicero
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+// On-device approximate nearest-neighbour index for conversation memory.  Independent of llama.cpp
+// so the host tools can exercise it without a model.
+namespace cicero {
+
+enum class VectorEncoding : uint32_t {
+    Float32 = 0,
+    // One signed byte per dimension plus a per-vector scale; 4x smaller, slightly lower recall.
+    Int8 = 1,
+};
+
+struct VectorIndexOptions {
+    int32_t dimension = 0;
+    VectorEncoding encoding = VectorEncoding::Float32;
+    // HNSW fan-out: M links per node on the upper layers, 2 * M on layer 0.
+    int32_t max_neighbors = 16;
+    int32_t ef_construction = 100;
+};
+
+struct VectorMatch {
+    int64_t id = 0;
+    // Cosine similarity to the query.
+    float score = 0.0f;
+};
+
+class MappedRegion;
+
+// HNSW graph over cosine similarity whose vectors and links live in three memory-mapped,
+// append-only files in one directory:
+//   vectors.cvi  header + fixed-size records (id, scale, payload), one per vector
+//   graph.cvi    header + fixed-size layer-0 link lists, one per vector
+//   links.cvi    header + the upper-layer link lists of the few nodes that have them
+// Nothing is read into the heap on open; pages fault in as searches touch them.  Appends write
+// the vector record before its links, and open() links any vector a crash left unlinked.
+// Searches may run concurrently with each other; add() excludes them.
+class VectorIndex {
+public:
+    ~VectorIndex();
+
+    VectorIndex(const VectorIndex&) = delete;
+    VectorIndex& operator=(const VectorIndex&) = delete;
+
+    // Opens the index in `directory`, creating it when empty.  Throws std::runtime_error when the
+    // files exist with a different dimension or encoding.
+    static std::unique_ptr<VectorIndex> open(const std::string& directory, const VectorIndexOptions& options);
+
+    // Appends `count` vectors of dimension() floats each.  Vectors are L2-normalised on the way in.
+    void add(const int64_t* ids, const float* vectors, size_t count);
+
+    // Up to `k` stored vectors most similar to `query`, best first.  `ef` (raised to at least k)
+    // trades latency for recall.
+    std::vector<VectorMatch> search(const float* query, size_t k, size_t ef) const;
+
+    size_t size() const;
+    int32_t dimension() const { return options_.dimension; }
+
+    // Flushes the mapped files to storage.
+    void sync();
+
+private:
+    struct Query;
+
+    explicit VectorIndex(const VectorIndexOptions& options);
+
+    void linkNode(uint32_t node);
+    float similarity(const Query& query, uint32_t node) const;
+    float similarity(uint32_t a, uint32_t b) const;
+    Query prepareQuery(const float* vector) const;
+    Query nodeQuery(uint32_t node) const;
+    uint32_t greedyClosest(const Query& query, uint32_t entry, int32_t level) const;
+    std::vector<std::pair<float, uint32_t>> searchLayer(const Query& query,
+                                                        const std::vector<uint32_t>& entries,
+                                                        size_t ef,
+                                                        int32_t level) const;
+    std::vector<uint32_t> selectNeighbors(std::vector<std::pair<float, uint32_t>> candidates, size_t limit) const;
+    uint32_t* links(uint32_t node, int32_t level, uint32_t*& count) const;
+    void connect(uint32_t node, uint32_t neighbor, int32_t level);
+
+    VectorIndexOptions options_;
+    size_t record_bytes_ = 0;
+    size_t node_bytes_ = 0;
+    std::unique_ptr<MappedRegion> vectors_;
+    std::unique_ptr<MappedRegion> graph_;
+    std::unique_ptr<MappedRegion> links_;
+    uint64_t rng_state_ = 0;
+    mutable std::shared_mutex mutex_;
+};
+
+}  // namespace cicero
@@ -0,0 +1,313 @@
+#include "vector_kernels.h"
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__ARM_NEON)
+#include <arm_neon.h>
+#elif defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+namespace cicero {
+
+namespace {
+
+#if defined(__ARM_NEON)
+
+float horizontalSum(float32x4_t value) {
+#if defined(__aarch64__)
+    return vaddvq_f32(value);
+#else
+    const float32x2_t pair = vadd_f32(vget_low_f32(value), vget_high_f32(value));
+    return vget_lane_f32(vpadd_f32(pair, pair), 0);
+#endif
+}
+
+int32_t horizontalSum(int32x4_t value) {
+#if defined(__aarch64__)
+    return vaddvq_s32(value);
+#else
+    const int32x2_t pair = vadd_s32(vget_low_s32(value), vget_high_s32(value));
+    return vget_lane_s32(vpadd_s32(pair, pair), 0);
+#endif
+}
+
+float32x4_t multiplyAdd(float32x4_t acc, float32x4_t a, float32x4_t b) {
+#if defined(__aarch64__)
+    return vfmaq_f32(acc, a, b);
+#else
+    return vmlaq_f32(acc, a, b);
+#endif
+}
+
+#elif defined(__AVX2__)
+
+float horizontalSum(__m256 value) {
+    __m128 sum = _mm_add_ps(_mm256_castps256_ps128(value), _mm256_extractf128_ps(value, 1));
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+}
+
+int32_t horizontalSum(__m256i value) {
+    __m128i sum = _mm_add_epi32(_mm256_castsi256_si128(value), _mm256_extracti128_si256(value, 1));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+#elif defined(__SSE2__)
+
+float horizontalSum(__m128 value) {
+    __m128 sum = _mm_add_ps(value, _mm_movehl_ps(value, value));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 0x55));
+    return _mm_cvtss_f32(sum);
+}
+
+int32_t horizontalSum(__m128i value) {
+    __m128i sum = _mm_add_epi32(value, _mm_shuffle_epi32(value, 0x4e));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, 0xb1));
+    return _mm_cvtsi128_si32(sum);
+}
+
+// Sign-extends the low / high eight bytes of `value` to 16 bits (SSE2 has no pmovsxbw).
+__m128i widenLow(__m128i value) {
+    return _mm_srai_epi16(_mm_unpacklo_epi8(value, value), 8);
+}
+
+__m128i widenHigh(__m128i value) {
+    return _mm_srai_epi16(_mm_unpackhi_epi8(value, value), 8);
+}
+
+#endif
+
+}  // namespace
+
+float dotF32(const float* a, const float* b, size_t n) {
+    size_t i = 0;
+    float sum = 0.0f;
+#if defined(__ARM_NEON)
+    float32x4_t acc0 = vdupq_n_f32(0.0f);
+    float32x4_t acc1 = vdupq_n_f32(0.0f);
+    float32x4_t acc2 = vdupq_n_f32(0.0f);
+    float32x4_t acc3 = vdupq_n_f32(0.0f);
+    for (; i + 16 <= n; i += 16) {
+        acc0 = multiplyAdd(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+        acc1 = multiplyAdd(acc1, vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+        acc2 = multiplyAdd(acc2, vld1q_f32(a + i + 8), vld1q_f32(b + i + 8));
+        acc3 = multiplyAdd(acc3, vld1q_f32(a + i + 12), vld1q_f32(b + i + 12));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = multiplyAdd(acc0, vld1q_f32(a + i), vld1q_f32(b + i));
+    }
+    sum = horizontalSum(vaddq_f32(vaddq_f32(acc0, acc1), vaddq_f32(acc2, acc3)));
+#elif defined(__AVX2__)
+    __m256 acc0 = _mm256_setzero_ps();
+    __m256 acc1 = _mm256_setzero_ps();
+    for (; i + 16 <= n; i += 16) {
+#if defined(__FMA__)
+        acc0 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i), acc0);
+        acc1 = _mm256_fmadd_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8), acc1);
+#else
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+        acc1 = _mm256_add_ps(acc1, _mm256_mul_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8)));
+#endif
+    }
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm256_add_ps(acc0, _mm256_mul_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i)));
+    }
+    sum = horizontalSum(_mm256_add_ps(acc0, acc1));
+#elif defined(__SSE2__)
+    __m128 acc0 = _mm_setzero_ps();
+    __m128 acc1 = _mm_setzero_ps();
+    for (; i + 8 <= n; i += 8) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+        acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4)));
+    }
+    for (; i + 4 <= n; i += 4) {
+        acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i)));
+    }
+    sum = horizontalSum(_mm_add_ps(acc0, acc1));
+#endif
+    for (; i < n; ++i) {
+        sum += a[i] * b[i];
+    }
+    return sum;
+}
+
+int32_t dotI8(const int8_t* a, const int8_t* b, size_t n) {
+    size_t i = 0;
+    int32_t sum = 0;
+#if defined(__ARM_NEON)
+    int32x4_t acc = vdupq_n_s32(0);
+    for (; i + 16 <= n; i += 16) {
+        const int8x16_t va = vld1q_s8(a + i);
+        const int8x16_t vb = vld1q_s8(b + i);
+#if defined(__ARM_FEATURE_DOTPROD)
+        acc = vdotq_s32(acc, va, vb);
+#else
+        acc = vpadalq_s16(acc, vmull_s8(vget_low_s8(va), vget_low_s8(vb)));
+        acc = vpadalq_s16(acc, vmull_s8(vget_high_s8(va), vget_high_s8(vb)));
+#endif
+    }
+    sum = horizontalSum(acc);
+#elif defined(__AVX2__)
+    __m256i acc = _mm256_setzero_si256();
+    for (; i + 16 <= n; i += 16) {
+        const __m256i va = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        const __m256i vb = _mm256_cvtepi8_epi16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        acc = _mm256_add_epi32(acc, _mm256_madd_epi16(va, vb));
+    }
+    sum = horizontalSum(acc);
+#elif defined(__SSE2__)
+    __m128i acc = _mm_setzero_si128();
+    for (; i + 16 <= n; i += 16) {
+        const __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        const __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(widenLow(va), widenLow(vb)));
+        acc = _mm_add_epi32(acc, _mm_madd_epi16(widenHigh(va), widenHigh(vb)));
+    }
+    sum = horizontalSum(acc);
+#endif
+    for (; i < n; ++i) {
+        sum += static_cast<int32_t>(a[i]) * static_cast<int32_t>(b[i]);
+    }
+    return sum;
+}
+
+float quantizeI8(const float* in, int8_t* out, size_t n) {
+    float max_abs = 0.0f;
+    for (size_t i = 0; i < n; ++i) {
+        max_abs = std::max(max_abs, std::fabs(in[i]));
+    }
+    if (max_abs == 0.0f) {
+        std::fill(out, out + n, static_cast<int8_t>(0));
+        return 0.0f;
+    }
+    const float scale = max_abs / 127.0f;
+    const float inverse = 1.0f / scale;
+    for (size_t i = 0; i < n; ++i) {
+        const long value = std::lrint(in[i] * inverse);
+        out[i] = static_cast<int8_t>(std::clamp<long>(value, -127, 127));
+    }
+    return scale;
+}
+
+float maxF32(const float* values, size_t n) {
+    size_t i = 0;
+    float result = values[0];
+#if defined(__ARM_NEON)
+    if (n >= 8) {
+        float32x4_t max0 = vld1q_f32(values);
+        float32x4_t max1 = vld1q_f32(values + 4);
+        for (i = 8; i + 8 <= n; i += 8) {
+            max0 = vmaxq_f32(max0, vld1q_f32(values + i));
+            max1 = vmaxq_f32(max1, vld1q_f32(values + i + 4));
+        }
+        const float32x4_t max = vmaxq_f32(max0, max1);
+#if defined(__aarch64__)
+        result = vmaxvq_f32(max);
+#else
+        float32x2_t pair = vmax_f32(vget_low_f32(max), vget_high_f32(max));
+        pair = vpmax_f32(pair, pair);
+        result = vget_lane_f32(pair, 0);
+#endif
+    }
+#elif defined(__AVX2__)
+    if (n >= 16) {
+        __m256 max0 = _mm256_loadu_ps(values);
+        __m256 max1 = _mm256_loadu_ps(values + 8);
+        for (i = 16; i + 16 <= n; i += 16) {
+            max0 = _mm256_max_ps(max0, _mm256_loadu_ps(values + i));
+            max1 = _mm256_max_ps(max1, _mm256_loadu_ps(values + i + 8));
+        }
+        const __m256 max = _mm256_max_ps(max0, max1);
+        __m128 half = _mm_max_ps(_mm256_castps256_ps128(max), _mm256_extractf128_ps(max, 1));
+        half = _mm_max_ps(half, _mm_movehl_ps(half, half));
+        half = _mm_max_ss(half, _mm_shuffle_ps(half, half, 0x55));
+        result = _mm_cvtss_f32(half);
+    }
+#elif defined(__SSE2__)
+    if (n >= 8) {
+        __m128 max0 = _mm_loadu_ps(values);
+        __m128 max1 = _mm_loadu_ps(values + 4);
+        for (i = 8; i + 8 <= n; i += 8) {
+            max0 = _mm_max_ps(max0, _mm_loadu_ps(values + i));
+            max1 = _mm_max_ps(max1, _mm_loadu_ps(values + i + 4));
+        }
+        __m128 max = _mm_max_ps(max0, max1);
+        max = _mm_max_ps(max, _mm_movehl_ps(max, max));
+        max = _mm_max_ss(max, _mm_shuffle_ps(max, max, 0x55));
+        result = _mm_cvtss_f32(max);
+    }
+#endif
+    for (; i < n; ++i) {
+        result = std::max(result, values[i]);
+    }
+    return result;
+}
+
+size_t selectAtLeast(const float* values, size_t n, float threshold, uint32_t* out) {
+    size_t i = 0;
+    size_t count = 0;
+#if defined(__ARM_NEON)
+    const float32x4_t limit = vdupq_n_f32(threshold);
+    for (; i + 8 <= n; i += 8) {
+        const uint32x4_t hits = vorrq_u32(vcgeq_f32(vld1q_f32(values + i), limit),
+                                          vcgeq_f32(vld1q_f32(values + i + 4), limit));
+#if defined(__aarch64__)
+        const bool any = vmaxvq_u32(hits) != 0;
+#else
+        const uint32x2_t folded = vorr_u32(vget_low_u32(hits), vget_high_u32(hits));
+        const bool any = (vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0;
+#endif
+        if (any) {
+            for (size_t j = i; j < i + 8; ++j) {
+                if (values[j] >= threshold) {
+                    out[count++] = static_cast<uint32_t>(j);
+                }
+            }
+        }
+    }
+#elif defined(__AVX2__)
+    const __m256 limit = _mm256_set1_ps(threshold);
+    for (; i + 8 <= n; i += 8) {
+        auto mask = static_cast<uint32_t>(
+                _mm256_movemask_ps(_mm256_cmp_ps(_mm256_loadu_ps(values + i), limit, _CMP_GE_OQ)));
+        while (mask) {
+            out[count++] = static_cast<uint32_t>(i) + static_cast<uint32_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#elif defined(__SSE2__)
+    const __m128 limit = _mm_set1_ps(threshold);
+    for (; i + 4 <= n; i += 4) {
+        auto mask = static_cast<uint32_t>(_mm_movemask_ps(_mm_cmpge_ps(_mm_loadu_ps(values + i), limit)));
+        while (mask) {
+            out[count++] = static_cast<uint32_t>(i) + static_cast<uint32_t>(__builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+    }
+#endif
+    for (; i < n; ++i) {
+        if (values[i] >= threshold) {
+            out[count++] = static_cast<uint32_t>(i);
+        }
+    }
+    return count;
+}
+
+const char* vectorKernelName() {
+#if defined(__ARM_NEON)
+    return "neon";
+#elif defined(__AVX2__)
+    return "avx2";
+#elif defined(__SSE2__)
+    return "sse2";
+#else
+    return "scalar";
+#endif
+}
+
+}  // namespace cicero
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// SIMD kernels behind the vector index and the token sampler.  Each has a NEON path (arm64-v8a
+// and armeabi-v7a), an SSE/AVX2 path (x86_64 devices and host builds) and a scalar fallback,
+// picked at compile time.
+namespace cicero {
+
+float dotF32(const float* a, const float* b, size_t n);
+
+int32_t dotI8(const int8_t* a, const int8_t* b, size_t n);
+
+// Symmetric per-vector quantisation: out[i] = round(in[i] / scale) with scale = max|in| / 127.
+// Returns the scale (0 for an all-zero vector).
+float quantizeI8(const float* in, int8_t* out, size_t n);
+
+// Largest of the `n` (> 0) values; -infinity entries are fine, NaNs are not.
+float maxF32(const float* values, size_t n);
+
+// Writes the indices i with values[i] >= threshold to `out` in ascending order and returns how
+// many there were.  `out` must have room for n indices.  Blocks with no survivor cost one compare.
+size_t selectAtLeast(const float* values, size_t n, float threshold, uint32_t* out);
+
+// Name of the kernel set compiled in ("neon", "avx2", "sse2" or "scalar").
+const char* vectorKernelName();
+
+}  // namespace cicero
@@ -19,6 +19,7 @@
 import androidx.core.widget.TextViewCompat
 import androidx.core.widget.doAfterTextChanged
 import com.cicero.ciceroai.R
+import com.cicero.ciceroai.llama.ModelInfo
 import com.cicero.ciceroai.settings.PresetOption
 import com.google.android.material.color.MaterialColors
 import com.google.android.material.R as MaterialR
@@ -280,7 +281,7 @@ private fun render(state: MainUiState) {
         binding.logTicker.text = state.logMessages.lastOrNull() ?: getString(R.string.log_placeholder)
 
         updateModelSpinner(state.downloadedModels, state.selectedModelName)
-        updateDownloadedModels(state.downloadedModels, state.selectedModelName)
+        updateDownloadedModels(state.downloadedModels, state.selectedModelName, state.downloadedModelInfo)
 
         val expectedButtonId = optionToPresetButtonId[state.selectedPreset]
         if (expectedButtonId != null && binding.presetToggleGroup.checkedButtonId != expectedButtonId) {
@@ -342,7 +343,11 @@ private fun render(state: MainUiState) {
         binding.topPValueLabel.text = getString(R.string.settings_top_p_value, state.topP)
     }
 
-    private fun updateDownloadedModels(models: List<String>, selectedModel: String?) {
+    private fun updateDownloadedModels(
+        models: List<String>,
+        selectedModel: String?,
+        modelInfo: Map<String, ModelInfo>
+    ) {
         binding.downloadedModelsList.removeAllViews()
         if (models.isEmpty()) {
             binding.downloadedModelsList.isVisible = false
@@ -353,7 +358,7 @@ private fun updateDownloadedModels(models: List<String>, selectedModel: String?)
         binding.downloadedModelsList.isVisible = true
         binding.downloadedModelsEmpty.isVisible = false
         models.forEachIndexed { index, modelName ->
-            val card = createDownloadedModelCard(modelName, modelName == selectedModel)
+            val card = createDownloadedModelCard(modelName, modelName == selectedModel, modelInfo[modelName])
             if (index == models.lastIndex) {
                 (card.layoutParams as? LinearLayout.LayoutParams)?.bottomMargin = 0
             }
@@ -482,7 +487,11 @@ private fun setupDropdown(
         }
     }
 
-    private fun createDownloadedModelCard(modelName: String, isSelected: Boolean): MaterialCardView {
+    private fun createDownloadedModelCard(
+        modelName: String,
+        isSelected: Boolean,
+        info: ModelInfo?
+    ): MaterialCardView {
         val context = this
         val card = MaterialCardView(context).apply {
             val padding = resources.getDimensionPixelSize(R.dimen.spacing_medium)
@@ -516,6 +525,18 @@ private fun createDownloadedModelCard(modelName: String, isSelected: Boolean): M
         }
 
         container.addView(title)
+        info?.let { details ->
+            container.addView(TextView(context).apply {
+                text = getString(
+                    R.string.downloaded_model_details,
+                    details.architecture ?: "?",
+                    details.parameterLabel,
+                    details.quantization ?: "?",
+                    details.contextLength
+                )
+                TextViewCompat.setTextAppearance(this, MaterialR.style.TextAppearance_MaterialComponents_Caption)
+            })
+        }
         container.addView(subtitle)
         card.addView(container)
         return card
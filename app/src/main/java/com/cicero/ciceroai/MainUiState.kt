@@ -1,5 +1,6 @@
 package com.cicero.ciceroai
 
+import com.cicero.ciceroai.llama.ModelInfo
 import com.cicero.ciceroai.settings.PresetOption
 
 enum class MainPage {
@@ -23,6 +24,7 @@ data class MainUiState(
     val logMessages: List<String>,
     val downloadedModels: List<String>,
     val selectedModelName: String?,
+    val downloadedModelInfo: Map<String, ModelInfo> = emptyMap(),
     val standardModels: List<StandardModelInfo>,
     val selectedStandardModelIndex: Int,
     val selectedPreset: PresetOption,
@@ -7,6 +7,7 @@
 import androidx.lifecycle.viewModelScope
 import com.cicero.ciceroai.llama.LlamaController
 import com.cicero.ciceroai.llama.LlamaSettingsParser
+import com.cicero.ciceroai.llama.ModelAssetManager
 import com.cicero.ciceroai.settings.PresetOption
 import com.cicero.ciceroai.settings.PresetValues
 import com.cicero.ciceroai.settings.SettingsConfig
@@ -241,6 +242,8 @@ PresetOption.TURBO to PresetValues(
 
     private var prepareJob: Job? = null
     private var downloadJob: Job? = null
+    private var inferenceJob: Job? = null
+    private var probeJob: Job? = null
 
     init {
         refreshDownloadedModels()
@@ -340,7 +343,7 @@ fun runInference(prompt: String) {
             return
         }
 
-        viewModelScope.launch {
+        inferenceJob = viewModelScope.launch {
             _uiState.update { state ->
                 state.copy(
                     promptError = null,
@@ -363,22 +366,57 @@ fun runInference(prompt: String) {
                     temperature = latestSettingsConfig.temperature,
                     topP = latestSettingsConfig.topP
                 ).sanitized()
-                val tokenBudget = computeTokenBudget(
+                val tokenBudget = controller.fitPrompt(
+                    segments = listOf(sanitizedPrompt),
+                    pinnedSegments = 0,
+                    maxTokens = sanitizedSamplingConfig.maxTokens
+                )?.toTokenBudget() ?: computeTokenBudget(
                     prompt = sanitizedPrompt,
                     contextSize = contextSize,
                     configuredMaxTokens = sanitizedSamplingConfig.maxTokens
                 )
-                val samplingConfig = sanitizedSamplingConfig.copy(maxTokens = tokenBudget.maxTokens)
+                // With context shifting the window slides during generation, so the configured
+                // length is not capped by the room left after the prompt.
+                val samplingConfig = if (sanitizedSamplingConfig.contextShift) {
+                    sanitizedSamplingConfig
+                } else {
+                    sanitizedSamplingConfig.copy(maxTokens = tokenBudget.maxTokens)
+                }
                 appendLog(
                     context.getString(
                         R.string.log_inference_requesting_completion,
-                        tokenBudget.maxTokens,
+                        samplingConfig.maxTokens,
                         tokenBudget.remainingTokens,
                         contextSize
                     )
                 )
                 val result = controller.runInference(sanitizedPrompt, samplingConfig)
                 appendLog(context.getString(R.string.log_inference_success))
+                val completionStats = controller.lastCompletionStats()
+                completionStats
+                    ?.takeIf { it.contextShifts > 0L }
+                    ?.let { stats ->
+                        appendLog(
+                            context.getString(
+                                R.string.log_inference_context_shift_stats,
+                                stats.contextShifts,
+                                stats.shiftedTokens
+                            )
+                        )
+                    }
+                completionStats
+                    ?.takeIf { it.draftSteps > 0L }
+                    ?.let { stats ->
+                        appendLog(
+                            context.getString(
+                                R.string.log_inference_speculative_stats,
+                                stats.draftAcceptedTokens,
+                                stats.draftProposedTokens,
+                                (stats.draftAcceptanceRate * 100).roundToInt(),
+                                stats.draftMaxTokens
+                            )
+                        )
+                    }
                 _uiState.update { state ->
                     state.copy(outputText = result)
                 }
@@ -787,15 +825,67 @@ private fun prepareModel(file: File) {
                     fallbackThreads = threads,
                     fallbackContext = latestSettingsConfig.contextSize
                 )
-                val runtimeConfig = baseRuntimeConfig.copy(
+                val requestedConfig = baseRuntimeConfig.copy(
                     contextSize = latestSettingsConfig.contextSize,
                     batchSize = latestSettingsConfig.batchSize.takeIf { it > 0 },
                     nGpuLayers = latestSettingsConfig.nGpuLayers
                 ).sanitized()
+                // Rejects files that are not GGUF models before the expensive load.
+                val modelInfo = controller.probeModel(file)
+                val trainedConfig = modelInfo.fitRuntimeConfig(requestedConfig)
+                if (trainedConfig.contextSize != requestedConfig.contextSize) {
+                    appendLog(
+                        context.getString(
+                            R.string.log_model_context_clamped,
+                            requestedConfig.contextSize,
+                            trainedConfig.contextSize
+                        )
+                    )
+                }
+                // Shrinking the context up front beats being OOM-killed halfway through the load.
+                val memoryPlan = controller.planMemory(file, trainedConfig)
+                val runtimeConfig = when {
+                    memoryPlan.maxContextSize >= trainedConfig.contextSize -> trainedConfig
+                    memoryPlan.maxContextSize > 0 -> {
+                        appendLog(
+                            context.getString(
+                                R.string.log_model_context_memory_clamped,
+                                trainedConfig.contextSize,
+                                memoryPlan.maxContextSize,
+                                formatFileSize(memoryPlan.totalBytes)
+                            )
+                        )
+                        trainedConfig.copy(contextSize = memoryPlan.maxContextSize)
+                    }
+                    else -> {
+                        appendLog(
+                            context.getString(
+                                R.string.log_model_memory_insufficient,
+                                formatFileSize(memoryPlan.totalBytes)
+                            )
+                        )
+                        trainedConfig
+                    }
+                }
+                var reportedPercent = -1
                 controller.prepareSession(
                     modelFile = file,
                     runtimeConfig = runtimeConfig
-                )
+                ) { progress ->
+                    val percent = (progress * 100).toInt()
+                    if (percent != reportedPercent) {
+                        reportedPercent = percent
+                        _uiState.update { state ->
+                            state.copy(
+                                modelStatus = context.getString(
+                                    R.string.model_status_loading_progress,
+                                    file.name,
+                                    percent
+                                )
+                            )
+                        }
+                    }
+                }
                 _uiState.update { state ->
                     state.copy(
                         modelStatus = context.getString(R.string.model_status_ready, file.name),
@@ -832,7 +922,11 @@ private fun clearModelReference() {
 
     private fun refreshDownloadedModels() {
         val modelsDir = File(context.filesDir, "models")
-        val names = modelsDir.listFiles()?.filter { it.isFile }?.map { it.name }?.sorted().orEmpty()
+        val names = modelsDir.listFiles()
+            ?.filter { ModelAssetManager.isModelFile(it) }
+            ?.map { it.name }
+            ?.sorted()
+            .orEmpty()
         val savedFile = latestSettingsConfig.modelPath?.let { File(it) }
         val savedName = if (savedFile != null && savedFile.exists()) {
             savedFile.name
@@ -855,6 +949,23 @@ private fun refreshDownloadedModels() {
                 selectedModelName = selectedName
             )
         }
+        probeDownloadedModels(modelsDir, names)
+    }
+
+    // Metadata only, so this stays cheap even for several multi-GB models; unchanged files are
+    // answered from the native cache. Files that are not valid GGUF models simply get no details.
+    private fun probeDownloadedModels(modelsDir: File, names: List<String>) {
+        probeJob?.cancel()
+        probeJob = viewModelScope.launch {
+            val infos = names.mapNotNull { name ->
+                try {
+                    name to controller.probeModel(File(modelsDir, name))
+                } catch (error: IllegalStateException) {
+                    null
+                }
+            }.toMap()
+            _uiState.update { state -> state.copy(downloadedModelInfo = infos) }
+        }
     }
 
     private fun getSavedModelFile(): File? {
@@ -905,8 +1016,10 @@ private fun resolveFileName(url: String): String {
     private fun formatFileSize(bytes: Long): String = Formatter.formatShortFileSize(context, bytes)
 
     override fun onCleared() {
+        inferenceJob?.cancel()
         prepareJob?.cancel()
         downloadJob?.cancel()
+        probeJob?.cancel()
         controller.release()
         super.onCleared()
     }
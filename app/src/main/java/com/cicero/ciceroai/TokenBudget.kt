@@ -1,5 +1,6 @@
 package com.cicero.ciceroai
 
+import com.cicero.ciceroai.llama.PromptFit
 import kotlin.math.max
 import kotlin.math.min
 import kotlin.math.roundToInt
@@ -25,6 +26,10 @@ internal fun deriveDefaultMaxTokens(contextSize: Int): Int {
     return min(sanitizedContext, candidate)
 }
 
+/**
+ * Rough fallback used only while no model is loaded; once a session exists the budget comes from
+ * the exact native count (see [PromptFit.toTokenBudget]).
+ */
 internal fun estimatePromptTokens(prompt: String): Int {
     val trimmed = prompt.trim()
     if (trimmed.isEmpty()) {
@@ -51,3 +56,9 @@ internal fun computeTokenBudget(
         maxTokens = effectiveMaxTokens
     )
 }
+
+internal fun PromptFit.toTokenBudget(): TokenBudget = TokenBudget(
+    promptTokens = promptTokens,
+    remainingTokens = remainingTokens,
+    maxTokens = maxTokens
+)
@@ -1,5 +1,9 @@
 package com.cicero.ciceroai.llama
 
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
+
 internal object LlamaBridge {
     init {
         System.loadLibrary("cicero_llama")
@@ -7,12 +11,28 @@
 
     private external fun nativeInitWithConfig(
         modelPath: String,
-        runtimeConfig: RuntimeConfig
+        packedRuntimeConfig: ByteBuffer,
+        listener: NativeLoadListener?
     ): Long
 
+    /**
+     * Loads [modelPath] into a new session. Fields listed in [RuntimeConfig.autoTune] are measured
+     * on first load and the result is cached in [tuneCacheDir] for later loads of the same model.
+     * [onProgress] is called on the loading thread; returning `false` from it aborts the load with
+     * a [java.util.concurrent.CancellationException].
+     */
     @JvmStatic
-    fun nativeInit(modelPath: String, runtimeConfig: RuntimeConfig): Long {
-        return nativeInitWithConfig(modelPath, runtimeConfig.sanitized())
+    fun nativeInit(
+        modelPath: String,
+        runtimeConfig: RuntimeConfig,
+        tuneCacheDir: String? = null,
+        onProgress: LoadProgressListener? = null
+    ): Long {
+        return nativeInitWithConfig(
+            modelPath,
+            NativeConfigCodec.encodeRuntime(runtimeConfig.sanitized(), tuneCacheDir),
+            onProgress?.let { NativeLoadForwarder(it) }
+        )
     }
 
     @Deprecated(
@@ -31,16 +51,191 @@ fun nativeInit(modelPath: String, threadCount: Int, contextSize: Int): Long {
         )
     }
 
+    private external fun nativeReconfigure(handle: Long, packedRuntimeConfig: ByteBuffer): Boolean
+
+    /**
+     * Applies [runtimeConfig] to the live session [handle] without reloading the weights: thread
+     * counts change in place, other context settings rebuild only the llama context. Returns
+     * `false`, leaving the session as it was, when model-level fields (GPU layers, main GPU, mmap,
+     * mlock) differ and a fresh [nativeInit] is needed.
+     */
+    fun reconfigure(handle: Long, runtimeConfig: RuntimeConfig, tuneCacheDir: String? = null): Boolean =
+        nativeReconfigure(handle, NativeConfigCodec.encodeRuntime(runtimeConfig.sanitized(), tuneCacheDir))
+
     external fun nativeRelease(handle: Long)
 
+    /**
+     * Points the session at an on-disk prompt snapshot directory. Completions whose prompt starts
+     * with a stored prefix restore it instead of prefilling. An empty [directory] disables the
+     * library; [maxBytes] caps the directory size with least-recently-used eviction.
+     */
+    external fun nativeConfigurePromptSnapshots(handle: Long, directory: String, maxBytes: Long)
+
+    /**
+     * Evaluates [prompt] and stores its KV state as a reusable snapshot. Returns `false` when the
+     * prompt is empty or the state could not be serialised.
+     */
+    external fun nativeSavePromptSnapshot(handle: Long, prompt: String): Boolean
+
+    /**
+     * Cancels the interactive completion currently running on [handle], from any thread. Decoding
+     * stops within one ubatch and the completion call returns the text generated so far; the KV
+     * cache stays valid for the next call. Returns `false` when nothing was running.
+     */
+    external fun nativeCancel(handle: Long): Boolean
+
     external fun nativeIsVulkanAvailable(): Boolean
 
+    private external fun nativeProbeModel(modelPath: String, strings: Array<String?>): LongArray
+
+    /**
+     * Reads the GGUF header and metadata of [modelPath] (context length, layers, parameter count,
+     * quantization, chat template) in milliseconds, without loading weights. Results are cached
+     * natively until the file's size or mtime changes. Throws [IllegalStateException] for files
+     * that cannot be read or are not GGUF models.
+     */
+    fun probeModel(modelPath: String): ModelInfo {
+        val strings = arrayOfNulls<String>(ModelInfo.NATIVE_STRINGS)
+        return ModelInfo.fromNative(nativeProbeModel(modelPath, strings), strings)
+    }
+
+    private external fun nativePlanMemory(
+        modelPath: String,
+        packedRuntimeConfig: ByteBuffer,
+        budgetBytes: Long
+    ): LongArray
+
+    /**
+     * Estimates the weights, KV cache and compute buffers of loading [modelPath] with
+     * [runtimeConfig] from its GGUF metadata, and the largest context that fits [budgetBytes]
+     * (skipped when the budget is not positive). Nothing is loaded.
+     */
+    fun planMemory(modelPath: String, runtimeConfig: RuntimeConfig, budgetBytes: Long): MemoryPlan =
+        MemoryPlan.fromNative(
+            nativePlanMemory(modelPath, NativeConfigCodec.encodeRuntime(runtimeConfig.sanitized()), budgetBytes)
+        )
+
+    private external fun nativeGetLastCompletionStats(handle: Long): LongArray
+
+    fun lastCompletionStats(handle: Long): CompletionStats =
+        CompletionStats.fromNative(nativeGetLastCompletionStats(handle))
+
+    private external fun nativeGetMetrics(handle: Long, reset: Boolean): LongArray
+
+    /**
+     * Per-phase counters and latency histograms of [handle] (tokenize, prefill chunks, decodes,
+     * sampling, detokenize, stop matching and the token callback). [reset] zeroes them after
+     * reading.
+     */
+    fun metrics(handle: Long, reset: Boolean = false): NativeMetrics =
+        NativeMetrics.fromNative(nativeGetMetrics(handle, reset))
+
+    /**
+     * Keeps the last [maxEvents] timed events of [handle] in a native ring buffer for
+     * [nativeDumpTrace]; 0 turns tracing off and frees the buffer.
+     */
+    external fun nativeConfigureTrace(handle: Long, maxEvents: Int)
+
+    /** Buffered trace events as Chrome trace-event JSON, loadable in Perfetto or chrome://tracing. */
+    external fun nativeDumpTrace(handle: Long): String
+
+    private external fun nativeCountTokens(handle: Long, text: String): Int
+
+    private external fun nativeFitPrompt(
+        handle: Long,
+        segments: Array<String>,
+        pinnedSegments: Int,
+        maxTokens: Int
+    ): IntArray
+
+    /** Exact number of tokens [text] occupies as a completion prompt, BOS included. */
+    fun countTokens(handle: Long, text: String): Int = nativeCountTokens(handle, text)
+
+    /**
+     * Fits the concatenation of [segments] into the session context so that [maxTokens] can still
+     * be generated, dropping the oldest segments after the first [pinnedSegments] when needed. The
+     * last segment is always kept. Token counts of repeated segments are cached natively.
+     */
+    fun fitPrompt(
+        handle: Long,
+        segments: List<String>,
+        pinnedSegments: Int,
+        maxTokens: Int
+    ): PromptFit = PromptFit.fromNative(
+        nativeFitPrompt(handle, segments.toTypedArray(), pinnedSegments, maxTokens)
+    )
+
+    private external fun nativeEmbeddingSize(handle: Long): Int
+
+    private external fun nativeEmbed(
+        handle: Long,
+        texts: Array<String>,
+        pooling: Int,
+        normalize: Boolean,
+        output: ByteBuffer
+    )
+
+    /**
+     * Embeds [texts] in as few multi-sequence decodes as possible on a dedicated embedding context
+     * that shares the session's weights. With [normalize] every vector has unit L2 norm.
+     */
+    fun embed(
+        handle: Long,
+        texts: List<String>,
+        pooling: EmbeddingPooling = EmbeddingPooling.MEAN,
+        normalize: Boolean = true
+    ): Embeddings {
+        val dimension = nativeEmbeddingSize(handle)
+        val output = ByteBuffer.allocateDirect(texts.size * dimension * Float.SIZE_BYTES)
+            .order(ByteOrder.nativeOrder())
+        if (texts.isNotEmpty()) {
+            nativeEmbed(handle, texts.toTypedArray(), pooling.nativeValue, normalize, output)
+        }
+        return Embeddings(texts.size, dimension, output.asFloatBuffer().asReadOnlyBuffer())
+    }
+
+    external fun nativeVectorIndexOpen(
+        directory: String,
+        dimension: Int,
+        int8: Boolean,
+        maxNeighbors: Int,
+        efConstruction: Int
+    ): Long
+
+    external fun nativeVectorIndexClose(handle: Long)
+
+    /** [vectors] must be a direct buffer holding `ids.size * dimension` floats. */
+    external fun nativeVectorIndexAdd(handle: Long, ids: LongArray, vectors: FloatBuffer)
+
+    /** Writes up to `outIds.size` matches best first and returns how many were written. */
+    external fun nativeVectorIndexSearch(
+        handle: Long,
+        query: FloatBuffer,
+        ef: Int,
+        outIds: LongArray,
+        outScores: FloatArray
+    ): Int
+
+    external fun nativeVectorIndexSize(handle: Long): Long
+
+    external fun nativeVectorIndexSync(handle: Long)
+
     fun isVulkanAvailable(): Boolean = nativeIsVulkanAvailable()
 
     fun interface CompletionListener {
         fun onToken(token: String)
     }
 
+    /** Receives finished [bulkCompletion] items; return `false` to cancel the remaining ones. */
+    fun interface BulkCompletionListener {
+        fun onItem(result: BulkCompletionResult): Boolean
+    }
+
+    /** Model loading progress in `0f..1f`; return `false` to cancel the load. */
+    fun interface LoadProgressListener {
+        fun onProgress(progress: Float): Boolean
+    }
+
     fun nativeCompletionWithProgress(
         handle: Long,
         prompt: String,
@@ -49,24 +244,93 @@ fun nativeCompletionWithProgress(
     ): String {
         val sanitized = sampling.sanitized()
         val nativeListener = listener?.let { NativeCompletionForwarder(it) }
-        val stopSequences = sanitized.stopSequences.toTypedArray()
         return nativeCompletionWithOptions(
             handle = handle,
             prompt = prompt,
-            maxTokens = sanitized.maxTokens,
-            temperature = sanitized.temperature ?: Float.NaN,
-            topP = sanitized.topP ?: Float.NaN,
-            topK = sanitized.topK ?: -1,
-            repeatPenalty = sanitized.repeatPenalty ?: Float.NaN,
-            repeatLastN = sanitized.repeatLastN ?: -1,
-            frequencyPenalty = sanitized.frequencyPenalty ?: Float.NaN,
-            presencePenalty = sanitized.presencePenalty ?: Float.NaN,
-            stopSequences = stopSequences,
-            seed = sanitized.seed ?: SAMPLING_SEED_UNSET,
+            sampling = NativeConfigCodec.encodeSampling(sanitized),
             listener = nativeListener
         )
     }
 
+    /**
+     * Runs a completion through the native continuous-batching engine so it can share decode steps
+     * with other concurrent batched requests on the same session. Requires
+     * [RuntimeConfig.seqMax] >= 2; each in-flight request occupies one KV sequence. The call blocks
+     * the current thread until the request finishes and [listener] is invoked on that thread.
+     */
+    fun nativeBatchedCompletionWithProgress(
+        handle: Long,
+        prompt: String,
+        sampling: SamplingConfig,
+        listener: CompletionListener?
+    ): String {
+        val sanitized = sampling.sanitized()
+        val nativeListener = listener?.let { NativeCompletionForwarder(it) }
+        return nativeBatchedCompletion(
+            handle = handle,
+            prompt = prompt,
+            sampling = NativeConfigCodec.encodeSampling(sanitized),
+            listener = nativeListener
+        )
+    }
+
+    /**
+     * Runs every entry of [inputs] after the shared [prefix] through the continuous-batching
+     * engine: the prefix is prefilled once and its KV state copied to each item, so only the inputs
+     * are prefilled per item, many of them per decode step. Prefix and inputs are tokenized
+     * separately, so end the prefix at a natural boundary such as a newline. [listener] receives
+     * each item on the calling thread as soon as it finishes (not in input order); returning
+     * `false` cancels the rest. Requires [RuntimeConfig.seqMax] >= 3 and is meant for background
+     * jobs: waiting items yield to [nativeBatchedCompletionWithProgress] requests.
+     */
+    fun bulkCompletion(
+        handle: Long,
+        prefix: String,
+        inputs: List<String>,
+        sampling: SamplingConfig,
+        listener: BulkCompletionListener
+    ) {
+        if (inputs.isEmpty()) {
+            return
+        }
+        nativeBulkCompletion(
+            handle = handle,
+            prefix = prefix,
+            inputs = inputs.toTypedArray(),
+            sampling = NativeConfigCodec.encodeSampling(sampling.sanitized()),
+            listener = NativeBulkForwarder(listener)
+        )
+    }
+
+    /**
+     * Streams a completion through a shared direct ring buffer instead of one JNI string per
+     * token. [listener] receives UTF-8 complete chunks coalesced according to [cadence], on the
+     * calling thread; blocking in it applies backpressure to generation. With [batched] the request
+     * runs through the continuous-batching engine (see [nativeBatchedCompletionWithProgress]).
+     */
+    fun nativeStreamingCompletion(
+        handle: Long,
+        prompt: String,
+        sampling: SamplingConfig,
+        cadence: StreamCadence,
+        listener: CompletionListener,
+        batched: Boolean = false
+    ): String {
+        val sanitized = sampling.sanitized()
+        val sanitizedCadence = cadence.sanitized()
+        val stream = TokenStreamBuffer()
+        return nativeStreamingCompletion(
+            handle = handle,
+            prompt = prompt,
+            sampling = NativeConfigCodec.encodeSampling(sanitized),
+            batched = batched,
+            buffer = stream.buffer,
+            flushTokens = sanitizedCadence.flushTokens,
+            flushIntervalMs = sanitizedCadence.flushIntervalMs,
+            listener = NativeStreamForwarder(stream, listener)
+        )
+    }
+
     fun nativeCompletionWithProgress(
         handle: Long,
         prompt: String,
@@ -85,16 +349,7 @@ fun nativeCompletion(handle: Long, prompt: String, maxTokens: Int): String {
         return nativeCompletionWithOptions(
             handle = handle,
             prompt = prompt,
-            maxTokens = maxTokens,
-            temperature = Float.NaN,
-            topP = Float.NaN,
-            topK = -1,
-            repeatPenalty = Float.NaN,
-            repeatLastN = -1,
-            frequencyPenalty = Float.NaN,
-            presencePenalty = Float.NaN,
-            stopSequences = emptyArray(),
-            seed = SAMPLING_SEED_UNSET,
+            sampling = NativeConfigCodec.encodeSampling(SamplingConfig(maxTokens = maxTokens).sanitized()),
             listener = null
         )
     }
@@ -102,20 +357,35 @@ fun nativeCompletion(handle: Long, prompt: String, maxTokens: Int): String {
     private external fun nativeCompletionWithOptions(
         handle: Long,
         prompt: String,
-        maxTokens: Int,
-        temperature: Float,
-        topP: Float,
-        topK: Int,
-        repeatPenalty: Float,
-        repeatLastN: Int,
-        frequencyPenalty: Float,
-        presencePenalty: Float,
-        stopSequences: Array<String>,
-        seed: Int,
+        sampling: ByteBuffer,
         listener: NativeCompletionListener?
     ): String
 
-    private const val SAMPLING_SEED_UNSET: Int = -1
+    private external fun nativeBatchedCompletion(
+        handle: Long,
+        prompt: String,
+        sampling: ByteBuffer,
+        listener: NativeCompletionListener?
+    ): String
+
+    private external fun nativeBulkCompletion(
+        handle: Long,
+        prefix: String,
+        inputs: Array<String>,
+        sampling: ByteBuffer,
+        listener: NativeBulkListener
+    )
+
+    private external fun nativeStreamingCompletion(
+        handle: Long,
+        prompt: String,
+        sampling: ByteBuffer,
+        batched: Boolean,
+        buffer: ByteBuffer,
+        flushTokens: Int,
+        flushIntervalMs: Int,
+        listener: NativeStreamListener
+    ): String
 
     private class NativeCompletionForwarder(
         private val delegate: CompletionListener
@@ -128,4 +398,41 @@ override fun onTokenGenerated(token: String) {
     private interface NativeCompletionListener {
         fun onTokenGenerated(token: String)
     }
+
+    private class NativeStreamForwarder(
+        private val stream: TokenStreamBuffer,
+        private val delegate: CompletionListener
+    ) : NativeStreamListener {
+        override fun onChunksAvailable() {
+            val chunk = stream.drain()
+            if (chunk.isNotEmpty()) {
+                delegate.onToken(chunk)
+            }
+        }
+    }
+
+    private interface NativeStreamListener {
+        fun onChunksAvailable()
+    }
+
+    private class NativeBulkForwarder(
+        private val delegate: BulkCompletionListener
+    ) : NativeBulkListener {
+        override fun onItemFinished(index: Int, text: String, error: String?, stats: LongArray): Boolean =
+            delegate.onItem(BulkCompletionResult(index, text, error, CompletionStats.fromNative(stats)))
+    }
+
+    private interface NativeBulkListener {
+        fun onItemFinished(index: Int, text: String, error: String?, stats: LongArray): Boolean
+    }
+
+    private class NativeLoadForwarder(
+        private val delegate: LoadProgressListener
+    ) : NativeLoadListener {
+        override fun onLoadProgress(progress: Float): Boolean = delegate.onProgress(progress)
+    }
+
+    private interface NativeLoadListener {
+        fun onLoadProgress(progress: Float): Boolean
+    }
 }
@@ -1,6 +1,47 @@
 package com.cicero.ciceroai.llama
 
+import java.nio.FloatBuffer
+import java.util.Locale
+import kotlin.math.ceil
 import kotlin.math.max
+import kotlin.math.min
+
+/**
+ * Runtime fields that can be left to the native auto-tuner. The tuner benchmarks candidate values
+ * once per model and CPU topology and caches the winner; the configured value of a tuned field
+ * only serves as a fallback when tuning fails.
+ */
+enum class AutoTuneField(internal val bit: Int) {
+    THREADS(1),
+    THREADS_BATCH(2),
+    BATCH(4),
+    UBATCH(8)
+}
+
+/**
+ * Element type of the KV cache; [nativeValue] is the ggml type id. [Q8_0] halves the memory of the
+ * default [F16] cache with little quality loss and [Q4_0] quarters it. A quantized V cache needs
+ * flash attention, so it cannot be combined with `flashAttention = 0`.
+ */
+enum class KvCacheType(internal val nativeValue: Int, val configName: String) {
+    F32(0, "f32"),
+    F16(1, "f16"),
+    BF16(30, "bf16"),
+    Q8_0(8, "q8_0"),
+    Q5_1(7, "q5_1"),
+    Q5_0(6, "q5_0"),
+    Q4_1(3, "q4_1"),
+    Q4_0(2, "q4_0"),
+    IQ4_NL(20, "iq4_nl");
+
+    val isQuantized: Boolean
+        get() = this != F32 && this != F16 && this != BF16
+
+    companion object {
+        fun fromConfigName(name: String): KvCacheType? =
+            values().firstOrNull { it.configName.equals(name.trim(), ignoreCase = true) }
+    }
+}
 
 /**
  * Configuration for llama.cpp runtime initialisation. Values that are `null` indicate that the
@@ -23,7 +64,13 @@ data class RuntimeConfig(
     val embeddings: Boolean? = null,
     val kvUnified: Boolean? = null,
     val useMmap: Boolean? = null,
-    val useMlock: Boolean? = null
+    val useMlock: Boolean? = null,
+    val draftModelPath: String? = null,
+    val draftTokens: Int? = null,
+    val autoTune: Set<AutoTuneField> = emptySet(),
+    val prefetch: Boolean? = null,
+    val typeK: KvCacheType? = null,
+    val typeV: KvCacheType? = null
 ) {
     init {
         require(threadCount > 0) { "threadCount harus lebih besar dari 0" }
@@ -42,7 +89,9 @@ fun sanitized(): RuntimeConfig {
             mainGpu = mainGpu?.takeIf { it >= 0 },
             flashAttention = flashAttention?.takeIf { it in -1..1 },
             ropeFreqBase = ropeFreqBase?.takeIf { it > 0f },
-            ropeFreqScale = ropeFreqScale?.takeIf { it > 0f }
+            ropeFreqScale = ropeFreqScale?.takeIf { it > 0f },
+            draftModelPath = draftModelPath?.trim()?.takeIf { it.isNotEmpty() },
+            draftTokens = draftTokens?.takeIf { it > 0 }
         )
     }
 
@@ -69,10 +118,25 @@ data class SamplingConfig(
     val frequencyPenalty: Float? = null,
     val presencePenalty: Float? = null,
     val stopSequences: List<String> = emptyList(),
-    val seed: Int? = null
+    val seed: Int? = null,
+    /**
+     * Opt-in sliding window: once the context is full, keep the first [sinkTokens] tokens, drop
+     * half of the rest and continue generating instead of stopping. [maxTokens] may then exceed
+     * the context size. Without [sinkTokens] a quarter of the window (at most the prompt) is kept.
+     */
+    val contextShift: Boolean = false,
+    val sinkTokens: Int? = null,
+    /**
+     * Constrains the output to a GBNF [grammar] (start rule `root`) or to JSON matching
+     * [jsonSchema], so it is valid the first time instead of being retried. Compiled grammars are
+     * cached natively per model, so reusing the same text is cheap.
+     */
+    val grammar: String? = null,
+    val jsonSchema: String? = null
 ) {
     init {
         require(maxTokens >= 0) { "maxTokens tidak boleh negatif" }
+        require(grammar == null || jsonSchema == null) { "grammar dan jsonSchema tidak boleh diisi bersamaan" }
     }
 
     fun sanitized(): SamplingConfig {
@@ -84,6 +148,9 @@ fun sanitized(): SamplingConfig {
         val sanitizedFrequencyPenalty = frequencyPenalty?.takeIf { it.isFinite() }
         val sanitizedPresencePenalty = presencePenalty?.takeIf { it.isFinite() }
         val sanitizedSeed = seed?.takeIf { it >= 0 }
+        val sanitizedSinkTokens = sinkTokens?.takeIf { it >= 0 }
+        val sanitizedGrammar = grammar?.takeIf { it.isNotBlank() }
+        val sanitizedJsonSchema = jsonSchema?.takeIf { it.isNotBlank() }
         val sanitizedStops = stopSequences.mapNotNull { sequence ->
             sequence.takeIf { it.isNotEmpty() }
         }
@@ -98,7 +165,10 @@ fun sanitized(): SamplingConfig {
             frequencyPenalty = sanitizedFrequencyPenalty,
             presencePenalty = sanitizedPresencePenalty,
             stopSequences = sanitizedStops,
-            seed = sanitizedSeed
+            seed = sanitizedSeed,
+            sinkTokens = sanitizedSinkTokens,
+            grammar = sanitizedGrammar,
+            jsonSchema = sanitizedJsonSchema
         )
     }
 
@@ -109,6 +179,285 @@ fun withDefaults(maxTokens: Int): SamplingConfig {
     }
 }
 
+/**
+ * Counters reported by the native layer for the most recent completion on a session. The draft
+ * fields stay zero unless a speculative draft model is configured.
+ */
+data class CompletionStats(
+    val promptTokens: Long,
+    val reusedPromptTokens: Long,
+    val generatedTokens: Long,
+    val draftMaxTokens: Long,
+    val draftSteps: Long,
+    val draftProposedTokens: Long,
+    val draftAcceptedTokens: Long,
+    val contextShifts: Long = 0L,
+    val shiftedTokens: Long = 0L,
+    val cancelled: Boolean = false
+) {
+    val draftAcceptanceRate: Float
+        get() = if (draftProposedTokens > 0L) {
+            draftAcceptedTokens.toFloat() / draftProposedTokens
+        } else {
+            0f
+        }
+
+    val meanDraftLength: Float
+        get() = if (draftSteps > 0L) draftProposedTokens.toFloat() / draftSteps else 0f
+
+    companion object {
+        internal fun fromNative(values: LongArray): CompletionStats {
+            fun valueAt(index: Int): Long = values.getOrElse(index) { 0L }
+            return CompletionStats(
+                promptTokens = valueAt(0),
+                reusedPromptTokens = valueAt(1),
+                generatedTokens = valueAt(2),
+                draftMaxTokens = valueAt(3),
+                draftSteps = valueAt(4),
+                draftProposedTokens = valueAt(5),
+                draftAcceptedTokens = valueAt(6),
+                contextShifts = valueAt(7),
+                shiftedTokens = valueAt(8),
+                cancelled = valueAt(9) != 0L
+            )
+        }
+    }
+}
+
+/**
+ * One finished item of [LlamaBridge.bulkCompletion]. [index] points into the submitted inputs;
+ * [error] is set when only this item failed (for example an input too long for the context).
+ * [CompletionStats.reusedPromptTokens] counts the shared prefix tokens the item did not prefill.
+ */
+data class BulkCompletionResult(
+    val index: Int,
+    val text: String,
+    val error: String?,
+    val stats: CompletionStats
+) {
+    val isSuccess: Boolean
+        get() = error == null
+}
+
+/** Hot-path phases timed natively, in the order of the `nativeGetMetrics` array. */
+enum class MetricPhase {
+    TOKENIZE,
+    PREFILL,
+    DECODE,
+    SAMPLE,
+    DETOKENIZE,
+    STOP_MATCH,
+    CALLBACK,
+    EMBED
+}
+
+/**
+ * Timings of one [MetricPhase]. [histogram] bucket 0 counts events under 1 µs and bucket `i`
+ * events in [2^(i-1), 2^i) µs; the last bucket is open-ended.
+ */
+data class PhaseMetrics(
+    val count: Long,
+    val totalNanos: Long,
+    val maxNanos: Long,
+    val histogram: List<Long>
+) {
+    val meanNanos: Long
+        get() = if (count > 0L) totalNanos / count else 0L
+
+    /** Upper bound of the histogram bucket holding the [quantile] (0..1) event, capped at [maxNanos]. */
+    fun quantileNanos(quantile: Double): Long {
+        if (count <= 0L) return 0L
+        val rank = ceil(quantile.coerceIn(0.0, 1.0) * count).toLong().coerceAtLeast(1L)
+        var seen = 0L
+        histogram.forEachIndexed { bucket, events ->
+            seen += events
+            if (seen >= rank) {
+                return min(BUCKET_BASE_NANOS shl bucket, maxNanos)
+            }
+        }
+        return maxNanos
+    }
+
+    private companion object {
+        const val BUCKET_BASE_NANOS = 1_000L
+    }
+}
+
+/** Cumulative native phase timings of a session since it was created or last reset. */
+data class NativeMetrics(val phases: Map<MetricPhase, PhaseMetrics>) {
+    operator fun get(phase: MetricPhase): PhaseMetrics = phases.getValue(phase)
+
+    companion object {
+        private const val BUCKETS = 24
+        private const val VALUES_PER_PHASE = 3 + BUCKETS
+
+        internal fun fromNative(values: LongArray): NativeMetrics {
+            fun valueAt(index: Int): Long = values.getOrElse(index) { 0L }
+            val phases = MetricPhase.values().associateWith { phase ->
+                val base = phase.ordinal * VALUES_PER_PHASE
+                PhaseMetrics(
+                    count = valueAt(base),
+                    totalNanos = valueAt(base + 1),
+                    maxNanos = valueAt(base + 2),
+                    histogram = List(BUCKETS) { bucket -> valueAt(base + 3 + bucket) }
+                )
+            }
+            return NativeMetrics(phases)
+        }
+    }
+}
+
+/** How the per-token embeddings of a text are reduced to one vector. */
+enum class EmbeddingPooling(internal val nativeValue: Int) {
+    MEAN(0),
+    CLS(1),
+    LAST(2)
+}
+
+/**
+ * Embeddings of [count] texts, [dimension] floats each, stored back to back in a direct buffer
+ * filled by the native layer. [vector] returns views into that buffer, not copies.
+ */
+class Embeddings internal constructor(
+    val count: Int,
+    val dimension: Int,
+    private val data: FloatBuffer
+) {
+    /** All vectors as one flat, read-only buffer in input order. */
+    val flat: FloatBuffer
+        get() = data.duplicate().apply { rewind() }
+
+    fun vector(index: Int): FloatBuffer {
+        require(index in 0 until count) { "index di luar rentang: $index" }
+        return data.duplicate().apply {
+            position(index * dimension)
+            limit((index + 1) * dimension)
+        }.slice()
+    }
+}
+
+/**
+ * Exact prompt budget computed natively with the model vocabulary. Segments before
+ * [firstKeptSegment] (after the pinned ones) were dropped to leave room for [maxTokens].
+ */
+data class PromptFit(
+    val firstKeptSegment: Int,
+    val promptTokens: Int,
+    val maxTokens: Int,
+    val capacity: Int
+) {
+    val remainingTokens: Int
+        get() = (capacity - promptTokens).coerceAtLeast(0)
+
+    companion object {
+        internal fun fromNative(values: IntArray): PromptFit {
+            fun valueAt(index: Int): Int = values.getOrElse(index) { 0 }
+            return PromptFit(
+                firstKeptSegment = valueAt(0),
+                promptTokens = valueAt(1),
+                maxTokens = valueAt(2),
+                capacity = valueAt(3)
+            )
+        }
+    }
+}
+
+/**
+ * GGUF metadata of a model file, read by [LlamaBridge.probeModel] without loading the weights.
+ * Numeric fields are 0 when the file does not state them; [chatTemplate] is `null` when the model
+ * has none.
+ */
+data class ModelInfo(
+    val architecture: String?,
+    val name: String?,
+    val quantization: String?,
+    val chatTemplate: String?,
+    val fileSizeBytes: Long,
+    val parameterCount: Long,
+    val weightBytes: Long,
+    val contextLength: Int,
+    val layerCount: Int,
+    val embeddingLength: Int,
+    val headCount: Int,
+    val headCountKv: Int,
+    val keyLength: Int,
+    val valueLength: Int,
+    val vocabSize: Int,
+    val feedForwardLength: Int
+) {
+    /** Parameter count in the usual model-card form, e.g. `1.5B` or `494M`. */
+    val parameterLabel: String
+        get() = when {
+            parameterCount >= 1_000_000_000L -> "%.1fB".format(Locale.ROOT, parameterCount / 1e9)
+            parameterCount >= 1_000_000L -> "${parameterCount / 1_000_000L}M"
+            else -> parameterCount.toString()
+        }
+
+    /**
+     * [config] with its context capped at [contextLength]: beyond the training context the model
+     * degrades into noise unless RoPE scaling is configured explicitly.
+     */
+    fun fitRuntimeConfig(config: RuntimeConfig): RuntimeConfig {
+        if (contextLength <= 0 || config.contextSize <= contextLength || config.ropeFreqScale != null) {
+            return config
+        }
+        return config.copy(contextSize = contextLength)
+    }
+
+    companion object {
+        internal const val NATIVE_STRINGS = 4
+
+        internal fun fromNative(values: LongArray, strings: Array<String?>): ModelInfo {
+            fun valueAt(index: Int): Long = values.getOrElse(index) { 0L }
+            fun intAt(index: Int): Int = valueAt(index).coerceIn(0L, Int.MAX_VALUE.toLong()).toInt()
+            return ModelInfo(
+                architecture = strings.getOrNull(0),
+                name = strings.getOrNull(1),
+                quantization = strings.getOrNull(2),
+                chatTemplate = strings.getOrNull(3),
+                fileSizeBytes = valueAt(0),
+                parameterCount = valueAt(1),
+                weightBytes = valueAt(2),
+                contextLength = intAt(3),
+                layerCount = intAt(4),
+                embeddingLength = intAt(5),
+                headCount = intAt(6),
+                headCountKv = intAt(7),
+                keyLength = intAt(8),
+                valueLength = intAt(9),
+                vocabSize = intAt(10),
+                feedForwardLength = intAt(11)
+            )
+        }
+    }
+}
+
+/**
+ * Memory estimate of loading a model with a [RuntimeConfig], computed by [LlamaBridge.planMemory]
+ * from the GGUF metadata alone. [maxContextSize] is the largest context (a multiple of 256, capped
+ * at the training context) that keeps [totalBytes] within the budget; 0 means not even 256 fit.
+ */
+data class MemoryPlan(
+    val weightBytes: Long,
+    val kvBytes: Long,
+    val computeBytes: Long,
+    val totalBytes: Long,
+    val maxContextSize: Int
+) {
+    companion object {
+        internal fun fromNative(values: LongArray): MemoryPlan {
+            fun valueAt(index: Int): Long = values.getOrElse(index) { 0L }
+            return MemoryPlan(
+                weightBytes = valueAt(0),
+                kvBytes = valueAt(1),
+                computeBytes = valueAt(2),
+                totalBytes = valueAt(3),
+                maxContextSize = valueAt(4).coerceIn(0L, Int.MAX_VALUE.toLong()).toInt()
+            )
+        }
+    }
+}
+
 /**
  * Parser helpers for turning loosely structured DataStore strings into strongly typed configs. The
  * strings are expected to contain JSON blobs but we fall back to sensible defaults when parsing
@@ -144,10 +493,14 @@ fun parseSamplingConfig(raw: String?, defaultMaxTokens: Int): SamplingConfig {
     fun fromJson(raw: String, fallbackThreads: Int, fallbackContext: Int): RuntimeConfig {
         val json = org.json.JSONObject(raw)
         val threadsValue = json.opt("threads") ?: json.opt("thread_count") ?: json.opt("n_threads")
-        val (threadCount, threadBatch) = parseThreadCounts(threadsValue, fallbackThreads)
+        val threads = parseThreadCounts(threadsValue, fallbackThreads)
         val context = extractInt(json, "context", "context_size", "n_ctx", "ctx") ?: fallbackContext
         val batch = extractInt(json, "batch", "n_batch")
         val ubatch = extractInt(json, "ubatch", "n_ubatch")
+        val autoTune = threads.autoTune.toMutableSet().apply {
+            if (isAuto(json, "batch", "n_batch")) add(AutoTuneField.BATCH)
+            if (isAuto(json, "ubatch", "n_ubatch")) add(AutoTuneField.UBATCH)
+        }
         val seqMax = extractInt(json, "seq_max", "n_seq_max")
         val nGpuLayers = extractInt(json, "n_gpu_layers", "gpu_layers")
         val mainGpu = extractInt(json, "main_gpu")
@@ -160,11 +513,18 @@ fun fromJson(raw: String, fallbackThreads: Int, fallbackContext: Int): RuntimeCo
         val kvUnified = extractBoolean(json, "kv_unified")
         val useMmap = extractBoolean(json, "use_mmap")
         val useMlock = extractBoolean(json, "use_mlock")
+        val prefetch = extractBoolean(json, "prefetch")
+        val draftModelPath = extractString(json, "draft_model", "draft_model_path", "model_draft")
+        val draftTokens = extractInt(json, "draft_tokens", "n_draft", "draft_max")
+        // "kv_cache_type" sets both halves; "type_k"/"type_v" override it per half.
+        val kvCacheType = extractKvCacheType(json, "kv_cache_type", "cache_type")
+        val typeK = extractKvCacheType(json, "type_k", "cache_type_k", "ctk") ?: kvCacheType
+        val typeV = extractKvCacheType(json, "type_v", "cache_type_v", "ctv") ?: kvCacheType
 
         return RuntimeConfig(
-            threadCount = threadCount,
+            threadCount = threads.count,
             contextSize = context,
-            threadCountBatch = threadBatch,
+            threadCountBatch = threads.batch,
             batchSize = batch,
             ubatchSize = ubatch,
             seqMax = seqMax,
@@ -178,29 +538,50 @@ fun fromJson(raw: String, fallbackThreads: Int, fallbackContext: Int): RuntimeCo
             embeddings = embeddings,
             kvUnified = kvUnified,
             useMmap = useMmap,
-            useMlock = useMlock
+            useMlock = useMlock,
+            draftModelPath = draftModelPath,
+            draftTokens = draftTokens,
+            autoTune = autoTune,
+            prefetch = prefetch,
+            typeK = typeK,
+            typeV = typeV
         )
     }
 
-    private fun parseThreadCounts(value: Any?, fallbackThreads: Int): Pair<Int, Int?> {
+    private class ThreadCounts(
+        val count: Int,
+        val batch: Int? = null,
+        val autoTune: Set<AutoTuneField> = emptySet()
+    )
+
+    /**
+     * `"auto"` hands both thread counts to the native tuner; [fallbackThreads] is then only used
+     * if tuning fails.
+     */
+    private fun parseThreadCounts(value: Any?, fallbackThreads: Int): ThreadCounts {
+        val fallback = fallbackThreads.coerceAtLeast(1)
         return when (value) {
-            is Number -> value.toInt().coerceAtLeast(1) to null
+            is Number -> ThreadCounts(value.toInt().coerceAtLeast(1))
             is String -> {
                 val trimmed = value.trim()
-                if (trimmed.equals("auto", ignoreCase = true) || trimmed.isEmpty()) {
-                    fallbackThreads.coerceAtLeast(1) to null
+                if (trimmed.equals("auto", ignoreCase = true)) {
+                    ThreadCounts(fallback, autoTune = setOf(AutoTuneField.THREADS, AutoTuneField.THREADS_BATCH))
                 } else {
-                    trimmed.toIntOrNull()?.takeIf { it > 0 }?.let { it to null }
-                        ?: (fallbackThreads.coerceAtLeast(1) to null)
+                    ThreadCounts(trimmed.toIntOrNull()?.takeIf { it > 0 } ?: fallback)
                 }
             }
             is org.json.JSONObject -> {
-                val inference = extractInt(value, "inference", "decode", "eval", "generation")
-                    ?: fallbackThreads
-                val batch = extractInt(value, "batch", "batch_eval", "thread_count_batch")
-                inference.coerceAtLeast(1) to batch?.takeIf { it > 0 }
+                val inferenceKeys = arrayOf("inference", "decode", "eval", "generation")
+                val batchKeys = arrayOf("batch", "batch_eval", "thread_count_batch")
+                val inference = extractInt(value, *inferenceKeys) ?: fallback
+                val batch = extractInt(value, *batchKeys)
+                val autoTune = buildSet {
+                    if (isAuto(value, *inferenceKeys)) add(AutoTuneField.THREADS)
+                    if (isAuto(value, *batchKeys)) add(AutoTuneField.THREADS_BATCH)
+                }
+                ThreadCounts(inference.coerceAtLeast(1), batch?.takeIf { it > 0 }, autoTune)
             }
-            else -> fallbackThreads.coerceAtLeast(1) to null
+            else -> ThreadCounts(fallback)
         }
     }
 }
@@ -217,6 +598,15 @@ fun fromJson(raw: String, defaultMaxTokens: Int): SamplingConfig {
         val frequencyPenalty = extractFloat(json, "frequency_penalty")
         val presencePenalty = extractFloat(json, "presence_penalty")
         val seed = extractInt(json, "seed")
+        val contextShift = extractBoolean(json, "context_shift", "ctx_shift") ?: false
+        val sinkTokens = extractInt(json, "sink_tokens", "n_keep")
+        val grammar = extractString(json, "grammar")
+        // The schema may be given inline as an object or pre-serialised as a string.
+        val jsonSchema = when (val schemaRaw = json.opt("json_schema") ?: json.opt("schema")) {
+            is org.json.JSONObject -> schemaRaw.toString()
+            is String -> schemaRaw
+            else -> null
+        }?.takeIf { grammar == null }
 
         val stopsRaw = json.opt("stop_sequences") ?: json.opt("stop") ?: json.opt("stops")
         val stopSequences = when (stopsRaw) {
@@ -242,7 +632,11 @@ fun fromJson(raw: String, defaultMaxTokens: Int): SamplingConfig {
             frequencyPenalty = frequencyPenalty,
             presencePenalty = presencePenalty,
             stopSequences = stopSequences,
-            seed = seed
+            seed = seed,
+            contextShift = contextShift,
+            sinkTokens = sinkTokens,
+            grammar = grammar,
+            jsonSchema = jsonSchema
         )
     }
 }
@@ -263,6 +657,23 @@ private fun extractInt(json: org.json.JSONObject, vararg keys: String): Int? {
     return null
 }
 
+private fun isAuto(json: org.json.JSONObject, vararg keys: String): Boolean {
+    val key = keys.firstOrNull { json.has(it) && !json.isNull(it) } ?: return false
+    val value = json.get(key)
+    return value is String && value.trim().equals("auto", ignoreCase = true)
+}
+
+private fun extractString(json: org.json.JSONObject, vararg keys: String): String? {
+    for (key in keys) {
+        if (!json.has(key) || json.isNull(key)) continue
+        val value = json.get(key)
+        if (value is String && value.isNotBlank()) {
+            return value.trim()
+        }
+    }
+    return null
+}
+
 private fun extractFloat(json: org.json.JSONObject, vararg keys: String): Float? {
     for (key in keys) {
         if (!json.has(key) || json.isNull(key)) continue
@@ -302,6 +713,9 @@ private fun extractBoolean(json: org.json.JSONObject, vararg keys: String): Bool
     return null
 }
 
+private fun extractKvCacheType(json: org.json.JSONObject, vararg keys: String): KvCacheType? =
+    extractString(json, *keys)?.let { KvCacheType.fromConfigName(it) }
+
 private fun extractFlashAttention(value: Any?): Int? {
     return when (value) {
         is Number -> value.toInt().takeIf { it in -1..1 }
@@ -1,81 +1,308 @@
 package com.cicero.ciceroai.llama
 
+import android.app.ActivityManager
 import android.content.Context
 import java.io.File
+import java.util.concurrent.atomic.AtomicBoolean
+import java.util.concurrent.locks.ReentrantReadWriteLock
+import kotlin.concurrent.read
+import kotlin.concurrent.write
+import kotlinx.coroutines.CoroutineStart
 import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.awaitCancellation
 import kotlinx.coroutines.channels.BufferOverflow
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.ensureActive
 import kotlinx.coroutines.flow.MutableSharedFlow
 import kotlinx.coroutines.flow.SharedFlow
 import kotlinx.coroutines.flow.asSharedFlow
+import kotlinx.coroutines.isActive
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.runBlocking
 import kotlinx.coroutines.withContext
 
 class LlamaController(context: Context) {
     private val appContext = context.applicationContext
     private val assetManager = ModelAssetManager(appContext)
     private val dispatcher = Dispatchers.Default
+    private val batchDispatcher = Dispatchers.IO
+    @Volatile
     private var session: LlamaSession? = null
+    // Native calls on the session hold the read lock; replacing or reconfiguring it takes the write
+    // lock, so a context is never rebuilt or freed under a running completion. Held only around
+    // blocking native calls, never across a suspension.
+    private val sessionLock = ReentrantReadWriteLock()
+    private val snapshotDir = File(appContext.cacheDir, "prompt_snapshots")
+    private val tuningDir = File(appContext.filesDir, "runtime_tuning")
+    // Chunks are already coalesced natively, so a full buffer suspends the emitting inference
+    // thread (and with it generation) instead of dropping text.
     private val _inferenceProgress = MutableSharedFlow<String>(
         replay = 0,
         extraBufferCapacity = 64,
-        onBufferOverflow = BufferOverflow.DROP_OLDEST
+        onBufferOverflow = BufferOverflow.SUSPEND
     )
 
     val inferenceProgress: SharedFlow<String> = _inferenceProgress.asSharedFlow()
 
+    /**
+     * Loads [modelFile] off the caller's thread, reporting progress in `0f..1f` to
+     * [onLoadProgress]. Cancelling the calling coroutine aborts the native load mid-way. Waits for
+     * running completions to finish before the current session is reconfigured or replaced.
+     */
     suspend fun prepareSession(
         modelFile: File,
-        runtimeConfig: RuntimeConfig
-    ): LlamaSession = withContext(dispatcher) {
-        session
-            ?.takeIf {
-                it.modelFile.absolutePath == modelFile.absolutePath &&
-                    it.modelFile.exists() &&
-                    it.runtimeConfig == runtimeConfig
+        runtimeConfig: RuntimeConfig,
+        onLoadProgress: (Float) -> Unit = {}
+    ): LlamaSession = withContext(batchDispatcher) {
+        val sanitizedConfig = runtimeConfig.sanitized()
+        sessionLock.write {
+            session
+                ?.takeIf { it.modelFile.absolutePath == modelFile.absolutePath && it.modelFile.exists() }
+                ?.let { current ->
+                    if (current.runtimeConfig == sanitizedConfig) {
+                        return@withContext current
+                    }
+                    // Context-level changes keep the loaded weights; only model-level ones reload.
+                    val reconfigured = try {
+                        LlamaBridge.reconfigure(current.handle, sanitizedConfig, tuningDir.absolutePath)
+                    } catch (error: IllegalStateException) {
+                        release()
+                        throw error
+                    }
+                    if (reconfigured) {
+                        onLoadProgress(1f)
+                        val updated = current.copy(runtimeConfig = sanitizedConfig)
+                        session = updated
+                        return@withContext updated
+                    }
+                }
+            session?.let {
+                LlamaBridge.nativeRelease(it.handle)
+                session = null
             }
-            ?.let { return@withContext it }
-        session?.let {
-            LlamaBridge.nativeRelease(it.handle)
-            session = null
-        }
 
-        val sanitizedConfig = runtimeConfig.sanitized()
-        val handle = LlamaBridge.nativeInit(modelFile.absolutePath, sanitizedConfig)
-        val newSession = LlamaSession(handle, modelFile, sanitizedConfig)
-        session = newSession
-        return@withContext newSession
+            val handle = LlamaBridge.nativeInit(
+                modelFile.absolutePath,
+                sanitizedConfig,
+                tuningDir.absolutePath
+            ) { progress ->
+                onLoadProgress(progress)
+                isActive
+            }
+            if (!isActive) {
+                // Cancelled after the last progress report; the finished session is not wanted.
+                LlamaBridge.nativeRelease(handle)
+                ensureActive()
+            }
+            LlamaBridge.nativeConfigurePromptSnapshots(
+                handle,
+                snapshotDir.absolutePath,
+                PROMPT_SNAPSHOT_MAX_BYTES
+            )
+            val newSession = LlamaSession(handle, modelFile, sanitizedConfig)
+            session = newSession
+            newSession
+        }
     }
 
+    // Bundled models are still copied out of the APK once: llama.cpp opens models by path and
+    // parses the GGUF from byte 0, so it cannot map one stored at an offset inside the APK.
     suspend fun prepareSessionFromAsset(
         assetName: String,
-        runtimeConfig: RuntimeConfig
+        runtimeConfig: RuntimeConfig,
+        onLoadProgress: (Float) -> Unit = {}
     ): LlamaSession {
         val modelFile = assetManager.copyModelIfNeeded(assetName)
-        return prepareSession(modelFile, runtimeConfig)
+        return prepareSession(modelFile, runtimeConfig, onLoadProgress)
     }
 
     suspend fun runInference(
         prompt: String,
-        samplingConfig: SamplingConfig
+        samplingConfig: SamplingConfig,
+        streamCadence: StreamCadence = StreamCadence()
     ): String = withContext(dispatcher) {
-        val currentSession =
-            session ?: error("Model belum siap. Panggil prepareSession() terlebih dahulu.")
-        LlamaBridge.nativeCompletionWithProgress(
-            currentSession.handle,
-            prompt,
-            samplingConfig
-        ) { token ->
-            _inferenceProgress.tryEmit(token)
+        cancelNativeOnCancellation {
+            sessionLock.read {
+                val currentSession =
+                    session ?: error("Model belum siap. Panggil prepareSession() terlebih dahulu.")
+                LlamaBridge.nativeStreamingCompletion(
+                    currentSession.handle,
+                    prompt,
+                    samplingConfig,
+                    streamCadence,
+                    LlamaBridge.CompletionListener { chunk ->
+                        if (!_inferenceProgress.tryEmit(chunk)) {
+                            runBlocking { _inferenceProgress.emit(chunk) }
+                        }
+                    }
+                )
+            }
+        }
+    }
+
+    /**
+     * Stops the in-flight [runInference] call, which then returns the partial output. Safe to call
+     * from any thread; returns `false` when no completion was running.
+     */
+    fun cancelInference(): Boolean = session?.let { LlamaBridge.nativeCancel(it.handle) } ?: false
+
+    // The native call blocks its thread, so coroutine cancellation alone would leave it decoding.
+    // A watcher child forwards cancellation of the caller to the session's native cancel token;
+    // while [block] holds the read lock the session cannot be swapped underneath it.
+    private suspend fun <T> cancelNativeOnCancellation(block: () -> T): T = coroutineScope {
+        val finished = AtomicBoolean(false)
+        val watcher = launch(start = CoroutineStart.UNDISPATCHED) {
+            try {
+                awaitCancellation()
+            } finally {
+                if (!finished.get()) {
+                    cancelInference()
+                }
+            }
+        }
+        try {
+            block()
+        } finally {
+            finished.set(true)
+            watcher.cancel()
+        }
+    }
+
+    /**
+     * Runs a background completion (e.g. summarisation) through the native batching engine so it
+     * shares decode steps with other batched requests instead of queueing behind them. Each call
+     * blocks an IO thread while its request is in flight.
+     */
+    suspend fun runBatchedInference(
+        prompt: String,
+        samplingConfig: SamplingConfig,
+        onToken: ((String) -> Unit)? = null
+    ): String = withContext(batchDispatcher) {
+        sessionLock.read {
+            val currentSession =
+                session ?: error("Model belum siap. Panggil prepareSession() terlebih dahulu.")
+            LlamaBridge.nativeBatchedCompletionWithProgress(
+                currentSession.handle,
+                prompt,
+                samplingConfig,
+                onToken?.let { callback -> LlamaBridge.CompletionListener { token -> callback(token) } }
+            )
+        }
+    }
+
+    /**
+     * Runs the same [prefix] (e.g. a tagging or summarising instruction) over every entry of
+     * [inputs] as one background bulk job; see [LlamaBridge.bulkCompletion]. [onItem] is called on
+     * an IO thread as items finish. Cancelling the calling coroutine cancels the remaining items
+     * once the next one finishes.
+     */
+    suspend fun runBulkInference(
+        prefix: String,
+        inputs: List<String>,
+        samplingConfig: SamplingConfig,
+        onItem: (BulkCompletionResult) -> Unit
+    ) = withContext(batchDispatcher) {
+        sessionLock.read {
+            val currentSession =
+                session ?: error("Model belum siap. Panggil prepareSession() terlebih dahulu.")
+            LlamaBridge.bulkCompletion(
+                currentSession.handle,
+                prefix,
+                inputs,
+                samplingConfig,
+                LlamaBridge.BulkCompletionListener { result ->
+                    onItem(result)
+                    isActive
+                }
+            )
+        }
+    }
+
+    /**
+     * Stores the evaluated state of [prompt] (for example a persona or preset preamble) so that
+     * later completions starting with it can skip the prefill, including after an app restart.
+     */
+    suspend fun savePromptSnapshot(prompt: String): Boolean = withContext(dispatcher) {
+        sessionLock.read {
+            val currentSession =
+                session ?: error("Model belum siap. Panggil prepareSession() terlebih dahulu.")
+            LlamaBridge.nativeSavePromptSnapshot(currentSession.handle, prompt)
         }
     }
 
+    /**
+     * Exact prompt budget for the current session, or `null` when no model is loaded yet. See
+     * [LlamaBridge.fitPrompt].
+     */
+    suspend fun fitPrompt(
+        segments: List<String>,
+        pinnedSegments: Int,
+        maxTokens: Int
+    ): PromptFit? = withContext(dispatcher) {
+        sessionLock.read {
+            session?.let { LlamaBridge.fitPrompt(it.handle, segments, pinnedSegments, maxTokens) }
+        }
+    }
+
+    suspend fun embed(
+        texts: List<String>,
+        pooling: EmbeddingPooling = EmbeddingPooling.MEAN,
+        normalize: Boolean = true
+    ): Embeddings = withContext(batchDispatcher) {
+        sessionLock.read {
+            val currentSession =
+                session ?: error("Model belum siap. Panggil prepareSession() terlebih dahulu.")
+            LlamaBridge.embed(currentSession.handle, texts, pooling, normalize)
+        }
+    }
+
+    fun lastCompletionStats(): CompletionStats? =
+        session?.let { LlamaBridge.lastCompletionStats(it.handle) }
+
+    fun metrics(reset: Boolean = false): NativeMetrics? =
+        session?.let { LlamaBridge.metrics(it.handle, reset) }
+
+    fun configureTrace(maxEvents: Int) {
+        session?.let { LlamaBridge.nativeConfigureTrace(it.handle, maxEvents) }
+    }
+
+    fun dumpTrace(): String? = session?.let { LlamaBridge.nativeDumpTrace(it.handle) }
+
+    /** Metadata of [modelFile] without loading it; see [LlamaBridge.probeModel]. */
+    suspend fun probeModel(modelFile: File): ModelInfo = withContext(batchDispatcher) {
+        LlamaBridge.probeModel(modelFile.absolutePath)
+    }
+
+    /**
+     * Memory plan for loading [modelFile] with [runtimeConfig], budgeted against what the device can
+     * spare right now: available memory above the low-memory threshold plus the KV cache and
+     * compute buffers the current session frees when it is replaced. Mapped weights are page cache
+     * and already count as available.
+     */
+    suspend fun planMemory(modelFile: File, runtimeConfig: RuntimeConfig): MemoryPlan = withContext(batchDispatcher) {
+        val memoryInfo = ActivityManager.MemoryInfo()
+        appContext.getSystemService(ActivityManager::class.java)?.getMemoryInfo(memoryInfo)
+        val reclaimable = session?.let { current ->
+            try {
+                val plan = LlamaBridge.planMemory(current.modelFile.absolutePath, current.runtimeConfig, 0L)
+                plan.kvBytes + plan.computeBytes
+            } catch (error: IllegalStateException) {
+                0L
+            }
+        } ?: 0L
+        val budget = memoryInfo.availMem - memoryInfo.threshold + reclaimable
+        LlamaBridge.planMemory(modelFile.absolutePath, runtimeConfig, budget.coerceAtLeast(1L))
+    }
+
     suspend fun listBundledModels(): List<String> = assetManager.listBundledModels()
 
     suspend fun downloadModel(
         url: String,
         fileName: String,
         onProgress: suspend (downloadedBytes: Long, totalBytes: Long?) -> Unit = { _, _ -> },
-        onStatus: suspend (message: String) -> Unit = {}
-    ): File = assetManager.downloadModel(url, fileName, onProgress, onStatus)
+        onStatus: suspend (message: String) -> Unit = {},
+        expectedSha256: String? = null
+    ): File = assetManager.downloadModel(url, fileName, onProgress, onStatus, expectedSha256)
 
     fun isVulkanAvailable(): Boolean = LlamaBridge.isVulkanAvailable()
 
@@ -87,6 +314,8 @@ fun release() {
     }
 }
 
+private const val PROMPT_SNAPSHOT_MAX_BYTES: Long = 512L * 1024L * 1024L
+
 data class LlamaSession(
     val handle: Long,
     val modelFile: File,
@@ -9,8 +9,6 @@
 import kotlinx.coroutines.delay
 import kotlinx.coroutines.withContext
 import okhttp3.OkHttpClient
-import okhttp3.Request
-import kotlin.io.DEFAULT_BUFFER_SIZE
 
 class ModelAssetManager(
     private val context: Context,
@@ -24,6 +22,14 @@ class ModelAssetManager(
         .writeTimeout(timeoutConfig.writeTimeoutMinutes, TimeUnit.MINUTES)
         .callTimeout(timeoutConfig.callTimeoutMinutes, TimeUnit.MINUTES)
         .build()
+    // Partial downloads and their progress live outside the models directory, which must only
+    // hold loadable models. The system may clear them under storage pressure; the download then
+    // simply starts over.
+    private val downloader = RangedDownloader(
+        httpClient,
+        headers = mapOf("User-Agent" to USER_AGENT, "Accept" to ACCEPT_HEADER),
+        partialDir = File(context.cacheDir, "downloads")
+    )
 
     companion object {
         private const val MAX_DOWNLOAD_ATTEMPTS = 3
@@ -37,6 +43,12 @@ class ModelAssetManager(
         private const val INITIAL_BACKOFF_MILLIS = 1_000L
         private const val MAX_BACKOFF_MILLIS = 60_000L
         private val RETRYABLE_STATUS_CODES = setOf(408, 425, 429, 500, 502, 503, 504)
+        // Download sidecars that earlier versions kept inside the models directory.
+        private val SIDECAR_SUFFIXES = listOf(".part", ".part.state", ".part.state.tmp", ".sha256")
+
+        /** True for files in the models directory that can be offered as a model. */
+        fun isModelFile(file: File): Boolean =
+            file.isFile && SIDECAR_SUFFIXES.none { file.name.endsWith(it) }
     }
 
     data class TimeoutConfig(
@@ -68,11 +80,20 @@ suspend fun listBundledModels(): List<String> = withContext(dispatcher) {
         context.assets.list("models")?.sorted()?.toList().orEmpty()
     }
 
+    /**
+     * Downloads [url] into the models directory as parallel ranged segments (see
+     * [RangedDownloader]). A failed or interrupted download keeps its partial file, and the next
+     * call for the same [fileName] and [url] resumes it. The SHA-256 is computed while
+     * downloading, checked against [expectedSha256] when given, and stored as
+     * `checksums/<fileName>.sha256` beside the models directory. A download the server refuses
+     * outright (a non-retryable HTTP status) drops its partial file.
+     */
     suspend fun downloadModel(
         url: String,
         fileName: String,
         onProgress: suspend (downloadedBytes: Long, totalBytes: Long?) -> Unit = { _, _ -> },
-        onStatus: suspend (message: String) -> Unit = {}
+        onStatus: suspend (message: String) -> Unit = {},
+        expectedSha256: String? = null
     ): File = withContext(dispatcher) {
         require(url.startsWith("http", ignoreCase = true)) {
             "URL harus menggunakan skema HTTP atau HTTPS"
@@ -81,94 +102,45 @@ suspend fun downloadModel(
         val modelsDir = File(context.filesDir, "models").apply { mkdirs() }
         val safeName = File(fileName).name.ifBlank { throw IOException("Nama berkas tidak valid") }
         val targetFile = File(modelsDir, safeName)
-        val tempPrefix = safeName.substringBefore('.').takeIf { it.length >= 3 } ?: "model"
         var attempt = 0
         var waitCount = 0
         var lastError: IOException? = null
 
         onStatus(context.getString(R.string.model_status_downloading))
 
-        attemptLoop@ while (attempt < MAX_DOWNLOAD_ATTEMPTS) {
-            val tempFile = File.createTempFile(tempPrefix, ".download", modelsDir)
+        while (attempt < MAX_DOWNLOAD_ATTEMPTS) {
             try {
-                val request = Request.Builder()
-                    .url(url)
-                    .header("User-Agent", USER_AGENT)
-                    .header("Accept", ACCEPT_HEADER)
-                    .build()
-
-                var shouldRetry = false
-                var retryDelayMillis: Long? = null
-
-                httpClient.newCall(request).execute().use { response ->
-                    if (!response.isSuccessful) {
-                        if (response.code in RETRYABLE_STATUS_CODES) {
-                            val retryAfterSeconds = parseRetryAfterSeconds(response.header("Retry-After"))
-                            retryDelayMillis = computeRetryDelayMillis(retryAfterSeconds, waitCount)
-                            waitCount++
-                            shouldRetry = true
-                            return@use
-                        }
-
-                        throw IOException(
-                            "Gagal mengunduh model. Kode respons: ${response.code}"
-                        )
-                    }
-
-                    val body = response.body ?: throw IOException("Respons tidak memiliki konten")
-                    val totalBytes = body.contentLength().takeIf { it > 0L }
-                    body.byteStream().use { input ->
-                        tempFile.outputStream().use { output ->
-                            val buffer = ByteArray(DEFAULT_BUFFER_SIZE)
-                            var downloaded = 0L
-                            while (true) {
-                                val read = input.read(buffer)
-                                if (read == -1) break
-                                output.write(buffer, 0, read)
-                                downloaded += read
-                                onProgress(downloaded, totalBytes)
-                            }
-                            output.flush()
-
-                            if (totalBytes != null && downloaded != totalBytes) {
-                                throw IOException(
-                                    "Unduhan terputus. Hanya menerima $downloaded dari $totalBytes byte"
-                                )
-                            }
-                        }
-                    }
-                    waitCount = 0
-                }
-
-                if (shouldRetry) {
-                    tempFile.delete()
-                    val delayMillis = retryDelayMillis ?: 0L
-                    if (delayMillis > 0L) {
-                        val formattedDuration = formatDelayMessage(delayMillis)
-                        onStatus(
-                            context.getString(
-                                R.string.model_status_download_waiting_retry,
-                                formattedDuration
-                            )
-                        )
-                        delay(delayMillis)
-                        onStatus(context.getString(R.string.model_status_downloading))
-                    }
-                    continue@attemptLoop
-                }
-
-                if (targetFile.exists()) {
+                val sha256 = downloader.download(url, targetFile, onProgress)
+                if (expectedSha256 != null && !sha256.equals(expectedSha256.trim(), ignoreCase = true)) {
                     targetFile.delete()
+                    throw IOException("Checksum model tidak cocok: $sha256")
                 }
-
-                if (!tempFile.renameTo(targetFile)) {
-                    tempFile.copyTo(targetFile, overwrite = true)
-                    tempFile.delete()
-                }
-
+                val checksumsDir = File(context.filesDir, "checksums").apply { mkdirs() }
+                File(checksumsDir, "$safeName.sha256").writeText(sha256)
                 return@withContext targetFile
+            } catch (error: HttpStatusException) {
+                if (error.code !in RETRYABLE_STATUS_CODES) {
+                    lastError = error
+                    attempt++
+                    waitCount = 0
+                    if (attempt >= MAX_DOWNLOAD_ATTEMPTS) {
+                        downloader.discardPartial(targetFile)
+                        throw error
+                    }
+                    continue
+                }
+                val delayMillis = computeRetryDelayMillis(parseRetryAfterSeconds(error.retryAfter), waitCount)
+                waitCount++
+                onStatus(
+                    context.getString(
+                        R.string.model_status_download_waiting_retry,
+                        formatDelayMessage(delayMillis)
+                    )
+                )
+                delay(delayMillis)
+                onStatus(context.getString(R.string.model_status_downloading))
             } catch (error: IOException) {
-                tempFile.delete()
+                // The partial download stays on disk, so the next attempt resumes it.
                 lastError = error
                 attempt++
                 waitCount = 0
@@ -0,0 +1,191 @@
+package com.cicero.ciceroai.llama
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * Packs [RuntimeConfig] and [SamplingConfig] into the versioned binary format decoded by
+ * `llama_bridge.cpp`, so the native side reads plain memory instead of calling back into the JVM
+ * for every field.
+ *
+ * Layout (native byte order): `u32 magic, u16 version, u16 kind, u32 payloadLength`, followed by
+ * `u16 tag, u16 length, value` records. `null` fields are omitted and unknown tags are skipped by
+ * the decoder, so adding a knob only needs a new tag on both sides.
+ */
+internal object NativeConfigCodec {
+    private const val MAGIC = 0x47464343 // "CCFG"
+    private const val VERSION: Short = 1
+    private const val KIND_RUNTIME: Short = 1
+    private const val KIND_SAMPLING: Short = 2
+    private const val HEADER_BYTES = 12
+    private const val RECORD_HEADER_BYTES = 4
+    private const val SAMPLING_CACHE_SIZE = 16
+
+    private val samplingCache = object : LinkedHashMap<SamplingConfig, ByteBuffer>(
+        SAMPLING_CACHE_SIZE, 0.75f, true
+    ) {
+        override fun removeEldestEntry(eldest: MutableMap.MutableEntry<SamplingConfig, ByteBuffer>?): Boolean =
+            size > SAMPLING_CACHE_SIZE
+    }
+
+    fun encodeRuntime(config: RuntimeConfig, tuneCacheDir: String? = null): ByteBuffer = Writer(KIND_RUNTIME).apply {
+        putInt(RuntimeTag.THREAD_COUNT, config.threadCount)
+        putInt(RuntimeTag.CONTEXT_SIZE, config.contextSize)
+        putInt(RuntimeTag.THREAD_COUNT_BATCH, config.threadCountBatch)
+        putInt(RuntimeTag.BATCH_SIZE, config.batchSize)
+        putInt(RuntimeTag.UBATCH_SIZE, config.ubatchSize)
+        putInt(RuntimeTag.SEQ_MAX, config.seqMax)
+        putInt(RuntimeTag.N_GPU_LAYERS, config.nGpuLayers)
+        putInt(RuntimeTag.MAIN_GPU, config.mainGpu)
+        putInt(RuntimeTag.FLASH_ATTENTION, config.flashAttention)
+        putFloat(RuntimeTag.ROPE_FREQ_BASE, config.ropeFreqBase)
+        putFloat(RuntimeTag.ROPE_FREQ_SCALE, config.ropeFreqScale)
+        putBoolean(RuntimeTag.OFFLOAD_KQV, config.offloadKqv)
+        putBoolean(RuntimeTag.NO_PERF, config.noPerf)
+        putBoolean(RuntimeTag.EMBEDDINGS, config.embeddings)
+        putBoolean(RuntimeTag.KV_UNIFIED, config.kvUnified)
+        putBoolean(RuntimeTag.USE_MMAP, config.useMmap)
+        putBoolean(RuntimeTag.USE_MLOCK, config.useMlock)
+        putString(RuntimeTag.DRAFT_MODEL_PATH, config.draftModelPath)
+        putInt(RuntimeTag.DRAFT_TOKENS, config.draftTokens)
+        putBoolean(RuntimeTag.PREFETCH, config.prefetch)
+        putInt(RuntimeTag.TYPE_K, config.typeK?.nativeValue)
+        putInt(RuntimeTag.TYPE_V, config.typeV?.nativeValue)
+        if (config.autoTune.isNotEmpty()) {
+            putInt(RuntimeTag.AUTO_TUNE, config.autoTune.fold(0) { mask, field -> mask or field.bit })
+            putString(RuntimeTag.TUNE_CACHE_DIR, tuneCacheDir)
+        }
+    }.toDirectBuffer()
+
+    /**
+     * Encoded buffers are immutable once written, so recently used sampling configs are reused
+     * across completions instead of being packed again.
+     */
+    fun encodeSampling(config: SamplingConfig): ByteBuffer {
+        synchronized(samplingCache) {
+            samplingCache[config]?.let { return it }
+        }
+        val encoded = Writer(KIND_SAMPLING).apply {
+            putInt(SamplingTag.MAX_TOKENS, config.maxTokens)
+            putFloat(SamplingTag.TEMPERATURE, config.temperature)
+            putFloat(SamplingTag.TOP_P, config.topP)
+            putInt(SamplingTag.TOP_K, config.topK)
+            putFloat(SamplingTag.REPEAT_PENALTY, config.repeatPenalty)
+            putInt(SamplingTag.REPEAT_LAST_N, config.repeatLastN)
+            putFloat(SamplingTag.FREQUENCY_PENALTY, config.frequencyPenalty)
+            putFloat(SamplingTag.PRESENCE_PENALTY, config.presencePenalty)
+            config.stopSequences.forEach { putString(SamplingTag.STOP_SEQUENCE, it) }
+            putInt(SamplingTag.SEED, config.seed)
+            putBoolean(SamplingTag.CONTEXT_SHIFT, config.contextShift)
+            putInt(SamplingTag.SINK_TOKENS, config.sinkTokens)
+            putString(SamplingTag.GRAMMAR, config.grammar)
+            putString(SamplingTag.JSON_SCHEMA, config.jsonSchema)
+        }.toDirectBuffer()
+        synchronized(samplingCache) {
+            samplingCache[config] = encoded
+        }
+        return encoded
+    }
+
+    private object RuntimeTag {
+        const val THREAD_COUNT = 1
+        const val CONTEXT_SIZE = 2
+        const val THREAD_COUNT_BATCH = 3
+        const val BATCH_SIZE = 4
+        const val UBATCH_SIZE = 5
+        const val SEQ_MAX = 6
+        const val N_GPU_LAYERS = 7
+        const val MAIN_GPU = 8
+        const val FLASH_ATTENTION = 9
+        const val ROPE_FREQ_BASE = 10
+        const val ROPE_FREQ_SCALE = 11
+        const val OFFLOAD_KQV = 12
+        const val NO_PERF = 13
+        const val EMBEDDINGS = 14
+        const val KV_UNIFIED = 15
+        const val USE_MMAP = 16
+        const val USE_MLOCK = 17
+        const val DRAFT_MODEL_PATH = 18
+        const val DRAFT_TOKENS = 19
+        const val AUTO_TUNE = 20
+        const val TUNE_CACHE_DIR = 21
+        const val PREFETCH = 22
+        const val TYPE_K = 23
+        const val TYPE_V = 24
+    }
+
+    private object SamplingTag {
+        const val MAX_TOKENS = 1
+        const val TEMPERATURE = 2
+        const val TOP_P = 3
+        const val TOP_K = 4
+        const val REPEAT_PENALTY = 5
+        const val REPEAT_LAST_N = 6
+        const val FREQUENCY_PENALTY = 7
+        const val PRESENCE_PENALTY = 8
+        const val STOP_SEQUENCE = 9
+        const val SEED = 10
+        const val CONTEXT_SHIFT = 11
+        const val SINK_TOKENS = 12
+        const val GRAMMAR = 13
+        const val JSON_SCHEMA = 14
+    }
+
+    private class Writer(private val kind: Short) {
+        private var buffer = ByteBuffer.allocate(256).order(ByteOrder.nativeOrder())
+
+        fun putInt(tag: Int, value: Int?) {
+            value ?: return
+            record(tag, Int.SIZE_BYTES).putInt(value)
+        }
+
+        fun putFloat(tag: Int, value: Float?) {
+            value ?: return
+            record(tag, Float.SIZE_BYTES).putFloat(value)
+        }
+
+        fun putBoolean(tag: Int, value: Boolean?) {
+            value ?: return
+            record(tag, 1).put(if (value) 1.toByte() else 0.toByte())
+        }
+
+        fun putString(tag: Int, value: String?) {
+            value ?: return
+            val bytes = value.toByteArray(Charsets.UTF_8)
+            require(bytes.size <= 0xFFFF) { "Nilai konfigurasi terlalu panjang untuk dikemas" }
+            record(tag, bytes.size).put(bytes)
+        }
+
+        private fun record(tag: Int, length: Int): ByteBuffer {
+            ensureCapacity(RECORD_HEADER_BYTES + length)
+            return buffer.putShort(tag.toShort()).putShort(length.toShort())
+        }
+
+        private fun ensureCapacity(extra: Int) {
+            if (buffer.remaining() >= extra) {
+                return
+            }
+            val grown = ByteBuffer
+                .allocate(maxOf(buffer.capacity() * 2, buffer.position() + extra))
+                .order(ByteOrder.nativeOrder())
+            buffer.flip()
+            grown.put(buffer)
+            buffer = grown
+        }
+
+        fun toDirectBuffer(): ByteBuffer {
+            val payloadLength = buffer.position()
+            val direct = ByteBuffer
+                .allocateDirect(HEADER_BYTES + payloadLength)
+                .order(ByteOrder.nativeOrder())
+            direct.putInt(MAGIC)
+                .putShort(VERSION)
+                .putShort(kind)
+                .putInt(payloadLength)
+            buffer.flip()
+            direct.put(buffer)
+            direct.flip()
+            return direct
+        }
+    }
+}
@@ -0,0 +1,385 @@
+package com.cicero.ciceroai.llama
+
+import java.io.File
+import java.io.IOException
+import java.io.RandomAccessFile
+import java.nio.ByteBuffer
+import java.nio.channels.FileChannel
+import java.security.MessageDigest
+import java.util.concurrent.atomic.AtomicInteger
+import java.util.concurrent.atomic.AtomicLongArray
+import kotlin.coroutines.coroutineContext
+import kotlinx.coroutines.Dispatchers
+import kotlinx.coroutines.async
+import kotlinx.coroutines.awaitAll
+import kotlinx.coroutines.coroutineScope
+import kotlinx.coroutines.ensureActive
+import kotlinx.coroutines.flow.MutableStateFlow
+import kotlinx.coroutines.flow.first
+import kotlinx.coroutines.flow.update
+import kotlinx.coroutines.launch
+import kotlinx.coroutines.withContext
+import okhttp3.OkHttpClient
+import okhttp3.Request
+import okhttp3.Response
+
+/** Unsuccessful HTTP response; [retryAfter] is the raw `Retry-After` header, if any. */
+internal class HttpStatusException(
+    val code: Int,
+    val retryAfter: String?
+) : IOException("Gagal mengunduh model. Kode respons: $code")
+
+/**
+ * Downloads a URL as fixed-size HTTP Range segments, fetched by [parallelism] workers into a
+ * preallocated `.part` file in [partialDir] (next to the target when null). Segment progress is
+ * saved after every finished segment (and when a download fails), so the next call resumes where
+ * the last one stopped, also after a process restart, as long as the server still reports the same
+ * length and validator (ETag or Last-Modified).
+ *
+ * Workers take segments in file order, so the written region stays nearly contiguous and the
+ * SHA-256 is computed right behind it over freshly written, still cached bytes instead of in a
+ * second pass over the finished file. Servers that ignore `Range` get a single plain stream.
+ */
+internal class RangedDownloader(
+    private val client: OkHttpClient,
+    private val headers: Map<String, String> = emptyMap(),
+    private val parallelism: Int = DEFAULT_PARALLELISM,
+    private val segmentBytes: Long = DEFAULT_SEGMENT_BYTES,
+    private val partialDir: File? = null
+) {
+    companion object {
+        const val DEFAULT_PARALLELISM = 4
+        const val DEFAULT_SEGMENT_BYTES = 16L * 1024 * 1024
+        private const val BUFFER_BYTES = 256 * 1024
+        private const val HTTP_PARTIAL_CONTENT = 206
+        private val CONTENT_RANGE_TOTAL = Regex("""bytes\s+\d+-\d+/(\d+)""")
+
+        fun partFile(target: File, directory: File? = null): File =
+            File(directory ?: target.parentFile, "${target.name}.part")
+
+        fun stateFile(target: File, directory: File? = null): File =
+            File(directory ?: target.parentFile, "${target.name}.part.state")
+    }
+
+    /** Drops the resumable progress of [target]. */
+    fun discardPartial(target: File) {
+        stateFile(target, partialDir).delete()
+        partFile(target, partialDir).delete()
+    }
+
+    /**
+     * Downloads [url] to [target], replacing it, and returns the lowercase hex SHA-256 of the
+     * content. On failure the partial download is kept for the next call.
+     */
+    suspend fun download(
+        url: String,
+        target: File,
+        onProgress: suspend (downloadedBytes: Long, totalBytes: Long?) -> Unit
+    ): String = withContext(Dispatchers.IO) {
+        partialDir?.mkdirs()
+        val remote = client.newCall(request(url) { header("Range", "bytes=0-0") }).execute().use { response ->
+            if (!response.isSuccessful) {
+                throw HttpStatusException(response.code, response.header("Retry-After"))
+            }
+            if (response.code == HTTP_PARTIAL_CONTENT) RemoteFile.from(response) else null
+        }
+
+        val sha256 = if (remote == null) {
+            client.newCall(request(url)).execute().use { response ->
+                if (!response.isSuccessful) {
+                    throw HttpStatusException(response.code, response.header("Retry-After"))
+                }
+                streamWhole(response, target, onProgress)
+            }
+        } else {
+            downloadRanges(url, remote, target, onProgress)
+        }
+
+        val part = partFile(target, partialDir)
+        if (target.exists()) {
+            target.delete()
+        }
+        if (!part.renameTo(target)) {
+            part.copyTo(target, overwrite = true)
+            part.delete()
+        }
+        stateFile(target, partialDir).delete()
+        sha256
+    }
+
+    private suspend fun downloadRanges(
+        url: String,
+        remote: RemoteFile,
+        target: File,
+        onProgress: suspend (downloadedBytes: Long, totalBytes: Long?) -> Unit
+    ): String {
+        val part = partFile(target, partialDir)
+        val stateFile = stateFile(target, partialDir)
+        val state = DownloadState.load(stateFile)
+            ?.takeIf { it.matches(url, remote, segmentBytes) && part.length() == remote.length }
+            ?: DownloadState.create(url, remote, segmentBytes).also {
+                part.delete()
+                RandomAccessFile(part, "rw").use { file -> file.setLength(remote.length) }
+                it.save(stateFile)
+            }
+
+        return RandomAccessFile(part, "rw").use { file ->
+            val channel = file.channel
+            val written = MutableStateFlow(state.downloadedBytes())
+            val nextSegment = AtomicInteger(0)
+            coroutineScope {
+                val hasher = async { hashContiguous(channel, state, written) }
+                val reporter = launch { written.collect { onProgress(it, remote.length) } }
+                try {
+                    val workers = parallelism.coerceIn(1, state.segmentCount)
+                    List(workers) {
+                        async {
+                            while (true) {
+                                val index = nextSegment.getAndIncrement()
+                                if (index >= state.segmentCount) {
+                                    break
+                                }
+                                if (state.remaining(index) > 0L) {
+                                    fetchSegment(url, remote, state, index, channel, written)
+                                    channel.force(false)
+                                    state.save(stateFile)
+                                }
+                            }
+                        }
+                    }.awaitAll()
+                } finally {
+                    if (!state.stale) {
+                        channel.force(false)
+                    }
+                    state.save(stateFile)
+                }
+                val sha256 = hasher.await()
+                reporter.cancel()
+                onProgress(remote.length, remote.length)
+                sha256
+            }
+        }
+    }
+
+    private suspend fun fetchSegment(
+        url: String,
+        remote: RemoteFile,
+        state: DownloadState,
+        index: Int,
+        channel: FileChannel,
+        written: MutableStateFlow<Long>
+    ) {
+        val segmentStart = state.segmentStart(index)
+        val end = segmentStart + state.segmentLength(index) - 1
+        var position = segmentStart + state.done[index]
+        val request = request(url) {
+            header("Range", "bytes=$position-$end")
+            remote.validator?.let { header("If-Range", it) }
+        }
+        client.newCall(request).execute().use { response ->
+            if (response.code != HTTP_PARTIAL_CONTENT) {
+                if (response.isSuccessful) {
+                    // If-Range answered with the whole (changed) file: start over next time.
+                    state.stale = true
+                    throw IOException("Berkas model di server berubah selama unduhan.")
+                }
+                throw HttpStatusException(response.code, response.header("Retry-After"))
+            }
+            val body = response.body ?: throw IOException("Respons tidak memiliki konten")
+            body.byteStream().use { input ->
+                val buffer = ByteArray(BUFFER_BYTES)
+                while (position <= end) {
+                    coroutineContext.ensureActive()
+                    val read = input.read(buffer, 0, minOf(buffer.size.toLong(), end - position + 1).toInt())
+                    if (read == -1) {
+                        break
+                    }
+                    val chunk = ByteBuffer.wrap(buffer, 0, read)
+                    while (chunk.hasRemaining()) {
+                        channel.write(chunk, position + chunk.position())
+                    }
+                    position += read
+                    state.done.addAndGet(index, read.toLong())
+                    written.update { it + read }
+                }
+            }
+        }
+        if (position <= end) {
+            throw IOException("Unduhan terputus pada byte $position dari ${remote.length}")
+        }
+    }
+
+    // Hashes the contiguous downloaded prefix of the file as it grows.
+    private suspend fun hashContiguous(
+        channel: FileChannel,
+        state: DownloadState,
+        written: MutableStateFlow<Long>
+    ): String {
+        val digest = MessageDigest.getInstance("SHA-256")
+        val buffer = ByteBuffer.allocate(BUFFER_BYTES)
+        var hashed = 0L
+        while (hashed < state.length) {
+            val frontier = state.contiguousBytes()
+            if (frontier <= hashed) {
+                written.first { state.contiguousBytes() > hashed }
+                continue
+            }
+            while (hashed < frontier) {
+                buffer.clear()
+                buffer.limit(minOf(BUFFER_BYTES.toLong(), frontier - hashed).toInt())
+                val read = channel.read(buffer, hashed)
+                if (read <= 0) {
+                    throw IOException("Gagal membaca ulang berkas unduhan untuk checksum")
+                }
+                buffer.flip()
+                digest.update(buffer)
+                hashed += read
+            }
+        }
+        return digest.digest().toHex()
+    }
+
+    // Fallback for servers without range support: one stream, hashed in memory, not resumable.
+    private suspend fun streamWhole(
+        response: Response,
+        target: File,
+        onProgress: suspend (downloadedBytes: Long, totalBytes: Long?) -> Unit
+    ): String {
+        stateFile(target, partialDir).delete()
+        val digest = MessageDigest.getInstance("SHA-256")
+        val body = response.body ?: throw IOException("Respons tidak memiliki konten")
+        val totalBytes = body.contentLength().takeIf { it > 0L }
+        var downloaded = 0L
+        body.byteStream().use { input ->
+            partFile(target, partialDir).outputStream().use { output ->
+                val buffer = ByteArray(BUFFER_BYTES)
+                while (true) {
+                    coroutineContext.ensureActive()
+                    val read = input.read(buffer)
+                    if (read == -1) break
+                    output.write(buffer, 0, read)
+                    digest.update(buffer, 0, read)
+                    downloaded += read
+                    onProgress(downloaded, totalBytes)
+                }
+            }
+        }
+        if (totalBytes != null && downloaded != totalBytes) {
+            throw IOException("Unduhan terputus. Hanya menerima $downloaded dari $totalBytes byte")
+        }
+        return digest.digest().toHex()
+    }
+
+    private fun request(url: String, configure: Request.Builder.() -> Unit = {}): Request =
+        Request.Builder()
+            .url(url)
+            .apply { headers.forEach { (name, value) -> header(name, value) } }
+            .apply(configure)
+            .build()
+
+    private fun ByteArray.toHex(): String = joinToString("") { "%02x".format(it) }
+
+    private class RemoteFile(val length: Long, val validator: String?) {
+        companion object {
+            fun from(response: Response): RemoteFile? {
+                val length = response.header("Content-Range")
+                    ?.let { CONTENT_RANGE_TOTAL.find(it) }
+                    ?.groupValues?.get(1)?.toLongOrNull()
+                    ?.takeIf { it > 0L }
+                    ?: return null
+                // Weak ETags cannot be used with If-Range.
+                val validator = response.header("ETag")?.takeUnless { it.startsWith("W/") }
+                    ?: response.header("Last-Modified")
+                return RemoteFile(length, validator)
+            }
+        }
+    }
+
+    // Per-segment progress, persisted as a small line-oriented text file.
+    private class DownloadState(
+        val url: String,
+        val length: Long,
+        val validator: String?,
+        val segmentBytes: Long,
+        val done: AtomicLongArray
+    ) {
+        @Volatile
+        var stale = false
+
+        val segmentCount: Int
+            get() = done.length()
+
+        fun segmentStart(index: Int): Long = index * segmentBytes
+
+        fun segmentLength(index: Int): Long = minOf(segmentBytes, length - segmentStart(index))
+
+        fun remaining(index: Int): Long = segmentLength(index) - done[index]
+
+        fun downloadedBytes(): Long = (0 until segmentCount).sumOf { done[it] }
+
+        fun contiguousBytes(): Long {
+            var total = 0L
+            for (index in 0 until segmentCount) {
+                val segmentDone = done[index]
+                total += segmentDone
+                if (segmentDone < segmentLength(index)) break
+            }
+            return total
+        }
+
+        fun matches(url: String, remote: RemoteFile, segmentBytes: Long): Boolean =
+            this.url == url && length == remote.length && validator == remote.validator &&
+                this.segmentBytes == segmentBytes
+
+        @Synchronized
+        fun save(file: File) {
+            if (stale) {
+                file.delete()
+                return
+            }
+            val text = buildString {
+                appendLine(VERSION)
+                appendLine(url)
+                appendLine(length)
+                appendLine(validator.orEmpty())
+                appendLine(segmentBytes)
+                appendLine((0 until segmentCount).joinToString(",") { done[it].toString() })
+            }
+            val temp = File(file.parentFile, "${file.name}.tmp")
+            temp.writeText(text)
+            if (!temp.renameTo(file)) {
+                temp.copyTo(file, overwrite = true)
+                temp.delete()
+            }
+        }
+
+        companion object {
+            private const val VERSION = "cicero-download-v1"
+
+            fun create(url: String, remote: RemoteFile, segmentBytes: Long): DownloadState {
+                val count = ((remote.length + segmentBytes - 1) / segmentBytes).toInt()
+                return DownloadState(url, remote.length, remote.validator, segmentBytes, AtomicLongArray(count))
+            }
+
+            fun load(file: File): DownloadState? {
+                val lines = runCatching { file.readLines() }.getOrNull() ?: return null
+                if (lines.size < 6 || lines[0] != VERSION) {
+                    return null
+                }
+                val length = lines[2].toLongOrNull() ?: return null
+                val segmentBytes = lines[4].toLongOrNull()?.takeIf { it > 0L } ?: return null
+                val done = lines[5].split(',').map { it.toLongOrNull() ?: return null }
+                val state = DownloadState(
+                    url = lines[1],
+                    length = length,
+                    validator = lines[3].ifEmpty { null },
+                    segmentBytes = segmentBytes,
+                    done = AtomicLongArray(done.toLongArray())
+                )
+                val consistent = state.segmentCount == ((length + segmentBytes - 1) / segmentBytes).toInt() &&
+                    (0 until state.segmentCount).all { done[it] in 0L..state.segmentLength(it) }
+                return state.takeIf { consistent }
+            }
+        }
+    }
+}
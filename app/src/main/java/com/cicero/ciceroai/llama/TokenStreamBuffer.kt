@@ -0,0 +1,67 @@
+package com.cicero.ciceroai.llama
+
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+
+/**
+ * How often native code hands streamed text to Kotlin: after [flushTokens] generated tokens or
+ * [flushIntervalMs] milliseconds, whichever comes first. The first chunk is always delivered
+ * immediately.
+ */
+data class StreamCadence(
+    val flushTokens: Int = 8,
+    val flushIntervalMs: Int = 50
+) {
+    fun sanitized(): StreamCadence = copy(
+        flushTokens = flushTokens.coerceAtLeast(1),
+        flushIntervalMs = flushIntervalMs.coerceAtLeast(0)
+    )
+}
+
+/**
+ * Direct ring buffer shared with the native token stream. Native code appends UTF-8 complete
+ * chunks and advances the write cursor; [drain] decodes everything published since the last call
+ * and advances the read cursor. Native blocks on the listener whenever the ring is full, so a
+ * slow consumer throttles generation rather than losing text.
+ *
+ * Layout (native byte order): `[0, 8)` write cursor, `[8, 16)` read cursor, then the ring. Both
+ * cursors count bytes since the start of the completion.
+ */
+internal class TokenStreamBuffer(capacityBytes: Int = DEFAULT_CAPACITY_BYTES) {
+    val buffer: ByteBuffer = ByteBuffer
+        .allocateDirect(HEADER_BYTES + capacityBytes.coerceAtLeast(MIN_CAPACITY_BYTES))
+        .order(ByteOrder.nativeOrder())
+
+    private val capacity = buffer.capacity() - HEADER_BYTES
+    private val ring: ByteBuffer = buffer.duplicate()
+    private var scratch = ByteArray(capacity)
+
+    fun drain(): String {
+        val written = buffer.getLong(WRITE_CURSOR_OFFSET)
+        val read = buffer.getLong(READ_CURSOR_OFFSET)
+        val available = (written - read).toInt()
+        if (available <= 0) {
+            return ""
+        }
+
+        val start = (read % capacity).toInt()
+        val first = minOf(available, capacity - start)
+        ring.clear()
+        ring.position(HEADER_BYTES + start)
+        ring.get(scratch, 0, first)
+        if (available > first) {
+            ring.position(HEADER_BYTES)
+            ring.get(scratch, first, available - first)
+        }
+        buffer.putLong(READ_CURSOR_OFFSET, written)
+        return String(scratch, 0, available, Charsets.UTF_8)
+    }
+
+    companion object {
+        const val WRITE_CURSOR_OFFSET = 0
+        const val READ_CURSOR_OFFSET = 8
+        const val HEADER_BYTES = 16
+        const val DEFAULT_CAPACITY_BYTES = 16 * 1024
+        private const val MIN_CAPACITY_BYTES = 64
+    }
+}
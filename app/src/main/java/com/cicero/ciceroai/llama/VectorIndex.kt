@@ -0,0 +1,129 @@
+package com.cicero.ciceroai.llama
+
+import java.io.Closeable
+import java.io.File
+import java.nio.ByteBuffer
+import java.nio.ByteOrder
+import java.nio.FloatBuffer
+import java.util.concurrent.locks.ReentrantReadWriteLock
+import kotlin.concurrent.read
+import kotlin.concurrent.write
+
+data class VectorMatch(
+    val id: Long,
+    /** Cosine similarity to the query, 1 for an identical direction. */
+    val score: Float
+)
+
+/**
+ * Approximate nearest-neighbour index over cosine similarity, stored as memory-mapped files in
+ * [directory] and searched natively, so neither the vectors nor the graph are copied onto the Java
+ * heap. Vectors are normalised on insert; ids are caller-defined and need not be unique.
+ *
+ * Searches may run concurrently; [add] waits for them. Call [close] to unmap the files.
+ */
+class VectorIndex private constructor(
+    private var handle: Long,
+    val dimension: Int
+) : Closeable {
+    private val lock = ReentrantReadWriteLock()
+
+    val size: Long
+        get() = lock.read { LlamaBridge.nativeVectorIndexSize(checkOpen()) }
+
+    /** Appends `ids.size` vectors laid out back to back in [vectors]. */
+    fun add(ids: LongArray, vectors: FloatBuffer) {
+        require(vectors.remaining() >= ids.size * dimension) {
+            "vectors berisi ${vectors.remaining()} float, dibutuhkan ${ids.size * dimension}"
+        }
+        if (ids.isEmpty()) {
+            return
+        }
+        val direct = vectors.toDirect()
+        lock.read { LlamaBridge.nativeVectorIndexAdd(checkOpen(), ids, direct) }
+    }
+
+    fun add(ids: LongArray, embeddings: Embeddings) {
+        require(embeddings.dimension == dimension) {
+            "dimensi embedding ${embeddings.dimension} tidak sama dengan indeks ($dimension)"
+        }
+        require(ids.size == embeddings.count) { "jumlah id tidak sama dengan jumlah embedding" }
+        add(ids, embeddings.flat)
+    }
+
+    /**
+     * Up to [k] stored vectors most similar to [query], best first. A larger [ef] visits more of the
+     * graph: higher recall, higher latency.
+     */
+    fun search(query: FloatBuffer, k: Int, ef: Int = DEFAULT_EF): List<VectorMatch> {
+        require(query.remaining() >= dimension) { "query berisi ${query.remaining()} float, dibutuhkan $dimension" }
+        require(k > 0) { "k harus positif" }
+        val direct = query.toDirect()
+        val ids = LongArray(k)
+        val scores = FloatArray(k)
+        val found = lock.read { LlamaBridge.nativeVectorIndexSearch(checkOpen(), direct, ef, ids, scores) }
+        return List(found) { VectorMatch(ids[it], scores[it]) }
+    }
+
+    fun search(query: FloatArray, k: Int, ef: Int = DEFAULT_EF): List<VectorMatch> =
+        search(FloatBuffer.wrap(query), k, ef)
+
+    /** Flushes pending writes to storage; the OS also does this on its own schedule. */
+    fun sync() {
+        lock.read { LlamaBridge.nativeVectorIndexSync(checkOpen()) }
+    }
+
+    override fun close() {
+        lock.write {
+            if (handle != 0L) {
+                LlamaBridge.nativeVectorIndexClose(handle)
+                handle = 0L
+            }
+        }
+    }
+
+    private fun checkOpen(): Long {
+        check(handle != 0L) { "Indeks vektor sudah ditutup." }
+        return handle
+    }
+
+    companion object {
+        const val DEFAULT_EF = 64
+
+        /**
+         * Opens the index in [directory], creating it when empty. With [int8] vectors are stored
+         * as one byte per dimension: four times smaller at a small recall cost. [maxNeighbors] and
+         * [int8] are fixed when the index is created.
+         */
+        fun open(
+            directory: File,
+            dimension: Int,
+            int8: Boolean = false,
+            maxNeighbors: Int = 16,
+            efConstruction: Int = 100
+        ): VectorIndex {
+            require(dimension > 0) { "dimensi harus positif" }
+            val handle = LlamaBridge.nativeVectorIndexOpen(
+                directory.absolutePath,
+                dimension,
+                int8,
+                maxNeighbors,
+                efConstruction
+            )
+            return VectorIndex(handle, dimension)
+        }
+
+        // JNI reads vectors in place: that needs a direct, native-order buffer starting at the position.
+        private fun FloatBuffer.toDirect(): FloatBuffer {
+            if (isDirect && order() == ByteOrder.nativeOrder()) {
+                return slice()
+            }
+            val copy = ByteBuffer.allocateDirect(remaining() * Float.SIZE_BYTES)
+                .order(ByteOrder.nativeOrder())
+                .asFloatBuffer()
+            copy.put(duplicate())
+            copy.flip()
+            return copy
+        }
+    }
+}
@@ -1,5 +1,6 @@
 package com.cicero.ciceroai
 
+import com.cicero.ciceroai.llama.PromptFit
 import org.junit.Assert.assertEquals
 import org.junit.Assert.assertTrue
 import org.junit.Test
@@ -47,4 +48,15 @@ class TokenBudgetTest {
         assertTrue(largerContextBudget.remainingTokens > smallerContextBudget.remainingTokens)
         assertTrue(largerContextBudget.maxTokens > smallerContextBudget.maxTokens)
     }
+
+    @Test
+    fun `native prompt fit maps to exact budget`() {
+        val fit = PromptFit.fromNative(intArrayOf(2, 900, 124, 1024))
+        val budget = fit.toTokenBudget()
+
+        assertEquals(2, fit.firstKeptSegment)
+        assertEquals(900, budget.promptTokens)
+        assertEquals(124, budget.remainingTokens)
+        assertEquals(124, budget.maxTokens)
+    }
 }
@@ -0,0 +1,29 @@
+package com.cicero.ciceroai.llama
+
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertNull
+import org.junit.Test
+
+class ModelInfoTest {
+
+    @Test
+    fun `fromNative maps the probe arrays and context is capped at the training length`() {
+        val values = longArrayOf(986_000_000L, 1_543_714_304L, 985_000_000L, 32_768L, 28L, 1_536L, 12L, 2L, 128L, 128L)
+        val info = ModelInfo.fromNative(values, arrayOf("qwen2", "Qwen2.5 1.5B Instruct", "Q4_K_M", null))
+
+        assertEquals("qwen2", info.architecture)
+        assertEquals("Q4_K_M", info.quantization)
+        assertNull(info.chatTemplate)
+        assertEquals(32_768, info.contextLength)
+        assertEquals(2, info.headCountKv)
+        // Missing trailing values default to 0.
+        assertEquals(0, info.vocabSize)
+        assertEquals("1.5B", info.parameterLabel)
+
+        val tooLong = RuntimeConfig(threadCount = 4, contextSize = 65_536)
+        assertEquals(32_768, info.fitRuntimeConfig(tooLong).contextSize)
+        assertEquals(4_096, info.fitRuntimeConfig(tooLong.copy(contextSize = 4_096)).contextSize)
+        val scaled = tooLong.copy(ropeFreqScale = 0.5f)
+        assertEquals(65_536, info.fitRuntimeConfig(scaled).contextSize)
+    }
+}
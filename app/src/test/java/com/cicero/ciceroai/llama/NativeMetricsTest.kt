@@ -0,0 +1,29 @@
+package com.cicero.ciceroai.llama
+
+import org.junit.Assert.assertEquals
+import org.junit.Test
+
+class NativeMetricsTest {
+
+    @Test
+    fun `fromNative splits phases and quantiles follow the histogram`() {
+        val valuesPerPhase = 27
+        val values = LongArray(MetricPhase.values().size * valuesPerPhase)
+        val decode = MetricPhase.DECODE.ordinal * valuesPerPhase
+        values[decode] = 4L
+        values[decode + 1] = 40_000_000L
+        values[decode + 2] = 15_000_000L
+        // Three decodes in [4, 8) ms and one in [8, 16) ms.
+        values[decode + 3 + 13] = 3L
+        values[decode + 3 + 14] = 1L
+
+        val metrics = NativeMetrics.fromNative(values)
+
+        val phase = metrics[MetricPhase.DECODE]
+        assertEquals(4L, phase.count)
+        assertEquals(10_000_000L, phase.meanNanos)
+        assertEquals(8_192_000L, phase.quantileNanos(0.5))
+        assertEquals(15_000_000L, phase.quantileNanos(0.99))
+        assertEquals(0L, metrics[MetricPhase.SAMPLE].count)
+    }
+}
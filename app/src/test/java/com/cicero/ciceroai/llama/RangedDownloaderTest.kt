@@ -0,0 +1,154 @@
+package com.cicero.ciceroai.llama
+
+import com.sun.net.httpserver.HttpExchange
+import com.sun.net.httpserver.HttpServer
+import java.io.File
+import java.io.IOException
+import java.net.InetSocketAddress
+import java.nio.file.Files
+import java.security.MessageDigest
+import java.util.concurrent.Executors
+import java.util.concurrent.atomic.AtomicLong
+import kotlin.random.Random
+import kotlinx.coroutines.runBlocking
+import okhttp3.OkHttpClient
+import org.junit.After
+import org.junit.Assert.assertArrayEquals
+import org.junit.Assert.assertEquals
+import org.junit.Assert.assertFalse
+import org.junit.Assert.assertTrue
+import org.junit.Assert.fail
+import org.junit.Before
+import org.junit.Test
+
+class RangedDownloaderTest {
+    private val content = Random(42).nextBytes(3 * 1024 * 1024 + 123)
+    private val servedBytes = AtomicLong()
+    // Bytes the server still sends before cutting the connection; negative disables the fault.
+    private val failAfterBytes = AtomicLong(-1)
+    private var supportRanges = true
+    private lateinit var server: HttpServer
+    private lateinit var directory: File
+
+    @Before
+    fun setUp() {
+        directory = Files.createTempDirectory("ranged-download").toFile()
+        server = HttpServer.create(InetSocketAddress("127.0.0.1", 0), 0)
+        server.createContext("/model.gguf") { exchange -> serve(exchange) }
+        server.executor = Executors.newFixedThreadPool(8)
+        server.start()
+    }
+
+    @After
+    fun tearDown() {
+        server.stop(0)
+        directory.deleteRecursively()
+    }
+
+    @Test
+    fun `parallel segments reassemble the file and its sha256`() = runBlocking {
+        val target = File(directory, "model.gguf")
+        var lastProgress = 0L
+
+        val sha256 = downloader().download(url(), target) { downloaded, _ -> lastProgress = downloaded }
+
+        assertArrayEquals(content, target.readBytes())
+        assertEquals(sha256Hex(content), sha256)
+        assertEquals(content.size.toLong(), lastProgress)
+        assertFalse(RangedDownloader.stateFile(target).exists())
+        assertFalse(RangedDownloader.partFile(target).exists())
+    }
+
+    @Test
+    fun `interrupted download resumes instead of restarting`() = runBlocking {
+        val target = File(directory, "model.gguf")
+        failAfterBytes.set(content.size / 2L)
+        try {
+            downloader().download(url(), target) { _, _ -> }
+            fail("Unduhan seharusnya terputus")
+        } catch (expected: IOException) {
+        }
+        assertTrue(RangedDownloader.stateFile(target).exists())
+
+        failAfterBytes.set(-1)
+        val sha256 = downloader().download(url(), target) { _, _ -> }
+
+        assertArrayEquals(content, target.readBytes())
+        assertEquals(sha256Hex(content), sha256)
+        // Only whole segments in flight at the interruption may be fetched twice.
+        assertTrue(servedBytes.get() < content.size + 4L * SEGMENT_BYTES)
+    }
+
+    @Test
+    fun `partial files stay out of the target directory until discarded`() = runBlocking {
+        val modelsDir = File(directory, "models").apply { mkdirs() }
+        val partialDir = File(directory, "downloads")
+        val target = File(modelsDir, "model.gguf")
+        val downloader = RangedDownloader(OkHttpClient(), segmentBytes = SEGMENT_BYTES, partialDir = partialDir)
+        failAfterBytes.set(content.size / 2L)
+        try {
+            downloader.download(url(), target) { _, _ -> }
+            fail("Unduhan seharusnya terputus")
+        } catch (expected: IOException) {
+        }
+
+        assertEquals(emptyList<String>(), modelsDir.list()!!.toList())
+        assertTrue(RangedDownloader.partFile(target, partialDir).exists())
+        downloader.discardPartial(target)
+        assertEquals(emptyList<String>(), partialDir.list()!!.toList())
+    }
+
+    @Test
+    fun `servers without range support get a single stream`() = runBlocking {
+        supportRanges = false
+        val target = File(directory, "model.gguf")
+
+        val sha256 = downloader().download(url(), target) { _, _ -> }
+
+        assertArrayEquals(content, target.readBytes())
+        assertEquals(sha256Hex(content), sha256)
+    }
+
+    private fun downloader() = RangedDownloader(OkHttpClient(), parallelism = 4, segmentBytes = SEGMENT_BYTES)
+
+    private fun url() = "http://127.0.0.1:${server.address.port}/model.gguf"
+
+    private fun serve(exchange: HttpExchange) {
+        exchange.responseHeaders.add("ETag", "\"model-v1\"")
+        val range = exchange.requestHeaders.getFirst("Range")
+            ?.takeIf { supportRanges }
+            ?.removePrefix("bytes=")
+            ?.split('-')
+        val start = range?.get(0)?.toInt() ?: 0
+        val end = range?.get(1)?.takeIf { it.isNotEmpty() }?.toInt() ?: (content.size - 1)
+        if (range != null) {
+            exchange.responseHeaders.add("Content-Range", "bytes $start-$end/${content.size}")
+            exchange.sendResponseHeaders(206, (end - start + 1).toLong())
+        } else {
+            exchange.sendResponseHeaders(200, content.size.toLong())
+        }
+        exchange.responseBody.use { output ->
+            var position = start
+            while (position <= end) {
+                val chunk = minOf(16 * 1024, end - position + 1)
+                val budget = failAfterBytes.get()
+                if (budget in 0L until chunk.toLong()) {
+                    throw IOException("Koneksi diputus oleh server uji")
+                }
+                if (budget >= 0) {
+                    failAfterBytes.addAndGet(-chunk.toLong())
+                }
+                output.write(content, position, chunk)
+                servedBytes.addAndGet(chunk.toLong())
+                position += chunk
+            }
+        }
+    }
+
+    private fun sha256Hex(bytes: ByteArray): String =
+        MessageDigest.getInstance("SHA-256").digest(bytes).joinToString("") { "%02x".format(it) }
+
+    private companion object {
+        const val SEGMENT_BYTES = 256L * 1024
+    }
+}
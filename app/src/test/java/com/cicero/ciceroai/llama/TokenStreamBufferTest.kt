@@ -0,0 +1,31 @@
+package com.cicero.ciceroai.llama
+
+import org.junit.Assert.assertEquals
+import org.junit.Test
+
+class TokenStreamBufferTest {
+
+    @Test
+    fun `drain decodes chunks that wrap around the ring`() {
+        val stream = TokenStreamBuffer(capacityBytes = 64)
+        val ringSize = stream.buffer.capacity() - TokenStreamBuffer.HEADER_BYTES
+
+        var written = 0L
+        fun publish(text: String) {
+            for (byte in text.toByteArray(Charsets.UTF_8)) {
+                val index = TokenStreamBuffer.HEADER_BYTES + (written % ringSize).toInt()
+                stream.buffer.put(index, byte)
+                written++
+            }
+            stream.buffer.putLong(TokenStreamBuffer.WRITE_CURSOR_OFFSET, written)
+        }
+
+        publish("a".repeat(60))
+        assertEquals("a".repeat(60), stream.drain())
+
+        publish("Selamat pagi, dunia é")
+        assertEquals("Selamat pagi, dunia é", stream.drain())
+        assertEquals(written, stream.buffer.getLong(TokenStreamBuffer.READ_CURSOR_OFFSET))
+        assertEquals("", stream.drain())
+    }
+}